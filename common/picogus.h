@@ -62,6 +62,10 @@ static const char *modenames[8] = {
 #define CMD_GUSBUF     0x10 // Audio buffer size
 #define CMD_GUSDMA     0x11 // DMA interval
 #define CMD_GUS44K     0x12 // Force 44k
+#define CMD_GUSINTERP  0x13 // Voice interpolation mode
+#define CMD_GUSBUFMAX  0x14 // Max audio buffer size
+#define CMD_GUSBUFCUR  0x15 // Current audio buffer size (read only)
+#define CMD_GUSBUFPEAK 0x16 // Peak audio buffer size (read only)
 
 #define CMD_WTVOL      0x20 // Wavetable mixer volume
 #define CMD_MPUDELAY   0x21 // MPU sysex delay
@@ -87,6 +91,9 @@ static const char *modenames[8] = {
 #define CMD_CDLOAD     0x64 // Load CD image or get loaded image index
 #define CMD_CDNAME     0x65 // Get name of loaded CD image
 #define CMD_CDAUTOADV  0x66 // Set autoadvance for CD image on USB reinsert
+#define CMD_CDLATENCY  0x67 // USB drive read latency histogram
+#define CMD_CDCACHE    0x68 // CD sector cache statistics
+#define CMD_CDCOUNT    0x69 // Number of CD images in the list
 
 #define CMD_MAINVOL    0x70 // Main Volume
 #define CMD_OPLVOL     0x71 // Adlib volume
@@ -98,5 +105,6 @@ static const char *modenames[8] = {
 #define CMD_DEFAULTS   0xE0 // Select reset to defaults register
 #define CMD_SAVE       0xE1 // Select save settings register
 #define CMD_REBOOT     0xE2 // Select reboot register
+#define CMD_TRACE      0xE3 // Trace records (TRACE firmware)
 #define CMD_HWTYPE     0xF0 // Hardware type 
 #define CMD_FLASH      0xFF // Firmware write mode
@@ -87,6 +87,7 @@ static void usage(card_mode_t mode, bool print_all)
     pageprintf("   /wtvol x      - set volume of WT header. 0-100, Default 100 (2.0 cards only)\n");
     pageprintf("   /joy 1|0      - enable/disable USB joystick support, Default: 0\n");
     pageprintf("   /mainvol x    - set the main audio volume: 0 - 100\n");
+    pageprintf("   /tracedump f  - save trace records to file f (TRACE firmware builds only)\n");
     //         "...............................................................................\n"
     pageprintf("MPU-401 settings:\n");
     pageprintf("   /mpuport x    - set the base port of the MPU-401. Default: 330, 0 to disable\n");
@@ -98,10 +99,14 @@ static void usage(card_mode_t mode, bool print_all)
         pageprintf("   /gusport x  - set the base port of the GUS. Default: 240\n");
         pageprintf("   /gusbuf n   - set audio buffer to n samples. Default: 4, Min: 1, Max: 256\n");
         pageprintf("                 (tweaking can help programs that hang or have audio glitches)\n");
+        pageprintf("   /gusbufmax n - let the buffer grow up to n samples when rendering falls\n");
+        pageprintf("                 behind. Default: 4. At /gusbuf or lower the size stays fixed\n");
         pageprintf("   /gusdma n   - force DMA interval to n us. Default: 0, Min: 0, Max: 255\n");
         pageprintf("                 Specifying 0 restores the GUS default behavior.\n");
         pageprintf("                 (increase to fix games with streaming audio like Doom)\n");
         pageprintf("   /gus44k 1|0 - Fixed 44.1kHz output for all active voice #s [EXPERIMENTAL]\n");
+        pageprintf("   /gusinterp n - voice interpolation: 0 linear (default), 1 cubic, 2 sinc\n");
+        pageprintf("                 (1 and 2 fall back to linear at voice counts that can't keep up)\n");
         pageprintf("   /gusvol x   - set the GUS audio volume: 0 - 100\n");
     }
     if (mode == SB_MODE || print_all) {
@@ -124,6 +129,7 @@ static void usage(card_mode_t mode, bool print_all)
         pageprintf("   /cdloadname x - load CD image by name. Names with spaces can be quoted\n");
         pageprintf("   /cdvol n      - set the CD audio volume: 0 - 100\n");
         pageprintf("   /cdauto 1|0   - auto-advance loaded image when same USB drive is reinserted\n");
+        pageprintf("   /cdstats      - show USB drive latencies and CD cache use since last run\n");
     }
     if (mode == PSG_MODE || print_all) {
         //         "...............................................................................\n"
@@ -272,18 +278,25 @@ static int init_sb(void)
 }
 
 
-static void print_string(uint8_t cmd)
+static void read_string(uint8_t cmd, char *str)
 {
     outp(CONTROL_PORT, 0xCC); // Knock on the door...
     outp(CONTROL_PORT, cmd);  // Select command register
 
-    char str[256] = {0};
+    memset(str, 0, 256);
     for (uint8_t i = 0; i < 255; ++i) {
         str[i] = inp(DATA_PORT_HIGH);
         if (!str[i]) {
             break;
         }
     }
+}
+
+
+static void print_string(uint8_t cmd)
+{
+    char str[256];
+    read_string(cmd, str);
     puts(str);
 }
 
@@ -305,11 +318,15 @@ static cdrom_image_status_t wait_for_cd_status(void)
     outp(CONTROL_PORT, CMD_CDSTATUS); // Select CD image status register
     cdrom_image_status_t cd_status;
     for (uint16_t i = 0; i < 256; ++i) {
-        delay(100);
-        cd_status = (cdrom_image_status_t)inp(DATA_PORT_HIGH);
-        if (cd_status != CD_STATUS_BUSY) {
-            break;
+        // Commands the card can answer at once, such as listing images it already has, are done
+        // within a few reads
+        for (uint16_t j = 0; j < 1000; ++j) {
+            cd_status = (cdrom_image_status_t)inp(DATA_PORT_HIGH);
+            if (cd_status != CD_STATUS_BUSY) {
+                return cd_status;
+            }
         }
+        delay(100);
     }
     return cd_status;
 }
@@ -333,18 +350,23 @@ static int print_cdimage_list(void)
         return 99;
     }
 
+    outp(CONTROL_PORT, CMD_CDCOUNT); // Select CD image count register
+    uint16_t count = inpw(DATA_PORT_LOW);
     outp(CONTROL_PORT, CMD_CDLIST); // Select CD image list register
-    char b[256], c, *p = b;
-    uint8_t line = 1;
-
-    while ((c = inp(DATA_PORT_HIGH)) != 4 /* ASCII EOT */) {
-        *p++ = c;
-        if (!c) {
-            putchar(current_index == line ? '*' : ' ');
-            pageprintf(" %2d: %s\n", line++, b);
-            p = b;
+    char b[256];
+
+    for (uint16_t line = 1; line <= count; ++line) {
+        // Each name is read whole, from the catalog the card keeps until the drive changes
+        for (uint8_t i = 0; i < 255; ++i) {
+            if (!(b[i] = inp(DATA_PORT_HIGH))) {
+                break;
+            }
         }
+        b[255] = 0;
+        putchar(current_index == line ? '*' : ' ');
+        pageprintf(" %2d: %s\n", line, b);
     }
+    inp(DATA_PORT_HIGH); // EOT, which ends the list on the card
 
     if (current_index) {
         printf("Currently loaded image marked with \"*\".\n");
@@ -381,6 +403,12 @@ static int wait_for_cd_load(void)
         print_string(CMD_CDERROR);
         return 98;
     }
+    // A loaded image can still leave a warning, such as when it is badly fragmented
+    char warning[256];
+    read_string(CMD_CDERROR, warning);
+    if (warning[0]) {
+        printf("Warning: %s\n", warning);
+    }
     return print_cdimage_current();
 }
 
@@ -717,6 +745,11 @@ static bool cmdSendPort(const char* arg, const int cmd)
     return ctrlSendUint16(arg, cmd, 0, 0x3FF);
 }
 
+static bool cmdGUSInterp(const char* arg, const int cmd)
+{
+    return ctrlSendUint8(arg, cmd, 0, 2);
+}
+
 static bool cmdSetVol(const char* arg, const int cmd)
 {
     return ctrlSendUint8(arg, cmd, 0, 100);
@@ -801,6 +834,56 @@ static bool cmdCDList(const char* arg, const int cmd)
     exit(print_cdimage_list());
 }
 
+#define CD_LATENCY_BUCKETS 16
+#define CD_CACHE_STATS 5
+
+// Reads n 32-bit counters from register cmd, then clears them
+static void read_cd_counters(const int cmd, uint32_t* counts, uint8_t n)
+{
+    outp(CONTROL_PORT, 0xCC); // Knock on the door...
+    outp(CONTROL_PORT, cmd);
+    for (uint8_t i = 0; i < n; ++i) {
+        counts[i] = 0;
+        for (uint8_t b = 0; b < 4; ++b) {
+            counts[i] |= (uint32_t)inp(DATA_PORT_HIGH) << (b * 8);
+        }
+    }
+    outp(DATA_PORT_HIGH, 0); // Start counting again
+}
+
+static bool cmdCDStats(const char* arg, const int cmd)
+{
+    uint32_t counts[CD_LATENCY_BUCKETS];
+    uint32_t cache[CD_CACHE_STATS];
+    uint32_t total = 0;
+    read_cd_counters(cmd, counts, CD_LATENCY_BUCKETS);
+    read_cd_counters(CMD_CDCACHE, cache, CD_CACHE_STATS);
+    for (uint8_t i = 0; i < CD_LATENCY_BUCKETS; ++i) {
+        total += counts[i];
+    }
+    printf("USB drive reads: %lu\n", total);
+    for (uint8_t i = 0; i < CD_LATENCY_BUCKETS; ++i) {
+        if (!counts[i]) {
+            continue;
+        }
+        if (i == 0) {
+            printf("  under 128us: %lu\n", counts[i]);
+        } else if (i == CD_LATENCY_BUCKETS - 1) {
+            printf("  %luus and over: %lu\n", 64UL << i, counts[i]);
+        } else {
+            printf("  %lu-%luus: %lu\n", 64UL << i, 128UL << i, counts[i]);
+        }
+    }
+    printf("CD sectors from cache: %lu, waited for: %lu\n", cache[0], cache[1]);
+    if (cache[2]) {
+        printf("  cache reads: %lu, %lu drive sectors each on average\n", cache[2], cache[3] / cache[2]);
+    }
+    if (cache[4]) {
+        printf("  sectors read through FatFS: %lu\n", cache[4]);
+    }
+    exit(0);
+}
+
 static bool cmdCDLoad(const char* arg, const int cmd)
 {
     ctrlSendUint8(arg, cmd, 0, 255);
@@ -821,6 +904,44 @@ static bool cmdGUSBuffer(const char* arg, const int cmd)
     return true;
 }
 
+// Enough for both of the firmware's trace rings. Reading the records adds more of them, so the
+// dump is capped rather than run until the card has nothing left.
+#define TRACE_DUMP_MAX_FRAMES 2048
+#define TRACE_FRAME_SYNC 0x1e
+#define TRACE_FRAME_SIZE 10
+
+static bool cmdTraceDump(const char* arg, const int cmd)
+{
+    outp(CONTROL_PORT, 0xCC); // Knock on the door...
+    outp(CONTROL_PORT, cmd);
+    outp(DATA_PORT_HIGH, 1); // Drain trace records to the control port instead of the UART
+    uint8_t frame[TRACE_FRAME_SIZE];
+    frame[0] = inp(DATA_PORT_HIGH);
+    if (frame[0] != TRACE_FRAME_SYNC && frame[0] != 0) {
+        fprintf(stderr, "ERROR: firmware was not built with tracing\n");
+        return false;
+    }
+    FILE* fp = fopen(arg, "wb");
+    if (!fp) {
+        fprintf(stderr, "ERROR: could not open %s\n", arg);
+        outp(DATA_PORT_HIGH, 0);
+        return false;
+    }
+    uint16_t frames = 0;
+    while (frame[0] == TRACE_FRAME_SYNC && frames < TRACE_DUMP_MAX_FRAMES) {
+        for (uint8_t i = 1; i < TRACE_FRAME_SIZE; ++i) {
+            frame[i] = inp(DATA_PORT_HIGH);
+        }
+        fwrite(frame, 1, TRACE_FRAME_SIZE, fp);
+        ++frames;
+        frame[0] = inp(DATA_PORT_HIGH);
+    }
+    fclose(fp);
+    outp(DATA_PORT_HIGH, 0); // Back to the UART
+    printf("Saved %u trace records to %s\n", frames, arg);
+    return true;
+}
+
 static bool cmdFlashPico(const char* arg, const int cmd)
 {
     if (strlen(arg) > 255)
@@ -859,6 +980,8 @@ ParseCommand parseCommands[] = {
     {"/wtvol", cmdSetVol, CMD_WTVOL, ARG_REQUIRE},
     {"/gus44k", cmdSendBool, CMD_GUS44K, ARG_REQUIRE, "false"},
     {"/gusbuf", cmdGUSBuffer, CMD_GUSBUF, ARG_REQUIRE, "4"},
+    {"/gusinterp", cmdGUSInterp, CMD_GUSINTERP, ARG_REQUIRE, "0"},
+    {"/gusbufmax", cmdGUSBuffer, CMD_GUSBUFMAX, ARG_REQUIRE, "4"},
     {"/gusdma", cmdSendUint8, CMD_GUSDMA, ARG_REQUIRE, "0"},
     {"/gusport", cmdSendPort, CMD_GUSPORT, ARG_NONE, "240"},
     {"/sbport", cmdSendPort, CMD_SBPORT, ARG_NONE, "220"},
@@ -883,12 +1006,14 @@ ParseCommand parseCommands[] = {
     {"/cdload", cmdCDLoad, CMD_CDLOAD, ARG_REQUIRE},
     {"/cdauto", cmdSendBool, CMD_CDAUTOADV, ARG_REQUIRE, "true"},
     {"/cdloadname", cmdCDLoadName, CMD_CDNAME, ARG_REQUIRE},
+    {"/cdstats", cmdCDStats, CMD_CDLATENCY, ARG_NONE},
     {"/mainvol", cmdSetVol, CMD_MAINVOL, ARG_REQUIRE, "100"},
     {"/oplvol", cmdSetVol, CMD_OPLVOL, ARG_REQUIRE, "100"},
     {"/sbvol", cmdSetVol, CMD_SBVOL, ARG_REQUIRE, "100"},
     {"/cdvol", cmdSetVol, CMD_CDVOL, ARG_REQUIRE, "100"},
     {"/gusvol", cmdSetVol, CMD_GUSVOL, ARG_REQUIRE, "100"},
     {"/psgvol", cmdSetVol, CMD_PSGVOL, ARG_REQUIRE, "100"},
+    {"/tracedump", cmdTraceDump, CMD_TRACE, ARG_REQUIRE, "trace.bin"},
     {0}
 };
  
@@ -978,7 +1103,14 @@ static void printGUSMode()
         return;
     }
     printf("GUS mode: ");
-    printf("Audio buffer: %u samples; ", ctrlGetUint8(CMD_GUSBUF) + 1);
+    uint16_t buf_min = ctrlGetUint8(CMD_GUSBUF) + 1;
+    uint16_t buf_max = ctrlGetUint8(CMD_GUSBUFMAX) + 1;
+    if (buf_max > buf_min) {
+        printf("Audio buffer: %u-%u samples (now %u, peak %u); ", buf_min, buf_max,
+               ctrlGetUint8(CMD_GUSBUFCUR) + 1, ctrlGetUint8(CMD_GUSBUFPEAK) + 1);
+    } else {
+        printf("Audio buffer: %u samples; ", buf_min);
+    }
 
     uint8_t tmp_uint8 = ctrlGetUint8(CMD_GUSDMA);
     if (tmp_uint8 == 0) {
@@ -989,11 +1121,14 @@ static void printGUSMode()
 
     tmp_uint8 = ctrlGetUint8(CMD_GUS44K);
     if (tmp_uint8) {
-        printf("Sample rate: fixed 44.1k\n");
+        printf("Sample rate: fixed 44.1k; ");
     } else {
-        printf("Sample rate: variable\n");
+        printf("Sample rate: variable; ");
     }
 
+    tmp_uint8 = ctrlGetUint8(CMD_GUSINTERP);
+    printf("Interpolation: %s\n", tmp_uint8 == 2 ? "sinc" : (tmp_uint8 == 1 ? "cubic" : "linear"));
+
     printf("Running in GUS mode on port %x\n", ctrlGetUint16(CMD_GUSPORT));
 }
 
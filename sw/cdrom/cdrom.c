@@ -32,7 +32,10 @@
 #include "cdrom_error_msg.h"
 #include "pico/multicore.h"
 #include "hardware/structs/timer.h"
+#include "hardware/sync.h"
 #include "audio/volctrl.h"
+#include "msc_app.h"
+#include "cdrom_cache.h"
 
 
 /* The addresses sent from the guest are absolute, ie. a LBA of 0 corresponds to a MSF of 00:00:00. Otherwise, the counter displayed by the guest is wrong:
@@ -136,6 +139,7 @@ bcd2bin(uint8_t x)
 */
 
 void cdrom_tasks(cdrom_t *dev) {
+    msc_app_task();
     // Will almost always be CD_COMMAND_NONE, so use __builtin_expect to tell the compiler
     switch (__builtin_expect(dev->image_command, CD_COMMAND_NONE)) {
     case CD_COMMAND_NONE:
@@ -143,9 +147,8 @@ void cdrom_tasks(cdrom_t *dev) {
         break;
     case CD_COMMAND_IMAGE_LIST:
         cdrom_errorstr_clear();
-        dev->image_list = cdman_list_images(&dev->image_count);
         dev->image_command = CD_COMMAND_NONE;
-        dev->image_status = dev->image_list ? CD_STATUS_READY : CD_STATUS_ERROR;
+        dev->image_status = cdman_catalog_update(true) ? CD_STATUS_READY : CD_STATUS_ERROR;
         break;
     case CD_COMMAND_IMAGE_LOAD_INDEX:
         cdman_load_image_index(dev, dev->image_data);
@@ -243,14 +246,56 @@ void cdrom_fifo_clear(cdrom_fifo_t *fifo) {
 }
 
 
+/* Posts a stop, seek or pause for core 1 to apply (see cdrom_audio_ring_t).
+   A read in flight when this is called is thrown away when it completes. */
+static void
+cdrom_audio_ring_flush(cdrom_t *dev, uint8_t kind, uint32_t lba, uint32_t end)
+{
+    cdrom_audio_ring_t *ring = &dev->audio_ring;
+
+    if (ring->flushes == ring->flushed || kind >= ring->flush_kind) {
+        ring->flush_lba = lba;
+        ring->flush_end = end;
+        __dmb();
+        ring->flush_kind = kind;
+    }
+    __dmb();
+    ring->flushes++;
+}
+
+/* Core 1: drops whatever has been read ahead and moves seek_pos for the last
+   request posted by cdrom_audio_ring_flush */
+static void
+cdrom_audio_ring_apply(cdrom_t *dev)
+{
+    cdrom_audio_ring_t *ring = &dev->audio_ring;
+    const uint32_t flushes = ring->flushes;
+
+    if (flushes == ring->flushed)
+        return;
+    __dmb();
+    const uint8_t kind = ring->flush_kind;
+    // The mixer takes frames in an IRQ on this core
+    const uint32_t irq = save_and_disable_interrupts();
+    if (kind == CD_AUDIO_FLUSH_SEEK) {
+        dev->seek_pos = ring->flush_lba;
+        dev->cd_end   = ring->flush_end;
+    } else if (kind == CD_AUDIO_FLUSH_REWIND) {
+        dev->seek_pos -= (cdrom_audio_ring_level(ring) + SAMPLES_PER_SECTOR - 1) / SAMPLES_PER_SECTOR;
+    }
+    ring->tail    = ring->head;
+    ring->running = false;
+    ring->ended   = false;
+    ring->flushed = flushes;
+    restore_interrupts(irq);
+}
+
 void
 cdrom_stop(cdrom_t *dev)
 {
     if (dev->cd_status > CD_STATUS_DATA_ONLY)
         dev->cd_status = CD_STATUS_STOPPED;
-#if USE_CD_AUDIO_FIFO
-    fifo_reset(&dev->audio_fifo);
-#endif
+    cdrom_audio_ring_flush(dev, CD_AUDIO_FLUSH_STOP, 0, 0);
 }
 
 uint8_t cdrom_seek(cdrom_t *dev, int m, int s, int f) {
@@ -260,156 +305,154 @@ uint8_t cdrom_seek(cdrom_t *dev, int m, int s, int f) {
     cdrom_log("CD-ROM %i: Seek to M:%x S:%x F:%x\n", dev->id, m,s,f);
     pos = MSFtoLBA(m, s, f) - 150;    
     //TODO: Should i check if this is a valid seek?
-    dev->seek_pos = pos;
-    cdrom_stop(dev);
+    if (dev->cd_status > CD_STATUS_DATA_ONLY)
+        dev->cd_status = CD_STATUS_STOPPED;
+    cdrom_audio_ring_flush(dev, CD_AUDIO_FLUSH_SEEK, pos, dev->cd_end);
     return 1;
 }
 
-#if USE_CD_AUDIO_FIFO
-audio_fifo_t* cdrom_audio_fifo_peek(cdrom_t *dev) {
-    return &dev->audio_fifo;
-}
-void cdrom_audio_fifo_init(cdrom_t *dev) {
-    fifo_init(&dev->audio_fifo);
+/* Called from tuh_task() when a read started by cdrom_audio_callback ends */
+static void
+cdrom_audio_read_done(bool ok, uintptr_t arg)
+{
+    ((cdrom_t *) arg)->audio_ring.read_result = ok;
 }
 
-bool cdrom_audio_callback(cdrom_t *dev, uint32_t len) {
-    bool ret = true;
+/* Core 1: hands sectors read into the ring at head to the player, or stops
+   playing if they couldn't be read */
+static bool
+cdrom_audio_ring_commit(cdrom_t *dev, uint32_t lba, uint32_t count, bool read_successful)
+{
+    cdrom_audio_ring_t *ring = &dev->audio_ring;
 
-    if (dev->cd_status != CD_STATUS_PLAYING) {
+    if (!read_successful) {
+        cdrom_log("CD-ROM %i: Read LBA %08X+%u failed\n", dev->id, lba, count);
+        dev->cd_status = CD_STATUS_STOPPED;
         return false;
     }
+    cdrom_log("CD-ROM %i: Read LBA %08X+%u successful\n", dev->id, lba, count);
+    dev->seek_pos = lba + count;
+    // Samples in place before the player can see them
+    __dmb();
+    ring->head = cdrom_audio_ring_advance(ring->head, count * SAMPLES_PER_SECTOR);
+    return true;
+}
 
-    // --- Fill audio_fifo using data from audio_sector_buffer, reading new sectors as needed ---
-    // Loop until FIFO has 'len' samples, or is full, or an error/EoT occurs.
-    while (fifo_level(&dev->audio_fifo) < len && ret) {
-        uint32_t samples_remaining_in_sector = SAMPLES_PER_SECTOR - dev->audio_sector_consumed_samples;
-
-        if (samples_remaining_in_sector == 0) { // Need to read a new sector
-            if (dev->seek_pos < dev->cd_end) {
-                bool read_successful;
-                if (dev->audio_muted_soft) {
-                    // Muted: "Fake" a read by filling the sector buffer with silence
-                    cdrom_log("CD-ROM %i: Muted. Faking read of LBA %08X with silence.\n", dev->id, dev->seek_pos);
-                    read_successful = true;
-                    memset(dev->audio_sector_buffer, 0, RAW_SECTOR_SIZE);
-                } else {
-                    read_successful = dev->ops->read_sector(dev, CD_READ_AUDIO, dev->audio_sector_buffer, dev->seek_pos);
-                }
-                if (read_successful) {
-                    /* putchar('r'); */
-                    cdrom_log("CD-ROM %i: Read LBA %08X successful\n", dev->id, dev->seek_pos);
-                    dev->seek_pos++;
-                    /* dev->audio_sector_total_samples = SAMPLES_PER_SECTOR; */
-                    dev->audio_sector_consumed_samples = 0;
-                    samples_remaining_in_sector = SAMPLES_PER_SECTOR; // Update for current iteration
-                } else {
-                    cdrom_log("CD-ROM %i: Read LBA %08X failed\n", dev->id, dev->seek_pos);
-                    dev->cd_status = CD_STATUS_STOPPED;
-                    ret = false; // Mark error
-                    break;   // Exit fill loop: read error
-                }
-            } else { // End of disc
-                cdrom_log("CD-ROM %i: Playing completed (reached cd_end)\n", dev->id);
-                dev->cd_status = CD_STATUS_PLAYING_COMPLETED;
-                ret = false; // Mark end of track
-                break;   // Exit fill loop: end of track
+bool cdrom_audio_callback(cdrom_t *dev) {
+    cdrom_audio_ring_t *ring = &dev->audio_ring;
+
+    cdrom_audio_ring_apply(dev);
+    // Read ahead a batch of sectors at a time, once there is room for a whole batch
+    while (dev->cd_status == CD_STATUS_PLAYING) {
+        cdrom_audio_ring_apply(dev);
+        if (ring->reading) {
+            if (ring->read_result < 0) {
+                // Still on its way from the drive
+                return true;
             }
+            ring->reading = false;
+            if (ring->flushes != ring->read_flushes) {
+                // Stopped, paused or moved while reading: these sectors aren't wanted any more
+                continue;
+            }
+            if (!cdrom_audio_ring_commit(dev, ring->read_lba, ring->read_count, ring->read_result))
+                return false;
+            continue;
         }
 
-        // At this point, if ret is still true, samples_remaining_in_sector should be > 0.
-        uint32_t space_in_fifo = fifo_free_space(&dev->audio_fifo);
-
-        // Determine how many samples to transfer from staging to FIFO
-        uint32_t samples_to_transfer = (samples_remaining_in_sector < space_in_fifo) ?
-                                       samples_remaining_in_sector : space_in_fifo;
-
-        /* printf("%u\n", samples_to_transfer); */
-        // Add samples from sector buffer to FIFO
-        bool added_ok = fifo_add_samples(&dev->audio_fifo,
-                                         &dev->current_sector_samples[dev->audio_sector_consumed_samples],
-                                         /* &dev->current_sector_samples[dev->audio_sector_consumed_samples], */
-                                         samples_to_transfer);
-        if (added_ok) {
-            /* putchar('y'); */
-            dev->audio_sector_consumed_samples += samples_to_transfer;
-        } else {
-            putchar('n');
-            // This implies fifo_add_samples failed even though we thought there was space.
-            // Could be a bug in fifo_free_space or fifo_add_samples, or a race condition in a threaded env (not here).
-            cdrom_log("CD-ROM %i: fifo_add_samples failed unexpectedly! Space was %u, tried to add %u.\n",
-                      dev->id, space_in_fifo, samples_to_transfer);
-            ret = false; // Treat as an error
-            break;
+        const uint32_t level = cdrom_audio_ring_level(ring);
+        if (dev->seek_pos >= dev->cd_end) {
+            ring->ended = true;
+            if (level) {
+                // Still playing out what was read ahead
+                return true;
+            }
+            cdrom_log("CD-ROM %i: Playing completed (reached cd_end)\n", dev->id);
+            // Unless a new play came in meanwhile
+            if (ring->flushes == ring->flushed)
+                dev->cd_status = CD_STATUS_PLAYING_COMPLETED;
+            return false;
         }
-    } // End while (fifo_level < len && ret)
 
-    cdrom_log("CD-ROM %i: Audio cb. FIFO level: %u. Staging: %d/%d. Ret %d\n",
-              dev->id, fifo_level(&dev->audio_fifo),
-              dev->audio_sector_consumed_samples, dev->audio_sector_total_samples, ret);
-    return ret;
+        uint32_t count = (CD_AUDIO_RING_SAMPLES - level) / SAMPLES_PER_SECTOR;
+        if (count < CD_AUDIO_READ_SECTORS) {
+            return true;
+        }
+        // Batches line up with the end of the ring, unless one was cut short by cd_end
+        // or the end of a track before a flush; then the next is split there.
+        const uint32_t index = cdrom_audio_ring_index(ring->head);
+        count = CD_AUDIO_READ_SECTORS;
+        if (count > (CD_AUDIO_RING_SAMPLES - index) / SAMPLES_PER_SECTOR)
+            count = (CD_AUDIO_RING_SAMPLES - index) / SAMPLES_PER_SECTOR;
+        if (count > dev->cd_end - dev->seek_pos)
+            count = dev->cd_end - dev->seek_pos;
+
+        const uint32_t lba = dev->seek_pos;
+        const uint32_t flushes = ring->flushes;
+        uint8_t *sectors = (uint8_t *) &ring->samples[index];
+        bool read_successful;
+        if (dev->audio_muted_soft) {
+            // Muted: "Fake" a read by filling the sectors with silence
+            cdrom_log("CD-ROM %i: Muted. Faking read of LBA %08X+%u with silence.\n", dev->id, lba, count);
+            read_successful = true;
+            memset(sectors, 0, count * RAW_SECTOR_SIZE);
+        } else {
+            // Straight off the drive without waiting if it can be, else through FatFS
+            const uint32_t started = dev->ops->read_audio_async ?
+                dev->ops->read_audio_async(dev, sectors, lba, count, cdrom_audio_read_done, (uintptr_t) dev) : 0;
+            if (started) {
+                ring->reading      = true;
+                ring->read_lba     = lba;
+                ring->read_count   = started;
+                ring->read_flushes = flushes;
+                ring->read_result  = -1;
+                return true;
+            }
+            read_successful = dev->ops->read_audio_sectors(dev, sectors, lba, count);
+        }
+        if (ring->flushes != flushes) {
+            // Stopped, paused or moved while reading: these sectors aren't wanted any more
+            continue;
+        }
+        if (!cdrom_audio_ring_commit(dev, lba, count, read_successful))
+            return false;
+    }
+    return false;
 }
-#endif // USE_CD_AUDIO_FIFO
 
 uint32_t cdrom_audio_callback_simple(cdrom_t *dev, int16_t *buffer, uint32_t len, bool pad) {
+    cdrom_audio_ring_t *ring = &dev->audio_ring;
+
     if (dev->cd_status != CD_STATUS_PLAYING) {
         return 0;
     }
 
     uint32_t samples_produced = 0;
-    // --- Fill buffer using data from audio_sector_buffer, reading new sectors as needed ---
-    // Loop until FIFO has 'len' samples, or is full, or an error/EoT occurs.
+    // Fill buffer from the ring, topping it up as it goes, until an error or the end
     while (samples_produced < len) {
-        uint32_t samples_remaining_in_sector = SAMPLES_PER_SECTOR - dev->audio_sector_consumed_samples;
-
-        if (samples_remaining_in_sector == 0) { // Need to read a new sector
-            if (dev->seek_pos < dev->cd_end) {
-                bool read_successful;
-                if (dev->audio_muted_soft) {
-                    // Muted: "Fake" a read by filling the sector buffer with silence
-                    cdrom_log("CD-ROM %i: Muted. Faking read of LBA %08X with silence.\n", dev->id, dev->seek_pos);
-                    read_successful = true;
-                    memset(dev->audio_sector_buffer, 0, RAW_SECTOR_SIZE);
-                } else {
-                    read_successful = dev->ops->read_sector(dev, CD_READ_AUDIO, dev->audio_sector_buffer, dev->seek_pos);
-                }
-                if (read_successful) {
-                    /* putchar('r'); */
-                    cdrom_log("CD-ROM %i: Read LBA %08X successful\n", dev->id, dev->seek_pos);
-                    dev->seek_pos++;
-                    /* dev->audio_sector_total_samples = SAMPLES_PER_SECTOR; */
-                    dev->audio_sector_consumed_samples = 0;
-                    samples_remaining_in_sector = SAMPLES_PER_SECTOR; // Update for current iteration
-                } else {
-                    cdrom_log("CD-ROM %i: Read LBA %08X failed\n", dev->id, dev->seek_pos);
-                    dev->cd_status = CD_STATUS_STOPPED;
-                    break;   // Exit fill loop: read error
-                }
-            } else { // End of disc
-                cdrom_log("CD-ROM %i: Playing completed (reached cd_end)\n", dev->id);
-                dev->cd_status = CD_STATUS_PLAYING_COMPLETED;
-                break;   // Exit fill loop: end of track
-            }
-        }
+        cdrom_audio_callback(dev);
+        if (ring->flushes != ring->flushed)
+            break;
 
-        // At this point, if ret is still true, samples_remaining_in_sector should be > 0.
-        uint32_t space_in_buffer = len - samples_produced;
-        // Determine how many samples to transfer from staging to buffer
-        uint32_t samples_to_transfer = (samples_remaining_in_sector < space_in_buffer) ?
-                                       samples_remaining_in_sector : space_in_buffer;
+        const uint32_t tail = ring->tail;
+        const uint32_t index = cdrom_audio_ring_index(tail);
+        uint32_t samples_to_transfer = cdrom_audio_ring_level(ring);
+        if (samples_to_transfer > len - samples_produced)
+            samples_to_transfer = len - samples_produced;
+        if (samples_to_transfer > CD_AUDIO_RING_SAMPLES - index)
+            samples_to_transfer = CD_AUDIO_RING_SAMPLES - index;
+        if (!samples_to_transfer)
+            break;
 
-        /* printf("%u\n", samples_to_transfer); */
-        // Add samples from sector buffer to FIFO
-        //memcpy(buffer + samples_produced, &dev->current_sector_samples[dev->audio_sector_consumed_samples], samples_to_transfer * sizeof(int16_t));
         for (uint32_t i = 0; i < samples_to_transfer; i++)
         {
-            int32_t sample = dev->current_sector_samples[dev->audio_sector_consumed_samples + i];       
+            int32_t sample = ring->samples[index + i];
             buffer[samples_produced + i] = (int16_t)scale_sample(sample, cd_audio_volume, 0);
         }
 
         samples_produced += samples_to_transfer;
-        dev->audio_sector_consumed_samples += samples_to_transfer;
-    } // End while (fifo_level < len && ret)
+        ring->tail = cdrom_audio_ring_advance(tail, samples_to_transfer);
+    }
 
     if (!pad) {
         return samples_produced;
@@ -425,22 +468,30 @@ uint32_t cdrom_audio_callback_simple(cdrom_t *dev, int16_t *buffer, uint32_t len
 }
 
 
+/* Called from the core 1 loop: each call moves the next requested sector into
+   data_fifo once the cache has it, and returns without waiting on the drive
+   while it doesn't. */
 void __inline cdrom_read_data(cdrom_t *dev) {
     uint32_t pos;    
-    /* uint16_t x; */
-    /* uint8_t m,s,f;     */
-    /*
-    TODO, need to handle  when multiple blocks are requested.
-    */   
+    const uint8_t *data;
+
     if(dev->req_total) {
-    /* while(dev->req_total) { */
         if(cdrom_fifo_level(&dev->data_fifo) >= 2048) return;//need to be empty.        
         pos = MSFtoLBA(dev->req_m,dev->req_s,dev->req_f) - 150;    
         pos += dev->req_cur;
-        // Read CD sector directly from fatfs into data fifo - note this assumes
-        // 2048 byte sectors
-        dev->ops->read_sector(dev, CD_READ_DATA, dev->data_fifo.data + dev->data_fifo.tail, pos);
-        dev->data_fifo.tail = (dev->data_fifo.tail + 2048) & 4095;
+        switch (dev->ops->get_data_sector(dev, pos, dev->req_total - dev->req_cur, &data)) {
+            case CD_CACHE_PENDING:
+                return;
+            case CD_CACHE_READY:
+                cdrom_fifo_write_multiple(&dev->data_fifo, data, 2048);
+                break;
+            default:
+                // Read CD sector directly from fatfs into data fifo - note this assumes
+                // 2048 byte sectors
+                dev->ops->read_sector(dev, CD_READ_DATA, dev->data_fifo.data + dev->data_fifo.tail, pos);
+                dev->data_fifo.tail = (dev->data_fifo.tail + 2048) & 4095;
+                break;
+        }
         dev->req_cur++;
         if(dev->req_cur == dev->req_total) {
             cdrom_output_status(dev);
@@ -509,15 +560,8 @@ uint8_t cdrom_audio_playmsf(cdrom_t *dev, int m,int s, int f, int M, int S, int
         return 0;
     }    
     
-    /*
-    Changing these seek positions during audio playback  is a problemo.
-    */
-
-    dev->seek_pos  = pos;
-    dev->cd_end    = pos2;
-#if USE_CD_AUDIO_FIFO
-    fifo_reset(&dev->audio_fifo);
-#endif
+    /* Core 1 moves to these before it reads again */
+    cdrom_audio_ring_flush(dev, CD_AUDIO_FLUSH_SEEK, pos, pos2);
     dev->cd_status = CD_STATUS_PLAYING;
     
     return 1;
@@ -528,9 +572,8 @@ cdrom_audio_pause_resume(cdrom_t *dev, uint8_t resume)
 {
     if ((dev->cd_status == CD_STATUS_PLAYING) || (dev->cd_status == CD_STATUS_PAUSED))
         dev->cd_status = (dev->cd_status & 0xfe) | (resume & 0x01);
-#if USE_CD_AUDIO_FIFO
-    fifo_reset(&dev->audio_fifo);
-#endif
+    /* Carry on from the sector being played, not from where read-ahead got to */
+    cdrom_audio_ring_flush(dev, CD_AUDIO_FLUSH_REWIND, 0, 0);
 }
 
 
@@ -606,7 +649,6 @@ cdrom_global_init(void)
     /* Clear the global data. */
     memset(&cdrom, 0x00, sizeof(cdrom));
     cdrom.error_str = cdrom_errorstr_get();
-    cdrom.current_sector_samples = (int16_t*)cdrom.audio_sector_buffer;
     set_volume(CMD_CDVOL);
 }
 
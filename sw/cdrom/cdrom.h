@@ -122,6 +122,12 @@ typedef struct cdrom_ops_t {
     int (*is_track_pre)(struct cdrom *dev, uint32_t lba);
     int (*sector_size)(struct cdrom *dev, uint32_t lba);
     int (*read_sector)(struct cdrom *dev, int type, uint8_t *b, uint32_t lba);
+    int (*read_audio_sectors)(struct cdrom *dev, uint8_t *b, uint32_t lba, uint32_t count);
+    /* Starts reading up to count sectors and returns how many, calling done when
+       they are in place; 0 if they have to be read with read_audio_sectors */
+    uint32_t (*read_audio_async)(struct cdrom *dev, uint8_t *b, uint32_t lba, uint32_t count,
+                                 void (*done)(bool ok, uintptr_t arg), uintptr_t arg);
+    int (*get_data_sector)(struct cdrom *dev, uint32_t lba, uint32_t count, const uint8_t **data);
     int (*track_type)(struct cdrom *dev, uint32_t lba);
     void (*exit)(struct cdrom *dev);
 } cdrom_ops_t;
@@ -134,10 +140,90 @@ typedef struct cdrom_fifo_t {
     volatile uint16_t tail;
 } cdrom_fifo_t;
 
-
-#if USE_CD_AUDIO_FIFO
-#include "audio/audio_fifo.h"
+/* CD-DA is read ahead into a ring of raw sectors that the mixer plays straight
+   from. Sectors are read CD_AUDIO_READ_SECTORS at a time, once that many are
+   free, so each refill is one multi-sector read of the image. Where the image
+   lies on the drive, the read is queued with read_audio_async and core 1 goes
+   on with its loop until it ends; otherwise it waits on read_audio_sectors. */
+#ifndef CD_AUDIO_RING_SECTORS
+#define CD_AUDIO_RING_SECTORS 8
+#endif
+#ifndef CD_AUDIO_READ_SECTORS
+#define CD_AUDIO_READ_SECTORS 4
 #endif
+#define CD_AUDIO_RING_SAMPLES  (CD_AUDIO_RING_SECTORS * SAMPLES_PER_SECTOR)
+/* Samples in the ring before the mixer starts, or restarts after running dry */
+#define CD_AUDIO_START_SAMPLES (CD_AUDIO_READ_SECTORS * SAMPLES_PER_SECTOR)
+
+/* head and tail run from 0 to 2 * CD_AUDIO_RING_SAMPLES - 1, so a full ring
+   can be told from an empty one.
+
+   Stop, seek, play and pause come from MKE commands on core 0, which only post
+   a request and bump flushes. cdrom_audio_callback on core 1 applies it: it
+   drops what was read ahead and moves seek_pos, with the mixer's IRQ held off.
+   The mixer plays nothing while a request is waiting. Requests that arrive
+   before core 1 gets to them are merged, the highest kind winning. */
+#define CD_AUDIO_FLUSH_STOP   0 /* Carry on from where read-ahead got to */
+#define CD_AUDIO_FLUSH_REWIND 1 /* Carry on from the sector being played */
+#define CD_AUDIO_FLUSH_SEEK   2 /* Carry on from flush_lba, up to flush_end */
+typedef struct cdrom_audio_ring_t {
+    int16_t samples[CD_AUDIO_RING_SAMPLES];
+    volatile uint32_t head;     /* Written by cdrom_audio_callback only */
+    volatile uint32_t tail;     /* Written by the player, and by cdrom_audio_callback with its IRQ held off */
+    volatile uint32_t flushes;  /* Written by core 0 only, see cdrom_audio_ring_flush */
+    volatile uint32_t flushed;  /* The last of flushes applied by cdrom_audio_callback */
+    volatile uint32_t flush_lba;
+    volatile uint32_t flush_end;
+    volatile uint8_t flush_kind;
+    volatile bool ended;        /* Nothing left to read before cd_end */
+    volatile bool running;      /* Mixer is playing from the ring */
+    /* The read_audio_async read in flight, into the ring at head: core 1 only */
+    bool reading;
+    volatile int8_t read_result; /* -1 until it ends, then 1 if it succeeded or 0 */
+    uint8_t read_count;
+    uint32_t read_lba;
+    uint32_t read_flushes;      /* flushes when it started */
+} cdrom_audio_ring_t;
+
+static inline uint32_t cdrom_audio_ring_index(uint32_t pos) {
+    return pos < CD_AUDIO_RING_SAMPLES ? pos : pos - CD_AUDIO_RING_SAMPLES;
+}
+
+static inline uint32_t cdrom_audio_ring_advance(uint32_t pos, uint32_t samples) {
+    pos += samples;
+    return pos < 2 * CD_AUDIO_RING_SAMPLES ? pos : pos - 2 * CD_AUDIO_RING_SAMPLES;
+}
+
+static inline uint32_t cdrom_audio_ring_level(const cdrom_audio_ring_t *ring) {
+    const uint32_t head = ring->head, tail = ring->tail;
+    return head >= tail ? head - tail : head + 2 * CD_AUDIO_RING_SAMPLES - tail;
+}
+
+/* Takes the next stereo frame for the mixer from the sector it was read into.
+   Waits for CD_AUDIO_START_SAMPLES to be read ahead before starting, unless
+   that is all there is before the end. */
+static inline bool cdrom_audio_ring_take_frame(cdrom_audio_ring_t *ring, int16_t *left, int16_t *right) {
+    if (ring->flushes != ring->flushed) {
+        // Stopped, paused or moved: what was read ahead is about to be dropped
+        return false;
+    }
+    const uint32_t level = cdrom_audio_ring_level(ring);
+    if (!ring->running) {
+        if (!level || (level < CD_AUDIO_START_SAMPLES && !ring->ended)) {
+            return false;
+        }
+        ring->running = true;
+    } else if (!level) {
+        ring->running = false;
+        return false;
+    }
+    const uint32_t tail = ring->tail;
+    const int16_t *frame = &ring->samples[cdrom_audio_ring_index(tail)];
+    *left = frame[0];
+    *right = frame[1];
+    ring->tail = cdrom_audio_ring_advance(tail, 2);
+    return true;
+}
 
 typedef struct cdrom {
     uint8_t id;
@@ -168,8 +254,6 @@ typedef struct cdrom {
     int   is_dir;
     void *priv;
 
-    char **image_list;
-    int image_count;
     char image_path[128];
 
     uint32_t sound_on;
@@ -197,14 +281,7 @@ typedef struct cdrom {
     const char *error_str;
 
     // int16_t cd_buffer[BUF_SIZE];
-    uint8_t audio_sector_buffer[RAW_SECTOR_SIZE];
-    int16_t *current_sector_samples;       // Convenience pointer: (int16_t*)audio_sector_buffer
-    int audio_sector_total_samples;        // Samples available in current_sector_samples after a read
-    int audio_sector_consumed_samples;     // Samples consumed from current_sector_samples
-
-#if USE_CD_AUDIO_FIFO
-    audio_fifo_t audio_fifo;
-#endif
+    cdrom_audio_ring_t audio_ring;
 } cdrom_t;
 
 extern cdrom_t cdrom;
@@ -226,16 +303,11 @@ void cdrom_tasks(cdrom_t *dev);
 void cdrom_output_status(cdrom_t *dev);
 uint8_t cdrom_status(cdrom_t *dev);
 
-#if USE_CD_AUDIO_FIFO
-extern audio_fifo_t* cdrom_audio_fifo_peek(cdrom_t *dev);
-void cdrom_audio_fifo_init(cdrom_t *dev);
-#endif
-
 extern int     cdrom_lba_to_msf_accurate(int lba);
 extern double  cdrom_seek_time(cdrom_t *dev);
 extern void    cdrom_stop(cdrom_t *dev);
 extern int     cdrom_is_pre(cdrom_t *dev, uint32_t lba);
-extern bool    cdrom_audio_callback(cdrom_t *dev, uint32_t len);
+extern bool    cdrom_audio_callback(cdrom_t *dev);
 extern uint32_t cdrom_audio_callback_simple(cdrom_t *dev, int16_t *buffer, uint32_t len, bool pad);
 
 extern uint8_t cdrom_audio_track_search(cdrom_t *dev, uint32_t pos, int type, uint8_t playbit);
@@ -0,0 +1,434 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "cdrom_cache.h"
+#include "msc_app.h"
+
+// Drive reads per line at most, one per fragment of the image it spans
+#define CD_CACHE_MAX_READS 4
+
+#define LINE_FREE    0
+#define LINE_FILLING 1
+#define LINE_VALID   2
+
+typedef struct cache_line_t {
+    uint32_t lba;          // First CD sector held
+    uint32_t last_use;
+    uint16_t data_offset;  // Start of the first sector's user data in the line's buffer
+    uint16_t stride;       // Bytes from one sector to the next
+    uint8_t  count;        // Sectors held; 0 once invalidated while being read
+    uint8_t  state;
+} cache_line_t;
+
+static cache_line_t lines[CD_CACHE_LINES];
+static uint8_t line_buff[CD_CACHE_LINES][CD_CACHE_LINE_BYTES] __attribute__((aligned(4)));
+static uint32_t use_count;
+
+// The line being read: one drive read after another, from the completion of the last
+static struct {
+    cache_line_t *line;    // NULL when no read is in progress
+    uint8_t *dest;
+    uint8_t reads;
+    uint8_t next;
+    uint32_t lba[CD_CACHE_MAX_READS];
+    uint16_t count[CD_CACHE_MAX_READS];
+} fill;
+
+// Last sector returned, to tell when the host is reading sequentially
+static uint32_t last_lba = UINT32_MAX;
+// End of the host's read that sector was part of, and whether that read carried straight on from
+// the one before. Lines are only read ahead past the end of a read when it did.
+static uint32_t request_end;
+static bool streaming;
+// Sector the host is waiting on, counted as a miss when first asked for
+static uint32_t waiting_lba = UINT32_MAX;
+// Sectors of a line that couldn't be read off the drive, read through FatFS until a read succeeds
+static uint32_t failed_start, failed_end;
+
+// The audio read in progress: one drive read after another into audio_buff, as for a line, then
+// the sectors copied out of it
+static struct {
+    cdrom_cache_done_t done;  // NULL when no read is in progress
+    uintptr_t arg;
+    uint8_t *buff;
+    uint8_t *dest;
+    uint16_t data_offset;
+    uint16_t stride;
+    uint8_t sectors;
+    uint8_t reads;
+    uint8_t next;
+    uint32_t lba[CD_CACHE_MAX_READS];
+    uint16_t count[CD_CACHE_MAX_READS];
+} audio;
+static uint8_t audio_buff[CD_CACHE_AUDIO_BYTES] __attribute__((aligned(4)));
+
+static cdrom_cache_stats_t stats;
+
+static cache_line_t *line_find(uint32_t lba)
+{
+    for (uint32_t i = 0; i < CD_CACHE_LINES; ++i) {
+        cache_line_t *line = &lines[i];
+        if (line->state != LINE_FREE && lba - line->lba < line->count) {
+            return line;
+        }
+    }
+    return NULL;
+}
+
+// Where bytes bytes of a track's file from first (a drive sector boundary) are on the drive: a run
+// of drive sectors per fragment they span. Returns the number of runs, or 0 if there are more than
+// CD_CACHE_MAX_READS or they can't be read straight off the drive.
+static uint8_t locate_runs(const track_t *trk, uint32_t first, uint32_t bytes, uint32_t *lba, uint16_t *count)
+{
+    uint32_t pos = first;
+    uint8_t reads = 0;
+    while (pos < first + bytes) {
+        if (reads == CD_CACHE_MAX_READS) {
+            return 0;
+        }
+        const uint32_t run = trk->file->locate(trk->file, pos, first + bytes - pos, &lba[reads]);
+        if (!run) {
+            return 0;
+        }
+        count[reads++] = run / FF_MAX_SS;
+        pos += run;
+    }
+    return reads;
+}
+
+static bool fill_issue(void);
+
+static void fill_done(bool ok, uintptr_t arg)
+{
+    cache_line_t *line = fill.line;
+    (void) arg;
+
+    if (ok && line->count && ++fill.next < fill.reads) {
+        if (fill_issue()) {
+            return;
+        }
+        ok = false;
+    }
+    fill.line = NULL;
+    if (!line->count) {
+        line->state = LINE_FREE;
+    } else if (ok) {
+        line->state = LINE_VALID;
+        failed_end = failed_start;
+    } else {
+        line->state = LINE_FREE;
+        failed_start = line->lba;
+        failed_end = line->lba + line->count;
+    }
+}
+
+static bool fill_issue(void)
+{
+    const uint8_t i = fill.next;
+    if (!msc_read_async(fill.dest, fill.lba[i], fill.count[i], fill_done, 0)) {
+        return false;
+    }
+    fill.dest += fill.count[i] * FF_MAX_SS;
+    ++stats.reads;
+    stats.read_sectors += fill.count[i];
+    return true;
+}
+
+// The track holding CD sector lba if it is data the cache holds, with count cut to the sectors of
+// it a line can hold and *offset set to where their user data starts in the image's sectors
+static const track_t *line_track(cd_img_t *img, uint32_t lba, uint32_t *count, uint32_t *offset)
+{
+    const int track = cdi_get_track(img, lba) - 1;
+    if (track < 0) {
+        return NULL;
+    }
+    const track_t *trk = &img->tracks[track];
+    if (trk->mode2 && trk->form != 1) {
+        return NULL;
+    } else if (trk->sector_size == COOKED_SECTOR_SIZE) {
+        *offset = 0;
+    } else if (trk->sector_size == RAW_SECTOR_SIZE || trk->sector_size == 2448) {
+        *offset = trk->mode2 ? 24 : 16;
+    } else {
+        return NULL;
+    }
+
+    // Up to the end of the track, and as many as fit the buffer
+    if (*count > img->tracks[track + 1].start - lba) {
+        *count = img->tracks[track + 1].start - lba;
+    }
+    if (*count > CD_CACHE_LINE_SECTORS) {
+        *count = CD_CACHE_LINE_SECTORS;
+    }
+    return trk;
+}
+
+// The least recently used line other than the one holding sector keep and the one being read
+static cache_line_t *line_victim(uint32_t keep)
+{
+    cache_line_t *victim = NULL;
+    const cache_line_t *kept = line_find(keep);
+    for (uint32_t i = 0; i < CD_CACHE_LINES; ++i) {
+        cache_line_t *line = &lines[i];
+        if (line != kept && line->state != LINE_FILLING && (!victim || line->last_use < victim->last_use)) {
+            victim = line;
+        }
+    }
+    return victim;
+}
+
+// Starts reading a line of up to count sectors from CD sector lba, in place of the least recently
+// used one other than the line holding sector keep. Returns CD_CACHE_PENDING, or CD_CACHE_DIRECT if
+// the sector can't be read into the cache off the drive.
+static int line_start(cd_img_t *img, uint32_t lba, uint32_t count, uint32_t keep)
+{
+    uint32_t offset;
+    const track_t *trk = line_track(img, lba, &count, &offset);
+    if (!trk) {
+        return CD_CACHE_DIRECT;
+    }
+    const uint32_t seek = trk->skip + (lba - trk->start) * trk->sector_size + offset;
+    const uint32_t first = seek & ~(FF_MAX_SS - 1);
+    uint32_t bytes;
+    while ((bytes = (seek - first + (count - 1) * trk->sector_size + COOKED_SECTOR_SIZE + FF_MAX_SS - 1)
+                    & ~(FF_MAX_SS - 1)) > CD_CACHE_LINE_BYTES) {
+        --count;
+    }
+
+    // Where each fragment's part of it is on the drive
+    const uint8_t reads = locate_runs(trk, first, bytes, fill.lba, fill.count);
+    if (!reads) {
+        return CD_CACHE_DIRECT;
+    }
+
+    cache_line_t *victim = line_victim(keep);
+    victim->lba = lba;
+    victim->last_use = ++use_count;
+    victim->data_offset = seek - first;
+    victim->stride = trk->sector_size;
+    victim->count = count;
+    victim->state = LINE_FILLING;
+
+    fill.line = victim;
+    fill.dest = line_buff[victim - lines];
+    fill.reads = reads;
+    fill.next = 0;
+    if (!fill_issue()) {
+        fill.line = NULL;
+        victim->state = LINE_FREE;
+        return CD_CACHE_DIRECT;
+    }
+    return CD_CACHE_PENDING;
+}
+
+// Reads a line of up to count sectors from CD sector lba through FatFS, waiting for it, for data
+// that can't be read straight off the drive: a .cdz image, one in too many fragments to map, or
+// sectors whose drive read failed. Returns NULL if they can't be read into the cache.
+static cache_line_t *line_read(cd_img_t *img, uint32_t lba, uint32_t count)
+{
+    uint32_t offset;
+    if (!line_track(img, lba, &count, &offset)) {
+        return NULL;
+    }
+    cache_line_t *victim = line_victim(lba);
+    victim->state = LINE_FREE;
+    if (!cdi_read_sectors(img, line_buff[victim - lines], 0, lba, count)) {
+        return NULL;
+    }
+    victim->lba = lba;
+    victim->last_use = ++use_count;
+    victim->data_offset = 0;
+    victim->stride = COOKED_SECTOR_SIZE;
+    victim->count = count;
+    victim->state = LINE_VALID;
+    stats.direct += count;
+    return victim;
+}
+
+// Keeps CD_CACHE_READ_AHEAD lines read past the one holding lba while the host reads sequentially
+static void read_ahead(cd_img_t *img, const cache_line_t *line, uint32_t lba)
+{
+    if (fill.line || lba != last_lba + 1) {
+        return;
+    }
+    const uint32_t end = streaming ? UINT32_MAX : request_end;
+    uint32_t next = line->lba + line->count;
+    for (uint32_t i = 0; i < CD_CACHE_READ_AHEAD && next < end; ++i) {
+        const cache_line_t *ahead = line_find(next);
+        if (!ahead) {
+            if (next - failed_start >= failed_end - failed_start) {
+                line_start(img, next, end - next, lba);
+            }
+            return;
+        }
+        next = ahead->lba + ahead->count;
+    }
+}
+
+int cdrom_cache_read(cd_img_t *img, uint32_t lba, uint32_t count, const uint8_t **data)
+{
+    if (lba + count != request_end) {
+        // A new read
+        request_end = lba + count;
+        streaming = (lba == last_lba + 1);
+    }
+    cache_line_t *line = line_find(lba);
+    if (line && line->state == LINE_VALID) {
+        line->last_use = ++use_count;
+        *data = line_buff[line - lines] + line->data_offset + (lba - line->lba) * line->stride;
+        if (lba == waiting_lba) {
+            waiting_lba = UINT32_MAX;
+        } else {
+            ++stats.hits;
+        }
+        read_ahead(img, line, lba);
+        last_lba = lba;
+        return CD_CACHE_READY;
+    }
+
+    if (lba != waiting_lba) {
+        ++stats.misses;
+        waiting_lba = lba;
+    }
+    if (line || fill.line) {
+        // Wait for the line being read, then read this one if it wasn't that
+        return CD_CACHE_PENDING;
+    }
+    // Just the sectors asked for unless the host is streaming
+    if (streaming) {
+        count = CD_CACHE_LINE_SECTORS;
+    }
+    if (lba - failed_start >= failed_end - failed_start && line_start(img, lba, count, lba) == CD_CACHE_PENDING) {
+        return CD_CACHE_PENDING;
+    }
+    waiting_lba = UINT32_MAX;
+    last_lba = lba;
+    line = line_read(img, lba, count);
+    if (line) {
+        *data = line_buff[line - lines];
+        return CD_CACHE_READY;
+    }
+    ++stats.direct;
+    return CD_CACHE_DIRECT;
+}
+
+static bool audio_issue(void);
+
+static void audio_done(bool ok, uintptr_t arg)
+{
+    (void) arg;
+
+    if (ok && ++audio.next < audio.reads) {
+        if (audio_issue()) {
+            return;
+        }
+        ok = false;
+    }
+    if (ok) {
+        const uint8_t *src = audio_buff + audio.data_offset;
+        for (uint8_t i = 0; i < audio.sectors; ++i, src += audio.stride) {
+            memcpy(audio.dest + i * RAW_SECTOR_SIZE, src, RAW_SECTOR_SIZE);
+        }
+    }
+    const cdrom_cache_done_t done = audio.done;
+    audio.done = NULL;
+    done(ok, audio.arg);
+}
+
+static bool audio_issue(void)
+{
+    const uint8_t i = audio.next;
+    if (!msc_read_async(audio.buff, audio.lba[i], audio.count[i], audio_done, 0)) {
+        return false;
+    }
+    audio.buff += audio.count[i] * FF_MAX_SS;
+    return true;
+}
+
+uint32_t cdrom_cache_read_audio(cd_img_t *img, uint8_t *buff, uint32_t lba, uint32_t count,
+                                cdrom_cache_done_t done, uintptr_t arg)
+{
+    const int track = cdi_get_track(img, lba) - 1;
+    if (audio.done || track < 0) {
+        return 0;
+    }
+    const track_t *trk = &img->tracks[track];
+    if (trk->sector_size != RAW_SECTOR_SIZE && trk->sector_size != 2448) {
+        return 0;
+    }
+
+    if (count > img->tracks[track + 1].start - lba) {
+        count = img->tracks[track + 1].start - lba;
+    }
+    if (count > CD_CACHE_AUDIO_SECTORS) {
+        count = CD_CACHE_AUDIO_SECTORS;
+    }
+    const uint32_t seek = trk->skip + (lba - trk->start) * trk->sector_size;
+    const uint32_t first = seek & ~(FF_MAX_SS - 1);
+    uint32_t bytes;
+    while ((bytes = (seek - first + (count - 1) * trk->sector_size + RAW_SECTOR_SIZE + FF_MAX_SS - 1)
+                    & ~(FF_MAX_SS - 1)) > CD_CACHE_AUDIO_BYTES) {
+        --count;
+    }
+    audio.reads = locate_runs(trk, first, bytes, audio.lba, audio.count);
+    if (!audio.reads) {
+        return 0;
+    }
+
+    audio.done = done;
+    audio.arg = arg;
+    audio.buff = audio_buff;
+    audio.dest = buff;
+    audio.data_offset = seek - first;
+    audio.stride = trk->sector_size;
+    audio.sectors = count;
+    audio.next = 0;
+    if (!audio_issue()) {
+        audio.done = NULL;
+        return 0;
+    }
+    return count;
+}
+
+void cdrom_cache_invalidate(void)
+{
+    for (uint32_t i = 0; i < CD_CACHE_LINES; ++i) {
+        if (lines[i].state == LINE_FILLING) {
+            // Freed when its read ends
+            lines[i].count = 0;
+        } else {
+            lines[i].state = LINE_FREE;
+        }
+    }
+    last_lba = UINT32_MAX;
+    waiting_lba = UINT32_MAX;
+    request_end = 0;
+    failed_end = failed_start;
+}
+
+void cdrom_cache_stats_get(cdrom_cache_stats_t *s)
+{
+    *s = stats;
+}
+
+void cdrom_cache_stats_clear(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// Cache of CD data sectors read off the USB drive. Sectors are read in lines of up to
+// CD_CACHE_LINE_SECTORS consecutive sectors of one track, each line a single run of drive sectors
+// (one READ10 per fragment of the image it spans) read without waiting, and lines are replaced least
+// recently used first. While the host reads sequentially, the lines following the one it is reading
+// are read ahead of it.
+//
+// Data that can't be read straight off the drive, in a .cdz image or one in too many fragments to
+// map, is read a line at a time through FatFS with cdi_read_sectors() instead, waiting for it.
+//
+// CD audio is read the same way, without waiting, through a buffer of its own and then copied to
+// where the caller wants it, since its sectors don't start on drive sectors.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cdrom_image_backend.h"
+
+// CD sectors per line: 16 drive sectors for an ISO, 19 for a raw image
+#ifndef CD_CACHE_LINE_SECTORS
+#define CD_CACHE_LINE_SECTORS 4
+#endif
+#ifndef CD_CACHE_LINES
+#define CD_CACHE_LINES 4
+#endif
+// Lines kept read ahead of the one the host is reading from
+#ifndef CD_CACHE_READ_AHEAD
+#define CD_CACHE_READ_AHEAD 2
+#endif
+// Room for the raw sectors, and a drive sector before and after them for where they start and
+// end within one
+#define CD_CACHE_LINE_BYTES (CD_CACHE_LINE_SECTORS * RAW_SECTOR_SIZE + FF_MAX_SS)
+// Raw audio sectors read at once at most, and the buffer they are read into: a whole drive sector
+// either side of them, so that many always fit
+#ifndef CD_CACHE_AUDIO_SECTORS
+#define CD_CACHE_AUDIO_SECTORS 4
+#endif
+#define CD_CACHE_AUDIO_BYTES (CD_CACHE_AUDIO_SECTORS * RAW_SECTOR_SIZE + 2 * FF_MAX_SS)
+
+// Results of cdrom_cache_read
+#define CD_CACHE_READY   1
+#define CD_CACHE_PENDING 0
+#define CD_CACHE_DIRECT  -1
+
+typedef struct cdrom_cache_stats_t {
+    uint32_t hits;          // Sectors found in the cache
+    uint32_t misses;        // Sectors the host had to wait for, or read through FatFS
+    uint32_t reads;         // Drive reads issued
+    uint32_t read_sectors;  // Drive sectors they read
+    uint32_t direct;        // Sectors read through FatFS instead, a line at a time or by the caller
+} cdrom_cache_stats_t;
+
+#define CD_CACHE_STATS_WORDS (sizeof(cdrom_cache_stats_t) / sizeof(uint32_t))
+
+// Called from tuh_task() when an audio read ends; ok is false if it failed
+typedef void (*cdrom_cache_done_t)(bool ok, uintptr_t arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Looks up the 2048 bytes of user data of CD sector lba, the first of count the host has asked for,
+// reading a line from it if needed. Returns CD_CACHE_READY with *data pointing at them,
+// CD_CACHE_PENDING while they are on their way from the drive, or CD_CACHE_DIRECT if the caller
+// has to read the sector itself: when it isn't Mode 1 or Mode 2 Form 1 data, or couldn't be read.
+int cdrom_cache_read(cd_img_t *img, uint32_t lba, uint32_t count, const uint8_t **data);
+
+// Starts reading up to count raw sectors of the audio track holding CD sector lba into buff, at most
+// CD_CACHE_AUDIO_SECTORS and up to the end of the track, and returns how many without waiting. done
+// is called once they are in place. Returns 0 if the caller has to read them through FatFS: when
+// the track isn't audio, isn't contiguous on the drive or another audio read is in progress.
+uint32_t cdrom_cache_read_audio(cd_img_t *img, uint8_t *buff, uint32_t lba, uint32_t count,
+                                cdrom_cache_done_t done, uintptr_t arg);
+
+// Forgets every line, for when the image changes. A read in progress is left to finish.
+void cdrom_cache_invalidate(void);
+
+void cdrom_cache_stats_get(cdrom_cache_stats_t *stats);
+void cdrom_cache_stats_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -32,6 +32,7 @@
 #define HAVE_STDARG_H
 
 #include "cdrom_image_backend.h"
+#include "cdrom_cache.h"
 #include "cdrom.h"
 #include "86box_compat.h"
 
@@ -193,6 +194,31 @@ image_read_sector(struct cdrom *dev, int type, uint8_t *b, uint32_t lba)
     }
 }
 
+static int
+image_read_audio_sectors(struct cdrom *dev, uint8_t *b, uint32_t lba, uint32_t count)
+{
+    cd_img_t *img = (cd_img_t *) dev->image;
+
+    return cdi_read_audio_sectors(img, b, lba, count);
+}
+
+static uint32_t
+image_read_audio_async(struct cdrom *dev, uint8_t *b, uint32_t lba, uint32_t count,
+                       void (*done)(bool ok, uintptr_t arg), uintptr_t arg)
+{
+    cd_img_t *img = (cd_img_t *) dev->image;
+
+    return cdrom_cache_read_audio(img, b, lba, count, done, arg);
+}
+
+static int
+image_get_data_sector(struct cdrom *dev, uint32_t lba, uint32_t count, const uint8_t **data)
+{
+    cd_img_t *img = (cd_img_t *) dev->image;
+
+    return cdrom_cache_read(img, lba, count, data);
+}
+
 static int
 image_track_type(cdrom_t *dev, uint32_t lba)
 {
@@ -219,6 +245,7 @@ image_exit(cdrom_t *dev)
     dev->cd_status = CD_STATUS_EMPTY;
 
     if (img) {
+        cdrom_cache_invalidate();
         cdi_close(img);
         dev->image = NULL;
     }
@@ -233,6 +260,9 @@ static const cdrom_ops_t cdrom_image_ops = {
     image_is_track_pre,
     image_sector_size,
     image_read_sector,
+    image_read_audio_sectors,
+    image_read_audio_async,
+    image_get_data_sector,
     image_track_type,
     image_exit
 };
@@ -287,6 +317,8 @@ cdrom_image_open(cdrom_t *dev, const char *fn)
     dev->cdrom_capacity = image_get_capacity(dev);
     cdrom_image_log("CD-ROM capacity: %i sectors (%" PRIi64 " bytes)\n", dev->cdrom_capacity, ((uint64_t) dev->cdrom_capacity) << 11ULL);
 
+    cdi_report_fragments(img);
+
     /* Attach this handler to the drive. */
     // printf("Set Ops in Open\n");
     dev->ops = &cdrom_image_ops;
@@ -37,6 +37,8 @@
 #define HAVE_STDARG_H
 #include "cdrom_image_backend.h"
 #include "cdrom_error_msg.h"
+#include "cdrom_image_cdz.h"
+#include "diskio.h"
 #include "86box_compat.h"
 
 
@@ -107,20 +109,46 @@ cdrom_image_backend_log(const char *fmt, ...)
 
 /* #include "pico/stdlib.h" */
 /* extern uint LED_PIN; */
-/* Binary file functions. */
+
+/* The last drive sector read for part of its bytes, kept as f_read keeps
+   fp->buf, as consecutive raw sectors share drive sectors. */
+static uint8_t bin_sector_buf[FF_MAX_SS];
+static LBA_t   bin_sector_lba;
+static int     bin_sector_valid;
+
+/* Finds the drive sector holding byte seek of a mapped file, which must start
+   a drive sector, and returns how many bytes from there follow it on the
+   drive, to the end of its fragment. Returns 0 past the file's clusters. */
+static uint32_t
+bin_extent_find(const track_file_t *tf, uint32_t seek, uint32_t *lba)
+{
+    const track_extent_t *ext           = tf->extents;
+    const uint32_t        cluster_bytes = (uint32_t) tf->fp->obj.fs->csize * FF_MAX_SS;
+    const uint32_t        cluster       = seek / cluster_bytes;
+    uint32_t              lo            = 0;
+    uint32_t              hi            = tf->extents_num;
+    uint32_t              mid;
+
+    if (cluster >= ext[hi].cluster)
+        return 0;
+    while ((hi - lo) > 1) {
+        mid = (lo + hi) / 2;
+        if (ext[mid].cluster <= cluster)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    *lba = ext[lo].lba + ((seek - (ext[lo].cluster * cluster_bytes)) / FF_MAX_SS);
+    return (ext[lo + 1].cluster * cluster_bytes) - seek;
+}
+
+/* Reads through FatFS, for files too fragmented to map. */
 static int
-/* bin_read(void *priv, uint8_t *buffer, uint64_t seek, size_t count) */
-bin_read(void *priv, uint8_t *buffer, uint32_t seek, size_t count)
+bin_read_fatfs(track_file_t *tf, uint8_t *buffer, uint32_t seek, size_t count)
 {
     unsigned int bytes_read;
-    track_file_t *tf = (track_file_t *) priv;
-
-    /* cdrom_image_backend_log("CDROM: binary_read(%08lx, pos=%" PRIu64 " count=%lu\n", */
-    cdrom_image_backend_log("CDROM: binary_read(%08lx, pos=%" PRIu32 " count=%lu\n",
-                            tf->fp, seek, count);
 
-    if (tf->fp == NULL)
-        return 0;    
     //if (fseeko64(tf->fp, seek, SEEK_SET) == -1) {    
     if (f_lseek(tf->fp, seek) != FR_OK) {
 #ifdef ENABLE_CDROM_IMAGE_BACKEND_LOG
@@ -141,6 +169,131 @@ bin_read(void *priv, uint8_t *buffer, uint32_t seek, size_t count)
     return 1;
 }
 
+/* Binary file functions. */
+static int
+/* bin_read(void *priv, uint8_t *buffer, uint64_t seek, size_t count) */
+bin_read(void *priv, uint8_t *buffer, uint32_t seek, size_t count)
+{
+    track_file_t *tf = (track_file_t *) priv;
+    BYTE          pdrv;
+    uint32_t      lba;
+    uint32_t      run;
+    uint32_t      skip;
+    uint32_t      n;
+
+    /* cdrom_image_backend_log("CDROM: binary_read(%08lx, pos=%" PRIu64 " count=%lu\n", */
+    cdrom_image_backend_log("CDROM: binary_read(%08lx, pos=%" PRIu32 " count=%lu\n",
+                            tf->fp, seek, count);
+
+    if (tf->fp == NULL)
+        return 0;    
+    if (tf->extents == NULL)
+        return bin_read_fatfs(tf, buffer, seek, count);
+
+    /* Straight off the drive, a fragment at a time */
+    pdrv = tf->fp->obj.fs->pdrv;
+    while (count) {
+        skip = seek & (FF_MAX_SS - 1);
+        run  = bin_extent_find(tf, seek - skip, &lba);
+        if (!run)
+            return 0;
+        if (skip || (count < FF_MAX_SS)) {
+            if (!bin_sector_valid || (bin_sector_lba != lba)) {
+                bin_sector_valid = 0;
+                if (disk_read(pdrv, bin_sector_buf, lba, 1) != RES_OK)
+                    return 0;
+                bin_sector_lba   = lba;
+                bin_sector_valid = 1;
+            }
+            n = MIN(FF_MAX_SS - skip, count);
+            memcpy(buffer, bin_sector_buf + skip, n);
+        } else {
+            n = MIN(run, count & ~(FF_MAX_SS - 1));
+            if (disk_read(pdrv, buffer, lba, n / FF_MAX_SS) != RES_OK)
+                return 0;
+        }
+        buffer += n;
+        seek += n;
+        count -= n;
+    }
+
+    return 1;
+}
+
+/* Finds the drive sector holding byte seek of the file, which must start a
+   drive sector, and returns how many of the count bytes from there follow it
+   on the drive: those up to the end of its fragment. Returns 0 if they can't
+   be read straight off the drive. */
+static uint32_t
+bin_locate(void *priv, uint32_t seek, size_t count, uint32_t *lba)
+{
+    track_file_t *tf = (track_file_t *) priv;
+    uint32_t      run;
+
+    if ((tf->fp == NULL) || (tf->extents == NULL) || (seek & (FF_MAX_SS - 1)) || (seek >= f_size(tf->fp)))
+        return 0;
+
+    run = bin_extent_find(tf, seek, lba);
+    return (uint32_t) MIN(run, count);
+}
+
+/* Maps the runs of the file's clusters that lie together on the drive, from
+   the fast seek link map FatFS builds by walking the FAT, so that reads can
+   go straight to the drive without f_lseek walking it again. Leaves
+   tf->extents NULL if the file is in more than CD_EXTENTS_MAX fragments. */
+static void
+bin_map_extents(track_file_t *tf)
+{
+    FATFS          *fs = tf->fp->obj.fs;
+    DWORD          *tbl;
+    DWORD          *fit;
+    track_extent_t *ext;
+    uint32_t        n;
+    uint32_t        cluster = 0;
+    DWORD           ncl;
+    DWORD           scl;
+    FRESULT         res;
+
+    tf->extents     = NULL;
+    tf->extents_num = 0;
+
+    /* Walking the FAT is most of the time it takes, so walk it once into room
+       for the most fragments, then give back what the file didn't need. FatFS
+       leaves the size the map needs in its first entry. */
+    tbl = (DWORD *) malloc((2 + (2 * CD_EXTENTS_MAX)) * sizeof(DWORD));
+    if (tbl == NULL)
+        return;
+    tbl[0]        = 2 + (2 * CD_EXTENTS_MAX);
+    tf->fp->cltbl = tbl;
+    res           = f_lseek(tf->fp, CREATE_LINKMAP);
+    tf->fp->cltbl = NULL;
+    if (res != FR_OK) {
+        free(tbl);
+        return;
+    }
+    fit = (DWORD *) realloc(tbl, tbl[0] * sizeof(DWORD));
+    if (fit != NULL)
+        tbl = fit;
+
+    /* The map is the size word, a (length, first cluster) pair per fragment
+       and a 0: convert it in place, each pair read before it is written over,
+       with the 0 and the last cluster making way for the end of the file */
+    n   = (tbl[0] - 2) / 2;
+    ext = (track_extent_t *) tbl;
+    for (uint32_t i = 0; i < n; i++) {
+        ncl            = tbl[1 + (2 * i)];
+        scl            = tbl[2 + (2 * i)];
+        ext[i].cluster = cluster;
+        ext[i].lba     = fs->database + ((LBA_t) fs->csize * (scl - 2));
+        cluster += ncl;
+    }
+    ext[n].cluster = cluster;
+    ext[n].lba     = 0;
+
+    tf->extents     = ext;
+    tf->extents_num = n;
+}
+
 /* static uint64_t */
 static uint32_t
 bin_get_length(void *priv)
@@ -179,6 +332,9 @@ bin_close(void *priv)
         free(tf->fp);
         tf->fp = NULL;
     }
+    free(tf->extents);
+    tf->extents      = NULL;
+    bin_sector_valid = 0;
 
     tf->fn[0] = 0;
     /* memset(tf->fn, 0x00, sizeof(tf->fn)); */
@@ -210,14 +366,15 @@ bin_init(const char *filename, int *error)
 
     if (result == FR_OK) {
         cdrom_image_backend_log("all good\n");
-        // Set up fast seek for the file (avoids reading the FAT for each seek)
-        tf->fp->cltbl = tf->clmt;
-        tf->clmt[0] = SZ_TBL;
-        if (f_lseek(tf->fp, CREATE_LINKMAP) == FR_NOT_ENOUGH_CORE) {
-            // Size of clmt is too small for the file - it is too fragmented
-            cdrom_image_backend_log("File too fragmented for the cluster link map table. Falling back to slow seek\n");
+        // Map where the file is on the drive (avoids reading the FAT for each seek)
+        bin_map_extents(tf);
+        if (tf->extents == NULL) {
+            // Too fragmented to map
+            cdrom_image_backend_log("File too fragmented for the extent map. Falling back to slow seek\n");
         }
+        bin_sector_valid = 0;
         tf->read       = bin_read;
+        tf->locate     = bin_locate;
         tf->get_length = bin_get_length;
         tf->close      = bin_close;
     } else {
@@ -232,9 +389,14 @@ bin_init(const char *filename, int *error)
 static track_file_t *
 track_file_init(const char *filename, int *error)
 {
-    /* Current we only support .BIN files, either combined or one per
-       track. In the future, more is planned. */
-    return bin_init(filename, error);
+    /* .BIN files, either combined or one per track, and the compressed
+       .CDZ files made from them, read through the .CDZ file itself. */
+    track_file_t *tf  = bin_init(filename, error);
+    int           len = strlen(filename);
+
+    if ((tf != NULL) && (len >= 4) && (strncasecmp(filename + (len - 4), ".cdz", 4) == 0))
+        tf = cdz_open(tf, error);
+    return tf;
 }
 
 static void
@@ -296,14 +458,46 @@ cdi_set_device(cd_img_t *cdi, const char *path)
     if (len < 4) return 0;
     if (strncasecmp(path + (len - 4), ".cue", 4) == 0) {
         return cdi_load_cue(cdi, path);
-    } else if (strncasecmp(path + (len - 4), ".iso", 4) == 0) {
+    } else if ((strncasecmp(path + (len - 4), ".iso", 4) == 0) || (strncasecmp(path + (len - 4), ".cdz", 4) == 0)) {
         return cdi_load_iso(cdi, path);
     } else {
-        cdrom_errorstr_set("File '%s' not a cue or iso", path);
+        cdrom_errorstr_set("File '%s' not a cue, iso or cdz", path);
         return 0;
     }
 }
 
+/* Reports how many fragments the image's files are in, once loaded, and
+   leaves a warning in the error string when they are small enough to split
+   many reads, or too many to map. */
+void
+cdi_report_fragments(cd_img_t *cdi)
+{
+    const track_file_t *last      = NULL;
+    const track_file_t *tf;
+    uint32_t            fragments = 0;
+    uint32_t            bytes     = 0;
+    int                 unmapped  = 0;
+
+    for (int i = 0; i < cdi->tracks_num; i++) {
+        tf = cdi->tracks[i].file;
+        if ((tf == NULL) || (tf == last))
+            continue;
+        last = tf;
+        if (tf->extents == NULL)
+            unmapped = 1;
+        else {
+            fragments += tf->extents_num;
+            bytes += f_size(tf->fp);
+        }
+    }
+
+    printf("%" PRIu32 " fragments%s...", fragments, unmapped ? " and unmapped files" : "");
+    if (unmapped)
+        cdrom_errorstr_set("Image too fragmented, seeks will be slow. Defragment the USB drive");
+    else if ((fragments > 1) && ((bytes / fragments) < CD_EXTENT_WARN_BYTES))
+        cdrom_errorstr_set("Image is in %" PRIu32 " fragments, reads will be slower. Defragment the USB drive", fragments);
+}
+
 void
 cdi_get_audio_tracks(cd_img_t *cdi, int *st_track, int *end, TMSF *lead_out)
 {
@@ -459,7 +653,7 @@ cdi_read_sector(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector)
 
     if (raw && !track_is_raw) {
         memset(buffer, 0x00, 2448);
-        ret = trk->file->read(trk->file, buffer + offset, seek, length);
+        ret = trk->file->read(trk->file, buffer + offset, seek, cooked_size);
         if (!ret)
             return 0;
         /* Construct the rest of the raw sector. */
@@ -480,37 +674,131 @@ cdi_read_sector(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector)
     }
 }
 
+/* Finds where in each of the track's stored sectors the bytes a read of it
+   returns start, and how many there are: the user data for cooked reads, as
+   cdi_read_sector() takes it, or the 2352 bytes of a raw one. Returns 0 for
+   raw reads of a cooked track, which need their header made up. */
+static int
+cdi_sector_layout(const track_t *trk, int raw, uint32_t *offset, uint32_t *length)
+{
+    int track_is_raw = ((trk->sector_size == RAW_SECTOR_SIZE) || (trk->sector_size == 2448));
+
+    *offset = 0;
+    if (raw) {
+        *length = RAW_SECTOR_SIZE;
+        return track_is_raw;
+    }
+
+    if (trk->mode2 && (trk->form != 1)) {
+        if (trk->form == 2)
+            *length = (track_is_raw ? 2328 : trk->sector_size);
+        else
+            *length = 2336;
+    } else
+        *length = COOKED_SECTOR_SIZE;
+
+    if (track_is_raw)
+        *offset = (trk->mode2 && (trk->form >= 1)) ? 24 : 16;
+    return 1;
+}
+
+/* Reads num sectors, packed one after the other in buffer at the size
+   cdi_sector_layout() gives for their track: 2048 bytes each for cooked reads
+   of Mode 1 and Mode 2 Form 1 tracks. The sectors of each track are one read
+   of the image, straight into buffer if they are stored as they are returned,
+   else CD_SCATTER_SECTORS at a time into a static buffer that their data is
+   taken out of. */
 int
 cdi_read_sectors(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector, uint32_t num)
 {
-    int      sector_size;
-    int      success = 1;
-    uint8_t *buf;
-    uint32_t buf_len;
-
-    /* TODO: This fails to account for Mode 2. Shouldn't we have a function
-             to get sector size? */
-    sector_size = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
-    buf_len     = num * sector_size;
-    buf         = (uint8_t *) malloc(buf_len * sizeof(uint8_t));
-
-    for (uint32_t i = 0; i < num; i++) {
-        success = cdi_read_sector(cdi, &buf[i * sector_size], raw, sector + i);
-        if (!success)
-            break;
+    static uint8_t scatter_buf[CD_SCATTER_SECTORS * 2448];
+    int            track;
+    track_t       *trk;
+    uint32_t       offset;
+    uint32_t       length;
+    uint32_t       stride;
+    uint32_t       seek;
+    uint32_t       run;
+    uint32_t       chunk;
+    uint64_t       zero;
+
+    while (num) {
+        track = cdi_get_track(cdi, sector) - 1;
+        if (track < 0)
+            return 0;
+        trk = &cdi->tracks[track];
+
+        if (!cdi_sector_layout(trk, raw, &offset, &length) || (sector < trk->start)) {
+            /* Made up, or before the first track: a sector at a time */
+            run = 1;
+            if (!cdi_read_sector(cdi, scatter_buf, raw, sector))
+                return 0;
+            memcpy(buffer, scatter_buf, length);
+        } else {
+            stride = trk->sector_size;
+            run    = MIN(num, trk[1].start - sector);
+            seek   = trk->skip + ((sector - trk->start) * stride) + offset;
+            if (length == stride) {
+                if (!trk->file->read(trk->file, buffer, seek, run * length))
+                    return 0;
+            } else {
+                for (uint32_t i = 0; i < run; i += chunk) {
+                    chunk = MIN(run - i, CD_SCATTER_SECTORS);
+                    if (!trk->file->read(trk->file, scatter_buf, seek + (i * stride), ((chunk - 1) * stride) + length))
+                        return 0;
+                    for (uint32_t j = 0; j < chunk; j++)
+                        memcpy(buffer + ((i + j) * length), scatter_buf + (j * stride), length);
+                }
+            }
+        }
+
         /* Based on the DOSBox patch, but check all 8 bytes and makes sure it's not an
            audio track. */
-        if (raw && sector < cdi->tracks[0].length && !cdi->tracks[0].mode2 && (cdi->tracks[0].attr != AUDIO_TRACK) && *(uint64_t *) &(buf[i * sector_size + 2068])) {
-            free(buf);
-            return 0;
+        if (raw && !cdi->tracks[0].mode2 && (cdi->tracks[0].attr != AUDIO_TRACK)) {
+            for (uint32_t i = 0; (i < run) && ((sector + i) < cdi->tracks[0].length); i++) {
+                memcpy(&zero, buffer + (i * length) + 2068, sizeof(zero));
+                if (zero)
+                    return 0;
+            }
         }
+
+        buffer += run * length;
+        sector += run;
+        num -= run;
     }
 
-    memcpy((void *) buffer, buf, buf_len);
-    free(buf);
-    buf = NULL;
+    return 1;
+}
 
-    return success;
+/* Reads num 2352-byte audio sectors. A run within one track stored at 2352
+   bytes a sector is a single read of the image, which FatFS passes to the
+   drive as multi-sector reads. Sectors of cooked tracks read as silence. */
+int
+cdi_read_audio_sectors(cd_img_t *cdi, uint8_t *buffer, uint32_t sector, uint32_t num)
+{
+    int      track = cdi_get_track(cdi, sector) - 1;
+    track_t *trk;
+
+    if (track < 0)
+        return 0;
+
+    trk = &cdi->tracks[track];
+    if ((trk->sector_size == RAW_SECTOR_SIZE) && ((cdi_get_track(cdi, sector + num - 1) - 1) == track))
+        return trk->file->read(trk->file, buffer, trk->skip + ((sector - trk->start) * trk->sector_size),
+                               num * RAW_SECTOR_SIZE);
+
+    for (uint32_t i = 0; i < num; i++, sector++, buffer += RAW_SECTOR_SIZE) {
+        track = cdi_get_track(cdi, sector) - 1;
+        if (track < 0)
+            return 0;
+        trk = &cdi->tracks[track];
+        if ((trk->sector_size != RAW_SECTOR_SIZE) && (trk->sector_size != 2448))
+            memset(buffer, 0x00, RAW_SECTOR_SIZE);
+        else if (!trk->file->read(trk->file, buffer, trk->skip + ((sector - trk->start) * trk->sector_size), RAW_SECTOR_SIZE))
+            return 0;
+    }
+
+    return 1;
 }
 
 /* TODO: Do CUE+BIN images with a sector size of 2448 even exist? */
@@ -620,7 +908,7 @@ cdi_load_iso(cd_img_t *cdi, const char *filename)
     cdi->tracks_num = 0;
 
     /* Data track (shouldn't there be a lead in track?). */
-    trk.file = bin_init(filename, &error);
+    trk.file = track_file_init(filename, &error);
     if (error) {
         if ((trk.file != NULL) && (trk.file->close != NULL))
             trk.file->close(trk.file);
@@ -57,11 +57,26 @@ typedef struct SMSF {
     uint8_t  fr;
 } TMSF;
 
-#define SZ_TBL 32
+/* Fragments a track file can have and still be read straight off the drive;
+   more and it is read through FatFS, which walks the FAT on each seek. */
+#define CD_EXTENTS_MAX       1024
+/* Average fragment size below which loading the image warns about it */
+#define CD_EXTENT_WARN_BYTES (256 * 1024)
+/* Raw sectors cdi_read_sectors() reads at once to take the user data out of */
+#ifndef CD_SCATTER_SECTORS
+#define CD_SCATTER_SECTORS 4
+#endif
+
+/* A run of a track file's clusters that lie together on the drive. */
+typedef struct track_extent_t {
+    uint32_t cluster;   /* Index in the file of the run's first cluster */
+    uint32_t lba;       /* Drive sector it starts at */
+} track_extent_t;
 
 /* Track file struct. */
 typedef struct track_file_t {
     int (*read)(void *priv, uint8_t *buffer, uint32_t seek, size_t count);
+    uint32_t (*locate)(void *priv, uint32_t seek, size_t count, uint32_t *lba);
     // uint64_t (*get_length)(void *priv);
     uint32_t (*get_length)(void *priv);
     void (*close)(void *priv);
@@ -69,8 +84,10 @@ typedef struct track_file_t {
     char  fn[128];
     FIL *fp;
     void *priv;
-    // fast seek cluster link map table
-    uint32_t clmt[SZ_TBL];
+    // Where the file is on the drive, in file order, with an entry after the
+    // last fragment for the end of its clusters. NULL if it isn't mapped.
+    track_extent_t *extents;
+    uint32_t extents_num;
 } track_file_t;
 
 typedef struct track_t {
@@ -98,6 +115,7 @@ typedef struct cd_img_t {
 /* Binary file functions. */
 extern void cdi_close(cd_img_t *cdi);
 extern int  cdi_set_device(cd_img_t *cdi, const char *path);
+extern void cdi_report_fragments(cd_img_t *cdi);
 extern void cdi_get_audio_tracks(cd_img_t *cdi, int *st_track, int *end, TMSF *lead_out);
 extern void cdi_get_audio_tracks_lba(cd_img_t *cdi, int *st_track, int *end, uint32_t *lead_out);
 extern int  cdi_get_audio_track_info(cd_img_t *cdi, int end, int track, int *track_num, TMSF *start, uint8_t *attr);
@@ -106,6 +124,7 @@ extern int  cdi_get_track(cd_img_t *cdi, uint32_t sector);
 extern int  cdi_get_audio_sub(cd_img_t *cdi, uint32_t sector, uint8_t *attr, uint8_t *track, uint8_t *index, TMSF *rel_pos, TMSF *abs_pos);
 extern int  cdi_read_sector(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector);
 extern int  cdi_read_sectors(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector, uint32_t num);
+extern int  cdi_read_audio_sectors(cd_img_t *cdi, uint8_t *buffer, uint32_t sector, uint32_t num);
 extern int  cdi_read_sector_sub(cd_img_t *cdi, uint8_t *buffer, uint32_t sector);
 extern int  cdi_get_sector_size(cd_img_t *cdi, uint32_t sector);
 extern int  cdi_is_mode2(cd_img_t *cdi, uint32_t sector);
@@ -0,0 +1,305 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cdrom_image_cdz.h"
+
+// Most drive sectors of the index read at once: reads are of whole drive sectors, and the entries
+// of a hunk and the one after it can fall either side of a sector boundary
+#define CDZ_INDEX_SECTORS 2
+// Room after a hunk's buffer for reading its compressed data in whole drive sectors
+#define CDZ_ALIGN_SLOP (2 * FF_MAX_SS)
+
+typedef struct cdz_hunk_t {
+    uint32_t number;    // Hunk held, UINT32_MAX if none
+    uint32_t last_use;
+    uint8_t *data;      // Its bytes, with room after them to read it into compressed
+} cdz_hunk_t;
+
+typedef struct cdz_file_t {
+    track_file_t  tf;           // The image, first so the track file's priv is this
+    track_file_t *file;         // The .cdz
+    cdz_header_t  header;
+    uint32_t      file_size;
+    uint32_t      index_seek;   // Offset in the .cdz of index[], UINT32_MAX if none
+    uint32_t      index_size;   // Bytes of the .cdz in index[]
+    uint32_t      index[CDZ_INDEX_SECTORS * FF_MAX_SS / sizeof(uint32_t)];
+    uint32_t      use_count;
+    cdz_hunk_t    hunks[CDZ_HUNK_CACHE];
+} cdz_file_t;
+
+static cdz_stats_t stats;
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+// Adds the bytes of an LZ4 length that carries on past its 4 bits
+static bool length_more(const uint8_t **src, const uint8_t *src_end, uint32_t *len)
+{
+    uint8_t b;
+    do {
+        if (*src == src_end) {
+            return false;
+        }
+        b = *(*src)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+int cdz_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+    const uint8_t *const src_end = src + src_len;
+    uint8_t *const dst_start = dst;
+    uint8_t *const dst_end = dst + dst_len;
+
+    while (src < src_end) {
+        const uint8_t token = *src++;
+        uint32_t len = token >> 4;
+        if (len == 15 && !length_more(&src, src_end, &len)) {
+            return -1;
+        }
+        if (len > (uint32_t)(src_end - src) || len > (uint32_t)(dst_end - dst)) {
+            return -1;
+        }
+        // Moved rather than copied, as when decoding in place the output closes in on the input
+        memmove(dst, src, len);
+        src += len;
+        dst += len;
+        if (src == src_end) {
+            // The last sequence is just literals
+            break;
+        }
+
+        if (src_end - src < 2) {
+            return -1;
+        }
+        const uint32_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        len = token & 15;
+        if (len == 15 && !length_more(&src, src_end, &len)) {
+            return -1;
+        }
+        len += 4;
+        if (offset == 0 || offset > (uint32_t)(dst - dst_start) || len > (uint32_t)(dst_end - dst)) {
+            return -1;
+        }
+        const uint8_t *match = dst - offset;
+        if (offset >= len) {
+            memcpy(dst, match, len);
+            dst += len;
+        } else {
+            // A match overlapping what it produces repeats its last offset bytes
+            while (len--) {
+                *dst++ = *match++;
+            }
+        }
+    }
+    return dst - dst_start;
+}
+
+// Returns the entries of hunk and the one after it, which are the start and end of its data,
+// reading the drive sectors holding them into index[] if they aren't there
+static const uint32_t *index_get(cdz_file_t *cz, uint32_t hunk)
+{
+    const uint32_t seek = sizeof(cdz_header_t) + hunk * sizeof(uint32_t);
+    if (cz->index_seek == UINT32_MAX || seek < cz->index_seek
+        || seek + 2 * sizeof(uint32_t) > cz->index_seek + cz->index_size) {
+        const uint32_t first = seek & ~(FF_MAX_SS - 1);
+        const uint32_t sectors_end = (seek + 2 * sizeof(uint32_t) + FF_MAX_SS - 1) & ~(FF_MAX_SS - 1);
+        const uint32_t size = min_u32(sectors_end, cz->file_size) - first;
+        cz->index_seek = UINT32_MAX;
+        if (!cz->file->read(cz->file, (uint8_t *) cz->index, first, size)) {
+            return NULL;
+        }
+        cz->index_seek = first;
+        cz->index_size = size;
+    }
+    return &cz->index[(seek - cz->index_seek) / sizeof(uint32_t)];
+}
+
+// Returns the bytes of hunk, decoding it into the least recently used buffer if it isn't in one,
+// or NULL if it can't be read
+static const uint8_t *hunk_get(cdz_file_t *cz, uint32_t hunk)
+{
+    const uint32_t hunk_bytes = cz->header.hunk_bytes;
+    cdz_hunk_t *victim = &cz->hunks[0];
+    for (uint32_t i = 0; i < CDZ_HUNK_CACHE; ++i) {
+        cdz_hunk_t *h = &cz->hunks[i];
+        if (h->number == hunk) {
+            h->last_use = ++cz->use_count;
+            ++stats.hits;
+            return h->data;
+        }
+        if (h->last_use < victim->last_use) {
+            victim = h;
+        }
+    }
+
+    const uint32_t *entry = index_get(cz, hunk);
+    if (!entry) {
+        return NULL;
+    }
+    const uint32_t start = entry[0];
+    const uint32_t end = entry[1];
+    const uint32_t size = min_u32(hunk_bytes, cz->header.size - hunk * hunk_bytes);
+    if (end < start || end - start > size || end > cz->file_size) {
+        return NULL;
+    }
+    const uint32_t len = end - start;
+
+    // Read in whole drive sectors, as one command rather than one for each partial sector, into the
+    // end of the buffer. Compressed data is decoded from there to its start.
+    const uint32_t read_start = start & ~(FF_MAX_SS - 1);
+    const uint32_t read_end = min_u32((end + FF_MAX_SS - 1) & ~(FF_MAX_SS - 1), cz->file_size);
+    uint8_t *read_buf = victim->data + hunk_bytes + CDZ_INPLACE_MARGIN(hunk_bytes) + CDZ_ALIGN_SLOP
+                        - (read_end - read_start);
+    uint8_t *src = read_buf + (start - read_start);
+    victim->number = UINT32_MAX;
+    if (!cz->file->read(cz->file, read_buf, read_start, read_end - read_start)) {
+        return NULL;
+    }
+    if (len == size) {
+        memmove(victim->data, src, len);
+    } else {
+        if (cdz_decompress(src, len, victim->data, size) != (int) size) {
+            return NULL;
+        }
+        stats.bytes_decoded += size;
+    }
+    ++stats.hunks_read;
+    stats.bytes_read += len;
+    victim->number = hunk;
+    victim->last_use = ++cz->use_count;
+    return victim->data;
+}
+
+static int cdz_read(void *priv, uint8_t *buffer, uint32_t seek, size_t count)
+{
+    cdz_file_t *cz = (cdz_file_t *) priv;
+    const uint32_t hunk_bytes = cz->header.hunk_bytes;
+
+    while (count) {
+        if (seek >= cz->header.size) {
+            return 0;
+        }
+        const uint8_t *data = hunk_get(cz, seek / hunk_bytes);
+        if (!data) {
+            return 0;
+        }
+        const uint32_t offset = seek % hunk_bytes;
+        const uint32_t n = min_u32(count, min_u32(hunk_bytes, cz->header.size - (seek - offset)) - offset);
+        memcpy(buffer, data + offset, n);
+        buffer += n;
+        seek += n;
+        count -= n;
+    }
+    return 1;
+}
+
+// Compressed sectors can't be read straight off the drive
+static uint32_t cdz_locate(void *priv, uint32_t seek, size_t count, uint32_t *lba)
+{
+    (void) priv;
+    (void) seek;
+    (void) count;
+    (void) lba;
+    return 0;
+}
+
+static uint32_t cdz_get_length(void *priv)
+{
+    return ((cdz_file_t *) priv)->header.size;
+}
+
+static void cdz_free(cdz_file_t *cz)
+{
+    for (uint32_t i = 0; i < CDZ_HUNK_CACHE; ++i) {
+        free(cz->hunks[i].data);
+    }
+    cz->file->close(cz->file);
+    free(cz);
+}
+
+static void cdz_close(void *priv)
+{
+    cdz_free((cdz_file_t *) priv);
+}
+
+track_file_t *cdz_open(track_file_t *file, int *error)
+{
+    cdz_file_t *cz = (cdz_file_t *) calloc(1, sizeof(cdz_file_t));
+    if (!cz) {
+        *error = 2;
+        file->close(file);
+        return NULL;
+    }
+    cz->file = file;
+
+    const cdz_header_t *h = &cz->header;
+    if (!file->read(file, (uint8_t *) &cz->header, 0, sizeof(cdz_header_t))
+        || memcmp(h->magic, CDZ_MAGIC, sizeof(h->magic)) || h->version != CDZ_VERSION
+        || !h->hunk_bytes || h->hunk_bytes > CDZ_HUNK_MAX_BYTES
+        || h->hunks != ((uint64_t) h->size + h->hunk_bytes - 1) / h->hunk_bytes) {
+        *error = 3;
+        cdz_free(cz);
+        return NULL;
+    }
+    cz->file_size = file->get_length(file);
+    if (cz->file_size < sizeof(cdz_header_t) + ((uint64_t) h->hunks + 1) * sizeof(uint32_t)) {
+        *error = 3;
+        cdz_free(cz);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < CDZ_HUNK_CACHE; ++i) {
+        cz->hunks[i].number = UINT32_MAX;
+        cz->hunks[i].data = (uint8_t *) malloc(h->hunk_bytes + CDZ_INPLACE_MARGIN(h->hunk_bytes) + CDZ_ALIGN_SLOP);
+        if (!cz->hunks[i].data) {
+            *error = 2;
+            cdz_free(cz);
+            return NULL;
+        }
+    }
+    cz->index_seek = UINT32_MAX;
+
+    memcpy(cz->tf.fn, file->fn, sizeof(cz->tf.fn));
+    // Where the .cdz is on the drive, for reporting how fragmented it is
+    cz->tf.fp = file->fp;
+    cz->tf.extents = file->extents;
+    cz->tf.extents_num = file->extents_num;
+    cz->tf.read = cdz_read;
+    cz->tf.locate = cdz_locate;
+    cz->tf.get_length = cdz_get_length;
+    cz->tf.close = cdz_close;
+    return &cz->tf;
+}
+
+void cdz_stats_get(cdz_stats_t *s)
+{
+    *s = stats;
+}
+
+void cdz_stats_clear(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// Compressed CD image files (.cdz): an ISO or BIN image cut into hunks of a fixed number of bytes,
+// each compressed on its own as an LZ4 block, so that any sector can be read by reading and
+// decoding the hunk holding it. A .cdz stands in for the image it was made from, loaded on its own
+// as an ISO or named as the BINARY file of a cue sheet.
+//
+// Layout, all little endian:
+//   cdz_header_t
+//   uint32_t index[hunks + 1]  file offset of each hunk's data, then the end of the last
+//   hunk data
+// A hunk whose data is as long as the hunk is stored as it is, else it is an LZ4 block. Every hunk
+// is hunk_bytes long but the last, which holds the rest of the image.
+
+#include <stdint.h>
+
+#include "cdrom_image_backend.h"
+
+#define CDZ_MAGIC   "PGCDZ\x1a\0"
+#define CDZ_VERSION 1
+
+typedef struct cdz_header_t {
+    char     magic[8];    // CDZ_MAGIC with its terminator
+    uint32_t version;
+    uint32_t hunk_bytes;  // Bytes of the image per hunk, a multiple of its sector size
+    uint32_t hunks;
+    uint32_t size;        // Bytes in the image
+    uint32_t reserved[2];
+} cdz_header_t;
+
+// Largest hunk loaded: 16 raw sectors
+#define CDZ_HUNK_MAX_BYTES (16 * RAW_SECTOR_SIZE)
+// Decoded hunks kept, so a sector read across two hunks, or audio and data read in turn, don't
+// decode the same hunk again and again
+#ifndef CDZ_HUNK_CACHE
+#define CDZ_HUNK_CACHE 2
+#endif
+// Room to leave after a hunk of bytes bytes so that its compressed data can be read into the end of
+// the buffer it is decoded into: LZ4 output can only catch up with the input it is decoded from in
+// the last bytes of a block
+#define CDZ_INPLACE_MARGIN(bytes) (((bytes) >> 8) + 32)
+
+typedef struct cdz_stats_t {
+    uint32_t hits;           // Reads found in a decoded hunk
+    uint32_t hunks_read;     // Hunks read off the drive
+    uint32_t bytes_read;     // Their bytes as stored
+    uint32_t bytes_decoded;  // Bytes decoded from compressed hunks
+} cdz_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decodes the LZ4 block of src_len bytes at src into dst, which has room for dst_len bytes. The
+// block may have been read into the same buffer, ending CDZ_INPLACE_MARGIN(dst_len) bytes or more
+// after dst does. Returns the bytes decoded, or -1 if the block is corrupt.
+int cdz_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len);
+
+// Reads file as a .cdz, returning a track file of the image in it in its place, which owns file
+// from then on. Returns NULL with *error set if file isn't a .cdz that can be read, having closed
+// it.
+track_file_t *cdz_open(track_file_t *file, int *error);
+
+void cdz_stats_get(cdz_stats_t *stats);
+void cdz_stats_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
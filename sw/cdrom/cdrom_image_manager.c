@@ -8,60 +8,25 @@
 #include <stdio.h>
 
 #include "cdrom_error_msg.h"
+#include "hardware/sync.h"
 
 // Maximum filename length
 #define MAX_FILENAME_LEN 127
 
-// Node structure for the linked list of CD image files
-typedef struct CDImageNode {
-    char *filename;
-    struct CDImageNode *next;
-} CDImageNode;
-
-static CDImageNode* create_cd_node(const char *filename) {
-    CDImageNode *new_node = malloc(sizeof(CDImageNode));
-    if (!new_node) {
-        return NULL; // Memory allocation failed
-    }
-    
-    // Allocate memory for the filename and copy it
-    new_node->filename = malloc(strlen(filename) + 1);
-    if (!new_node->filename) {
-        free(new_node);
-        return NULL; // Memory allocation failed
-    }
-    
-    strcpy(new_node->filename, filename);
-    new_node->next = NULL;
-    return new_node;
-}
-
-// Add a filename to the sorted list (case insensitive)
-static bool add_cd_image_sorted(CDImageNode **head, const char *filename) {
-    CDImageNode *new_node = create_cd_node(filename);
-    if (!new_node) {
-        return false; // Memory allocation failed
-    }
-    
-    // Case 1: Empty list or new filename should be first
-    if (!*head || strncasecmp(filename, (*head)->filename, MAX_FILENAME_LEN) < 0) {
-        new_node->next = *head;
-        *head = new_node;
-        return true;
-    }
-    
-    // Case 2: Find the correct position to insert
-    CDImageNode *current = *head;
-    while (current->next && strncasecmp(filename, current->next->filename, MAX_FILENAME_LEN) > 0) {
-        current = current->next;
-    }
-    
-    // Insert the new node
-    new_node->next = current->next;
-    current->next = new_node;
-    
-    return true;
-}
+// The catalog of images on the USB drive: their names one after another in a string table, and
+// the offsets of the names in it in sorted order. It's built by core 1 when first needed after a
+// drive is mounted, and read by core 0 as the control port lists it. A rebuilt table is published
+// through one pointer, so core 0 never sees the count of one table with the names of another.
+typedef struct {
+    char *names;
+    uint16_t *offsets;
+    int count;
+} catalog_t;
+static catalog_t *volatile catalog;
+static bool catalog_valid;
+// The table the last rebuild replaced. Core 0 may be part way through listing a name from it, so
+// it is only freed once no list is in progress.
+static catalog_t *retired;
 
 static bool isCDImage(const char *filename) {
     int len = strlen(filename);
@@ -71,138 +36,172 @@ static bool isCDImage(const char *filename) {
         return false;
     }
     return (strncasecmp(filename + (len - 4), ".iso", 4) == 0 ||
-            strncasecmp(filename + (len - 4), ".cue", 4) == 0);
+            strncasecmp(filename + (len - 4), ".cue", 4) == 0 ||
+            strncasecmp(filename + (len - 4), ".cdz", 4) == 0);
 }
 
-// convert linked list to array and free the list
-static char** cd_list_to_array(CDImageNode *head, int *count) {
-    if (!head || !count) {
-        return NULL;
-    }
-    
-    // Count nodes
-    *count = 0;
-    CDImageNode *current = head;
-    while (current) {
-        (*count)++;
-        current = current->next;
-    }
-    
-    // Allocate array of string pointers
-    char **fileList = (char **)malloc(*count * sizeof(char *));
-    if (!fileList) {
-        return NULL;
-    }
-    
-    // Transfer filename ownership from nodes to array and free nodes
-    current = head;
-    int i = 0;
-    while (current) {
-        CDImageNode *temp = current;
-        
-        // Transfer ownership of filename string
-        fileList[i] = current->filename;
-        i++;
-        
-        current = current->next;
-        free(temp); // Only free the node, not the filename
-    }
-    
-    return fileList;
+static const char *sort_names;
+
+// Sort by name, case insensitive
+static int compare_names(const void *a, const void *b) {
+    return strncasecmp(sort_names + *(const uint16_t *)a, sort_names + *(const uint16_t *)b, MAX_FILENAME_LEN);
 }
 
-static void free_cd_list(CDImageNode *head) {
-    CDImageNode *current = head;
-    while (current) {
-        CDImageNode *temp = current;
-        current = current->next;
-        free(temp->filename);
-        free(temp);
+// Frees the table the last rebuild replaced if the control port is done with it: no list is in
+// progress, or the one asked for has just started and holds no name yet
+static bool catalog_reap(bool list_starting) {
+    if (!list_starting && cdrom.image_status != CD_STATUS_IDLE) {
+        return !retired;
     }
+    if (retired) {
+        free(retired->names);
+        free(retired->offsets);
+        free(retired);
+        retired = NULL;
+    }
+    return true;
 }
 
-/**
- * Lists files in a directory with .iso and .cue extensions, sorted alphabetically
- * 
- * @param fileCount: Pointer to int that will receive the number of files found
- * @return: Array of strings containing filenames, or NULL on error
- *          Caller needs to free memory with cdman_list_images_free
- */
-char** cdman_list_images(int *fileCount) {
-    if (!fileCount) {
-        return NULL;
+static bool catalog_build(bool list_starting) {
+    if (!list_starting && cdrom.image_status == CD_STATUS_READY) {
+        // The control port is reading a list out: keep the table it's listing until it's done
+        return true;
     }
-    
-    *fileCount = 0;
-    
-    // Open the directory
+    if (!catalog_reap(list_starting)) {
+        // Two tables back may still be in use: keep the one there is for now
+        return true;
+    }
+
     DIR dp;
     FRESULT res = f_opendir(&dp, "");
     if (res != FR_OK) {
         cdrom_errorstr_set("No USB disk or error mounting it");
-        return NULL;
+        return false;
     }
-    
-    CDImageNode *head = NULL;
+
+    // Append the names to the table as the directory is read, growing it as needed
+    char *names = NULL;
+    uint16_t *offsets = NULL;
+    uint32_t names_used = 0, names_size = 0;
+    int count = 0, offsets_size = 0;
+    const char *error = NULL;
     FILINFO fno;
-    
-    // Read directory entries and build sorted linked list
     while (1) {
         res = f_readdir(&dp, &fno);
         if (res != FR_OK || fno.fname[0] == 0) {
             break; // End of directory or error
         }
-        
-        // Skip directories
-        if (fno.fattrib & AM_DIR) {
+        // Skip directories and files that aren't images
+        if ((fno.fattrib & AM_DIR) || !isCDImage(fno.fname)) {
             continue;
         }
-        
-        // Check if it has valid extension and add to sorted list
-        if (isCDImage(fno.fname)) {
-            if (!add_cd_image_sorted(&head, fno.fname)) {
-                // Memory allocation failed, clean up and return error
-                f_closedir(&dp);
-                free_cd_list(head);
-                cdrom_errorstr_set("Memory allocation failed");
-                return NULL;
+        const uint32_t len = strlen(fno.fname) + 1;
+        if (names_used + len > UINT16_MAX) {
+            error = "Too many image files on USB disk";
+            break;
+        }
+        if (names_used + len > names_size) {
+            names_size = names_size ? names_size * 2 : 1024;
+            char *p = realloc(names, names_size);
+            if (!p) {
+                error = "Memory allocation failed";
+                break;
             }
+            names = p;
         }
+        if (count == offsets_size) {
+            offsets_size = offsets_size ? offsets_size * 2 : 32;
+            uint16_t *p = realloc(offsets, offsets_size * sizeof(uint16_t));
+            if (!p) {
+                error = "Memory allocation failed";
+                break;
+            }
+            offsets = p;
+        }
+        memcpy(names + names_used, fno.fname, len);
+        offsets[count++] = names_used;
+        names_used += len;
     }
-    
     f_closedir(&dp);
-    
-    if (!head) {
-        cdrom_errorstr_set("No image files on USB disk");
-        return NULL;
+
+    catalog_t *table = NULL;
+    if (!error) {
+        table = malloc(sizeof(catalog_t));
+        if (!table) {
+            error = "Memory allocation failed";
+        }
     }
-    
-    // Convert linked list to array and clean up list
-    char **fileList = cd_list_to_array(head, fileCount);
-    if (!fileList) {
-        free_cd_list(head);
-        cdrom_errorstr_set("Memory allocation failed");
-        return NULL;
+    if (error) {
+        free(names);
+        free(offsets);
+        cdrom_errorstr_set(error);
+        return false;
     }
-    
-    return fileList;
+    if (count) {
+        // Give back what the table grew by that it didn't use
+        char *p = realloc(names, names_used);
+        names = p ? p : names;
+        uint16_t *q = realloc(offsets, count * sizeof(uint16_t));
+        offsets = q ? q : offsets;
+        sort_names = names;
+        qsort(offsets, count, sizeof(uint16_t), compare_names);
+    }
+
+    table->names = names;
+    table->offsets = offsets;
+    table->count = count;
+    retired = catalog;
+    __dmb();
+    catalog = table;
+    catalog_valid = true;
+    return true;
 }
 
 /**
- * Helper function to free the array returned by cdman_list_images
- * 
- * @param fileList: Array of strings returned by cdman_list_images
- * @param fileCount: Number of files in the array
+ * Makes sure the catalog lists the .iso, .cue and .cdz files on the USB drive, reading its
+ * directory only if it hasn't been since the drive was mounted
+ *
+ * @param list_starting: true when the control port has asked to list it and holds no name yet
+ * @return: true if there are images, or false with the error string set
  */
-void cdman_list_images_free(char **fileList, int fileCount) {
-    if (fileList) {
-        for (int i = 0; i < fileCount; i++) {
-            if (fileList[i]) {
-                free(fileList[i]);
-            }
-        }
-        free(fileList);
+bool cdman_catalog_update(bool list_starting) {
+    if (!catalog_valid && !catalog_build(list_starting)) {
+        return false;
+    }
+    catalog_reap(list_starting);
+    if (!cdman_image_count()) {
+        cdrom_errorstr_set("No image files on USB disk");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Marks the catalog as out of date, for when a drive is mounted or unmounted. The table is kept
+ * until it's next built, and after that until the control port is done listing it.
+ */
+void cdman_catalog_invalidate(void) {
+    catalog_valid = false;
+}
+
+/**
+ * @return: Number of images in the catalog as it was last built
+ */
+int cdman_image_count(void) {
+    const catalog_t *table = catalog;
+    return table ? table->count : 0;
+}
+
+/**
+ * @param index: Index in the catalog, from 0 to cdman_image_count() - 1
+ * @return: The image's filename, or NULL if the catalog has since been rebuilt with fewer images
+ */
+const char *cdman_image_name(int index) {
+    const catalog_t *table = catalog;
+    if (!table || index < 0 || index >= table->count) {
+        return NULL;
     }
+    return table->names + table->offsets[index];
 }
 
 static uint8_t current_index, last_loaded_index;
@@ -217,42 +216,36 @@ void cdman_load_image_index(cdrom_t *dev, int imageIndex) {
     if (imageIndex == 0) {
         cdman_unload_image(dev);
     } else {
-        int imageCount;
-        char** images = cdman_list_images(&imageCount);
-        if (!images) {
+        if (!cdman_catalog_update(false)) {
             dev->image_command = CD_COMMAND_NONE;
             dev->image_status = CD_STATUS_ERROR;
             return;
         }
-        if (imageIndex > imageCount) {
+        if (imageIndex > cdman_image_count()) {
             // Wrap around index for autoadvance
             imageIndex = 1;
         }
-        strcpy(dev->image_path, images[imageIndex - 1]);
-        cdman_list_images_free(images, imageCount);
+        strcpy(dev->image_path, cdman_image_name(imageIndex - 1));
         dev->image_command = CD_COMMAND_IMAGE_LOAD;
     }
     current_index = last_loaded_index = imageIndex;
 }
 
 void cdman_set_image_index(cdrom_t *dev) {
-    int imageCount;
-    char** images = cdman_list_images(&imageCount);
-    if (!images) {
+    if (!cdman_catalog_update(false)) {
         dev->image_command = CD_COMMAND_NONE;
         dev->image_status = CD_STATUS_ERROR;
         return;
     }
     current_index = 0;
-    for (int i = 0; i < imageCount; ++i) {
-        if (strncasecmp(dev->image_path, images[i], MAX_FILENAME_LEN) == 0) {
+    for (int i = 0; i < cdman_image_count(); ++i) {
+        if (strncasecmp(dev->image_path, cdman_image_name(i), MAX_FILENAME_LEN) == 0) {
             current_index = last_loaded_index = i + 1;
             // Copy back the canonical name to image_path with proper case
-            strcpy(dev->image_path, images[i]);
+            strcpy(dev->image_path, cdman_image_name(i));
             break;
         }
     }
-    cdman_list_images_free(images, imageCount);
 }
 
 
@@ -283,6 +276,7 @@ void cdman_reload_image(cdrom_t *dev) {
 
 
 void cdman_set_serial(cdrom_t *dev, uint32_t serial) {
+    cdman_catalog_invalidate();
     if (drive_serial == serial) {
         // If we are re-inserting the same drive, maybe advance the disc image
         printf("Inserting the same drive...\n");
@@ -6,8 +6,10 @@
 extern "C" {
 #endif
 
-char** cdman_list_images(int *fileCount);
-void cdman_list_images_free(char **fileList, int fileCount);
+bool cdman_catalog_update(bool list_starting);
+void cdman_catalog_invalidate(void);
+int cdman_image_count(void);
+const char *cdman_image_name(int index);
 
 uint8_t cdman_current_image_index(void);
 void cdman_load_image_index(cdrom_t *dev, int imageIndex);
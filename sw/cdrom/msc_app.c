@@ -24,7 +24,9 @@
  */
 
 #include <ctype.h>
+#include <string.h>
 #include "tusb.h"
+#include "pico/time.h"
 /* #include "bsp/board_api.h" */
 
 #include "ff.h"
@@ -36,9 +38,27 @@
 
 //------------- Elm Chan FatFS -------------//
 static FATFS fatfs; // for simplicity only support 1 device
+#if FF_FS_READONLY == 0
 static volatile bool _disk_busy;
+#endif
 static uint8_t mounted_dev;
 
+typedef struct {
+    uint8_t *buff;
+    uint32_t lba;
+    uint16_t count;
+    msc_read_cb_t cb;
+    uintptr_t arg;
+    uint32_t queued_us;
+} msc_read_t;
+
+// Reads in order; the first is on the bus once read_issued is set
+static msc_read_t read_queue[MSC_READ_QUEUE_SIZE];
+static uint8_t read_head;
+static uint8_t read_count;
+static bool read_issued;
+static uint32_t read_latency[MSC_LATENCY_BUCKETS];
+
 // define the buffer to be place in USB/DMA memory with correct alignment/cache line size
 CFG_TUH_MEM_SECTION static struct {
   TUH_EPBUF_TYPE_DEF(scsi_inquiry_resp_t, inquiry);
@@ -47,10 +67,81 @@ CFG_TUH_MEM_SECTION static struct {
 
 bool msc_app_init(void)
 {
+#if FF_FS_READONLY == 0
     _disk_busy = false;
+#endif
+    return true;
+}
+
+static bool read_complete(uint8_t dev_addr, tuh_msc_complete_data_t const * cb_data);
+
+static void read_issue(void)
+{
+    if (read_issued || !read_count || !mounted_dev) {
+        return;
+    }
+    msc_read_t const *req = &read_queue[read_head];
+    // Refused while the drive is busy with something else, e.g. the inquiry; msc_app_task retries
+    read_issued = tuh_msc_read10(mounted_dev, 0, req->buff, req->lba, req->count, read_complete, 0);
+}
+
+static void read_finish(bool ok)
+{
+    msc_read_t const req = read_queue[read_head];
+    read_head = (read_head + 1) % MSC_READ_QUEUE_SIZE;
+    --read_count;
+    read_issued = false;
+
+    uint32_t const us = time_us_32() - req.queued_us;
+    uint32_t bucket = us < 128 ? 0 : 31 - __builtin_clz(us) - 6;
+    if (bucket >= MSC_LATENCY_BUCKETS) {
+        bucket = MSC_LATENCY_BUCKETS - 1;
+    }
+    ++read_latency[bucket];
+
+    req.cb(ok, req.arg);
+}
+
+static bool read_complete(uint8_t dev_addr, tuh_msc_complete_data_t const * cb_data)
+{
+    (void) dev_addr;
+    read_finish(cb_data->csw->status == MSC_CSW_STATUS_PASSED);
+    read_issue();
+    return true;
+}
+
+bool msc_read_async(uint8_t *buff, uint32_t lba, uint16_t count, msc_read_cb_t cb, uintptr_t arg)
+{
+    if (!mounted_dev || read_count == MSC_READ_QUEUE_SIZE) {
+        return false;
+    }
+    msc_read_t *req = &read_queue[(read_head + read_count) % MSC_READ_QUEUE_SIZE];
+    req->buff = buff;
+    req->lba = lba;
+    req->count = count;
+    req->cb = cb;
+    req->arg = arg;
+    req->queued_us = time_us_32();
+    ++read_count;
+    read_issue();
     return true;
 }
 
+void msc_app_task(void)
+{
+    read_issue();
+}
+
+void msc_latency_get(uint32_t counts[MSC_LATENCY_BUCKETS])
+{
+    memcpy(counts, read_latency, sizeof(read_latency));
+}
+
+void msc_latency_clear(void)
+{
+    memset(read_latency, 0, sizeof(read_latency));
+}
+
 static bool inquiry_complete_cb(uint8_t dev_addr, tuh_msc_complete_data_t const * cb_data) {
     msc_cbw_t const* cbw = cb_data->cbw;
     msc_csw_t const* csw = cb_data->csw;
@@ -106,8 +197,14 @@ void tuh_msc_umount_cb(uint8_t dev_addr)
     // printf("A MassStorage device is unmounted\r\n");
     mounted_dev = 0;
 
+    // Reads queued or on the bus won't complete now
+    while (read_count) {
+        read_finish(false);
+    }
+
     f_unmount("");
 
+    cdman_catalog_invalidate();
     cdman_unload_image(&cdrom);
 }
 
@@ -115,6 +212,7 @@ void tuh_msc_umount_cb(uint8_t dev_addr)
 // DiskIO
 //--------------------------------------------------------------------+
 
+#if FF_FS_READONLY == 0
 static void wait_for_disk_io(void)
 {
     while (_disk_busy) {
@@ -128,6 +226,12 @@ static bool disk_io_complete(uint8_t dev_addr, tuh_msc_complete_data_t const * c
   _disk_busy = false;
   return true;
 }
+#endif
+
+static void disk_read_complete(bool ok, uintptr_t arg)
+{
+    *(volatile int *) arg = ok ? RES_OK : RES_ERROR;
+}
 
 DSTATUS disk_status (
 	BYTE pdrv		/* Physical drive nmuber to identify the drive */
@@ -153,13 +257,31 @@ DRESULT disk_read (
 )
 {
     (void)pdrv;
-    uint8_t const lun = 0;
-
-    _disk_busy = true;
-    tuh_msc_read10(mounted_dev, lun, buff, sector, (uint16_t) count, disk_io_complete, 0);
-    wait_for_disk_io();
+    volatile int result = -1;
+
+    // FatFS needs the data now: queue behind any reads in flight and wait. This blocks core 1 for
+    // the whole transfer. Only the data cache's lines and CD audio batches (cdrom_cache.c) are
+    // read without waiting; directory and FAT reads, image loading, and sectors that can't be read
+    // straight off the drive (.cdz images, images in too many fragments to map, sectors other
+    // than Mode 1/Mode 2 Form 1 data, reads that failed) all still come through here.
+    while (!msc_read_async(buff, sector, (uint16_t) count, disk_read_complete, (uintptr_t) &result)) {
+        if (!mounted_dev) {
+            return RES_NOTRDY;
+        }
+        tuh_task();
+    }
+    while (result < 0) {
+        // Unmounting finishes every queued read, this one included, so result is no longer
+        // written to once the drive is gone
+        if (!mounted_dev) {
+            return RES_NOTRDY;
+        }
+        // Retries the read if the drive refused it while busy
+        msc_app_task();
+        tuh_task();
+    }
 
-    return RES_OK;
+    return (DRESULT) result;
 }
 
 #if FF_FS_READONLY == 0
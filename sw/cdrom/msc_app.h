@@ -27,9 +27,35 @@
 #define MSC_APP_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+// Reads that can be queued, counting the one on the bus
+#define MSC_READ_QUEUE_SIZE 4
+// Latency histogram: bucket 0 counts reads under 128us, bucket n reads from
+// 64 << n us, and the last bucket everything longer
+#define MSC_LATENCY_BUCKETS 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called from tuh_task() when a read ends; ok is false if it failed or the
+// drive was removed
+typedef void (*msc_read_cb_t)(bool ok, uintptr_t arg);
 
 bool msc_app_init(void);
 void msc_app_task(void);
 
+// Queues a read of count drive sectors into buff and returns at once. Fails
+// if there is no drive or the queue is full.
+bool msc_read_async(uint8_t *buff, uint32_t lba, uint16_t count, msc_read_cb_t cb, uintptr_t arg);
+
+void msc_latency_get(uint32_t counts[MSC_LATENCY_BUCKETS]);
+void msc_latency_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 
 #endif
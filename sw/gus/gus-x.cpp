@@ -28,6 +28,7 @@
 #include "hardware/gpio.h"
 #ifdef PSRAM
 #include "psram_spi.h"
+#include "hardware/sync.h"
 extern psram_spi_inst_t psram_spi;
 #endif
 
@@ -39,11 +40,13 @@ extern psram_spi_inst_t psram_spi;
 critical_section_t gus_crit;
 
 #include "system/pico_pic.h"
+#include "system/trace.h"
 #include "isa/isa_dma.h"
 extern dma_inst_t dma_config;
 
 #include "audio/clamp.h"
 #include "audio/volctrl.h"
+#include "gus_interp_taps.h"
 
 using namespace std;
 
@@ -82,6 +85,12 @@ using namespace std;
 
 #ifdef PSRAM
 #define GUS_RAM_SIZE            (1024u*1024u)
+// Per-voice sample cache: a ring of 16-byte lines, direct-mapped by PSRAM address
+#define GUS_CACHE_LINE_BITS     4
+#define GUS_CACHE_LINE          (1u << GUS_CACHE_LINE_BITS)
+#define GUS_CACHE_LINES         16u
+#define GUS_CACHE_MASK          (GUS_CACHE_LINE * GUS_CACHE_LINES - 1)
+#define GUS_LINE_MASK           ((GUS_RAM_SIZE >> GUS_CACHE_LINE_BITS) - 1)
 #else
 #define GUS_RAM_SIZE            (1024u*128u)
 #endif
@@ -143,12 +152,87 @@ static bool dma_enable_on_dma_control_polling = false;
 static uint16_t vol16bit[4096];
 static uint32_t pantable[16];
 
+// Largest audio buffer pgusinit can set, in frames
+#define GUS_MAX_BUFFER 256
 static uint32_t buffer_size = 4;
+// Bounds set by pgusinit for buffer_size, which moves between them with the render headroom
+static uint32_t buffer_min = 4;
+static uint32_t buffer_max = 4;
+static uint32_t buffer_peak = 4;
+// Grow the buffer when the play loop is busy for more than this fraction (/256) of the time a
+// buffer lasts, and shrink it once it has stayed below the lower one for GUS_BUFFER_SHRINK_HOLD_US
+#define GUS_BUFFER_GROW_LOAD 192
+#define GUS_BUFFER_SHRINK_LOAD 96
+#define GUS_BUFFER_SHRINK_HOLD_US 500000
+static int32_t buffer_load = 0;
+static uint32_t buffer_quiet_us = 0;
+// Bounds as last set on core0. The renderer on core1 takes them up before its next block, as it
+// owns buffer_size and the adaptation state; buffer_bounds_seq counts the changes.
+static volatile uint16_t buffer_min_set = 4;
+static volatile uint16_t buffer_max_set = 4;
+static volatile uint32_t buffer_bounds_seq = 0;
 static uint32_t dma_interval = 0;
 
 class GUSChannels;
 static void CheckVoiceIrq(void);
 
+// Voice interpolation modes, as set by CMD_GUSINTERP
+#define GUS_INTERP_LINEAR 0
+#define GUS_INTERP_CUBIC  1
+#define GUS_INTERP_SINC   2
+// Rendering may take up to this fraction (/256) of a block's real time before falling back to linear
+#define GUS_INTERP_MAX_LOAD 205
+static uint8_t gus_interp_mode = GUS_INTERP_LINEAR;
+// Highest voice count the 4-point modes have kept up with
+static uint8_t gus_interp_max_voices = 32;
+static int32_t gus_interp_load = 0;
+// 4-point taps for the block being rendered, or NULL for linear interpolation
+static const int16_t (*gus_interp_taps)[4] = NULL;
+
+#ifdef PSRAM
+// Cache lines wanted by all voices for the next block, read back to back before rendering it
+struct gus_prefetch_t {
+    uint32_t addr;
+    uint8_t* dst;
+    uint32_t len;
+};
+#define GUS_PREFETCH_MAX 128
+// Bytes a voice reads past its current block when it needs a new line anyway
+#define GUS_PREFETCH_AHEAD (GUS_CACHE_LINE * 4)
+static gus_prefetch_t gus_prefetch[GUS_PREFETCH_MAX];
+static uint32_t gus_prefetch_count = 0;
+
+// Lines of GUS RAM written that the renderer on core1 hasn't dropped from the voice caches yet.
+// One log per core, each with a single producer: pokes on core0, DMA on core1 (its DMA and timer
+// IRQs share a priority, so they never preempt each other). The renderer drains both.
+#define GUS_WRITE_LOG_SIZE 64
+typedef struct {
+    uint32_t lines[GUS_WRITE_LOG_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile bool overflow;
+} gus_write_log_t;
+static gus_write_log_t gus_write_log[2];
+
+static __force_inline void GUS_LogRamWrite(const uint32_t addr) {
+    gus_write_log_t* const log = &gus_write_log[get_core_num()];
+    const uint32_t line = (addr >> GUS_CACHE_LINE_BITS) & GUS_LINE_MASK;
+    const uint8_t head = log->head;
+    const uint8_t pending = head - log->tail;
+    if (pending && log->lines[(uint8_t)(head - 1) & (GUS_WRITE_LOG_SIZE - 1)] == line) {
+        // Sequential writes: this line is still waiting to be dropped
+        return;
+    }
+    if (pending == GUS_WRITE_LOG_SIZE) {
+        log->overflow = true;
+        return;
+    }
+    log->lines[head & (GUS_WRITE_LOG_SIZE - 1)] = line;
+    __dmb();
+    log->head = head + 1;
+}
+#endif
+
 struct GFGus {
     uint8_t gRegSelectData;     // what is read back from 3X3. not necessarily the index selected, but
     // apparently the last byte read OR written to ports 3X3-3X5 as seen
@@ -251,13 +335,14 @@ class GUSChannels {
         int32_t VolLeft;
         int32_t VolRight;
 
+#ifdef PSRAM
         struct sample_cache_t {
-            uint8_t data[32];
-            // Signed so it can hold -1 for invalid address
-            int32_t addr;
-            int32_t addr_next;
+            uint8_t data[GUS_CACHE_LINE * GUS_CACHE_LINES] __attribute__((aligned(4)));
+            // Line address (PSRAM address >> 4) held in each slot. Signed so it can hold -1 for none
+            int32_t tag[GUS_CACHE_LINES];
         };
         mutable sample_cache_t sample_cache;
+#endif
 
         GUSChannels(uint8_t num) { 
             channum = num;
@@ -279,11 +364,15 @@ class GUSChannels {
             PanLeft = 0;
             PanRight = 0;
             PanPot = 0x7;
-            sample_cache = {{0}, -1, -1};
+            ClearCache();
         }
 
         void ClearCache(void) {
-            sample_cache.addr = sample_cache.addr_next = -1;
+#ifdef PSRAM
+            for (uint32_t i = 0; i < GUS_CACHE_LINES; ++i) {
+                sample_cache.tag[i] = -1;
+            }
+#endif
         }
 
         INLINE int32_t LoadSample8(const uint32_t addr/*memory address without fractional bits*/) const {
@@ -309,49 +398,202 @@ class GUSChannels {
             int16_t data16[2];
         };
 
-        INLINE size_t prime_cache(const uint32_t addr, const uint8_t threshold) const {
-            uint32_t addr_hi = addr & 0xffff0u;
-            uint8_t addr_part = addr & 0xfu;
-            if (sample_cache.addr != addr_hi) {
-                if (sample_cache.addr_next != -1 && sample_cache.addr_next == addr_hi) {
-                    // We could avoid this memcpy by wrapping around the cache address... but I am tired
-                    memcpy(sample_cache.data, sample_cache.data + 16, 16);
+        // Makes sure a line is in the cache, reading it from PSRAM if it wasn't prefetched
+        INLINE void fetch_line(const uint32_t line) const {
+            const uint32_t slot = line & (GUS_CACHE_LINES - 1);
+            if (sample_cache.tag[slot] != (int32_t)line) {
+                psram_read(&psram_spi, line << GUS_CACHE_LINE_BITS, sample_cache.data + (slot << GUS_CACHE_LINE_BITS), GUS_CACHE_LINE);
+                sample_cache.tag[slot] = line;
+            }
+        }
+
+        void InvalidateLine(const uint32_t line) {
+            const uint32_t slot = line & (GUS_CACHE_LINES - 1);
+            if (sample_cache.tag[slot] == (int32_t)line) {
+                sample_cache.tag[slot] = -1;
+            }
+        }
+
+        INLINE uint32_t SampleByteAddr(const uint32_t addr/*memory address without fractional bits*/) const {
+            return (WaveCtrl & WCTRL_16BIT) ? ((addr & 0xC0000u) | ((addr & 0x1FFFFu) << 1u)) : (addr & 0xFFFFFu);
+        }
+
+        // Queues reads if any line holding samples first..last (plus the following sample, for
+        // interpolation) isn't cached. The read is widened to samples lo..hi, so one transaction
+        // also covers the next few blocks. Spans larger than the cache are cut short.
+        void QueueSamples(const uint32_t first, const uint32_t last, const uint32_t lo, const uint32_t hi) const {
+            // Bytes needed before the first sample and after the last one by the interpolator
+            const uint32_t head = gus_interp_taps ? ((WaveCtrl & WCTRL_16BIT) ? 2u : 1u) : 0u;
+            const uint32_t tail = gus_interp_taps ? ((WaveCtrl & WCTRL_16BIT) ? 5u : 2u) : ((WaveCtrl & WCTRL_16BIT) ? 3u : 1u);
+            const uint32_t n0 = SampleByteAddr(first) - head;
+            uint32_t n1 = SampleByteAddr(last) + tail;
+            if (n1 < n0 || n1 - n0 > GUS_CACHE_MASK) {
+                n1 = n0 + GUS_CACHE_MASK;
+            }
+            uint32_t l;
+            for (l = n0 >> GUS_CACHE_LINE_BITS; l <= (n1 >> GUS_CACHE_LINE_BITS); ++l) {
+                const uint32_t line = l & GUS_LINE_MASK;
+                if (sample_cache.tag[line & (GUS_CACHE_LINES - 1)] != (int32_t)line) {
+                    break;
+                }
+            }
+            if (l > (n1 >> GUS_CACHE_LINE_BITS)) {
+                return;
+            }
+
+            uint32_t e0 = SampleByteAddr(lo) - head;
+            uint32_t e1 = SampleByteAddr(hi) + tail;
+            if (e0 > n0 || e1 < n1 || e1 - e0 > GUS_CACHE_MASK) {
+                e0 = n0;
+                e1 = n1;
+            }
+            // Keep the lines that are needed now if the widened span doesn't fit the ring
+            const uint32_t first_line = MAX(e0 >> GUS_CACHE_LINE_BITS, (n1 >> GUS_CACHE_LINE_BITS) - (GUS_CACHE_LINES - 1));
+            const uint32_t last_line = MIN(e1 >> GUS_CACHE_LINE_BITS, first_line + (GUS_CACHE_LINES - 1));
+            for (l = first_line; l <= last_line; ++l) {
+                const uint32_t line = l & GUS_LINE_MASK;
+                const uint32_t slot = line & (GUS_CACHE_LINES - 1);
+                if (sample_cache.tag[slot] == (int32_t)line) {
+                    continue;
+                }
+                uint8_t* const dst = sample_cache.data + (slot << GUS_CACHE_LINE_BITS);
+                const uint32_t addr = line << GUS_CACHE_LINE_BITS;
+                gus_prefetch_t* const prev = gus_prefetch_count ? &gus_prefetch[gus_prefetch_count - 1] : NULL;
+                if (prev && prev->dst + prev->len == dst && prev->addr + prev->len == addr) {
+                    // Next line in both PSRAM and the ring: grow the previous read
+                    prev->len += GUS_CACHE_LINE;
+                } else if (gus_prefetch_count < GUS_PREFETCH_MAX) {
+                    gus_prefetch[gus_prefetch_count++] = { addr, dst, GUS_CACHE_LINE };
                 } else {
-                    psram_read(&psram_spi, addr_hi, sample_cache.data, 16);
+                    // Batch is full, leave it to be fetched on demand
+                    continue;
                 }
-                sample_cache.addr = addr_hi;
+                sample_cache.tag[slot] = line;
             }
-            // If we're about to read past the end of our cache, populate the other bank
-            uint32_t addr_next = ((addr_hi + 16) & 0xffff0u);
-            if (addr_part == threshold && sample_cache.addr_next != addr_next) {
-                psram_read(&psram_spi, addr_next, (sample_cache.data + 16), 16);
-                sample_cache.addr_next = addr_next;
+        }
+
+        // Predicts the samples the voice will touch over the next frames, following loop and
+        // bidirectional turnarounds, and queues the lines it doesn't have yet
+        void Prefetch(const uint32_t frames) const {
+            const uint32_t pos = WaveAddr >> WAVE_FRACT;
+            if (WaveCtrl & (WCTRL_STOP | WCTRL_STOPPED)) {
+                QueueSamples(pos, pos, pos, pos);
+                return;
+            }
+            const uint32_t start = WaveStart >> WAVE_FRACT;
+            const uint32_t end = WaveEnd >> WAVE_FRACT;
+            const uint32_t dist = ((WaveAddr & WAVE_FRACT_MASK) + frames * WaveAdd) >> WAVE_FRACT;
+            const uint32_t ahead = GUS_PREFETCH_AHEAD >> ((WaveCtrl & WCTRL_16BIT) ? 1 : 0);
+            const uint32_t loop_len = end - start;
+            if (!(WaveCtrl & WCTRL_DECREASING)) {
+                if (pos > end) {
+                    QueueSamples(pos, pos, pos, pos);
+                } else if (end - pos >= dist) {
+                    const uint32_t last = pos + dist;
+                    QueueSamples(pos, last, pos, end - last > ahead ? last + ahead : end);
+                } else if (!(WaveCtrl & WCTRL_LOOP)) {
+                    QueueSamples(pos, end, pos, end);
+                } else {
+                    const uint32_t over = dist - (end - pos);
+                    if (WaveCtrl & WCTRL_BIDIRECTIONAL) {
+                        const uint32_t first = loop_len > over ? MIN(pos, end - over) : start;
+                        QueueSamples(first, end, first, end);
+                    } else {
+                        const uint32_t last = loop_len > over ? start + over : end;
+                        QueueSamples(pos, end, pos, end);
+                        QueueSamples(start, last, start, end - last > ahead ? last + ahead : end);
+                    }
+                }
+            } else {
+                if (pos < start) {
+                    QueueSamples(pos, pos, pos, pos);
+                } else if (pos - start >= dist) {
+                    const uint32_t first = pos - dist;
+                    QueueSamples(first, pos, first - start > ahead ? first - ahead : start, pos);
+                } else if (!(WaveCtrl & WCTRL_LOOP)) {
+                    QueueSamples(start, pos, start, pos);
+                } else {
+                    const uint32_t over = dist - (pos - start);
+                    if (WaveCtrl & WCTRL_BIDIRECTIONAL) {
+                        const uint32_t last = loop_len > over ? MAX(pos, start + over) : end;
+                        QueueSamples(start, last, start, last);
+                    } else {
+                        const uint32_t first = loop_len > over ? end - over : start;
+                        QueueSamples(start, pos, start, pos);
+                        QueueSamples(first, end, first - start > ahead ? first - ahead : start, end);
+                    }
+                }
             }
-            return addr_part;
         }
 
         INLINE int16_t_pair LoadSamples8(const uint32_t addr/*memory address without fractional bits*/) const {
-            const size_t addr_part = prime_cache(addr, 0xfu);
+            const uint32_t a0 = addr & 0xFFFFFu/*1MB*/;
+            const uint32_t a1 = (addr + 1u) & 0xFFFFFu;
+            fetch_line(a0 >> GUS_CACHE_LINE_BITS);
+            if (!(a1 & (GUS_CACHE_LINE - 1))) {
+                fetch_line(a1 >> GUS_CACHE_LINE_BITS);
+            }
             return (union int16_t_pair){ .data16 = {
-                (int16_t)((uint16_t)sample_cache.data[addr_part] << 8),
-                (int16_t)((uint16_t)sample_cache.data[addr_part + 1] << 8)
+                (int16_t)((uint16_t)sample_cache.data[a0 & GUS_CACHE_MASK] << 8),
+                (int16_t)((uint16_t)sample_cache.data[a1 & GUS_CACHE_MASK] << 8)
             }};
         }
 
+        // Loads samples addr-1..addr+2 for 4-point interpolation
+        INLINE void LoadWindow8(const uint32_t addr/*memory address without fractional bits*/, int32_t* w) const {
+            const uint32_t a = addr - 1u;
+            fetch_line((a & 0xFFFFFu/*1MB*/) >> GUS_CACHE_LINE_BITS);
+            fetch_line(((a + 3u) & 0xFFFFFu) >> GUS_CACHE_LINE_BITS);
+            for (uint32_t i = 0; i < 4; ++i) {
+                w[i] = (int8_t)sample_cache.data[(a + i) & GUS_CACHE_MASK] << int32_t(8);
+            }
+        }
+
+        INLINE void LoadWindow16(const uint32_t addr/*memory address without fractional bits*/, int32_t* w) const {
+            const uint32_t a = ((addr & 0xC0000u/*256KB bank*/) | ((addr & 0x1FFFFu) << 1u)) - 2u;
+            fetch_line((a & 0xFFFFFu) >> GUS_CACHE_LINE_BITS);
+            fetch_line(((a + 6u) & 0xFFFFFu) >> GUS_CACHE_LINE_BITS);
+            for (uint32_t i = 0; i < 4; ++i) {
+                w[i] = *(int16_t*)(sample_cache.data + ((a + (i << 1)) & GUS_CACHE_MASK));
+            }
+        }
+
         INLINE int16_t_pair LoadSamples16(const uint32_t addr/*memory address without fractional bits*/) const {
-            const uint32_t adjaddr = (addr & 0xC0000u/*256KB bank*/) | ((addr & 0x1FFFFu) << 1u/*16-bit sample value within bank*/);
-            const size_t addr_part = prime_cache(adjaddr, 0xeu);
+            const uint32_t a0 = (addr & 0xC0000u/*256KB bank*/) | ((addr & 0x1FFFFu) << 1u/*16-bit sample value within bank*/);
+            const uint32_t a1 = (a0 + 2u) & 0xFFFFFu;
+            fetch_line(a0 >> GUS_CACHE_LINE_BITS);
+            if (!(a1 & (GUS_CACHE_LINE - 1))) {
+                fetch_line(a1 >> GUS_CACHE_LINE_BITS);
+            }
             return (union int16_t_pair){ .data16 = {
-                (int16_t)*(uint16_t*)(sample_cache.data + addr_part),
-                (int16_t)*(uint16_t*)(sample_cache.data + addr_part + 2)
+                (int16_t)*(uint16_t*)(sample_cache.data + (a0 & GUS_CACHE_MASK)),
+                (int16_t)*(uint16_t*)(sample_cache.data + (a1 & GUS_CACHE_MASK))
             }};
         }
 #endif // PSRAM
 
+        // Applies the current 4-point taps to samples n-1..n+2 at the voice's position
+        INLINE int32_t Interpolate4(const int32_t* w) const {
+            const int16_t* const taps = gus_interp_taps[(WaveAddr & WAVE_FRACT_MASK) >> (WAVE_FRACT - GUS_INTERP_PHASE_BITS)];
+            return (taps[0] * w[0] + taps[1] * w[1] + taps[2] * w[2] + taps[3] * w[3]) >> GUS_INTERP_TAP_BITS;
+        }
+
         // Returns a single 16-bit sample from the Gravis's RAM
+        template <bool hq = false>
         INLINE int32_t GetSample8() const {
             /* LoadSample*() will take care of wrapping to 1MB */
             const uint32_t useAddr = WaveAddr >> WAVE_FRACT;
+            if (hq) {
+                int32_t w[4];
+#ifdef PSRAM
+                LoadWindow8(useAddr, w);
+#else
+                for (uint32_t i = 0; i < 4; ++i) {
+                    w[i] = LoadSample8(useAddr - 1u + i);
+                }
+#endif
+                return Interpolate4(w);
+            }
             {
                 // Interpolate
 #ifdef PSRAM
@@ -375,9 +617,21 @@ class GUSChannels {
             }
         }
 
+        template <bool hq = false>
         INLINE int32_t GetSample16() const {
             /* Load Sample*() will take care of wrapping to 1MB and funky bank/sample conversion */
             const uint32_t useAddr = WaveAddr >> WAVE_FRACT;
+            if (hq) {
+                int32_t w[4];
+#ifdef PSRAM
+                LoadWindow16(useAddr, w);
+#else
+                for (uint32_t i = 0; i < 4; ++i) {
+                    w[i] = LoadSample16(useAddr - 1u + i);
+                }
+#endif
+                return Interpolate4(w);
+            }
             {
                 // Interpolate
 #ifdef PSRAM
@@ -414,13 +668,20 @@ class GUSChannels {
             }
         }
         __force_inline void WriteWaveCtrl(uint8_t val) {
-            uint32_t oldirq=myGUS.WaveIRQ;
             WaveCtrl = val & 0x7f;
+            WriteWaveIrq(val);
+        }
+        __force_inline void WriteWaveIrq(uint8_t val) {
+            // Core0 clears these bits as their IRQs are read, so they only change in gus_crit
+            critical_section_enter_blocking(&gus_crit);
+            uint32_t oldirq=myGUS.WaveIRQ;
 
             if ((val & 0xa0)==0xa0) myGUS.WaveIRQ|=irqmask;
             else myGUS.WaveIRQ&=~irqmask;
+            const bool changed = oldirq != myGUS.WaveIRQ;
+            critical_section_exit(&gus_crit);
 
-            if (oldirq != myGUS.WaveIRQ) 
+            if (changed)
                 CheckVoiceIrq();
         }
         INLINE uint8_t ReadWaveCtrl(void) {
@@ -442,14 +703,20 @@ class GUSChannels {
             return PanPot;
         }
         __force_inline void WriteRampCtrl(uint8_t val) {
-            uint32_t old=myGUS.RampIRQ;
             RampCtrl = val & 0x7f;
+            WriteRampIrq(val);
+        }
+        __force_inline void WriteRampIrq(uint8_t val) {
+            critical_section_enter_blocking(&gus_crit);
+            uint32_t old=myGUS.RampIRQ;
             //Manually set the irq
             if ((val & 0xa0) == 0xa0)
                 myGUS.RampIRQ |= irqmask;
             else
                 myGUS.RampIRQ &= ~irqmask;
-            if (old != myGUS.RampIRQ)
+            const bool changed = old != myGUS.RampIRQ;
+            critical_section_exit(&gus_crit);
+            if (changed)
                 CheckVoiceIrq();
         }
         INLINE uint8_t ReadRampCtrl(void) {
@@ -596,6 +863,95 @@ class GUSChannels {
             UpdateVolumes();
         }
 
+        // Applies a write to voice register reg (0x0-0xD) that was queued by the port handler.
+        // The IRQ bits of the control registers are set or cleared here too, in gus_crit.
+        void WriteRegister(const uint8_t reg, const uint16_t data) {
+            switch (reg) {
+            case 0x0:  // Channel voice control register
+                WriteWaveCtrl((uint16_t)data >> 8);
+                break;
+            case 0x1:  // Channel frequency control register
+                WriteWaveFreq(data);
+                break;
+            case 0x2:  // Channel MSW start address register
+                {
+                    // 10 bit fractional wave address
+                    uint32_t tmpaddr = (uint32_t)(data & 0x1fff) << 17; /* upper 13 bits of integer portion */
+                    WaveStart = (WaveStart & WAVE_MSWMASK) | tmpaddr;
+                }
+                break;
+            case 0x3:  // Channel LSW start address register
+                {
+                    // 10 bit fractional wave address
+                    uint32_t tmpaddr = (uint32_t)(data & 0xffe0) << 1; /* lower 7 bits of integer portion, and all 4 bits of fractional portion. bits 4-0 of the incoming 16-bit WORD are not used */
+                    WaveStart = (WaveStart & WAVE_LSWMASK) | tmpaddr;
+                }
+                break;
+            case 0x4:  // Channel MSW end address register
+                {
+                    // 10 bit fractional wave address
+                    uint32_t tmpaddr = (uint32_t)(data & 0x1fff) << 17; /* upper 13 bits of integer portion */
+                    WaveEnd = (WaveEnd & WAVE_MSWMASK) | tmpaddr;
+                }
+                break;
+            case 0x5:  // Channel MSW end address register
+                {
+                    // 10 bit fractional wave address
+                    uint32_t tmpaddr = (uint32_t)(data & 0xffe0) << 1; /* lower 7 bits of integer portion, and all 4 bits of fractional portion. bits 4-0 of the incoming 16-bit WORD are not used */
+                    WaveEnd = (WaveEnd & WAVE_LSWMASK) | tmpaddr;
+                }
+                break;
+            case 0x6:  // Channel volume ramp rate register
+                {
+                    uint8_t tmpdata = (uint16_t)data>>8;
+                    WriteRampRate(tmpdata);
+                }
+                break;
+            case 0x7:  // Channel volume ramp start register  EEEEMMMM
+                {
+                    uint8_t tmpdata = (uint16_t)data >> 8;
+                    RampStart = (uint32_t)(tmpdata << (4+RAMP_FRACT));
+                }
+                break;
+            case 0x8:  // Channel volume ramp end register  EEEEMMMM
+                {
+                    uint8_t tmpdata = (uint16_t)data >> 8;
+                    RampEnd = (uint32_t)(tmpdata << (4+RAMP_FRACT));
+                }
+                break;
+            case 0x9:  // Channel current volume register
+                {
+                    uint16_t tmpdata = (uint16_t)data >> 4;
+                    RampVol = (uint32_t)(tmpdata << RAMP_FRACT);
+                    UpdateVolumes();
+                }
+                break;
+            case 0xA:  // Channel MSW current address register
+                {
+                    // 10 bit fractional wave address
+                    uint32_t tmpaddr = (uint32_t)(data & 0x1fff) << 17; /* upper 13 bits of integer portion */
+                    WaveAddr = (WaveAddr & WAVE_MSWMASK) | tmpaddr;
+                }
+                break;
+            case 0xB:  // Channel LSW current address register
+                {
+                    // 10 bit fractional wave address
+                    uint32_t tmpaddr = (uint32_t)(data & 0xffff) << 1; /* lower 7 bits of integer portion, and all 9 bits of fractional portion */
+                    WaveAddr = (WaveAddr & WAVE_LSWMASK) | tmpaddr;
+                }
+                break;
+            case 0xC:  // Channel pan pot register
+                WritePanPot((uint16_t)data>>8);
+                break;
+            case 0xD:  // Channel volume control register
+                WriteRampCtrl((uint16_t)data >> 8);
+                break;
+            }
+        }
+
+        // Renders the voice for a single frame, handling any end conditions. Master volume
+        // is applied to the mixed bus by GUS_CallBack, not per voice.
+        template <bool hq>
         __force_inline void generateSample(int32_t* stream) {
             int32_t tmpsamp;
 
@@ -610,55 +966,315 @@ class GUSChannels {
             // normal output
             // Get sample
             if (WaveCtrl & WCTRL_16BIT)
-                tmpsamp = GetSample16();
+                tmpsamp = GetSample16<hq>();
             else
-                tmpsamp = GetSample8();
+                tmpsamp = GetSample8<hq>();
 
             // Output stereo sample if DAC enable on
             // if ((GUS_reset_reg & 0x02/*DAC enable*/) == 0x02) {
-                tmpsamp = scale_sample(tmpsamp, gus_volume, 0);
                 stream[0] += tmpsamp * VolLeft;
                 stream[1] += tmpsamp * VolRight;
                 WaveUpdate();
                 RampUpdate();
             // }
         }
-#if 0
-        __force_inline void generateSamples(int32_t* stream, uint32_t len) {
-            int32_t tmpsamp;
-            int i;
 
-            /* NTS: The GUS is *always* rendering the audio sample at the current position,
-             *      even if the voice is stopped. This can be confirmed using DOSLIB, loading
-             *      the Ultrasound test program, loading a WAV file into memory, then using
-             *      the Ultrasound test program's voice control dialog to single-step the
-             *      voice through RAM (abruptly change the current position) while the voice
-             *      is stopped. You will hear "popping" noises come out the GUS audio output
-             *      as the current position changes and the piece of the sample rendered
-             *      abruptly changes as well. */
-            // normal output
-            for (i = 0; i < (int)len; i++) {
-                // Get sample
-                if (WaveCtrl & WCTRL_16BIT)
-                    tmpsamp = GetSample16();
-                else
-                    tmpsamp = GetSample8();
-
-                // Output stereo sample if DAC enable on
-                if ((GUS_reset_reg & 0x02/*DAC enable*/) == 0x02) {
-                    stream[i << 1] += tmpsamp * VolLeft;
-                    stream[(i << 1) + 1] += tmpsamp * VolRight;
-                    WaveUpdate();
-                    RampUpdate();
+        // Number of frames, up to max, whose WaveUpdate() will not hit the start/end
+        // address (or wrap around GUS RAM). 0 means the next frame needs WaveUpdate().
+        INLINE uint32_t WaveRunLength(uint32_t max) const {
+            if (WaveCtrl & (WCTRL_STOP | WCTRL_STOPPED)) {
+                // Position doesn't move, but a stopped voice with IRQ enabled may rapid-fire IRQs
+                return (WaveCtrl & WCTRL_IRQENABLED) ? 0 : max;
+            }
+            uint32_t steps;
+            if (WaveCtrl & WCTRL_DECREASING) {
+                if (WaveAddr < WaveStart) return 0;
+                if (!WaveAdd) return max;
+                // WaveAddr - steps * WaveAdd >= WaveStart, so this can't wrap below 0 either
+                steps = (WaveAddr - WaveStart) / WaveAdd;
+            } else {
+                if (WaveAddr > WaveEnd) return 0;
+                if (!WaveAdd) return max;
+                steps = (WaveEnd - WaveAddr) / WaveAdd;
+            }
+            return steps < max ? steps : max;
+        }
+
+        // Number of frames, up to max, whose RampUpdate() will not reach the ramp end
+        INLINE uint32_t RampRunLength(uint32_t max) const {
+            if (RampCtrl & 0x3) return max;
+            uint32_t steps;
+            if (RampCtrl & 0x40) {
+                if (RampVol <= RampStart) return 0;
+                if (!RampAdd) return max;
+                steps = (RampVol - RampStart - 1) / RampAdd;
+            } else {
+                if (RampVol >= RampEnd) return 0;
+                if (!RampAdd) return max;
+                steps = (RampEnd - RampVol - 1) / RampAdd;
+            }
+            return steps < max ? steps : max;
+        }
+
+        // Renders n frames that are known to be free of wave and ramp end conditions, so
+        // address and volume just step linearly with no checks.
+        template <bool is16, bool ramping, bool hq>
+        INLINE void renderRun(int32_t* stream, uint32_t n) {
+            const int32_t step = (WaveCtrl & (WCTRL_STOP | WCTRL_STOPPED)) ? 0
+                : (WaveCtrl & WCTRL_DECREASING) ? -(int32_t)WaveAdd : (int32_t)WaveAdd;
+            if (!ramping && !VolLeft && !VolRight) {
+                // Silent voice: only the position needs to move
+                WaveAddr += step * (int32_t)n;
+                return;
+            }
+            const int32_t rstep = (RampCtrl & 0x40) ? -(int32_t)RampAdd : (int32_t)RampAdd;
+            int32_t* const end = stream + (n << 1);
+            while (stream != end) {
+                const int32_t tmpsamp = is16 ? GetSample16<hq>() : GetSample8<hq>();
+                stream[0] += tmpsamp * VolLeft;
+                stream[1] += tmpsamp * VolRight;
+                stream += 2;
+                WaveAddr += step;
+                if (ramping) {
+                    RampVol += rstep;
+                    UpdateVolumes();
                 }
             }
         }
-#endif
+
+        // Renders len frames of the voice into stream. Frames are rendered in runs up to
+        // the next loop point or ramp end; only the frame that hits one of those goes
+        // through the per-frame WaveUpdate()/RampUpdate() path. hq selects the 4-point
+        // interpolation taps in gus_interp_taps over linear interpolation.
+        template <bool hq>
+        void generateSamples(int32_t* stream, uint32_t len) {
+            while (len) {
+                const bool ramping = !(RampCtrl & 0x3);
+                const uint32_t n = RampRunLength(WaveRunLength(len));
+                if (!n) {
+                    generateSample<hq>(stream);
+                    stream += 2;
+                    --len;
+                    continue;
+                }
+                if (WaveCtrl & WCTRL_16BIT) {
+                    if (ramping) renderRun<true, true, hq>(stream, n);
+                    else renderRun<true, false, hq>(stream, n);
+                } else {
+                    if (ramping) renderRun<false, true, hq>(stream, n);
+                    else renderRun<false, false, hq>(stream, n);
+                }
+                stream += n << 1;
+                len -= n;
+            }
+        }
 };
 
 static GUSChannels *guschan[32] = {NULL};
+
+#ifdef PSRAM
+// Drops cache lines that were written since the last block, then reads in every line the active
+// voices are predicted to need for the next frames. Anything mispredicted is fetched on demand.
+// The reads are blocking, done before mixing rather than overlapped with it, as rp2040-psram only
+// reads synchronously. What they save is per-transaction overhead: gus_bench shows about a quarter
+// of the SPI transactions per frame of fetching on demand (0.65 against 2.53 at 14 voices, 1.56
+// against 5.99 at 32) for the same bytes.
+static void GUS_PrefetchSamples(const uint8_t active_channels, const uint32_t frames) {
+    for (uint32_t core = 0; core < 2; ++core) {
+        gus_write_log_t* const log = &gus_write_log[core];
+        const uint8_t head = log->head;
+        __dmb();
+        if (log->overflow) {
+            log->overflow = false;
+            for (uint32_t c = 0; c < 32; ++c) {
+                guschan[c]->ClearCache();
+            }
+            log->tail = head;
+        } else {
+            for (uint8_t tail = log->tail; tail != head; ) {
+                const uint32_t line = log->lines[tail & (GUS_WRITE_LOG_SIZE - 1)];
+                for (uint32_t c = 0; c < 32; ++c) {
+                    guschan[c]->InvalidateLine(line);
+                }
+                log->tail = ++tail;
+            }
+        }
+    }
+
+    gus_prefetch_count = 0;
+    for (uint32_t c = 0; c < active_channels; ++c) {
+        guschan[c]->Prefetch(frames);
+    }
+    for (uint32_t i = 0; i < gus_prefetch_count; ++i) {
+        psram_read(&psram_spi, gus_prefetch[i].addr, gus_prefetch[i].dst, gus_prefetch[i].len);
+    }
+}
+#endif
 static GUSChannels *curchan = NULL;
 
+// Voice register writes (0x0-0xD) and GUS resets are queued by the port handler on core0 and
+// applied by the renderer on core1, at the frame of the block matching when they arrived. Single
+// producer, single consumer: only core0 moves head and only core1 moves tail.
+struct gus_voice_write_t {
+    uint32_t time_us;
+    uint8_t voice;
+    uint8_t reg;
+    uint16_t data;
+};
+#define GUS_WRITE_QUEUE_SIZE 1024
+// reg of a queued GUS reset, which stops every voice
+#define GUS_WRITE_RESET 0xff
+// Set by core0 when the active channel count changes, for the renderer to rescale every voice's
+// wave and ramp rates to the new output rate
+static volatile bool gus_voice_rates_stale = false;
+static gus_voice_write_t gus_write_queue[GUS_WRITE_QUEUE_SIZE];
+static volatile uint32_t gus_write_queue_head = 0;
+static volatile uint32_t gus_write_queue_tail = 0;
+// Writes queued before the last GUS reset are dropped instead of applied. Resets themselves are
+// always applied.
+static volatile uint32_t gus_write_queue_fence = 0;
+// Last value written to each voice register and where it was queued, so register reads see writes
+// the renderer hasn't applied yet
+static uint16_t gus_voice_shadow[32][14];
+static uint32_t gus_voice_shadow_pos[32][14];
+// Registers, a bit each, written while the queue was full. The port handler doesn't wait for the
+// renderer: the renderer applies their last value from the shadow once it has applied everything
+// queued before the latest of them. Both sides change these in gus_crit.
+static uint16_t gus_voice_dropped[32];
+static volatile bool gus_voice_dropped_any = false;
+static uint32_t gus_voice_dropped_head = 0;
+// When the renderer last took writes from the queue
+static uint32_t gus_write_queue_time = 0;
+
+static __force_inline void GUS_QueueVoiceWrite(void) {
+    const uint32_t head = gus_write_queue_head;
+    gus_voice_shadow[myGUS.gCurChannel][myGUS.gRegSelect] = myGUS.gRegData;
+    // The last slot is kept for a reset
+    if (head - gus_write_queue_tail >= GUS_WRITE_QUEUE_SIZE - 1) {
+        critical_section_enter_blocking(&gus_crit);
+        gus_voice_dropped[myGUS.gCurChannel] |= 1u << myGUS.gRegSelect;
+        gus_voice_dropped_head = head;
+        gus_voice_dropped_any = true;
+        critical_section_exit(&gus_crit);
+        return;
+    }
+    gus_voice_write_t* const w = &gus_write_queue[head & (GUS_WRITE_QUEUE_SIZE - 1)];
+    w->time_us = time_us_32();
+    w->voice = myGUS.gCurChannel;
+    w->reg = myGUS.gRegSelect;
+    w->data = myGUS.gRegData;
+    gus_voice_shadow_pos[myGUS.gCurChannel][myGUS.gRegSelect] = head;
+    __dmb();
+    gus_write_queue_head = head + 1;
+}
+
+// Queues stopping every voice, and drops the writes still queued from before
+static void GUS_QueueReset(void) {
+    const uint32_t head = gus_write_queue_head;
+    gus_write_queue_fence = head;
+    critical_section_enter_blocking(&gus_crit);
+    memset(gus_voice_dropped, 0, sizeof(gus_voice_dropped));
+    gus_voice_dropped_any = false;
+    critical_section_exit(&gus_crit);
+    // Register reads see the stopped voices until the renderer gets to the reset
+    uint32_t pos = head;
+    if (head - gus_write_queue_tail >= GUS_WRITE_QUEUE_SIZE) {
+        // Full, so the last entry is an earlier reset; it stops the voices just the same
+        pos = head - 1;
+    } else {
+        gus_voice_write_t* const w = &gus_write_queue[head & (GUS_WRITE_QUEUE_SIZE - 1)];
+        w->time_us = time_us_32();
+        w->voice = 0;
+        w->reg = GUS_WRITE_RESET;
+        w->data = 0;
+    }
+    for (uint32_t v = 0; v < 32; ++v) {
+        gus_voice_shadow[v][0x0] = 0x0100;
+        gus_voice_shadow[v][0x9] = 0;
+        gus_voice_shadow[v][0xc] = 0x0700;
+        gus_voice_shadow[v][0xd] = 0x0100;
+        gus_voice_shadow_pos[v][0x0] = pos;
+        gus_voice_shadow_pos[v][0x9] = pos;
+        gus_voice_shadow_pos[v][0xc] = pos;
+        gus_voice_shadow_pos[v][0xd] = pos;
+    }
+    if (pos == head) {
+        __dmb();
+        gus_write_queue_head = head + 1;
+    }
+}
+
+static __force_inline bool GUS_VoiceWritePending(const uint8_t reg) {
+    const uint32_t tail = gus_write_queue_tail;
+    return gus_voice_shadow_pos[myGUS.gCurChannel][reg] - tail < gus_write_queue_head - tail ||
+           (gus_voice_dropped[myGUS.gCurChannel] >> reg) & 1;
+}
+
+// Applies the registers written while the queue was full, once the writes queued before them are in
+static void GUS_ApplyDroppedWrites(const uint32_t tail) {
+    if (!gus_voice_dropped_any) {
+        return;
+    }
+    critical_section_enter_blocking(&gus_crit);
+    if (!gus_voice_dropped_any || (int32_t)(tail - gus_voice_dropped_head) < 0) {
+        critical_section_exit(&gus_crit);
+        return;
+    }
+    uint16_t dropped[32];
+    memcpy(dropped, gus_voice_dropped, sizeof(dropped));
+    memset(gus_voice_dropped, 0, sizeof(gus_voice_dropped));
+    gus_voice_dropped_any = false;
+    critical_section_exit(&gus_crit);
+    // A value newer than the dropped write is queued or dropped too, so it's applied again after
+    for (uint32_t v = 0; v < 32; ++v) {
+        for (uint32_t reg = 0; dropped[v] >> reg; ++reg) {
+            if ((dropped[v] >> reg) & 1) {
+                guschan[v]->WriteRegister(reg, gus_voice_shadow[v][reg]);
+            }
+        }
+    }
+}
+
+// Applies queued writes up to head that land before frame pos of a block of frames that started
+// span_us after start_us. Returns the frame the next write lands on, or frames if none is left.
+static uint32_t GUS_ApplyVoiceWrites(const uint32_t head, const uint32_t start_us, const uint32_t span_us,
+                                     const uint32_t pos, const uint32_t frames) {
+    uint32_t tail = gus_write_queue_tail;
+    const uint32_t fence = gus_write_queue_fence;
+    if (gus_voice_rates_stale) {
+        gus_voice_rates_stale = false;
+        __dmb();
+        for (uint32_t c = 0; c < myGUS.ActiveChannels; ++c) {
+            guschan[c]->UpdateWaveRamp();
+        }
+    }
+    for (; tail != head; ++tail) {
+        const gus_voice_write_t* const w = &gus_write_queue[tail & (GUS_WRITE_QUEUE_SIZE - 1)];
+        if ((int32_t)(tail - fence) >= 0 || w->reg == GUS_WRITE_RESET) {
+            const int32_t offset = (int32_t)(w->time_us - start_us);
+            const uint32_t at = (offset <= 0 || !span_us) ? 0 : MIN((uint32_t)offset, span_us + 1) * frames / span_us;
+            if (at > pos) {
+                gus_write_queue_tail = tail;
+                return MIN(at, frames);
+            }
+            if (w->reg == GUS_WRITE_RESET) {
+                for (uint32_t c = 0; c < 32; ++c) {
+                    guschan[c]->RampVol = 0;
+                    guschan[c]->WriteWaveCtrl(0x1);
+                    guschan[c]->WriteRampCtrl(0x1);
+                    guschan[c]->WritePanPot(0x7);
+                    guschan[c]->ClearCache();
+                }
+            } else {
+                guschan[w->voice]->WriteRegister(w->reg, w->data);
+            }
+        }
+    }
+    gus_write_queue_tail = tail;
+    GUS_ApplyDroppedWrites(tail);
+    return frames;
+}
+
 #if C_DEBUG
 void DEBUG_PrintGUS() { //debugger "GUS" command
         LOG_MSG("GUS regsel=%02x regseld=%02x regdata=%02x DRAMaddr=%06x/%06x memsz=%06x curch=%02x MAXctrl=%02x regctl=%02x",
@@ -790,25 +1406,22 @@ static void GUSReset(void) {
         LOG_MSG("GUS reset with 0x%04X",myGUS.gRegData);
 
     if ((myGUS.gRegData & 0x100) == 0x000) {
-        // Stop all channels
-        int i;
-        for(i=0;i<32;i++) {
-            guschan[i]->RampVol=0;
-            guschan[i]->WriteWaveCtrl(0x1);
-            guschan[i]->WriteRampCtrl(0x1);
-            guschan[i]->WritePanPot(0x7);
-            guschan[i]->ClearCache();
-        }
+        // Stop all channels, in place of the writes still queued for the renderer
+        GUS_QueueReset();
 
         // Stop DMA
+        critical_section_enter_blocking(&gus_crit);
         GUS_StopDMA();
+        critical_section_exit(&gus_crit);
 
         // Reset
         adlib_commandreg = 85;
+        critical_section_enter_blocking(&gus_crit);
         myGUS.IRQStatus = 0;
         myGUS.RampIRQ = 0;
         myGUS.WaveIRQ = 0;
         myGUS.IRQChan = 0;
+        critical_section_exit(&gus_crit);
 
         myGUS.timers[0].delay = 80;
         myGUS.timers[1].delay = 320;
@@ -951,9 +1564,51 @@ uint32_t CheckVoiceIrq_async(Bitu val) {
     return 0;
 }
 
+// Reads a voice register back from the last value written to it, for writes the renderer hasn't
+// applied yet. Returns false for registers that aren't read back this way.
+__force_inline static bool ReadPendingVoiceRegister(uint16_t* ret) {
+    const uint8_t reg = myGUS.gRegSelect & 0xf;
+    if (!curchan || (myGUS.gRegSelect & 0xf0) != 0x80 || reg > 0xd || !GUS_VoiceWritePending(reg)) {
+        return false;
+    }
+    const uint16_t data = gus_voice_shadow[myGUS.gCurChannel][reg];
+    switch (reg) {
+    case 0x0: // Channel voice control read register
+    case 0xd: // Channel volume control register
+        // The write sets the voice's IRQ if it has both bit 7 and bit 5 set, and clears it otherwise
+        *ret = ((data & 0x7f00) | ((data & 0xa000) == 0xa000 ? 0x8000 : 0));
+        return true;
+    case 0x1: // Channel frequency control register
+    case 0xb: // Channel LSW current address register
+        *ret = data;
+        return true;
+    case 0x2: // Channel MSB start address register
+    case 0x4: // Channel MSB end address register
+    case 0xa: // Channel MSB current address register
+        *ret = data & 0x1fff;
+        return true;
+    case 0x3: // Channel LSW start address register
+    case 0x5: // Channel LSW end address register
+        *ret = data & 0xffe0;
+        return true;
+    case 0x9: // Channel volume register
+        *ret = data & 0xfff0;
+        return true;
+    case 0xc: // Channel pan pot register
+        *ret = data & 0xff00;
+        return true;
+    default:
+        return false;
+    }
+}
+
 __force_inline static uint16_t ExecuteReadRegister(void) {
     uint8_t tmpreg;
+    uint16_t pending;
 //  LOG_MSG("Read global reg %x",myGUS.gRegSelect);
+    if (ReadPendingVoiceRegister(&pending)) {
+        return pending;
+    }
     switch (myGUS.gRegSelect) {
     case 0x8E:  // read active channel register
         // NTS: The GUS SDK documents the active channel count as bits 5-0, which is wrong. it's bits 4-0. bits 7-5 are always 1 on real hardware.
@@ -1020,6 +1675,8 @@ __force_inline static uint16_t ExecuteReadRegister(void) {
         if (curchan) return curchan->ReadRampCtrl() << 8;
         else return 0x0300;
     case 0x8f: // General channel IRQ status register
+        // The renderer on core1 sets these bits in gus_crit as voices reach their ends
+        critical_section_enter_blocking(&gus_crit);
         tmpreg=myGUS.IRQChan|0x20;
         uint32_t mask;
         mask=1u << myGUS.IRQChan;
@@ -1028,6 +1685,7 @@ __force_inline static uint16_t ExecuteReadRegister(void) {
         myGUS.RampIRQ&=~mask;
         myGUS.WaveIRQ&=~mask;
         myGUS.IRQStatus&=0x9f;
+        critical_section_exit(&gus_crit);
         // mega hack
         // PIC_DeActivateIRQ();
         CheckVoiceIrq();
@@ -1061,96 +1719,25 @@ static uint32_t GUS_TimerEventHandler(Bitu val) {
 
  
 __force_inline static void ExecuteGlobRegister(void) {
-    int i;
 //  if (myGUS.gRegSelect|1!=0x44) LOG_MSG("write global register %x with %x", myGUS.gRegSelect, myGUS.gRegData);
     switch(myGUS.gRegSelect) {
     case 0x0:  // Channel voice control register
-        // TODO figure out what FillUp even does!!
-        // gus_chan->FillUp();
-        if(curchan) curchan->WriteWaveCtrl((uint16_t)myGUS.gRegData>>8);
+    case 0xD:  // Channel volume control register
+        if (curchan) GUS_QueueVoiceWrite();
         break;
     case 0x1:  // Channel frequency control register
-        // gus_chan->FillUp();
-        if(curchan) curchan->WriteWaveFreq(myGUS.gRegData);
-        break;
     case 0x2:  // Channel MSW start address register
-        if (curchan) {
-            // 10 bit fractional wave address
-            uint32_t tmpaddr = (uint32_t)(myGUS.gRegData & 0x1fff) << 17; /* upper 13 bits of integer portion */
-            curchan->WaveStart = (curchan->WaveStart & WAVE_MSWMASK) | tmpaddr;
-        }
-        break;
     case 0x3:  // Channel LSW start address register
-        if(curchan != NULL) {
-            // 10 bit fractional wave address
-            uint32_t tmpaddr = (uint32_t)(myGUS.gRegData & 0xffe0) << 1; /* lower 7 bits of integer portion, and all 4 bits of fractional portion. bits 4-0 of the incoming 16-bit WORD are not used */
-            curchan->WaveStart = (curchan->WaveStart & WAVE_LSWMASK) | tmpaddr;
-        }
-        break;
     case 0x4:  // Channel MSW end address register
-        if(curchan != NULL) {
-            // 10 bit fractional wave address
-            uint32_t tmpaddr = (uint32_t)(myGUS.gRegData & 0x1fff) << 17; /* upper 13 bits of integer portion */
-            curchan->WaveEnd = (curchan->WaveEnd & WAVE_MSWMASK) | tmpaddr;
-        }
-        break;
-    case 0x5:  // Channel MSW end address register
-        if(curchan != NULL) {
-            // 10 bit fractional wave address
-            uint32_t tmpaddr = (uint32_t)(myGUS.gRegData & 0xffe0) << 1; /* lower 7 bits of integer portion, and all 4 bits of fractional portion. bits 4-0 of the incoming 16-bit WORD are not used */
-            curchan->WaveEnd = (curchan->WaveEnd & WAVE_LSWMASK) | tmpaddr;
-        }
-        break;
+    case 0x5:  // Channel LSW end address register
     case 0x6:  // Channel volume ramp rate register
-        // gus_chan->FillUp();
-        if(curchan != NULL) {
-            uint8_t tmpdata = (uint16_t)myGUS.gRegData>>8;
-            curchan->WriteRampRate(tmpdata);
-        }
-        break;
-    case 0x7:  // Channel volume ramp start register  EEEEMMMM
-        if(curchan != NULL) {
-            uint8_t tmpdata = (uint16_t)myGUS.gRegData >> 8;
-            curchan->RampStart = (uint32_t)(tmpdata << (4+RAMP_FRACT));
-        }
-        break;
-    case 0x8:  // Channel volume ramp end register  EEEEMMMM
-        if(curchan != NULL) {
-            uint8_t tmpdata = (uint16_t)myGUS.gRegData >> 8;
-            curchan->RampEnd = (uint32_t)(tmpdata << (4+RAMP_FRACT));
-        }
-        break;
+    case 0x7:  // Channel volume ramp start register
+    case 0x8:  // Channel volume ramp end register
     case 0x9:  // Channel current volume register
-        // gus_chan->FillUp();
-        if(curchan != NULL) {
-            uint16_t tmpdata = (uint16_t)myGUS.gRegData >> 4;
-            curchan->RampVol = (uint32_t)(tmpdata << RAMP_FRACT);
-            curchan->UpdateVolumes();
-        }
-        break;
     case 0xA:  // Channel MSW current address register
-        // gus_chan->FillUp();
-        if(curchan != NULL) {
-            // 10 bit fractional wave address
-            uint32_t tmpaddr = (uint32_t)(myGUS.gRegData & 0x1fff) << 17; /* upper 13 bits of integer portion */
-            curchan->WaveAddr = (curchan->WaveAddr & WAVE_MSWMASK) | tmpaddr;
-        }
-        break;
     case 0xB:  // Channel LSW current address register
-        // gus_chan->FillUp();
-        if(curchan != NULL) {
-            // 10 bit fractional wave address
-            uint32_t tmpaddr = (uint32_t)(myGUS.gRegData & 0xffff) << 1; /* lower 7 bits of integer portion, and all 9 bits of fractional portion */
-            curchan->WaveAddr = (curchan->WaveAddr & WAVE_LSWMASK) | tmpaddr;
-        }
-        break;
     case 0xC:  // Channel pan pot register
-        // gus_chan->FillUp();
-        if(curchan) curchan->WritePanPot((uint16_t)myGUS.gRegData>>8);
-        break;
-    case 0xD:  // Channel volume control register
-        // gus_chan->FillUp();
-        if(curchan) curchan->WriteRampCtrl((uint16_t)myGUS.gRegData>>8);
+        if (curchan) GUS_QueueVoiceWrite();
         break;
     case 0xE:  // Set active channel register
         /* Hack for "Ice Fever" demoscene production:
@@ -1200,7 +1787,8 @@ __force_inline static void ExecuteGlobRegister(void) {
 #if LOG_GUS
         LOG_MSG("GUS set to %d channels freq=%luHz", myGUS.ActiveChannels,(unsigned long)myGUS.basefreq);
 #endif
-        for (i=0;i<myGUS.ActiveChannels;i++) guschan[i]->UpdateWaveRamp();
+        // The voices belong to the renderer, which rescales their rates before its next writes
+        gus_voice_rates_stale = true;
         break;
     case 0x10:  // Undocumented register used in Fast Tracker 2
         break;
@@ -1424,6 +2012,7 @@ __force_inline void write_gus(Bitu port, Bitu val) {
         if ((myGUS.gDramAddr & myGUS.gDramAddrMask) < myGUS.memsize) {
 #ifdef PSRAM
             psram_write8(&psram_spi, myGUS.gDramAddr & myGUS.gDramAddrMask, (uint8_t)val);
+            GUS_LogRamWrite(myGUS.gDramAddr & myGUS.gDramAddrMask);
             // psram_write8_async(&psram_spi, myGUS.gDramAddr & myGUS.gDramAddrMask, (uint8_t)val);
 #else
             GUSRam[myGUS.gDramAddr & myGUS.gDramAddrMask] = (uint8_t)val;
@@ -1440,6 +2029,106 @@ __force_inline void write_gus(Bitu port, Bitu val) {
 
 
 static bool GUS_DMA_Active = false;
+// Whether the running transfer is a burst (see DMA_Burst_Start) rather than one alarm per byte
+static bool GUS_DMA_Burst = false;
+
+#ifdef PSRAM
+// Burst data copied out of the DMA buffers in gus_crit, for core1 to write to PSRAM after letting go
+// of it, so a port access on core0 never waits on PSRAM. head moves in gus_crit, tail only in the
+// core1 DMA and timer IRQs. A burst only starts with the stage empty, so it holds at most the
+// buffer a burst IRQ is writing out and the two a stop copies out.
+#define GUS_DMA_STAGE_SIZE 4
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+    uint8_t data[DMA_BURST_WORDS];
+} gus_dma_stage_t;
+static gus_dma_stage_t gus_dma_stage[GUS_DMA_STAGE_SIZE];
+static volatile uint8_t gus_dma_stage_head = 0;
+static volatile uint8_t gus_dma_stage_tail = 0;
+
+// Writes the staged burst data to GUS RAM. Only on core1, outside gus_crit.
+static void GUS_DMA_WriteStaged(void) {
+    const uint8_t head = gus_dma_stage_head;
+    __dmb();
+    for (uint8_t tail = gus_dma_stage_tail; tail != head; ) {
+        const gus_dma_stage_t* const stage = &gus_dma_stage[tail & (GUS_DMA_STAGE_SIZE - 1)];
+        for (uint32_t done = 0; done < stage->len; ) {
+            // Split on each 256-byte boundary of GUS RAM so no write crosses a PSRAM page
+            const uint32_t start = stage->addr + done;
+            const uint32_t len = MIN(stage->len - done, 0x100 - (start & 0xff));
+            psram_write(&psram_spi, start, stage->data + done, len);
+            for (uint32_t addr = start; addr < start + len; addr += GUS_CACHE_LINE) {
+                GUS_LogRamWrite(addr);
+            }
+            GUS_LogRamWrite(start + len - 1);
+            done += len;
+        }
+        gus_dma_stage_tail = ++tail;
+    }
+}
+
+// Writes out the last of a burst stopped on core0
+static uint32_t GUS_DMA_FlushHandler(Bitu val) {
+    (void)val;//UNUSED
+    GUS_DMA_WriteStaged();
+    return 0;
+}
+static PIC_TimerEvent GUS_DMA_FlushEvent = {
+    .handler = GUS_DMA_FlushHandler
+};
+// Long enough that the alarm is never already due when it's added
+#define GUS_DMA_FLUSH_DELAY_US 10
+#endif
+
+// Takes the bytes of a burst for GUS RAM from dmaAddr on: with PSRAM they are staged for
+// GUS_DMA_WriteStaged. Called in gus_crit. Returns true if the last was the TC cycle.
+static bool GUS_DMA_WriteBurst(const uint32_t* words, uint32_t count) {
+    TRACE_EVENT(TRACE_DMA, count);
+    const bool invert = myGUS.DMAControl & 0x80;
+    // For 16-bit data only the high (odd) bytes are inverted
+    const uint32_t invert_mask = (myGUS.DMAControl & 0x40) ? 1 : 0;
+#ifdef PSRAM
+    gus_dma_stage_t* const stage = &gus_dma_stage[gus_dma_stage_head & (GUS_DMA_STAGE_SIZE - 1)];
+    stage->addr = myGUS.dmaAddr;
+    uint32_t len = 0;
+#endif
+    bool tc = false;
+    for (uint32_t i = 0; i < count && !tc; ++i) {
+        tc = words[i] & 0x100u;
+        uint8_t data8 = words[i] & 0xffu;
+        if (invert && (myGUS.dmaAddr & invert_mask) == invert_mask) {
+            data8 ^= 0x80;
+        }
+#ifdef PSRAM
+        stage->data[len++] = data8;
+#else
+        GUSRam[myGUS.dmaAddr] = data8;
+#endif
+        if (!tc) {
+            ++myGUS.dmaAddr;
+        }
+    }
+#ifdef PSRAM
+    stage->len = len;
+    __dmb();
+    gus_dma_stage_head = gus_dma_stage_head + 1;
+#endif
+    return tc;
+}
+
+// Raises the TC IRQ. Called in gus_crit.
+static void GUS_DMA_RaiseTC(void) {
+    myGUS.DMAControl |= 0x100u; /* NTS: DOSBox SVN approach: Use bit 8 for DMA TC IRQ */
+    myGUS.IRQStatus |= 0x80;
+    GUS_CheckIRQ();
+}
+
+// Raises the TC IRQ and stops DMA. Called in gus_crit.
+static void GUS_DMA_TerminalCount(void) {
+    GUS_StopDMA();
+    GUS_DMA_RaiseTC();
+}
 
 #ifdef POLLING_DMA
 __force_inline
@@ -1447,6 +2136,10 @@ __force_inline
 uint32_t 
 GUS_DMA_EventHandler(Bitu val) {
     (void)val;//UNUSED
+#ifdef PSRAM
+    // A transfer started before the last burst was written out goes after it
+    GUS_DMA_WriteStaged();
+#endif
     if (!GUS_DMA_Active) {
         return 0;
     }
@@ -1481,6 +2174,25 @@ static PIC_TimerEvent GUS_DMA_Event = {
 
 void 
 GUS_DMA_isr() {
+    if (GUS_DMA_Burst) {
+        // The PIO has stopped at TC. GUS_StopDMA takes whatever was collected up to it, and the
+        // TC IRQ is raised once that is in GUS RAM.
+        critical_section_enter_blocking(&gus_crit);
+        const bool tc = GUS_DMA_Burst;
+        if (tc) {
+            GUS_StopDMA();
+        }
+        critical_section_exit(&gus_crit);
+#ifdef PSRAM
+        GUS_DMA_WriteStaged();
+#endif
+        if (tc) {
+            critical_section_enter_blocking(&gus_crit);
+            GUS_DMA_RaiseTC();
+            critical_section_exit(&gus_crit);
+        }
+        return;
+    }
     myGUS.dmaWaiting = false;
     // Pull data from PIO even if we have to throw it away, because otherwise it will be stalled
     const uint32_t dma_data = DMA_Complete_Write(&dma_config);
@@ -1496,6 +2208,7 @@ GUS_DMA_isr() {
         return;
     }
 
+    TRACE_EVENT(TRACE_DMA, 1);
     const uint8_t dma_data8 = dma_data & 0xffu;
 #ifdef PSRAM
     // psram_write8_async(&psram_spi, myGUS.dmaAddr, dma_config.invertMsb ? dma_data8 ^ 0x80 : dma_data8);
@@ -1507,6 +2220,7 @@ GUS_DMA_isr() {
     dma_data_union.data8[dmaOffset] = dma_config.invertMsb ? dma_data ^ 0x80 : dma_data8;
     if ((dmaOffset) == 0x3) {
         psram_write32_async(&psram_spi, myGUS.dmaAddr - 0x3, dma_data_union.data32);
+        GUS_LogRamWrite(myGUS.dmaAddr);
     }
 #else
     GUSRam[myGUS.dmaAddr] = dma_config.invertMsb ? dma_data8 ^ 0x80 : dma_data8;
@@ -1519,14 +2233,12 @@ GUS_DMA_isr() {
         if (dmaOffset != 0x3) { // 0, 1, or 2
             // Due to the aligned nature of DMA writes, if we stomp on 1-3 bytes it's not a problem
             psram_write32_async(&psram_spi, myGUS.dmaAddr - dmaOffset, dma_data_union.data32);
+            GUS_LogRamWrite(myGUS.dmaAddr);
         }
 #endif
         critical_section_enter_blocking(&gus_crit);
         /* Raise the TC irq, and stop DMA */
-        myGUS.DMAControl |= 0x100u; /* NTS: DOSBox SVN approach: Use bit 8 for DMA TC IRQ */
-        myGUS.IRQStatus |= 0x80;
-        GUS_StopDMA();
-        GUS_CheckIRQ();
+        GUS_DMA_TerminalCount();
         critical_section_exit(&gus_crit);
     } else {
         ++myGUS.dmaAddr;
@@ -1536,6 +2248,25 @@ GUS_DMA_isr() {
 }
 irq_handler_t GUS_DMA_isr_pt = GUS_DMA_isr;
 
+// A burst buffer has filled. Each is copied out in gus_crit and written to GUS RAM after.
+void
+GUS_DMA_burst_isr() {
+    const uint32_t* words;
+    uint32_t count;
+    do {
+        critical_section_enter_blocking(&gus_crit);
+        count = DMA_Burst_Complete(&dma_config, &words);
+        if (count && GUS_DMA_Burst) {
+            GUS_DMA_WriteBurst(words, count);
+        }
+        critical_section_exit(&gus_crit);
+#ifdef PSRAM
+        GUS_DMA_WriteStaged();
+#endif
+    } while (count);
+}
+irq_handler_t GUS_DMA_burst_isr_pt = GUS_DMA_burst_isr;
+
 #ifdef POLLING_DMA
 static uint32_t next_event = 0;
 #endif
@@ -1548,6 +2279,25 @@ __force_inline void GUS_StopDMA() {
 #ifdef POLLING_DMA
     next_event = 0;
 #endif
+    if (GUS_DMA_Burst) {
+        GUS_DMA_Burst = false;
+        DMA_Burst_Stop(&dma_config);
+        // Take everything transferred before the stop: filled buffers first, then the rest
+        const uint32_t* words;
+        uint32_t count;
+        bool tc = false;
+        while ((count = DMA_Burst_Complete(&dma_config, &words))) {
+            tc = GUS_DMA_WriteBurst(words, count);
+        }
+        if (!tc && (count = DMA_Burst_Remainder(&dma_config, &words))) {
+            GUS_DMA_WriteBurst(words, count);
+        }
+#ifdef PSRAM
+        // Core1 writes it to GUS RAM; stopped from core0, its timer IRQ does
+        PIC_AddEvent(&GUS_DMA_FlushEvent, GUS_DMA_FLUSH_DELAY_US, 0);
+#endif
+        return;
+    }
     if (myGUS.dmaWaiting) {
         // Reset the PIO
         DMA_Cancel_Write(&dma_config);
@@ -1604,6 +2354,18 @@ __force_inline void GUS_StartDMA() {
     }
     
 #ifndef POLLING_DMA
+    // Let the PIO run the whole transfer on its own if the interval can be paced in hardware.
+    // Until the last burst is written out, go a byte at a time so the stage can't overflow.
+    DMA_Cancel_Write(&dma_config);
+#ifdef PSRAM
+    const bool staged = gus_dma_stage_head != gus_dma_stage_tail;
+#else
+    const bool staged = false;
+#endif
+    if (!staged && DMA_Burst_Start(&dma_config, myGUS.dmaInterval)) {
+        GUS_DMA_Burst = true;
+        return;
+    }
     PIC_AddEvent(&GUS_DMA_Event, myGUS.dmaInterval, 0);
 #else
     next_event = time_us_32() + myGUS.dmaInterval;
@@ -1611,44 +2373,132 @@ __force_inline void GUS_StartDMA() {
 }
 
 
+// With INTERP_CLAMP the interp1 clamp lane applies the >> VOL_SHIFT itself
+static __force_inline int16_t clamp_mix(int32_t d) {
+#ifdef INTERP_CLAMP
+    return clamp16(d);
+#else
+    return clamp16(d >> VOL_SHIFT);
+#endif
+}
+
 //extern uint32_t __scratch_x("my_sub_section") (GUS_CallBack)(Bitu max_len, int16_t* play_buffer) {  // did not compile/link multifw with this.. scratch?? check.
+// Starts adapting the buffer over from the min when pgusinit has changed the bounds
+static void GUS_ApplyAudioBufferBounds(void) {
+    static uint32_t seen_seq = 0;
+    const uint32_t seq = buffer_bounds_seq;
+    if (seq == seen_seq) {
+        return;
+    }
+    seen_seq = seq;
+    __dmb();
+    buffer_min = buffer_min_set;
+    buffer_max = buffer_max_set;
+    buffer_size = buffer_min;
+    buffer_peak = buffer_min;
+    buffer_load = 0;
+    buffer_quiet_us = 0;
+}
+
 extern uint32_t GUS_CallBack(Bitu max_len, int16_t* play_buffer) {
-    static int32_t accum[2];
+    static int32_t mix[GUS_MAX_BUFFER * 2];
 #ifdef SCALE_22K_TO_44K
     static int32_t prev_accum[2];
 #endif
     uint32_t s = 0;
 
+    GUS_ApplyAudioBufferBounds();
+
     if ((GUS_reset_reg & 0x01/*!master reset*/) == 0x01 && (GUS_reset_reg & 0x02/*DAC enable*/) == 0x02) {
-        while (s < buffer_size) {
-            accum[0] = accum[1] = 0;
-            uint32_t cur_rate = myGUS.basefreq;
-            for (Bitu c = 0; c < myGUS.ActiveChannels; ++c) {
-                guschan[c]->generateSample(accum);
+        // Voice count is sampled once per block, so a rate change takes effect on the next block
+        const uint8_t active_channels = myGUS.ActiveChannels;
+#ifdef SCALE_22K_TO_44K
+        const bool scale_22k = !myGUS.fixed_44k_output && active_channels == 28;
+        // Each rendered frame is output twice, so half as many make up the buffer
+        const uint32_t frames = scale_22k ? (buffer_size + 1) >> 1 : buffer_size;
+#else
+        const uint32_t frames = buffer_size;
+#endif
+        // 4-point interpolation is used unless it has already failed to keep up at this voice count
+        const bool hq = gus_interp_mode != GUS_INTERP_LINEAR && active_channels <= gus_interp_max_voices;
+        gus_interp_taps = hq ? (gus_interp_mode == GUS_INTERP_SINC ? gus_interp_sinc : gus_interp_cubic) : NULL;
+        const uint32_t render_start = hq ? time_us_32() : 0;
+
+        // Queued voice writes that arrived since the last block are spread over this one in
+        // proportion to their arrival times, so their relative timing is kept
+        const uint32_t now = time_us_32();
+        const uint32_t head = gus_write_queue_head;
+        __dmb();
+        const uint32_t start_us = gus_write_queue_time;
+        const uint32_t span_us = now - start_us;
+        gus_write_queue_time = now;
+        // After a stall (or the first block), apply everything up front
+        const uint32_t span = span_us > 0xffff ? 0 : span_us;
+        uint32_t pos = 0;
+        uint32_t next = GUS_ApplyVoiceWrites(head, start_us, span, 0, frames);
+
+        memset(mix, 0, frames * 2 * sizeof(int32_t));
+#ifdef PSRAM
+        GUS_PrefetchSamples(active_channels, frames);
+#endif
+        while (pos < frames) {
+            int32_t* const seg = mix + (pos << 1);
+            if (hq) {
+                for (Bitu c = 0; c < active_channels; ++c) {
+                    guschan[c]->generateSamples<true>(seg, next - pos);
+                }
+            } else {
+                for (Bitu c = 0; c < active_channels; ++c) {
+                    guschan[c]->generateSamples<false>(seg, next - pos);
+                }
+            }
+            pos = next;
+            next = GUS_ApplyVoiceWrites(head, start_us, span, pos, frames);
+        }
+        CheckVoiceIrq();
+
+        if (hq) {
+            // Track the share of the block's real time spent rendering (/256, averaged over ~16
+            // blocks). If it gets too high, drop to linear at this voice count and above.
+            const uint32_t deadline_us = frames * 1000000u / myGUS.basefreq;
+            const int32_t load = deadline_us ? (int32_t)(((time_us_32() - render_start) << 8) / deadline_us) : 0;
+            gus_interp_load += (load - gus_interp_load) >> 4;
+            if (gus_interp_load > GUS_INTERP_MAX_LOAD) {
+                gus_interp_max_voices = active_channels - 1;
+                gus_interp_load = 0;
             }
+        }
+
+        // Master volume is applied once to the mixed bus rather than to every voice sample
+        const int32_t volume = gus_volume;
+        if (volume != 0x10000) {
+            for (uint32_t i = 0; i < (frames << 1); ++i) {
+                mix[i] = (int32_t)(((int64_t)mix[i] * volume) >> 16);
+            }
+        }
+        for (uint32_t i = 0; i < frames; ++i) {
+            const int32_t* accum = mix + (i << 1);
 #ifdef SCALE_22K_TO_44K
-            if (!myGUS.fixed_44k_output && myGUS.ActiveChannels == 28) {
-                play_buffer[s << 1] = clamp16((accum[0] + prev_accum[0]) >> 1);
-                play_buffer[(s << 1) + 1] = clamp16((accum[1] + prev_accum[1]) >> 1);
+            if (scale_22k) {
+                play_buffer[s << 1] = clamp_mix((accum[0] + prev_accum[0]) >> 1);
+                play_buffer[(s << 1) + 1] = clamp_mix((accum[1] + prev_accum[1]) >> 1);
                 ++s;
             }
 #endif // SCALE_22K_TO_44K
-            play_buffer[s << 1] = clamp16(accum[0]);
-            play_buffer[(s << 1) + 1] = clamp16(accum[1]);
+            play_buffer[s << 1] = clamp_mix(accum[0]);
+            play_buffer[(s << 1) + 1] = clamp_mix(accum[1]);
             ++s;
 #ifdef SCALE_22K_TO_44K
             prev_accum[0] = accum[0];
             prev_accum[1] = accum[1];
 #endif
-            if (cur_rate != myGUS.basefreq) {
-                // Bail out if our sampling rate changed. This will produce 1 sample at the
-                // wrong rate, but it's better than producing up to buffer_size samples at the 
-                // wrong rate...
-                break;
-            }
         }
-        CheckVoiceIrq();
     } else {
+        // Nothing is rendering, so queued writes take effect right away
+        const uint32_t head = gus_write_queue_head;
+        __dmb();
+        GUS_ApplyVoiceWrites(head, 0, 0, 0, 0);
+        gus_write_queue_time = time_us_32();
         return 0;
     }
 
@@ -1777,13 +2627,62 @@ static void MakeTables(void) {
 
 void GUS_SetAudioBuffer(const uint16_t new_buffer_size) {
     // PICOGUS special port to set audio buffer size
-    buffer_size = new_buffer_size;
+    buffer_min_set = new_buffer_size > GUS_MAX_BUFFER ? GUS_MAX_BUFFER : (new_buffer_size ? new_buffer_size : 1);
+    __dmb();
+    buffer_bounds_seq = buffer_bounds_seq + 1;
+}
+void GUS_SetAudioBufferMax(const uint16_t new_buffer_max) {
+    // PICOGUS special port to set the largest size the audio buffer may grow to
+    buffer_max_set = new_buffer_max > GUS_MAX_BUFFER ? GUS_MAX_BUFFER : new_buffer_max;
+    __dmb();
+    buffer_bounds_seq = buffer_bounds_seq + 1;
+}
+uint32_t GUS_AudioBuffer(void) {
+    return buffer_size;
+}
+uint32_t GUS_AudioBufferPeak(void) {
+    return buffer_peak;
+}
+void GUS_AdaptAudioBuffer(const uint32_t busy_us, const uint32_t period_us) {
+    // A max at or below the min keeps the buffer fixed at the min
+    if (buffer_max <= buffer_min || !period_us) {
+        return;
+    }
+    const int32_t load = (int32_t)(((uint64_t)busy_us << 8) / period_us);
+    buffer_load += (load - buffer_load) >> 3;
+    uint32_t size = buffer_size;
+    if (load >= 256 || buffer_load > GUS_BUFFER_GROW_LOAD) {
+        // Missed (or nearly missed) the deadline: grow straight away
+        size += (size >> 1) + 1;
+    } else if (buffer_load < GUS_BUFFER_SHRINK_LOAD) {
+        buffer_quiet_us += period_us;
+        if (buffer_quiet_us < GUS_BUFFER_SHRINK_HOLD_US) {
+            return;
+        }
+        size -= (size >> 2) ? (size >> 2) : 1;
+    } else {
+        buffer_quiet_us = 0;
+        return;
+    }
+    size = MAX(buffer_min, MIN(size, buffer_max));
+    // Measure again from between the thresholds at the new size so it doesn't flap
+    buffer_load = (GUS_BUFFER_GROW_LOAD + GUS_BUFFER_SHRINK_LOAD) >> 1;
+    buffer_quiet_us = 0;
+    buffer_size = size;
+    buffer_peak = MAX(buffer_peak, size);
 }
 void GUS_SetDMAInterval(const uint16_t newInterval) {
     // PICOGUS special port to set DMA interval
     printf("setting dma interval to %u\n", newInterval);
     myGUS.dmaIntervalOverride = newInterval;
 }
+void GUS_SetInterpolation(const uint8_t new_mode) {
+    // PICOGUS special port to set voice interpolation
+    gus_interp_mode = new_mode <= GUS_INTERP_SINC ? new_mode : GUS_INTERP_LINEAR;
+    // Give the new mode a fresh chance at every voice count
+    gus_interp_max_voices = 32;
+    gus_interp_load = 0;
+}
 void GUS_SetFixed44k(const bool new_force44k) {
     // PICOGUS special port to set audio buffer size
     myGUS.fixed_44k_output = new_force44k;
@@ -1871,9 +2770,10 @@ public:
 static GUS* test = NULL;
 void GUS_OnReset(void) {
     LOG_MSG("Allocating GUS emulation");
-    test = new GUS();
-
+    // Initialized first, as resetting the card stops DMA under it
     critical_section_init(&gus_crit);
+
+    test = new GUS();
 }
 
 void GUS_Setup() {
@@ -9,3 +9,4 @@ extern uint32_t GUS_CallBack(Bitu len, int16_t* play_buffer);
 extern uint8_t GUS_activeChannels(void);
 extern uint32_t GUS_basefreq(void);
 extern void GUS_Setup(void);
+extern void GUS_AdaptAudioBuffer(uint32_t busy_us, uint32_t period_us);
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+
+# Generates the 4-point interpolation tables used by the GUS voice renderer.
+# Each table has one row of taps per phase of the sample position fraction,
+# applied to samples n-1, n, n+1 and n+2 and scaled to 1 << TAP_BITS.
+
+import math
+import sys
+
+PHASE_BITS = 8
+TAP_BITS = 14
+
+
+def catmull_rom(t):
+    return [
+        (-t**3 + 2*t**2 - t) / 2,
+        (3*t**3 - 5*t**2 + 2) / 2,
+        (-3*t**3 + 4*t**2 + t) / 2,
+        (t**3 - t**2) / 2,
+    ]
+
+
+def lanczos2(t):
+    def sinc(x):
+        return 1.0 if x == 0 else math.sin(math.pi * x) / (math.pi * x)
+    taps = [sinc(d) * sinc(d / 2) for d in (t + 1, t, 1 - t, 2 - t)]
+    total = sum(taps)
+    return [c / total for c in taps]
+
+
+def quantize(taps):
+    q = [round(c * (1 << TAP_BITS)) for c in taps]
+    # Make every row sum to exactly 1.0 so DC passes through unchanged
+    q[q.index(max(q))] += (1 << TAP_BITS) - sum(q)
+    assert sum(abs(c) for c in q) < (1 << (TAP_BITS + 1))
+    return q
+
+
+def table(name, fn):
+    rows = []
+    for phase in range(1 << PHASE_BITS):
+        taps = quantize(fn(phase / (1 << PHASE_BITS)))
+        rows.append("    {" + ", ".join(str(c) for c in taps) + "},")
+    return f"static const int16_t {name}[1 << GUS_INTERP_PHASE_BITS][4] = {{\n" + "\n".join(rows) + "\n};\n"
+
+
+with open(sys.argv[1], 'w') as f:
+    f.write(f"""
+#pragma once
+#include <stdint.h>
+
+#define GUS_INTERP_PHASE_BITS {PHASE_BITS}
+#define GUS_INTERP_TAP_BITS {TAP_BITS}
+
+{table("gus_interp_cubic", catmull_rom)}
+{table("gus_interp_sinc", lanczos2)}
+""")
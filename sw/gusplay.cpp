@@ -29,6 +29,7 @@
 #include "pico/audio_i2s.h"
 
 #include "system/pico_pic.h"
+#include "system/trace.h"
 
 #ifdef USB_STACK
 #include "tusb.h"
@@ -52,6 +53,7 @@ extern Settings settings;
 
 #include "isa/isa_dma.h"
 extern irq_handler_t GUS_DMA_isr_pt;
+extern irq_handler_t GUS_DMA_burst_isr_pt;
 extern dma_inst_t dma_config;
 
 #include "gus/gus-x.h"
@@ -107,6 +109,7 @@ void play_gus() {
     // Init ISA DMA on this core so it handles the ISR
     puts("Initing ISA DMA PIO...");
     dma_config = DMA_init(pio0, DMA_PIO_SM, GUS_DMA_isr_pt);
+    DMA_Burst_Init(&dma_config, GUS_DMA_burst_isr_pt);
 
 #ifdef PSRAM_CORE1
 #ifdef PSRAM
@@ -154,10 +157,14 @@ void play_gus() {
             ((struct audio_format *) ap->format)->sample_freq = playback_rate;
         }
         struct audio_buffer *buffer = take_audio_buffer(ap, true);
+        // Everything from here until the next take_audio_buffer must fit in the time a buffer plays for
+        uint32_t busy_begin = time_us_32();
         int16_t *samples = (int16_t *) buffer->buffer->bytes;
 
         // uint32_t gus_audio_begin = time_us_32();
+        TRACE_EVENT(TRACE_RENDER_BEGIN, buffer->max_sample_count);
         uint32_t sample_count = GUS_CallBack(buffer->max_sample_count, samples);
+        TRACE_EVENT(TRACE_RENDER_END, sample_count);
         buffer->sample_count = sample_count;
         /*
         uint32_t gus_audio_elapsed = time_us_32() - gus_audio_begin;
@@ -176,9 +183,13 @@ void play_gus() {
         // Service TinyUSB events
         tuh_task();
 #endif
-#ifdef SOUND_MPU
-        // Calculate number of midi bytes to send at current sample rate and number of samples generated
-        send_midi_bytes(MAX(31250 * sample_count / playback_rate + 1, 8));
-#endif
+        if (sample_count) {
+            const uint32_t busy_us = time_us_32() - busy_begin;
+            const uint32_t period_us = (uint64_t)sample_count * 1000000u / playback_rate;
+            if (busy_us > period_us) {
+                TRACE_EVENT(TRACE_UNDERRUN, MIN(busy_us, 0xffffu));
+            }
+            GUS_AdaptAudioBuffer(busy_us, period_us);
+        }
     }
 }
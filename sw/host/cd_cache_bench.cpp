@@ -0,0 +1,377 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side measurement of the CD sector cache in cdrom/cdrom_cache.c.
+//
+// Replays traces of the data sectors the host reads through the MKE interface against a simulated
+// USB drive, in virtual time: each drive read takes a fixed time per command plus a time per
+// drive sector, and the host takes a fixed time to move each CD sector out of data_fifo. It runs
+// each trace twice, once reading every sector with a drive read of its own as cdrom_read_data did
+// before the cache, the next read starting as the host begins taking the last sector, and once
+// through the cache, and reports the CD data throughput of each. Every sector the cache returns is
+// checked against the image.
+//
+// A trace file has a read per line: the first sector's LBA and optionally the number of
+// sectors, as in an MKE read command. '#' starts a comment.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "cdrom_cache.h"
+#include "msc_app.h"
+}
+
+struct Read {
+    uint32_t lba;
+    uint32_t count;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Read> reads;
+};
+
+// Simulation parameters
+static double command_us = 1000;
+static double sector_us = 500;
+static double host_us = 500;
+static uint32_t fragment_bytes = 32768;
+
+static constexpr uint32_t IMAGE_SECTORS = 300000;
+// Drive sector where the image file starts
+static constexpr uint32_t FILE_BASE = 8192;
+
+static uint8_t image_byte(uint32_t offset) {
+    const uint32_t x = offset * 2654435761u;
+    return (uint8_t)(x >> 24 ^ offset >> 11);
+}
+
+// Simulated drive, in virtual time
+
+struct DriveRead {
+    uint8_t *buff;
+    uint32_t lba;
+    uint16_t count;
+    msc_read_cb_t cb;
+    uintptr_t arg;
+    double queued;
+    double done;
+};
+
+static double now;
+static double drive_free;
+static std::deque<DriveRead> drive_queue;
+
+static double read_cost(uint32_t sectors) {
+    return command_us + sectors * sector_us;
+}
+
+static void drive_schedule() {
+    if (!drive_queue.empty() && drive_queue.front().done < 0) {
+        DriveRead &r = drive_queue.front();
+        r.done = std::max(r.queued, drive_free) + read_cost(r.count);
+    }
+}
+
+extern "C" bool msc_read_async(uint8_t *buff, uint32_t lba, uint16_t count, msc_read_cb_t cb, uintptr_t arg) {
+    if (drive_queue.size() == MSC_READ_QUEUE_SIZE) {
+        return false;
+    }
+    drive_queue.push_back({buff, lba, count, cb, arg, now, -1});
+    drive_schedule();
+    return true;
+}
+
+// Completes the reads that have ended by now, as tuh_task() would
+static void drive_poll() {
+    while (!drive_queue.empty() && drive_queue.front().done <= now) {
+        const DriveRead r = drive_queue.front();
+        drive_queue.pop_front();
+        drive_free = r.done;
+        for (uint32_t i = 0; i < r.count * 512u; ++i) {
+            r.buff[i] = image_byte((r.lba - FILE_BASE) * 512 + i);
+        }
+        // Reads queued from the callback start when this one ends
+        const double saved = now;
+        now = r.done;
+        drive_schedule();
+        r.cb(true, r.arg);
+        now = saved;
+        drive_schedule();
+    }
+}
+
+// The image file, stored contiguously but located as if in fragments of fragment_bytes
+static uint32_t file_locate(void *priv, uint32_t seek, size_t count, uint32_t *lba) {
+    (void)priv;
+    if (seek % 512) {
+        return 0;
+    }
+    *lba = FILE_BASE + seek / 512;
+    return std::min<uint32_t>(count, fragment_bytes - seek % fragment_bytes);
+}
+
+static track_file_t file;
+static track_t tracks[2];
+static cd_img_t image = {2, tracks};
+
+extern "C" int cdi_get_track(cd_img_t *cdi, uint32_t sector) {
+    return sector < cdi->tracks[1].start ? 1 : -1;
+}
+
+static void set_layout(uint32_t sector_size) {
+    tracks[0] = {};
+    tracks[0].number = 1;
+    tracks[0].track_number = 1;
+    tracks[0].attr = DATA_TRACK;
+    tracks[0].sector_size = sector_size;
+    file.locate = file_locate;
+    tracks[0].file = &file;
+    tracks[1] = tracks[0];
+    tracks[1].number = 2;
+    tracks[1].track_number = 0xaa;
+    tracks[1].start = IMAGE_SECTORS;
+}
+
+static uint32_t data_offset(uint32_t lba) {
+    const uint32_t size = tracks[0].sector_size;
+    return lba * size + (size == RAW_SECTOR_SIZE ? 16 : 0);
+}
+
+// Sectors the cache reads through FatFS, once the drive is done with the cache's reads: as one
+// read of the drive sectors they span, as FatFS makes for a run of them
+extern "C" int cdi_read_sectors(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector, uint32_t num) {
+    (void)cdi;
+    (void)raw;
+    while (!drive_queue.empty()) {
+        now = std::max(now, drive_queue.front().done);
+        drive_poll();
+    }
+    const uint32_t first = data_offset(sector) / 512;
+    const uint32_t end = (data_offset(sector + num - 1) + COOKED_SECTOR_SIZE + 511) / 512;
+    now = drive_free = std::max(now, drive_free) + read_cost(end - first);
+    for (uint32_t s = 0; s < num; ++s) {
+        const uint32_t offset = data_offset(sector + s);
+        for (uint32_t i = 0; i < COOKED_SECTOR_SIZE; ++i) {
+            buffer[s * COOKED_SECTOR_SIZE + i] = image_byte(offset + i);
+        }
+    }
+    return 1;
+}
+
+// Drive sectors a read of one CD sector's data takes
+static uint32_t single_read_sectors(uint32_t lba) {
+    return (data_offset(lba) % 512 + COOKED_SECTOR_SIZE + 511) / 512;
+}
+
+// Time to read the trace a drive read per sector: each read starts when the host begins taking the
+// sector before, as data_fifo then has room for it, or for the first of a read when the host has
+// taken the last sector of the one before and sends the command
+static double run_uncached(const Trace &trace) {
+    double drive = 0, host = -host_us;
+    for (const Read &r : trace.reads) {
+        host += host_us;
+        for (uint32_t s = r.lba; s < r.lba + r.count; ++s) {
+            const double ready = drive = std::max(drive, host) + read_cost(single_read_sectors(s));
+            host = std::max(ready, s == r.lba ? host : host + host_us);
+        }
+    }
+    return host + host_us;
+}
+
+// Time to read the trace through the cache
+static double run_cached(const Trace &trace, cdrom_cache_stats_t *stats) {
+    cdrom_cache_invalidate();
+    cdrom_cache_stats_clear();
+    now = drive_free = 0;
+    for (const Read &r : trace.reads) {
+        for (uint32_t s = r.lba; s < r.lba + r.count; ++s) {
+            const uint8_t *data;
+            int result;
+            while (drive_poll(), (result = cdrom_cache_read(&image, s, r.lba + r.count - s, &data)) == CD_CACHE_PENDING) {
+                if (drive_queue.empty()) {
+                    fprintf(stderr, "sector %u pending with no drive read in progress\n", s);
+                    exit(1);
+                }
+                now = std::max(now, drive_queue.front().done);
+            }
+            if (result == CD_CACHE_DIRECT) {
+                // Read through FatFS, once the drive is done with the cache's reads
+                while (!drive_queue.empty()) {
+                    now = std::max(now, drive_queue.front().done);
+                    drive_poll();
+                }
+                now = drive_free = std::max(now, drive_free) + read_cost(single_read_sectors(s));
+            } else {
+                const uint32_t offset = data_offset(s);
+                for (uint32_t i = 0; i < COOKED_SECTOR_SIZE; ++i) {
+                    if (data[i] != image_byte(offset + i)) {
+                        fprintf(stderr, "sector %u differs from the image at byte %u\n", s, i);
+                        exit(1);
+                    }
+                }
+            }
+            now += host_us;
+        }
+    }
+    // Let the read ahead finish, with the image closed
+    cdrom_cache_invalidate();
+    const double end = now;
+    while (!drive_queue.empty()) {
+        now = drive_queue.front().done;
+        drive_poll();
+    }
+    cdrom_cache_stats_get(stats);
+    return end;
+}
+
+static bool load_trace(const char *path, Trace *trace) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    const char *slash = strrchr(path, '/');
+    trace->name = slash ? slash + 1 : path;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = 0;
+        }
+        Read r = {0, 1};
+        const int n = sscanf(line, "%u %u", &r.lba, &r.count);
+        if (n <= 0) {
+            continue;
+        }
+        if (r.lba + r.count > IMAGE_SECTORS) {
+            fprintf(stderr, "%s: read past sector %u\n", path, IMAGE_SECTORS);
+            fclose(f);
+            return false;
+        }
+        trace->reads.push_back(r);
+    }
+    fclose(f);
+    return true;
+}
+
+// Traces like those of a game: streaming video, installing, random access and a file lookup
+// through the directory before each file read
+static std::vector<Trace> synthesize() {
+    std::mt19937 rng(1);
+    std::vector<Trace> traces(4);
+
+    traces[0].name = "video";
+    for (uint32_t lba = 20000; lba < 24000; lba += 8) {
+        traces[0].reads.push_back({lba, 8});
+    }
+
+    traces[1].name = "install";
+    for (uint32_t i = 0; i < 20; ++i) {
+        uint32_t lba = rng() % (IMAGE_SECTORS - 1000);
+        for (uint32_t left = 50 + rng() % 400; left;) {
+            const uint32_t count = std::min(left, 32u);
+            traces[1].reads.push_back({lba, count});
+            lba += count;
+            left -= count;
+        }
+    }
+
+    traces[2].name = "random";
+    for (uint32_t i = 0; i < 2000; ++i) {
+        traces[2].reads.push_back({(uint32_t)(rng() % IMAGE_SECTORS), 1});
+    }
+
+    traces[3].name = "dir+file";
+    for (uint32_t i = 0; i < 200; ++i) {
+        traces[3].reads.push_back({16, 1});
+        traces[3].reads.push_back({18 + (uint32_t)(rng() % 4), 1});
+        traces[3].reads.push_back({(uint32_t)(rng() % (IMAGE_SECTORS - 20)), 1 + (uint32_t)(rng() % 20)});
+    }
+    return traces;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-c us] [-r KB/s] [-h us] [-k KB] [trace...]\n"
+            "  -c  drive time per read command (default 1000us)\n"
+            "  -r  drive transfer rate (default 1000KB/s)\n"
+            "  -h  host time to take a sector out of the FIFO (default 500us)\n"
+            "  -k  fragment size (default 32KB)\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    std::vector<Trace> traces;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            command_us = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            sector_us = 500000.0 / atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-h") && i + 1 < argc) {
+            host_us = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+            fragment_bytes = strtoul(argv[++i], NULL, 0) * 1024;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            Trace trace;
+            if (!load_trace(argv[i], &trace)) {
+                return 1;
+            }
+            traces.push_back(trace);
+        }
+    }
+    if (!(sector_us > 0) || fragment_bytes < 512 || fragment_bytes % 512) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (traces.empty()) {
+        traces = synthesize();
+    }
+
+    printf("%-10s %-4s %8s %10s %10s %8s %8s %8s %8s %8s\n", "trace", "img", "sectors", "uncached", "cached",
+           "hits", "misses", "reads", "sec/read", "direct");
+    static const uint32_t sector_sizes[] = {COOKED_SECTOR_SIZE, RAW_SECTOR_SIZE};
+    for (const Trace &trace : traces) {
+        uint32_t sectors = 0;
+        for (const Read &r : trace.reads) {
+            sectors += r.count;
+        }
+        for (uint32_t size : sector_sizes) {
+            set_layout(size);
+            cdrom_cache_stats_t stats;
+            const double uncached_us = run_uncached(trace);
+            const double cached_us = run_cached(trace, &stats);
+            const double kb = sectors * 2.0;
+            printf("%-10s %-4s %8u %7.0fKB/s %7.0fKB/s %8u %8u %8u %8.1f %8u\n", trace.name.c_str(),
+                   size == RAW_SECTOR_SIZE ? "bin" : "iso", sectors, kb * 1e6 / uncached_us, kb * 1e6 / cached_us,
+                   stats.hits, stats.misses, stats.reads, stats.reads ? (double)stats.read_sectors / stats.reads : 0.0,
+                   stats.direct);
+        }
+    }
+    return 0;
+}
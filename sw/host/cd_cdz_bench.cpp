@@ -0,0 +1,253 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side measurement of compressed CD images (cdrom/cdrom_image_cdz.c).
+//
+// Puts an image and the .cdz made from it on a FAT volume in memory (fat_volume.cpp), read by
+// FatFS over a simulated USB drive in virtual time: each drive read takes a fixed time per command
+// plus a time per drive sector, at each of a set of transfer rates. Decoding is charged at a fixed
+// rate per decoded byte, standing in for core 1. Both images are read through the backend at random
+// a sector at a time, as the firmware reads a sector it has no line for, and for each rate it
+// reports the CD sectors per second read from each and the drive bytes each sector cost. Every
+// sector of the .cdz is checked against the image.
+//
+// Sequential reads go through the cache in the firmware, which reads a plain image ahead off the
+// drive without waiting but a .cdz a line at a time through FatFS, so they are compared with
+// cd_mke_bench -z instead, through cdrom_read_data.
+//
+// With no image given, a 32MB ISO is made up of runs of text, tables of small numbers, zeros and
+// random bytes, as stand-ins for the files, padding and compressed media of a game's CD.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "cdrom_image_backend.h"
+#include "cdrom_image_cdz.h"
+}
+#include "cdz_encode.h"
+#include "fat_volume.h"
+
+// Simulation parameters
+static double decode_us_per_byte = 1.0 / 20;  // 20MB/s
+static uint32_t hunk_sectors = 8;
+static uint32_t seeks = 2000;
+
+static std::vector<uint8_t> synthesize(uint32_t bytes) {
+    static const char *const words[] = {"the", "data", "level", "sound", "sprite", "player", "music", "error",
+                                        "file", "load", "save", "game", "map", "enemy", "score", "door"};
+    std::mt19937 rng(1);
+    std::vector<uint8_t> image(bytes);
+    for (uint32_t pos = 0; pos < bytes;) {
+        const uint32_t len = std::min<uint32_t>(bytes - pos, 16384 + rng() % (2 << 20));
+        const uint32_t kind = rng() % 20;
+        uint8_t *p = &image[pos];
+        if (kind < 5) {
+            // Text
+            for (uint32_t i = 0; i < len;) {
+                const char *w = words[rng() % 16];
+                for (; *w && i < len; ++w) {
+                    p[i++] = *w;
+                }
+                if (i < len) {
+                    p[i++] = rng() % 8 ? ' ' : '\n';
+                }
+            }
+        } else if (kind < 10) {
+            // Tables of small numbers
+            for (uint32_t i = 0; i < len; ++i) {
+                p[i] = i % 4 < 2 ? (uint8_t)(rng() % 16) : 0;
+            }
+        } else if (kind < 13) {
+            // Padding: already zero
+        } else {
+            // Compressed audio and video
+            for (uint32_t i = 0; i < len; ++i) {
+                p[i] = (uint8_t)rng();
+            }
+        }
+        pos += len;
+    }
+    return image;
+}
+
+struct Result {
+    double us = 0;
+    uint64_t drive_sectors = 0;
+    uint32_t sectors = 0;
+};
+
+// Times a read through img, adding it to r
+template <typename F> static void timed(Result &r, uint32_t sectors, F read) {
+    cdz_stats_t before, after;
+    cdz_stats_get(&before);
+    const double start = fat_drive.now;
+    const uint64_t start_sectors = fat_drive.sectors;
+    if (!read()) {
+        fprintf(stderr, "read failed\n");
+        exit(1);
+    }
+    cdz_stats_get(&after);
+    r.us += fat_drive.now - start + (after.bytes_decoded - before.bytes_decoded) * decode_us_per_byte;
+    r.drive_sectors += fat_drive.sectors - start_sectors;
+    r.sectors += sectors;
+}
+
+static cd_img_t *open_image(const char *name) {
+    cd_img_t *img = (cd_img_t *)calloc(1, sizeof(cd_img_t));
+    if (!cdi_set_device(img, name)) {
+        fprintf(stderr, "opening %s failed\n", name);
+        exit(1);
+    }
+    return img;
+}
+
+static void report(const char *rate, const char *name, const Result &rnd) {
+    printf("%8s %-5s %10.0f %10.0f\n", rate, name, rnd.sectors * 1e6 / rnd.us, rnd.drive_sectors * 512.0 / rnd.sectors);
+}
+
+static void run(double kbps) {
+    fat_drive.sector_us = 500000.0 / kbps;
+    cd_img_t *plain = open_image("GAME.ISO");
+    cd_img_t *cdz = open_image("GAME.CDZ");
+    const uint32_t sectors = plain->tracks[0].length;
+    if (cdz->tracks[0].length != sectors || cdz->tracks[0].sector_size != plain->tracks[0].sector_size) {
+        fprintf(stderr, "the .cdz doesn't load as the image does\n");
+        exit(1);
+    }
+
+    Result rnd[2];
+    std::vector<uint8_t> a(16 * COOKED_SECTOR_SIZE), b(16 * COOKED_SECTOR_SIZE);
+    for (uint32_t lba = 0; lba < sectors; lba += 16) {
+        const uint32_t n = std::min(16u, sectors - lba);
+        if (!cdi_read_sectors(plain, a.data(), 0, lba, n) || !cdi_read_sectors(cdz, b.data(), 0, lba, n)
+            || memcmp(a.data(), b.data(), n * COOKED_SECTOR_SIZE)) {
+            fprintf(stderr, "sectors from %u differ\n", lba);
+            exit(1);
+        }
+    }
+    std::mt19937 rng(2);
+    for (uint32_t i = 0; i < seeks; ++i) {
+        const uint32_t lba = rng() % sectors;
+        timed(rnd[0], 1, [&] { return cdi_read_sector(plain, a.data(), 0, lba); });
+        timed(rnd[1], 1, [&] { return cdi_read_sector(cdz, b.data(), 0, lba); });
+        if (memcmp(a.data(), b.data(), COOKED_SECTOR_SIZE)) {
+            fprintf(stderr, "sector %u differs\n", lba);
+            exit(1);
+        }
+    }
+    cdi_close(plain);
+    cdi_close(cdz);
+
+    char rate[16];
+    snprintf(rate, sizeof(rate), "%.0fKB/s", kbps);
+    report(rate, "image", rnd[0]);
+    report("", "cdz", rnd[1]);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-c us] [-r KB/s,...] [-d MB/s] [-s sectors] [-n seeks] [-m MB] [image]\n"
+            "  -c  drive time per read command (default 1000us)\n"
+            "  -r  drive transfer rates (default 250,500,1000)\n"
+            "  -d  decoding rate (default 20MB/s)\n"
+            "  -s  sectors per hunk (default 8)\n"
+            "  -n  random sector reads (default 2000)\n"
+            "  -m  MB of the image to use (default 64)\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    std::vector<double> rates;
+    const char *path = NULL;
+    uint32_t limit_mb = 64;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            fat_drive.command_us = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            for (char *s = argv[++i]; *s; s += *s == ',') {
+                rates.push_back(strtod(s, &s));
+                if (!(rates.back() > 0) || (*s && *s != ',')) {
+                    usage(argv[0]);
+                    return 1;
+                }
+            }
+        } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            decode_us_per_byte = 1.0 / atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            hunk_sectors = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            seeks = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            limit_mb = strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-' || path) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (rates.empty()) {
+        rates = {250, 500, 1000};
+    }
+
+    std::vector<uint8_t> image;
+    uint32_t sector_bytes = COOKED_SECTOR_SIZE;
+    if (path) {
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            perror(path);
+            return 1;
+        }
+        image.resize((size_t)limit_mb << 20);
+        image.resize(fread(image.data(), 1, image.size(), f));
+        fclose(f);
+        // A raw image has the sync pattern at the start of its first sector
+        static const uint8_t sync[12] = {0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0};
+        if (image.size() >= sizeof(sync) && !memcmp(image.data(), sync, sizeof(sync))) {
+            sector_bytes = RAW_SECTOR_SIZE;
+        }
+        image.resize(image.size() / sector_bytes * sector_bytes);
+    } else {
+        image = synthesize(32 << 20);
+    }
+    if (!(decode_us_per_byte > 0) || !seeks || !hunk_sectors || hunk_sectors * sector_bytes > CDZ_HUNK_MAX_BYTES
+        || image.size() < 32 * sector_bytes) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const std::vector<uint8_t> cdz = cdz_build(image.data(), (uint32_t)image.size(), hunk_sectors * sector_bytes);
+    static FATFS fs;
+    if (!fat_format_for(image.size() + cdz.size()) || !fat_add_file("GAME    ISO", image.data(), image.size())
+        || !fat_add_file("GAME    CDZ", cdz.data(), cdz.size()) || f_mount(&fs, "", 1) != FR_OK) {
+        fprintf(stderr, "making the volume failed\n");
+        return 1;
+    }
+    printf("%u sectors of %u bytes, in %u byte hunks compressed to %.1f%%\n", (uint32_t)(image.size() / sector_bytes),
+           sector_bytes, hunk_sectors * sector_bytes, 100.0 * cdz.size() / image.size());
+    printf("%8s %-5s %10s %10s\n", "USB", "file", "rnd sec/s", "rnd B/sec");
+    for (double kbps : rates) {
+        run(kbps);
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side measurement of the extent map in cdrom/cdrom_image_backend.c.
+//
+// Formats a FAT16 volume in memory (fat_volume.cpp) holding an ISO image split into a given number of fragments,
+// scattered over the volume out of order, and mounts it with FatFS over a simulated USB drive
+// in virtual time: each drive read takes a fixed time per command plus a time per drive sector.
+// For each fragment count it opens the image as the firmware does and times random single
+// sector seeks through cdi_read_sector(), which reads straight off the drive through the extent
+// map, against f_lseek() and f_read() as the backend used them before: with a 32 entry fast seek
+// table when the file fits one, and walking the FAT otherwise. Every sector read is checked
+// against the image, and the whole image is read through once sequentially.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "cdrom_image_backend.h"
+}
+
+#include "fat_volume.h"
+
+// Simulation parameters
+static uint32_t seeks = 2000;
+
+// A 16MB image on a 32MB volume of 2KB clusters
+static constexpr uint32_t VOLUME_SECTORS = 65536;
+static constexpr uint32_t CLUSTER_SECTORS = 4;
+static constexpr uint32_t IMAGE_SECTORS = 8192;
+static constexpr uint32_t IMAGE_CLUSTERS = IMAGE_SECTORS * COOKED_SECTOR_SIZE / (CLUSTER_SECTORS * 512);
+
+static uint8_t image_byte(uint32_t offset) {
+    const uint32_t x = offset * 2654435761u;
+    return (uint8_t)(x >> 24 ^ offset >> 11);
+}
+
+static void image_data(uint8_t *buff, uint32_t offset, uint32_t bytes, void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < bytes; ++i) {
+        buff[i] = image_byte(offset + i);
+    }
+}
+
+// Formats the volume with GAME.ISO on it in fragments pieces, out of order
+static void format(uint32_t fragments, uint32_t seed) {
+    if (!fat_format(VOLUME_SECTORS, CLUSTER_SECTORS)
+        || !fat_add_file("GAME    ISO", IMAGE_SECTORS * COOKED_SECTOR_SIZE, fragments, seed, image_data, NULL)) {
+        fprintf(stderr, "%u fragments don't fit on the volume\n", fragments);
+        exit(1);
+    }
+}
+
+struct Result {
+    double total_us;
+    double max_us;
+    uint32_t reads;
+};
+
+static void check(const uint8_t *buff, uint32_t lba, uint32_t count, const char *path) {
+    for (uint32_t i = 0; i < count * COOKED_SECTOR_SIZE; ++i) {
+        if (buff[i] != image_byte(lba * COOKED_SECTOR_SIZE + i)) {
+            fprintf(stderr, "%s: sector %u differs from the image at byte %u\n", path, lba + i / COOKED_SECTOR_SIZE,
+                    i % COOKED_SECTOR_SIZE);
+            exit(1);
+        }
+    }
+}
+
+template <typename F> static Result time_seeks(const std::vector<uint32_t> &lbas, F read) {
+    Result r = {0, 0, 0};
+    uint8_t buff[COOKED_SECTOR_SIZE];
+    for (uint32_t lba : lbas) {
+        const double start = fat_drive.now;
+        const uint32_t start_reads = fat_drive.reads;
+        read(buff, lba);
+        r.total_us += fat_drive.now - start;
+        r.max_us = std::max(r.max_us, fat_drive.now - start);
+        r.reads += fat_drive.reads - start_reads;
+    }
+    return r;
+}
+
+static void run(uint32_t fragments) {
+    format(fragments, fragments);
+    static FATFS fs;
+    if (f_mount(&fs, "", 1) != FR_OK) {
+        fprintf(stderr, "mount failed\n");
+        exit(1);
+    }
+
+    std::mt19937 rng(1);
+    std::vector<uint32_t> lbas(seeks);
+    for (uint32_t &lba : lbas) {
+        lba = rng() % IMAGE_SECTORS;
+    }
+
+    // Through the extent map, opened as the firmware opens an image
+    cd_img_t *img = (cd_img_t *)calloc(1, sizeof(cd_img_t));
+    fat_drive.reads = 0;
+    fat_drive.now = 0;
+    if (!cdi_set_device(img, "GAME.ISO")) {
+        fprintf(stderr, "opening the image failed\n");
+        exit(1);
+    }
+    const uint32_t open_reads = fat_drive.reads;
+    const double open_us = fat_drive.now;
+    const track_file_t *tf = img->tracks[0].file;
+    const Result mapped = time_seeks(lbas, [&](uint8_t *buff, uint32_t lba) {
+        if (!cdi_read_sector(img, buff, 0, lba)) {
+            fprintf(stderr, "cdi_read_sector(%u) failed\n", lba);
+            exit(1);
+        }
+        check(buff, lba, 1, "map");
+    });
+    // Through the whole image in 16 sector reads, across every fragment
+    std::vector<uint8_t> buff(16 * COOKED_SECTOR_SIZE);
+    fat_drive.now = 0;
+    for (uint32_t lba = 0; lba < IMAGE_SECTORS; lba += 16) {
+        if (!cdi_read_sectors(img, buff.data(), 0, lba, 16)) {
+            fprintf(stderr, "cdi_read_sectors(%u) failed\n", lba);
+            exit(1);
+        }
+        check(buff.data(), lba, 16, "map");
+    }
+    const double sequential_us = fat_drive.now;
+    const bool is_mapped = tf->extents != NULL;
+    cdi_close(img);
+
+    // Through FatFS as before, with the fast seek table if the file fits it
+    FIL fp;
+    DWORD clmt[32];
+    if (f_open(&fp, "GAME.ISO", FA_READ) != FR_OK) {
+        fprintf(stderr, "f_open failed\n");
+        exit(1);
+    }
+    fp.cltbl = clmt;
+    clmt[0] = sizeof(clmt) / sizeof(clmt[0]);
+    const bool fast_seek = f_lseek(&fp, CREATE_LINKMAP) == FR_OK;
+    if (!fast_seek) {
+        fp.cltbl = NULL;
+    }
+    const Result fatfs = time_seeks(lbas, [&](uint8_t *buff, uint32_t lba) {
+        UINT bytes_read;
+        if (f_lseek(&fp, lba * COOKED_SECTOR_SIZE) != FR_OK
+            || f_read(&fp, buff, COOKED_SECTOR_SIZE, &bytes_read) != FR_OK || bytes_read != COOKED_SECTOR_SIZE) {
+            fprintf(stderr, "f_read(%u) failed\n", lba);
+            exit(1);
+        }
+        check(buff, lba, 1, "FatFS");
+    });
+    f_close(&fp);
+    f_mount(NULL, "", 0);
+
+    printf("%9u %6s %5u %7.1fms | %-9s %8.0fus %7.0fus %6.2f | %8.0fus %7.0fus %6.2f %7.0fKB/s\n", fragments,
+           is_mapped ? "yes" : "no", open_reads, open_us / 1000, fast_seek ? "fast seek" : "FAT walk",
+           fatfs.total_us / seeks, fatfs.max_us, (double)fatfs.reads / seeks, mapped.total_us / seeks,
+           mapped.max_us, (double)mapped.reads / seeks, IMAGE_SECTORS * 2.0 * 1e6 / sequential_us);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-c us] [-r KB/s] [-n seeks] [fragments...]\n"
+            "  -c  drive time per read command (default 1000us)\n"
+            "  -r  drive transfer rate (default 1000KB/s)\n"
+            "  -n  random seeks timed per image (default 2000)\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    std::vector<uint32_t> counts;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            fat_drive.command_us = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            fat_drive.sector_us = 500000.0 / atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            seeks = strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            counts.push_back(strtoul(argv[i], NULL, 0));
+        }
+    }
+    if (!(fat_drive.sector_us > 0) || !seeks) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (counts.empty()) {
+        counts = {1, 8, 32, 256, CD_EXTENTS_MAX, CD_EXTENTS_MAX + 500};
+    }
+    for (uint32_t n : counts) {
+        if (!n || n > IMAGE_CLUSTERS) {
+            fprintf(stderr, "fragments must be from 1 to %u\n", IMAGE_CLUSTERS);
+            return 1;
+        }
+    }
+
+    printf("%9s %6s %5s %9s | %-9s %10s %9s %6s | %10s %9s %6s %11s\n", "fragments", "mapped", "open", "open time",
+           "before", "avg seek", "max seek", "reads", "avg seek", "max seek", "reads", "sequential");
+    for (uint32_t n : counts) {
+        run(n);
+    }
+    return 0;
+}
@@ -0,0 +1,729 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side harness for the whole CD-ROM drive: mke/mke.c, cdrom/ and FatFS, as the firmware
+// builds them, reading a FAT volume (fat_volume.cpp) off a simulated USB drive in virtual time.
+//
+// Three things run in turn, each on its own clock:
+// - The host's driver, as a queue of port accesses to the MKE interface that each take the time
+//   of an ISA cycle: command bytes written, the status port polled until data or a response is
+//   ready, then the data or response read out a byte at a time.
+// - Core 1's loop: cdrom_audio_callback() and cdrom_tasks(), taking a fixed time per pass plus
+//   the time any drive read it waits for and any .cdz hunk it decodes take. The drive completes
+//   queued reads from msc_app_task() as tuh_task() does.
+// - The mixer, taking a frame of CD audio from the ring every 1/44100s.
+// Core 1's clock leads. Before each pass, and while it waits on the drive, the host and mixer are
+// run up to its time, so they see what core 1 has done only once it has done it.
+//
+// Each scenario is a sequence of MKE commands, and reports the commands and sectors a second they
+// ran at, the times the host read an empty FIFO and the frames the mixer found no audio for. Unless
+// a FAT image file is given, the volume holds a cue sheet and BIN of a data track and audio
+// tracks, optionally with the data track as an ISO and a .cdz too, and every data byte the host
+// reads and every audio frame the mixer plays is checked.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "cdrom.h"
+#include "cdrom_cache.h"
+#include "cdrom_image_cdz.h"
+#include "cdrom_image_manager.h"
+#include "ff.h"
+#include "mke/mke.h"
+}
+#include "cdz_encode.h"
+#include "fat_volume.h"
+#include "system/flash_settings.h"
+
+extern "C" void MKE_WRITE(uint16_t address, uint8_t value);
+extern "C" uint8_t MKE_READ(uint16_t address);
+extern "C" void mke_init();
+
+cdrom_t cdrom;
+Settings settings;
+
+// Simulation parameters
+static double isa_us = 1;
+static double loop_us = 5;
+static double decode_us_per_byte = 1.0 / 20;  // 20MB/s
+static uint32_t read_sectors = 16;
+static uint32_t repeats = 0;  // 0 for each scenario's own
+static double play_seconds = 10;
+static double wait_limit_us = 2000000;
+
+static constexpr double FRAME_US = 1e6 / 44100;
+
+// The generated image
+static uint32_t data_sectors = 10000;
+static uint32_t audio_tracks = 4;
+static uint32_t audio_track_sectors = 1500;  // 20s
+static bool verify = true;
+// Sectors per hunk of the .cdz of the data track, 0 for none
+static uint32_t cdz_hunk = 0;
+
+static uint32_t image_sectors() {
+    return data_sectors + audio_tracks * audio_track_sectors;
+}
+
+// A data sector is random bytes, a repeated phrase or zeros, so that a .cdz of the data track
+// compresses as a game's data might. The others start with their LBA, to tell them apart.
+static uint8_t data_byte(uint32_t lba, uint32_t i) {
+    static const char phrase[] = "the player loads the level data and sprite map ";
+    const uint32_t kind = lba * 2654435761u >> 30;
+    if (kind < 2) {
+        const uint32_t x = (lba * 2048 + i) * 2654435761u;
+        return (uint8_t)(x >> 24);
+    } else if (i < 4) {
+        return (uint8_t)(lba >> (i * 8));
+    }
+    return kind == 2 ? phrase[(lba + i) % (sizeof(phrase) - 1)] : 0;
+}
+
+static void msf(uint32_t lba, uint8_t *m, uint8_t *s, uint8_t *f) {
+    const uint32_t frames = lba + 150;
+    *m = frames / 75 / 60;
+    *s = frames / 75 % 60;
+    *f = frames % 75;
+}
+
+static uint8_t bcd(uint32_t x) {
+    return (uint8_t)(x / 10 << 4 | x % 10);
+}
+
+// A tone for each track; frame counts stereo frames from the start of the disc
+static int16_t audio_sample(uint32_t frame) {
+    const uint32_t period = 20 + (frame / (SAMPLES_PER_SECTOR / 2) - data_sectors) / audio_track_sectors * 10;
+    return (int16_t)(frame % period * 1000);
+}
+
+static void raw_sector(uint32_t lba, uint8_t *out) {
+    if (lba < data_sectors) {
+        static const uint8_t sync[12] = {0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0};
+        memcpy(out, sync, sizeof(sync));
+        uint8_t m, s, f;
+        msf(lba, &m, &s, &f);
+        out[12] = bcd(m);
+        out[13] = bcd(s);
+        out[14] = bcd(f);
+        out[15] = 1;
+        for (uint32_t i = 0; i < 2048; ++i) {
+            out[16 + i] = data_byte(lba, i);
+        }
+        memset(out + 16 + 2048, 0, RAW_SECTOR_SIZE - 16 - 2048);
+    } else {
+        int16_t *samples = (int16_t *)out;
+        for (uint32_t i = 0; i < SAMPLES_PER_SECTOR; i += 2) {
+            samples[i] = samples[i + 1] = audio_sample(lba * SAMPLES_PER_SECTOR / 2 + i / 2);
+        }
+    }
+}
+
+static void bin_data(uint8_t *buff, uint32_t offset, uint32_t bytes, void *arg) {
+    (void)arg;
+    uint8_t sector[RAW_SECTOR_SIZE];
+    while (bytes) {
+        const uint32_t skip = offset % RAW_SECTOR_SIZE;
+        const uint32_t n = std::min(bytes, RAW_SECTOR_SIZE - skip);
+        raw_sector(offset / RAW_SECTOR_SIZE, sector);
+        memcpy(buff, sector + skip, n);
+        buff += n;
+        offset += n;
+        bytes -= n;
+    }
+}
+
+static std::string cue_sheet() {
+    std::string cue = "FILE \"GAME.BIN\" BINARY\r\n  TRACK 01 MODE1/2352\r\n    INDEX 01 00:00:00\r\n";
+    for (uint32_t t = 0; t < audio_tracks; ++t) {
+        const uint32_t start = data_sectors + t * audio_track_sectors;
+        char line[96];
+        snprintf(line, sizeof(line), "  TRACK %02u AUDIO\r\n    INDEX 01 %02u:%02u:%02u\r\n", t + 2, start / 75 / 60,
+                 start / 75 % 60, start % 75);
+        cue += line;
+    }
+    return cue;
+}
+
+static bool make_volume(uint32_t fragments, uint32_t extra_images) {
+    const uint64_t bin_bytes = (uint64_t)image_sectors() * RAW_SECTOR_SIZE;
+    const std::string cue = cue_sheet();
+    // The data track on its own, as an ISO and the .cdz made from it
+    std::vector<uint8_t> iso, cdz;
+    if (cdz_hunk) {
+        iso.resize((size_t)data_sectors * COOKED_SECTOR_SIZE);
+        for (uint32_t lba = 0; lba < data_sectors; ++lba) {
+            for (uint32_t i = 0; i < COOKED_SECTOR_SIZE; ++i) {
+                iso[(size_t)lba * COOKED_SECTOR_SIZE + i] = data_byte(lba, i);
+            }
+        }
+        cdz = cdz_build(iso.data(), (uint32_t)iso.size(), cdz_hunk * COOKED_SECTOR_SIZE);
+    }
+    if (bin_bytes > UINT32_MAX || !fat_format_for(bin_bytes + iso.size() + cdz.size())
+        || !fat_add_file("GAME    CUE", (const uint8_t *)cue.data(), cue.size())
+        || !fat_add_file("GAME    BIN", (uint32_t)bin_bytes, fragments, 1, bin_data, NULL)) {
+        return false;
+    }
+    if (cdz_hunk && (!fat_add_file("GAME    ISO", iso.data(), iso.size())
+                     || !fat_add_file("GAME    CDZ", cdz.data(), cdz.size()))) {
+        return false;
+    }
+    // Other images on the drive, to be listed
+    for (uint32_t i = 0; i < extra_images; ++i) {
+        char name[12];
+        snprintf(name, sizeof(name), "DISC%04uISO", i);
+        if (!fat_add_file(name, NULL, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The host's driver
+
+struct HostOp {
+    enum Kind { WRITE, WAIT, READ_INFO, READ_DATA, DELAY, END } kind;
+    uint8_t value;   // Byte written, or status bits waited for
+    uint32_t count;  // Bytes read, or us of delay
+    uint32_t lba;    // Sector read
+};
+
+struct Counts {
+    uint32_t commands = 0;
+    uint32_t sectors = 0;
+    uint32_t data_underruns = 0;
+    uint32_t info_underruns = 0;
+    uint32_t timeouts = 0;
+    uint32_t bad_sectors = 0;
+    uint32_t audio_frames = 0;
+    uint32_t audio_dry = 0;
+    uint32_t bad_frames = 0;
+    uint64_t port_accesses = 0;
+    double port_ns = 0;  // Host CPU time in mke.c
+};
+
+static Counts counts;
+static std::deque<HostOp> host_ops;
+static double host_now;
+static double wait_start;
+static uint32_t data_pos;
+static uint8_t sector_buf[2048];
+
+// Next commands, queued by the scenario running once the host has done those before
+static bool (*scenario_next)(void);
+
+static uint8_t port_read(uint16_t port) {
+    const auto start = std::chrono::steady_clock::now();
+    const uint8_t value = MKE_READ(port);
+    counts.port_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    ++counts.port_accesses;
+    return value;
+}
+
+static void port_write(uint16_t port, uint8_t value) {
+    const auto start = std::chrono::steady_clock::now();
+    MKE_WRITE(port, value);
+    counts.port_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    ++counts.port_accesses;
+}
+
+static void command(std::initializer_list<uint8_t> bytes) {
+    uint8_t cmd[7] = {};
+    std::copy(bytes.begin(), bytes.end(), cmd);
+    for (uint8_t b : cmd) {
+        host_ops.push_back({HostOp::WRITE, b, 0, 0});
+    }
+}
+
+// Waits for the response, reads its bytes and the status after them
+static void response(uint32_t bytes) {
+    host_ops.push_back({HostOp::WAIT, 0x04, 0, 0});
+    host_ops.push_back({HostOp::READ_INFO, 0, bytes + 1, 0});
+    host_ops.push_back({HostOp::END, 0, 0, 0});
+}
+
+static void read_command(uint32_t lba, uint32_t count) {
+    uint8_t m, s, f;
+    msf(lba, &m, &s, &f);
+    command({CMD1_READ, m, s, f, 0, 0, (uint8_t)count});
+    for (uint32_t i = 0; i < count; ++i) {
+        host_ops.push_back({HostOp::WAIT, 0x02, 0, 0});
+        host_ops.push_back({HostOp::READ_DATA, 0, 2048, lba + i});
+    }
+    response(0);
+}
+
+// Does the host's next port access, returning false when it has nothing left to do
+static bool host_step() {
+    if (host_ops.empty() && !(scenario_next && scenario_next())) {
+        scenario_next = NULL;
+        return false;
+    }
+    HostOp &op = host_ops.front();
+    switch (op.kind) {
+    case HostOp::WRITE:
+        port_write(0, op.value);
+        host_ops.pop_front();
+        wait_start = host_now + isa_us;
+        break;
+    case HostOp::WAIT:
+        // Status bits are low when set
+        if (!(port_read(1) & op.value)) {
+            host_ops.pop_front();
+        } else if (host_now - wait_start > wait_limit_us) {
+            // Gives up on the command
+            ++counts.timeouts;
+            while (host_ops.front().kind != HostOp::END) {
+                host_ops.pop_front();
+            }
+        }
+        break;
+    case HostOp::READ_INFO:
+        counts.info_underruns += !cdrom_fifo_level(&cdrom.info_fifo);
+        port_read(0);
+        if (!--op.count) {
+            host_ops.pop_front();
+        }
+        break;
+    case HostOp::READ_DATA:
+        counts.data_underruns += !cdrom_fifo_level(&cdrom.data_fifo);
+        sector_buf[data_pos++] = port_read(2);
+        if (data_pos == op.count) {
+            data_pos = 0;
+            ++counts.sectors;
+            if (verify) {
+                for (uint32_t i = 0; i < 2048; ++i) {
+                    if (sector_buf[i] != data_byte(op.lba, i)) {
+                        ++counts.bad_sectors;
+                        break;
+                    }
+                }
+            }
+            host_ops.pop_front();
+            wait_start = host_now + isa_us;
+        }
+        break;
+    case HostOp::DELAY:
+        host_now += op.count;
+        host_ops.pop_front();
+        wait_start = host_now;
+        return true;
+    case HostOp::END:
+        ++counts.commands;
+        host_ops.pop_front();
+        wait_start = host_now;
+        return true;
+    }
+    host_now += isa_us;
+    return true;
+}
+
+static bool host_busy() {
+    return !host_ops.empty() || scenario_next;
+}
+
+static void host_run_until(double t) {
+    while (host_now <= t && host_step()) {
+    }
+}
+
+// The mixer, taking a frame at a time from the ring
+
+static double mixer_now;
+static bool audio_started;
+// Frame the mixer should take next
+static uint32_t audio_frame;
+
+static void mixer_run_until(double t) {
+    for (; mixer_now + FRAME_US <= t; mixer_now += FRAME_US) {
+        int16_t left, right;
+        if (cdrom_audio_ring_take_frame(&cdrom.audio_ring, &left, &right)) {
+            audio_started = true;
+            ++counts.audio_frames;
+            if (verify) {
+                const int16_t sample = audio_sample(audio_frame++);
+                if (left != sample || right != sample) {
+                    ++counts.bad_frames;
+                }
+            }
+        } else if (audio_started && cdrom.cd_status == CD_STATUS_PLAYING) {
+            ++counts.audio_dry;
+        }
+    }
+}
+
+// Runs the others up to t, before core 1 goes on or while it waits on the drive until t
+static void others_run_until(double t) {
+    mixer_run_until(t);
+    host_run_until(t);
+}
+
+// A pass of core 1's loop, as play_adlib() makes with a CD-ROM, and any .cdz hunks it decoded
+static void core1_pass() {
+    cdz_stats_t before, after;
+    others_run_until(fat_drive.now);
+    cdz_stats_get(&before);
+    cdrom_audio_callback(&cdrom);
+    cdrom_tasks(&cdrom);
+    cdz_stats_get(&after);
+    fat_drive.now += loop_us + (after.bytes_decoded - before.bytes_decoded) * decode_us_per_byte;
+}
+
+// Has core 1 carry out an image command from the control port, returning the wall clock time it
+// took
+static double image_command(cdrom_image_command_t cmd) {
+    const auto start = std::chrono::steady_clock::now();
+    cdrom.image_command = cmd;
+    while (cdrom.image_command != CD_COMMAND_NONE) {
+        core1_pass();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Scenarios
+
+static std::string image_name = "GAME.CUE";
+static FILE *out;
+static std::mt19937 rng(1);
+static uint32_t remaining;
+static uint32_t next_lba;
+static uint32_t first_track, last_track;
+
+static uint32_t count_or(uint32_t n) {
+    return repeats ? repeats : n;
+}
+
+static bool status_next() {
+    if (!remaining) {
+        return false;
+    }
+    --remaining;
+    command({CMD1_STATUS});
+    response(0);
+    return true;
+}
+
+static bool toc_next() {
+    if (!remaining) {
+        return false;
+    }
+    --remaining;
+    command({CMD1_DISKINFO});
+    response(6);
+    for (uint32_t t = first_track; t <= last_track; ++t) {
+        command({CMD1_READTOC, 0, (uint8_t)t});
+        response(8);
+    }
+    return true;
+}
+
+static uint32_t data_track_sectors() {
+    return cdrom.cdrom_capacity ? std::min<uint32_t>(cdrom.cdrom_capacity, verify ? data_sectors : UINT32_MAX)
+                                : data_sectors;
+}
+
+static bool seq_next() {
+    if (!remaining) {
+        return false;
+    }
+    const uint32_t n = std::min(read_sectors, data_track_sectors() - next_lba);
+    read_command(next_lba, n);
+    next_lba += n;
+    if (next_lba == data_track_sectors()) {
+        next_lba = 0;
+    }
+    remaining -= std::min(remaining, n);
+    return true;
+}
+
+static bool random_next() {
+    if (!remaining) {
+        return false;
+    }
+    --remaining;
+    const uint32_t lba = rng() % data_track_sectors();
+    uint8_t m, s, f;
+    msf(lba, &m, &s, &f);
+    command({CMD1_SEEK, m, s, f});
+    response(0);
+    read_command(lba, 1);
+    return true;
+}
+
+// Plays the first audio track, asking where it has got to every 100ms as CD players do
+static bool play_next() {
+    if (!remaining) {
+        return false;
+    }
+    if (remaining == UINT32_MAX) {
+        // From the start of the second track to the lead-out, in the absolute MSF of the TOC
+        track_info_t from, to;
+        cdrom.ops->get_track_info(&cdrom, first_track + 1, 0, &from);
+        cdrom.ops->get_track_info(&cdrom, last_track + 1, 0, &to);
+        audio_started = false;
+        audio_frame = data_sectors * SAMPLES_PER_SECTOR / 2;
+        command({CMD1_PLAY_MSF, from.m, from.s, from.f, to.m, to.s, to.f});
+        response(0);
+        remaining = (uint32_t)(play_seconds * 10);
+        return true;
+    }
+    if (--remaining) {
+        host_ops.push_back({HostOp::DELAY, 0, 100000, 0});
+        command({CMD1_READSUBQ});
+        response(11);
+    } else {
+        command({CMD1_PAUSERESUME, 0});
+        response(0);
+    }
+    return true;
+}
+
+static void report(const char *name, double start) {
+    const double s = (host_now - start) / 1e6;
+    fprintf(out, "%-7s %8.2fs %9.0f %9.0f %7u %7u %7u %8u %7.0f", name, s, counts.commands / s, counts.sectors / s,
+            counts.data_underruns, counts.info_underruns, counts.timeouts, counts.audio_dry,
+            counts.port_accesses ? counts.port_ns / counts.port_accesses : 0.0);
+    if (counts.bad_sectors) {
+        fprintf(out, "  %u BAD SECTORS", counts.bad_sectors);
+    }
+    if (counts.bad_frames) {
+        fprintf(out, "  %u BAD FRAMES", counts.bad_frames);
+    }
+    fprintf(out, "\n");
+}
+
+static void run(const char *name, bool (*next)(void), uint32_t n) {
+    counts = Counts();
+    remaining = n;
+    next_lba = 0;
+    scenario_next = next;
+    const double start = host_now = mixer_now = fat_drive.now;
+    while (host_busy()) {
+        core1_pass();
+    }
+    report(name, start);
+}
+
+// Reloads the image: the control port's eject then load, as pgusinit -cdload does
+static void run_load(uint32_t n) {
+    const double start = fat_drive.now;
+    const uint32_t reads = fat_drive.reads;
+    double wall_ms = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        cdrom.image_path[0] = 0;
+        image_command(CD_COMMAND_IMAGE_LOAD);
+        strcpy(cdrom.image_path, image_name.c_str());
+        wall_ms += image_command(CD_COMMAND_IMAGE_LOAD);
+    }
+    fprintf(out, "load    %8.2fs  %u loads, each %.1fms with %.1f drive reads, and %.2fms of host CPU time\n",
+            (fat_drive.now - start) / 1e6, n, (fat_drive.now - start) / 1000 / n, (double)(fat_drive.reads - reads) / n,
+            wall_ms / n);
+}
+
+// Lists the images as pgusinit -cdlist does, charging each control port access its ISA time. The
+// first list reads the directory as it would after the drive is mounted.
+static void run_list(uint32_t n) {
+    cdman_catalog_invalidate();
+    const double start = fat_drive.now;
+    const uint32_t reads = fat_drive.reads;
+    double first_ms = 0, wall_ms = 0, isa_ms = 0;
+    int images = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        wall_ms += image_command(CD_COMMAND_IMAGE_LIST);
+        if (!i) {
+            first_ms = (fat_drive.now - start) / 1000;
+        }
+        images = cdman_image_count();
+        // Selecting the list, status, count and list again, the count's two bytes, each name and EOT
+        uint32_t accesses = 4 * 2 + 2 + 1;
+        for (int j = 0; j < images; ++j) {
+            accesses += strlen(cdman_image_name(j)) + 1;
+        }
+        isa_ms += accesses * isa_us / 1000;
+    }
+    fprintf(out,
+            "list    %8.2fs  %u lists of %d images, the first %.1fms with %u drive reads, each %.2fms of host CPU "
+            "time and %.1fms of port accesses\n",
+            (fat_drive.now - start) / 1e6, n, images, first_ms, fat_drive.reads - reads, wall_ms / n, isa_ms / n);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [options] [scenario...]\n"
+            "Scenarios: load list status toc seq random play (default all)\n"
+            "  -c us       drive time per read command (default 1000)\n"
+            "  -r KB/s     drive transfer rate (default 1000)\n"
+            "  -s n:us     every nth drive read takes us longer\n"
+            "  -a us       time per ISA port access (default 1)\n"
+            "  -o us       time per pass of core 1's loop (default 5)\n"
+            "  -d MB/s     rate core 1 decodes .cdz hunks at (default 20)\n"
+            "  -n sectors  sectors per read command (default 16)\n"
+            "  -N count    commands, sectors or loads in each scenario\n"
+            "  -p seconds  time to play audio for (default 10)\n"
+            "  -t tracks   audio tracks in the generated image (default 4)\n"
+            "  -k n        fragments of the generated BIN (default 1)\n"
+            "  -e n        other images on the generated volume, to list (default 0)\n"
+            "  -z sectors  add the data track as GAME.ISO and GAME.CDZ, in hunks of sectors\n"
+            "  -w file     write the generated volume to file\n"
+            "  -f file     use the FAT volume in file instead\n"
+            "  -l name     image to load from it (default GAME.CUE)\n"
+            "  -v          show the firmware's output\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    const char *load_path = NULL, *save_path = NULL;
+    uint32_t fragments = 1, extra_images = 0;
+    bool verbose = false;
+    std::vector<std::string> scenarios;
+    for (int i = 1; i < argc; ++i) {
+        const bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "-c") && more) {
+            fat_drive.command_us = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && more) {
+            fat_drive.sector_us = 500000.0 / atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && more) {
+            char *end;
+            fat_drive.stall_every = strtoul(argv[++i], &end, 0);
+            fat_drive.stall_us = *end == ':' ? atof(end + 1) : 0;
+        } else if (!strcmp(argv[i], "-a") && more) {
+            isa_us = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && more) {
+            loop_us = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-d") && more) {
+            decode_us_per_byte = 1.0 / atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && more) {
+            read_sectors = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-N") && more) {
+            repeats = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-p") && more) {
+            play_seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && more) {
+            audio_tracks = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-k") && more) {
+            fragments = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-e") && more) {
+            extra_images = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-z") && more) {
+            cdz_hunk = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-w") && more) {
+            save_path = argv[++i];
+        } else if (!strcmp(argv[i], "-f") && more) {
+            load_path = argv[++i];
+        } else if (!strcmp(argv[i], "-l") && more) {
+            image_name = argv[++i];
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            scenarios.push_back(argv[i]);
+        }
+    }
+    if (!(isa_us > 0) || !(loop_us > 0) || !(decode_us_per_byte > 0) || !read_sectors || read_sectors > 255 || audio_tracks > 98
+        || cdz_hunk * COOKED_SECTOR_SIZE > CDZ_HUNK_MAX_BYTES) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (scenarios.empty()) {
+        scenarios = {"load", "list", "status", "toc", "seq", "random", "play"};
+    }
+
+    if (load_path) {
+        verify = false;
+        if (!fat_load(load_path)) {
+            perror(load_path);
+            return 1;
+        }
+    } else if (!make_volume(fragments, extra_images)) {
+        fprintf(stderr, "making the volume failed\n");
+        return 1;
+    }
+    if (save_path && !fat_save(save_path)) {
+        perror(save_path);
+        return 1;
+    }
+
+    // The firmware's output goes to stdout, so the report goes to what stdout was
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    setvbuf(out, NULL, _IOLBF, 0);
+    if (!verbose) {
+        freopen("/dev/null", "w", stdout);
+    }
+
+    settings.Volume.mainVol = 100;
+    settings.Volume.cdVol = 100;
+    fat_drive.wait = others_run_until;
+    cdrom_global_init();
+    mke_init();
+    static FATFS fs;
+    if (f_mount(&fs, "", 1) != FR_OK) {
+        fprintf(stderr, "mounting the volume failed\n");
+        return 1;
+    }
+    strcpy(cdrom.image_path, image_name.c_str());
+    const double load_ms = image_command(CD_COMMAND_IMAGE_LOAD);
+    if (!cdrom.disk_loaded) {
+        fprintf(stderr, "loading %s failed: %s\n", image_name.c_str(), cdrom.error_str);
+        return 1;
+    }
+    int first, last;
+    cdrom.ops->get_tracks(&cdrom, &first, &last);
+    first_track = first;
+    last_track = last;
+    fprintf(out, "%s: %u tracks, %u sectors, loaded in %.1fms (%u drive reads, %.2fms of host CPU time)\n",
+            image_name.c_str(), last_track - first_track + 1, cdrom.cdrom_capacity, fat_drive.now / 1000,
+            fat_drive.reads, load_ms);
+    fprintf(out, "%-7s %9s %9s %9s %7s %7s %7s %8s %7s\n", "", "time", "cmds/s", "sectors/s", "data_ur", "info_ur",
+            "timeout", "dry", "ns/port");
+
+    for (const std::string &name : scenarios) {
+        if (name == "load") {
+            run_load(count_or(10));
+        } else if (name == "list") {
+            run_list(count_or(10));
+        } else if (name == "status") {
+            run("status", status_next, count_or(10000));
+        } else if (name == "toc") {
+            run("toc", toc_next, count_or(100));
+        } else if (name == "seq") {
+            run("seq", seq_next, count_or(data_track_sectors()));
+        } else if (name == "random") {
+            run("random", random_next, count_or(500));
+        } else if (name == "play") {
+            if (first_track == last_track) {
+                fprintf(out, "play    no audio tracks\n");
+                continue;
+            }
+            run("play", play_next, UINT32_MAX);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cdz_encode.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+extern "C" {
+#include "cdrom_image_cdz.h"
+}
+
+// LZ4 block rules: matches are at least 4 bytes, the last starts at least 12 bytes before the end
+// of the block and the last 5 bytes are literals
+static constexpr uint32_t MIN_MATCH = 4;
+static constexpr uint32_t MATCH_START_LIMIT = 12;
+static constexpr uint32_t LAST_LITERALS = 5;
+static constexpr uint32_t MAX_OFFSET = 65535;
+// Earlier positions with the same hash tried for each match: the tool can take its time
+static constexpr uint32_t CHAIN_DEPTH = 64;
+static constexpr uint32_t HASH_BITS = 16;
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void put_length(std::vector<uint8_t> &out, uint32_t len) {
+    for (; len >= 255; len -= 255) {
+        out.push_back(255);
+    }
+    out.push_back((uint8_t)len);
+}
+
+// Appends literals and then a match, or no match for the last sequence when match_len is 0
+static void put_sequence(std::vector<uint8_t> &out, const uint8_t *literals, uint32_t literal_len, uint32_t offset,
+                         uint32_t match_len) {
+    const uint32_t ml = match_len ? match_len - MIN_MATCH : 0;
+    out.push_back((uint8_t)(std::min(literal_len, 15u) << 4 | std::min(ml, 15u)));
+    if (literal_len >= 15) {
+        put_length(out, literal_len - 15);
+    }
+    out.insert(out.end(), literals, literals + literal_len);
+    if (match_len) {
+        out.push_back((uint8_t)offset);
+        out.push_back((uint8_t)(offset >> 8));
+        if (ml >= 15) {
+            put_length(out, ml - 15);
+        }
+    }
+}
+
+bool cdz_compress(const uint8_t *src, uint32_t n, std::vector<uint8_t> &out) {
+    const size_t base = out.size();
+    std::vector<int32_t> head(1u << HASH_BITS, -1), chain(n);
+    const auto hash = [&](uint32_t p) {
+        uint32_t v;
+        memcpy(&v, src + p, sizeof(v));
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    };
+    const auto insert = [&](uint32_t p) {
+        const uint32_t h = hash(p);
+        chain[p] = head[h];
+        head[h] = (int32_t)p;
+    };
+
+    uint32_t anchor = 0, p = 0;
+    while (p + MATCH_START_LIMIT <= n) {
+        const uint32_t max_len = n - LAST_LITERALS - p;
+        uint32_t best_len = 0, best_offset = 0, depth = 0;
+        for (int32_t c = head[hash(p)]; c >= 0 && p - c <= MAX_OFFSET && depth < CHAIN_DEPTH; c = chain[c], ++depth) {
+            uint32_t len = 0;
+            while (len < max_len && src[c + len] == src[p + len]) {
+                ++len;
+            }
+            if (len > best_len) {
+                best_len = len;
+                best_offset = p - c;
+                if (len == max_len) {
+                    break;
+                }
+            }
+        }
+        insert(p);
+        if (best_len < MIN_MATCH) {
+            ++p;
+            continue;
+        }
+        put_sequence(out, src + anchor, p - anchor, best_offset, best_len);
+        for (uint32_t q = p + 1; q < p + best_len && q + MATCH_START_LIMIT <= n; ++q) {
+            insert(q);
+        }
+        p += best_len;
+        anchor = p;
+        if (out.size() - base >= n) {
+            out.resize(base);
+            return false;
+        }
+    }
+    put_sequence(out, src + anchor, n - anchor, 0, 0);
+    if (out.size() - base >= n) {
+        out.resize(base);
+        return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> cdz_build(const uint8_t *image, uint32_t size, uint32_t hunk_bytes) {
+    const uint32_t hunks = (uint32_t)(((uint64_t)size + hunk_bytes - 1) / hunk_bytes);
+    const uint32_t index_at = sizeof(cdz_header_t);
+    std::vector<uint8_t> out(index_at + (hunks + 1) * sizeof(uint32_t));
+
+    // The header as the firmware reads it, which is little endian
+    memcpy(&out[0], CDZ_MAGIC, sizeof(CDZ_MAGIC));
+    put32(&out[offsetof(cdz_header_t, version)], CDZ_VERSION);
+    put32(&out[offsetof(cdz_header_t, hunk_bytes)], hunk_bytes);
+    put32(&out[offsetof(cdz_header_t, hunks)], hunks);
+    put32(&out[offsetof(cdz_header_t, size)], size);
+
+    std::vector<uint8_t> block, buff(hunk_bytes + CDZ_INPLACE_MARGIN(hunk_bytes));
+    for (uint32_t i = 0; i < hunks; ++i) {
+        put32(&out[index_at + i * sizeof(uint32_t)], (uint32_t)out.size());
+        const uint8_t *src = image + (size_t)i * hunk_bytes;
+        const uint32_t len = std::min(hunk_bytes, size - i * hunk_bytes);
+        block.clear();
+        bool compressed = cdz_compress(src, len, block);
+        if (compressed) {
+            // Decode it as the firmware does, read into the end of the buffer it decodes into
+            uint8_t *in = buff.data() + buff.size() - block.size();
+            memcpy(in, block.data(), block.size());
+            compressed = cdz_decompress(in, (uint32_t)block.size(), buff.data(), len) == (int)len
+                         && !memcmp(buff.data(), src, len);
+        }
+        if (compressed) {
+            out.insert(out.end(), block.begin(), block.end());
+        } else {
+            out.insert(out.end(), src, src + len);
+        }
+    }
+    put32(&out[index_at + hunks * sizeof(uint32_t)], (uint32_t)out.size());
+    return out;
+}
@@ -0,0 +1,32 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// Writer of the compressed CD images in cdrom/cdrom_image_cdz.h, for mkcdz and the benchmarks
+
+#include <stdint.h>
+#include <vector>
+
+// Compresses the n bytes at src as an LZ4 block, appending it to out. Returns false, leaving out
+// as it was, if the block wouldn't be smaller than src.
+bool cdz_compress(const uint8_t *src, uint32_t n, std::vector<uint8_t> &out);
+
+// Builds a .cdz of the size bytes of image in hunks of hunk_bytes. Every hunk is checked to decode
+// in place as the firmware decodes it, and stored as it is if it doesn't or doesn't compress.
+std::vector<uint8_t> cdz_build(const uint8_t *image, uint32_t size, uint32_t hunk_bytes);
@@ -0,0 +1,316 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "fat_volume.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "ff.h"
+#include "diskio.h"
+#include "msc_app.h"
+}
+
+FatDrive fat_drive;
+
+static constexpr uint32_t ROOT_ENTRIES = 512;
+static constexpr uint32_t ROOT_SECTORS = ROOT_ENTRIES * 32 / 512;
+
+// The volume made by fat_format(), or else the image file mapped by fat_load()
+static std::vector<uint8_t> volume;
+static const uint8_t *volume_data;
+static size_t volume_bytes;
+static void *mapped;
+static size_t mapped_bytes;
+static uint32_t cluster_sectors;
+static uint32_t data_start;
+static uint32_t clusters;
+static uint32_t next_free;
+static uint32_t files;
+
+static void put16(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+bool fat_format(uint32_t sectors, uint32_t spc) {
+    const uint32_t fat_sectors = ((sectors / spc + 2) * 2 + 511) / 512;
+    cluster_sectors = spc;
+    data_start = 1 + fat_sectors + ROOT_SECTORS;
+    clusters = (sectors - data_start) / spc;
+    // FatFS tells FAT12, 16 and 32 apart by the number of clusters
+    if (clusters < 4085 || clusters > 65524) {
+        return false;
+    }
+    next_free = 2;
+    files = 0;
+
+    volume.assign((size_t)sectors * 512, 0);
+    volume_data = volume.data();
+    volume_bytes = volume.size();
+    uint8_t *boot = &volume[0];
+    boot[0] = 0xeb;
+    boot[1] = 0x3c;
+    boot[2] = 0x90;
+    memcpy(boot + 3, "MSDOS5.0", 8);
+    put16(boot + 11, 512);
+    boot[13] = spc;
+    put16(boot + 14, 1);
+    boot[16] = 1;
+    put16(boot + 17, ROOT_ENTRIES);
+    put16(boot + 19, sectors < 65536 ? sectors : 0);
+    boot[21] = 0xf8;
+    put16(boot + 22, fat_sectors);
+    put16(boot + 24, 63);
+    put16(boot + 26, 255);
+    put32(boot + 32, sectors < 65536 ? 0 : sectors);
+    boot[36] = 0x80;
+    boot[38] = 0x29;
+    memcpy(boot + 43, "NO NAME    FAT16   ", 19);
+    put16(boot + 510, 0xaa55);
+
+    uint8_t *fat = &volume[512];
+    put16(fat, 0xfff8);
+    put16(fat + 2, 0xffff);
+    return true;
+}
+
+bool fat_format_for(uint64_t bytes) {
+    // Half as much again, for the directory, FAT and gaps between fragments
+    const uint64_t sectors = std::max<uint64_t>(bytes * 3 / 2 / 512, 32768);
+    for (uint32_t spc = 4; spc <= 64; spc *= 2) {
+        if (sectors <= 65524ull * spc && fat_format((uint32_t)sectors, spc)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fat_add_file(const char *name, uint32_t size, uint32_t fragments, uint32_t seed,
+                  void (*data)(uint8_t *buff, uint32_t offset, uint32_t bytes, void *arg), void *arg) {
+    const uint32_t cluster_bytes = cluster_sectors * 512;
+    const uint32_t file_clusters = (size + cluster_bytes - 1) / cluster_bytes;
+    if (volume.empty() || files == ROOT_ENTRIES || !fragments || fragments > std::max(file_clusters, 1u)
+        || next_free + file_clusters + fragments > clusters + 2) {
+        return false;
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> order(fragments);
+    for (uint32_t i = 0; i < fragments; ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin() + (fragments > 1), order.end(), rng);
+    std::vector<uint32_t> first_cluster(fragments);
+    for (uint32_t i = 0; i < fragments; ++i) {
+        const uint32_t f = order[i];
+        first_cluster[f] = next_free;
+        next_free += (file_clusters * (f + 1) / fragments - file_clusters * f / fragments) + 1;
+    }
+
+    uint8_t *fat = &volume[512];
+    uint32_t prev = 0;
+    for (uint32_t f = 0; f < fragments; ++f) {
+        const uint32_t start = file_clusters * f / fragments, end = file_clusters * (f + 1) / fragments;
+        for (uint32_t i = start; i < end; ++i) {
+            const uint32_t cluster = first_cluster[f] + i - start;
+            if (prev) {
+                put16(fat + prev * 2, cluster);
+            }
+            prev = cluster;
+            const uint32_t offset = i * cluster_bytes;
+            data(&volume[(size_t)(data_start + (cluster - 2) * cluster_sectors) * 512], offset,
+                 std::min(cluster_bytes, size - offset), arg);
+        }
+    }
+    if (prev) {
+        put16(fat + prev * 2, 0xffff);
+    }
+
+    uint8_t *dir = &volume[(size_t)(data_start - ROOT_SECTORS) * 512 + files++ * 32];
+    memcpy(dir, name, 11);
+    dir[11] = 0x20;
+    put16(dir + 26, file_clusters ? first_cluster[0] : 0);
+    put32(dir + 28, size);
+    return true;
+}
+
+static void copy_data(uint8_t *buff, uint32_t offset, uint32_t bytes, void *arg) {
+    memcpy(buff, (const uint8_t *)arg + offset, bytes);
+}
+
+bool fat_add_file(const char *name, const uint8_t *data, uint32_t size) {
+    return fat_add_file(name, size, 1, 0, copy_data, (void *)data);
+}
+
+bool fat_load(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *p = fstat(fd, &st) || st.st_size < 512 ? MAP_FAILED : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    if (mapped) {
+        munmap(mapped, mapped_bytes);
+    }
+    mapped = p;
+    mapped_bytes = st.st_size;
+    volume.clear();
+    volume_data = (const uint8_t *)p;
+    volume_bytes = mapped_bytes & ~(size_t)511;
+    return true;
+}
+
+bool fat_save(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+    const bool ok = fwrite(volume_data, 1, volume_bytes, f) == volume_bytes;
+    return fclose(f) == 0 && ok;
+}
+
+uint32_t fat_cluster_bytes() {
+    return cluster_sectors * 512;
+}
+
+// The drive
+
+struct DriveRead {
+    uint8_t *buff;
+    uint32_t lba;
+    uint16_t count;
+    msc_read_cb_t cb;
+    uintptr_t arg;
+    double queued;
+    double done;
+};
+
+static std::deque<DriveRead> drive_queue;
+static uint32_t read_latency[MSC_LATENCY_BUCKETS];
+
+// Returns when a read of count sectors from now ends, behind those the drive has already
+static double drive_schedule(uint32_t count) {
+    double cost = fat_drive.command_us + count * fat_drive.sector_us;
+    ++fat_drive.reads;
+    fat_drive.sectors += count;
+    if (fat_drive.stall_every && fat_drive.reads % fat_drive.stall_every == 0) {
+        cost += fat_drive.stall_us;
+    }
+    const double start = drive_queue.empty() ? fat_drive.now : std::max(fat_drive.now, fat_drive.busy_until);
+    fat_drive.busy_until = start + cost;
+    return fat_drive.busy_until;
+}
+
+static void drive_latency(double queued, double done) {
+    const uint32_t us = (uint32_t)(done - queued);
+    uint32_t bucket = us < 128 ? 0 : 31 - __builtin_clz(us) - 6;
+    ++read_latency[std::min<uint32_t>(bucket, MSC_LATENCY_BUCKETS - 1)];
+}
+
+static void drive_complete_first() {
+    const DriveRead r = drive_queue.front();
+    if (r.done > fat_drive.now) {
+        if (fat_drive.wait) {
+            fat_drive.wait(r.done);
+        }
+        fat_drive.now = r.done;
+    }
+    memcpy(r.buff, volume_data + (size_t)r.lba * 512, (size_t)r.count * 512);
+    drive_queue.pop_front();
+    drive_latency(r.queued, r.done);
+    r.cb(true, r.arg);
+}
+
+extern "C" bool msc_app_init(void) {
+    return true;
+}
+
+extern "C" void msc_app_task(void) {
+    while (!drive_queue.empty() && drive_queue.front().done <= fat_drive.now) {
+        drive_complete_first();
+    }
+}
+
+extern "C" bool msc_read_async(uint8_t *buff, uint32_t lba, uint16_t count, msc_read_cb_t cb, uintptr_t arg) {
+    if (!volume_data || drive_queue.size() == MSC_READ_QUEUE_SIZE || (uint64_t)lba + count > volume_bytes / 512) {
+        return false;
+    }
+    drive_queue.push_back({buff, lba, count, cb, arg, fat_drive.now, drive_schedule(count)});
+    return true;
+}
+
+extern "C" void msc_latency_get(uint32_t counts[MSC_LATENCY_BUCKETS]) {
+    memcpy(counts, read_latency, sizeof(read_latency));
+}
+
+extern "C" void msc_latency_clear(void) {
+    memset(read_latency, 0, sizeof(read_latency));
+}
+
+extern "C" DSTATUS disk_status(BYTE pdrv) {
+    return pdrv || !volume_data ? STA_NOINIT : 0;
+}
+
+extern "C" DSTATUS disk_initialize(BYTE pdrv) {
+    return disk_status(pdrv);
+}
+
+extern "C" DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (pdrv || (uint64_t)sector + count > volume_bytes / 512) {
+        return RES_PARERR;
+    }
+    // Queued behind the reads in flight, which complete as tuh_task() runs while waiting
+    while (!drive_queue.empty()) {
+        drive_complete_first();
+    }
+    const double queued = fat_drive.now;
+    const double done = drive_schedule(count);
+    if (fat_drive.wait) {
+        fat_drive.wait(done);
+    }
+    fat_drive.now = done;
+    memcpy(buff, volume_data + (size_t)sector * 512, (size_t)count * 512);
+    drive_latency(queued, done);
+    return RES_OK;
+}
+
+extern "C" DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    (void)pdrv;
+    (void)cmd;
+    (void)buff;
+    return RES_OK;
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// A FAT volume for the CD benchmarks, made in memory or loaded from an image file, which FatFS
+// reads through the disk_read() of fat_volume.cpp as if off a USB drive: in virtual time, each read
+// taking a fixed time per command plus a time per drive sector. The drive also takes the reads
+// cdrom/cdrom_cache.c queues with msc_read_async(), one at a time in order, completing them from
+// msc_app_task() once they are due, as tuh_task() does. disk_read() waits for those before it.
+
+#include <stdint.h>
+
+struct FatDrive {
+    double command_us = 1000;
+    double sector_us = 500;  // 1000KB/s
+    // Every stall_every'th read takes stall_us longer, as a drive does now and then
+    uint32_t stall_every = 0;
+    double stall_us = 0;
+    double now = 0;          // Virtual time of the caller, which disk_read() moves on
+    double busy_until = 0;   // When the drive finishes the reads it has
+    uint32_t reads = 0;
+    uint64_t sectors = 0;
+    // Called when disk_read() is about to wait until the time given, before its data is in place,
+    // for simulating what else happens meanwhile
+    void (*wait)(double until) = nullptr;
+};
+
+extern FatDrive fat_drive;
+
+// Formats a volume of sectors drive sectors in clusters of cluster_sectors, with room for 512 files
+// in its root directory. Returns false if that doesn't make a FAT16 volume.
+bool fat_format(uint32_t sectors, uint32_t cluster_sectors);
+
+// Formats a volume with room for files of bytes bytes in all, picking the cluster size
+bool fat_format_for(uint64_t bytes);
+
+// Adds a file to the root directory, in fragments runs of clusters taken from the free space in
+// a shuffled order and with a free cluster after each, so no two join up. name is as stored in the
+// directory entry, as "GAME    ISO". data is called for each cluster's bytes, given their offset
+// in the file. Returns false if it doesn't fit.
+bool fat_add_file(const char *name, uint32_t size, uint32_t fragments, uint32_t seed,
+                  void (*data)(uint8_t *buff, uint32_t offset, uint32_t bytes, void *arg), void *arg);
+
+// Adds a file holding size bytes from data, in one piece
+bool fat_add_file(const char *name, const uint8_t *data, uint32_t size);
+
+// Uses the FAT volume in the image file at path, a drive or partition image, in place of one made
+// in memory. Returns false if it can't be read.
+bool fat_load(const char *path);
+
+// Writes the volume to path, to be loaded again with fat_load()
+bool fat_save(const char *path);
+
+uint32_t fat_cluster_bytes();
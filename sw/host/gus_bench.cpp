@@ -0,0 +1,368 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side GUS render benchmark.
+//
+// Replays a stream of GUS port writes against the real GF1 emulation in
+// gus/gus-x.cpp and times GUS_CallBack() the same way play_gus() drives it.
+// Streams are either recorded to a file or synthesized for a given number of
+// active voices (a tracker-style pattern of looping 8/16-bit samples with
+// volume ramps, retriggered every 50Hz tick).
+//
+// Stream file format: one event per line, '#' starts a comment
+//   <frame> w <port> <value>   write_gus(port, value) before rendering <frame>
+//   <frame> r <port>           read_gus(port) before rendering <frame>
+// <frame> is decimal output frames at the GUS playback rate, <port> and
+// <value> are hex. <port> is relative to the GUS base port as passed to
+// write_gus(), e.g. 103 for 3X3 or 8 for 2X8.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "system/flash_settings.h"
+Settings settings;
+
+#include "psram_spi.h"
+psram_spi_inst_t psram_spi;
+
+#include "isa/isa_dma.h"
+dma_inst_t dma_config;
+
+#include "gus/gus-x.cpp"
+
+struct GusEvent {
+    uint32_t frame;
+    bool write;
+    uint16_t port;
+    uint8_t value;
+};
+
+class StreamBuilder {
+public:
+    std::vector<GusEvent> events;
+    uint32_t frame = 0;
+
+    void out(uint16_t port, uint8_t value) {
+        events.push_back({frame, true, port, value});
+    }
+    void reg8(uint8_t reg, uint8_t value) {
+        out(0x103, reg);
+        out(0x105, value);
+    }
+    void reg16(uint8_t reg, uint16_t value) {
+        out(0x103, reg);
+        out(0x104, value & 0xff);
+        out(0x105, value >> 8);
+    }
+    void voice_addr(uint8_t reg_msw, uint32_t addr) {
+        reg16(reg_msw, (addr >> 7) & 0x1fff);
+        reg16(reg_msw + 1, (addr & 0x7f) << 9);
+    }
+    void poke(uint32_t addr, uint8_t value) {
+        reg16(0x43, addr & 0xffff);
+        reg8(0x44, (addr >> 16) & 0xff);
+        out(0x107, value);
+    }
+};
+
+// Sample layout in GUS RAM used by the synthetic stream
+static constexpr uint32_t SYNTH_LEN = 2048;
+static constexpr uint32_t SYNTH_8BIT_ADDR = 0x00000;
+static constexpr uint32_t SYNTH_16BIT_ADDR = 0x40000; // start of 256KB bank 1
+
+static std::vector<GusEvent> synth_stream(uint8_t voices, uint32_t frames) {
+    StreamBuilder b;
+    // Reset, then take the card out of reset with the DAC enabled
+    b.reg8(0x4c, 0x00);
+    b.reg8(0x4c, 0x07);
+    b.reg8(0x4c, 0x07);
+    b.reg8(0x0e, 0xc0 | (voices - 1));
+
+    // Upload an 8-bit and a 16-bit waveform with some harmonics in them
+    for (uint32_t i = 0; i < SYNTH_LEN; ++i) {
+        double ph = 2.0 * M_PI * i / 64.0;
+        double v = 0.6 * sin(ph) + 0.25 * sin(3 * ph) + 0.1 * sin(7 * ph);
+        b.poke(SYNTH_8BIT_ADDR + i, (uint8_t)(int8_t)(v * 127));
+        int16_t v16 = (int16_t)(v * 32767);
+        b.poke(SYNTH_16BIT_ADDR + i * 2, v16 & 0xff);
+        b.poke(SYNTH_16BIT_ADDR + i * 2 + 1, (uint16_t)v16 >> 8);
+    }
+
+    const uint32_t rate = sample_rates[voices - 1];
+    const uint32_t tick = rate / 50;
+    uint32_t seed = 0x1234567u;
+    auto rnd = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 16;
+    };
+
+    for (uint32_t t = 0; b.frame < frames; ++t, b.frame += tick) {
+        for (uint8_t v = 0; v < voices; ++v) {
+            // Retrigger every voice on the first tick, then a handful per row
+            if (t && ((rnd() & 7) != 0)) {
+                continue;
+            }
+            const bool is16 = v & 1;
+            // 16-bit voice addresses count words within the 256KB bank, and
+            // the waveform sits at the start of its bank
+            const uint32_t start = is16 ? SYNTH_16BIT_ADDR : SYNTH_8BIT_ADDR;
+            const uint32_t loop_start = start + 64 * (rnd() & 7);
+            const uint32_t loop_end = start + SYNTH_LEN - 2;
+            b.out(0x102, v);
+            b.reg8(0x00, 0x03); // stop while reprogramming
+            b.reg8(0x0d, 0x03);
+            // Playback steps between 0.25 and 4 samples per frame
+            b.reg16(0x01, 256 + (rnd() % (4096 - 256)));
+            b.voice_addr(0x02, loop_start);
+            b.voice_addr(0x04, loop_end);
+            b.voice_addr(0x0a, start);
+            b.reg8(0x0c, rnd() & 0xf);
+            b.reg16(0x09, 0xe000);
+            // Slow decay ramp to exercise RampUpdate
+            b.reg8(0x06, 0x40 | (rnd() & 0x3f));
+            b.reg8(0x07, 0x40);
+            b.reg8(0x08, 0xe0);
+            b.reg8(0x0d, 0x40);
+            const uint8_t mode = rnd() % 3;
+            b.reg8(0x00, (is16 ? WCTRL_16BIT : 0) | WCTRL_LOOP | (mode == 2 ? WCTRL_BIDIRECTIONAL : 0));
+        }
+    }
+    return b.events;
+}
+
+static bool load_stream(const char *path, std::vector<GusEvent> &events) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    unsigned lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        ++lineno;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = 0;
+        }
+        GusEvent ev = {};
+        char op;
+        unsigned port, value = 0;
+        int n = sscanf(line, "%u %c %x %x", &ev.frame, &op, &port, &value);
+        if (n <= 0) {
+            continue;
+        }
+        if (n < 3 || (op != 'w' && op != 'r') || (op == 'w' && n < 4)) {
+            fprintf(stderr, "%s:%u: malformed event\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+        ev.write = op == 'w';
+        ev.port = port;
+        ev.value = value;
+        events.push_back(ev);
+    }
+    fclose(f);
+    return true;
+}
+
+static void save_stream(const char *path, const std::vector<GusEvent> &events) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "# GUS port write stream: <frame> w <port> <value> | <frame> r <port>\n");
+    for (const GusEvent &ev : events) {
+        if (ev.write) {
+            fprintf(f, "%u w %x %x\n", ev.frame, ev.port, ev.value);
+        } else {
+            fprintf(f, "%u r %x\n", ev.frame, ev.port);
+        }
+    }
+    fclose(f);
+}
+
+struct BenchResult {
+    uint8_t voices;
+    uint32_t rate;
+    uint64_t frames;
+    uint64_t buffers;
+    uint64_t total_ns;
+    uint64_t worst_ns;
+    uint64_t psram_reads;
+    uint64_t psram_read_bytes;
+};
+
+static BenchResult run_stream(const std::vector<GusEvent> &events, uint32_t max_frames, FILE *pcm_out) {
+    using clock = std::chrono::steady_clock;
+    static int16_t play_buffer[1024 * 2];
+    BenchResult r = {};
+    size_t next = 0;
+    uint64_t elapsed_us_frac = 0;
+
+    psram_spi.read_transactions = 0;
+    psram_spi.read_bytes = 0;
+    while (r.frames < max_frames) {
+        while (next < events.size() && events[next].frame <= r.frames) {
+            const GusEvent &ev = events[next++];
+            if (ev.write) {
+                write_gus(ev.port, ev.value);
+            } else {
+                (void)read_gus(ev.port);
+            }
+        }
+        // Don't count sample uploads against the render
+        if (r.frames == 0) {
+            psram_spi.read_transactions = 0;
+            psram_spi.read_bytes = 0;
+        }
+        const uint32_t rate = GUS_basefreq();
+        auto begin = clock::now();
+        uint32_t count = GUS_CallBack(1024, play_buffer);
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count();
+        if (!count) {
+            // DAC not enabled yet; let time pass as play_gus() would
+            count = buffer_size;
+        } else {
+            if (pcm_out) {
+                fwrite(play_buffer, sizeof(int16_t) * 2, count, pcm_out);
+            }
+            r.total_ns += ns;
+            r.worst_ns = ns > r.worst_ns ? ns : r.worst_ns;
+            ++r.buffers;
+        }
+        r.frames += count;
+        r.rate = rate;
+        r.voices = myGUS.ActiveChannels;
+        // Advance virtual time so GUS timers and DMA events keep firing
+        elapsed_us_frac += (uint64_t)count * 1000000u;
+        host_time_advance_us(elapsed_us_frac / rate);
+        elapsed_us_frac %= rate;
+    }
+    r.psram_reads = psram_spi.read_transactions;
+    r.psram_read_bytes = psram_spi.read_bytes;
+    return r;
+}
+
+static void print_result(const char *name, const BenchResult &r) {
+    const double deadline_ns = 1e9 * buffer_size / r.rate;
+    printf("%-20s %6u %6u %10.1f %12.1f %12llu %10.1f %8.2f %8.1f\n",
+           name, r.voices, r.rate,
+           r.frames ? (double)r.total_ns / r.frames : 0.0,
+           deadline_ns,
+           (unsigned long long)r.worst_ns,
+           r.buffers ? 100.0 * r.worst_ns / deadline_ns : 0.0,
+           r.frames ? (double)r.psram_reads / r.frames : 0.0,
+           r.frames ? (double)r.psram_read_bytes / r.frames : 0.0);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-b frames] [-i mode] [-s seconds] [-v voices[,voices...]] [-o stream.txt] [-a out.raw] [stream.txt ...]\n"
+            "  -b  GUS audio buffer size in frames (default 4, as pgusinit /gusbuf)\n"
+            "  -i  voice interpolation: 0 linear, 1 cubic, 2 sinc (default 0, as pgusinit /gusinterp)\n"
+            "  -s  seconds of audio to render per stream (default 10)\n"
+            "  -v  voice counts to synthesize streams for (default 14,20,28,32)\n"
+            "  -o  write the last synthesized stream to a file\n"
+            "  -a  write rendered audio of all streams as raw 16-bit stereo PCM\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    uint32_t buffer_frames = 4;
+    uint8_t interp = 0;
+    double seconds = 10.0;
+    std::vector<uint8_t> voice_counts = {14, 20, 28, 32};
+    const char *save_path = NULL;
+    FILE *pcm_out = NULL;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            buffer_frames = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            interp = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seconds = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "-v") && i + 1 < argc) {
+            voice_counts.clear();
+            for (char *tok = strtok(argv[++i], ","); tok; tok = strtok(NULL, ",")) {
+                unsigned v = strtoul(tok, NULL, 0);
+                if (v >= 14 && v <= 32) {
+                    voice_counts.push_back(v);
+                }
+            }
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+            pcm_out = fopen(argv[++i], "wb");
+            if (!pcm_out) {
+                perror(argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (buffer_frames < 1 || buffer_frames > 256) {
+        fprintf(stderr, "buffer size must be 1-256 frames\n");
+        return 1;
+    }
+
+    psram_spi = psram_spi_host_init();
+    PIC_Init();
+    settings.Volume.mainVol = 100;
+    settings.Volume.gusVol = 100;
+    GUS_OnReset();
+    GUS_Setup();
+    GUS_SetAudioBuffer(buffer_frames);
+    GUS_SetInterpolation(interp);
+
+    printf("%-20s %6s %6s %10s %12s %12s %10s %8s %8s\n",
+           "stream", "voices", "rate", "ns/frame", "deadline ns", "worst ns", "worst %", "psram/f", "bytes/f");
+    for (const char *path : files) {
+        std::vector<GusEvent> events;
+        if (!load_stream(path, events)) {
+            return 1;
+        }
+        write_gus(0x103, 0x4c);
+        write_gus(0x105, 0x00);
+        print_result(path, run_stream(events, (uint32_t)(seconds * 44100), pcm_out));
+    }
+    for (uint8_t voices : voice_counts) {
+        const uint32_t frames = (uint32_t)(seconds * sample_rates[voices - 1]);
+        std::vector<GusEvent> events = synth_stream(voices, frames);
+        if (save_path) {
+            save_stream(save_path, events);
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "synth-%u", voices);
+        print_result(name, run_stream(events, frames, pcm_out));
+    }
+    if (pcm_out) {
+        fclose(pcm_out);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (C) 2025  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Converts an ISO, or a BIN file of a cue sheet, to the compressed .cdz the firmware reads in its
+// place (see cdrom/cdrom_image_cdz.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <vector>
+
+extern "C" {
+#include "cdrom_image_cdz.h"
+}
+#include "cdz_encode.h"
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-s sectors] [-b bytes] image.iso|image.bin out.cdz\n"
+            "  -s  sectors per hunk (default 8)\n"
+            "  -b  bytes per sector (default 2352 for .bin, .img and .raw, else 2048)\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    uint32_t sectors = 8, sector_bytes = 0;
+    const char *in_path = NULL, *out_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            sectors = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            sector_bytes = strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-' || out_path) {
+            usage(argv[0]);
+            return 1;
+        } else if (!in_path) {
+            in_path = argv[i];
+        } else {
+            out_path = argv[i];
+        }
+    }
+    if (!out_path) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!sector_bytes) {
+        const char *ext = strrchr(in_path, '.');
+        sector_bytes = ext && (!strcasecmp(ext, ".bin") || !strcasecmp(ext, ".img") || !strcasecmp(ext, ".raw"))
+                           ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
+    }
+    const uint64_t hunk_bytes = (uint64_t)sectors * sector_bytes;
+    if (!hunk_bytes || hunk_bytes > CDZ_HUNK_MAX_BYTES) {
+        fprintf(stderr, "Hunks must be at most %u bytes\n", CDZ_HUNK_MAX_BYTES);
+        return 1;
+    }
+
+    FILE *f = fopen(in_path, "rb");
+    if (!f) {
+        perror(in_path);
+        return 1;
+    }
+    fseeko(f, 0, SEEK_END);
+    const off_t size = ftello(f);
+    fseeko(f, 0, SEEK_SET);
+    if (size <= 0 || size > UINT32_MAX) {
+        fprintf(stderr, "%s: images must be up to 4GB\n", in_path);
+        fclose(f);
+        return 1;
+    }
+    std::vector<uint8_t> image(size);
+    const bool read_ok = fread(image.data(), 1, image.size(), f) == image.size();
+    fclose(f);
+    if (!read_ok) {
+        perror(in_path);
+        return 1;
+    }
+
+    const std::vector<uint8_t> cdz = cdz_build(image.data(), (uint32_t)image.size(), (uint32_t)hunk_bytes);
+    if (cdz.size() > UINT32_MAX) {
+        fprintf(stderr, "%s: doesn't compress to under 4GB\n", in_path);
+        return 1;
+    }
+    f = fopen(out_path, "wb");
+    if (!f || fwrite(cdz.data(), 1, cdz.size(), f) != cdz.size() || fclose(f)) {
+        perror(out_path);
+        return 1;
+    }
+    printf("%s: %zu bytes in %u byte hunks, %.1f%% of %s\n", out_path, cdz.size(), (uint32_t)hunk_bytes,
+           100.0 * cdz.size() / image.size(), in_path);
+    return 0;
+}
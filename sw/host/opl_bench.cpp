@@ -0,0 +1,257 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side OPL output benchmark.
+//
+// Times producing 44.1kHz OPL output the way play_adlib() does: emu8950
+// rendering at its native 49716Hz through the resampler in resampler/. The
+// old path rendered one native sample per resampler input and pulled one
+// output sample at a time; the new one renders OPL_BLOCK_SAMPLES at a time
+// and fills the output FIFO in blocks. Both play the same patch on all nine
+// channels, the last three in rhythm mode, and their output is first checked
+// to be identical.
+//
+// Then it compares the cost per native sample of the OPL engines: emu8950 and
+// opl/opl3.c (Nuked OPL3) on the same OPL2 patch, and opl3.c with all 18
+// channels playing in OPL3 mode, four-operator pairs included. opl3.c is also
+// built with OPL3_RUN_IDLE_SLOTS, as Nuked OPL3 runs, to show what skipping
+// silent slots saves and how far the output moves from Nuked's.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "pico/stdlib.h"
+#include "opl/emu8950.h"
+extern "C" {
+#include "opl/opl3.h"
+// opl3.c built with OPL3_RUN_IDLE_SLOTS
+void OPL3_Reset_ref(opl3_chip *chip, Bit32u samplerate);
+void OPL3_WriteReg_ref(opl3_chip *chip, Bit16u reg, Bit8u v);
+void OPL3_Generate_ref(opl3_chip *chip, Bit16s *buf);
+}
+#include "audio/volctrl.h"
+#include <resampler.hpp>
+
+static constexpr uint32_t OPL_BLOCK_SAMPLES = 32;
+static constexpr uint32_t OUTPUT_RATE = 44100;
+
+int32_t opl_volume = 0x10000;
+
+static OPL *opl_single;
+static OPL *opl_block;
+
+static void render_single(int16_t *buffer, uint32_t nsamples) {
+    for (uint32_t i = 0; i < nsamples; ++i) {
+        OPL_calc_buffer(opl_single, &buffer[i], 1);
+        buffer[i] = scale_sample(buffer[i] << 1, opl_volume, 1);
+    }
+}
+
+static void render_block(int16_t *buffer, uint32_t nsamples) {
+    OPL_calc_buffer(opl_block, buffer, nsamples);
+    for (uint32_t i = 0; i < nsamples; ++i) {
+        buffer[i] = scale_sample(buffer[i] << 1, opl_volume, 1);
+    }
+}
+
+static Resampler<render_single, 1> resampler_single;
+static Resampler<render_block, OPL_BLOCK_SAMPLES> resampler_block;
+
+typedef void (*write_fn)(void *chip, uint16_t reg, uint8_t value);
+
+// A two-operator organ-ish patch on channels 0-5, and the rhythm section on 6-8. With opl3, the
+// same on the second bank's nine channels, and channels 0-2 and 9-11 as four-operator pairs
+static void setup(write_fn write, void *chip, bool opl3) {
+    static const uint8_t slot_offsets[9] = {0x00, 0x01, 0x02, 0x08, 0x09, 0x0a, 0x10, 0x11, 0x12};
+    static const uint16_t fnums[9] = {0x157, 0x181, 0x1b0, 0x1ca, 0x202, 0x241, 0x287, 0x2ae, 0x157};
+    write(chip, 0x01, 0x20);
+    if (opl3) {
+        write(chip, 0x105, 0x01);
+        write(chip, 0x104, 0x09);
+    }
+    for (uint32_t bank = 0; bank < (opl3 ? 2u : 1u); ++bank) {
+        const uint16_t b = bank << 8;
+        for (uint32_t ch = 0; ch < 9; ++ch) {
+            const uint8_t mod = slot_offsets[ch], car = mod + 3;
+            write(chip, b | (0x20 + mod), 0x21);
+            write(chip, b | (0x20 + car), 0x61);
+            write(chip, b | (0x40 + mod), 0x18);
+            write(chip, b | (0x40 + car), 0x00);
+            write(chip, b | (0x60 + mod), 0xf2);
+            write(chip, b | (0x60 + car), 0xf4);
+            write(chip, b | (0x80 + mod), 0x54);
+            write(chip, b | (0x80 + car), 0x56);
+            write(chip, b | (0xe0 + mod), ch & 3);
+            // Both outputs, or alternately left and right on the second bank
+            const uint8_t pan = opl3 ? (bank ? (ch & 1 ? 0x10 : 0x20) : 0x30) : 0;
+            write(chip, b | (0xc0 + ch), pan | 0x06 | (ch & 1));
+            write(chip, b | (0xa0 + ch), fnums[ch] & 0xff);
+            const bool melodic = ch < 6 || bank;
+            write(chip, b | (0xb0 + ch), (melodic ? 0x20 : 0) | 0x10 | (fnums[ch] + bank * 0x20) >> 8);
+        }
+    }
+    // Rhythm mode with bass drum, snare, tom, cymbal and hi-hat keyed on
+    write(chip, 0xbd, 0xff);
+}
+
+// Keys every channel and drum off, to measure them releasing and then idle
+static void release(write_fn write, void *chip, bool opl3) {
+    for (uint32_t bank = 0; bank < (opl3 ? 2u : 1u); ++bank) {
+        for (uint32_t ch = 0; ch < 9; ++ch) {
+            write(chip, bank << 8 | (0xb0 + ch), 0x10);
+        }
+    }
+    write(chip, 0xbd, 0x20);
+}
+
+static void write_emu8950(void *chip, uint16_t reg, uint8_t value) {
+    OPL_writeReg((OPL *)chip, reg, value);
+}
+
+static void write_nuked(void *chip, uint16_t reg, uint8_t value) {
+    OPL3_WriteReg((opl3_chip *)chip, reg, value);
+}
+
+static void write_nuked_ref(void *chip, uint16_t reg, uint8_t value) {
+    OPL3_WriteReg_ref((opl3_chip *)chip, reg, value);
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// Renders samples native frames with both builds of opl3.c, keying everything off a quarter of the
+// way through, and reports the time per frame of each. Also the largest difference between them and
+// the power of the difference relative to the output, left and right together.
+static void compare_nuked(bool opl3, uint32_t samples, double emu8950_ns) {
+    static opl3_chip chip, ref_chip;
+    OPL3_Reset(&chip, 49716);
+    OPL3_Reset_ref(&ref_chip, 49716);
+    setup(write_nuked, &chip, opl3);
+    setup(write_nuked_ref, &ref_chip, opl3);
+
+    std::vector<int16_t> out(samples * 2), ref_out(samples * 2);
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < samples; ++i) {
+        if (i == samples / 4) {
+            release(write_nuked, &chip, opl3);
+        }
+        OPL3_Generate(&chip, &out[i * 2]);
+    }
+    const double ns = elapsed_ns(begin) / samples;
+    begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < samples; ++i) {
+        if (i == samples / 4) {
+            release(write_nuked_ref, &ref_chip, opl3);
+        }
+        OPL3_Generate_ref(&ref_chip, &ref_out[i * 2]);
+    }
+    const double ref_ns = elapsed_ns(begin) / samples;
+
+    int max_diff = 0;
+    double signal = 0, error = 0;
+    for (uint32_t i = 0; i < samples * 2; ++i) {
+        const int diff = out[i] - ref_out[i];
+        max_diff = std::max(max_diff, abs(diff));
+        signal += (double)ref_out[i] * ref_out[i];
+        error += (double)diff * diff;
+    }
+    const char *name = opl3 ? "opl3 18ch" : "opl3";
+    printf("%-10s %10.1f %10.2f %10.1f %9d %9.1f\n", name, ns, ns / emu8950_ns, ref_ns, max_diff,
+           error > 0 ? 10 * log10(error / signal) : -INFINITY);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-s seconds]\n"
+            "  -s  seconds of output timed per path (default 10)\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = 10;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!seconds) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    opl_single = OPL_new(3579552, 49716);
+    opl_block = OPL_new(3579552, 49716);
+    setup(write_emu8950, opl_single, false);
+    setup(write_emu8950, opl_block, false);
+    resampler_single.set_ratio(49716, OUTPUT_RATE);
+    resampler_block.set_ratio(49716, OUTPUT_RATE);
+
+    const uint32_t total = seconds * OUTPUT_RATE;
+    std::vector<int16_t> single_out(total), block_out(total);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < total; ++i) {
+        single_out[i] = resampler_single.get_sample();
+    }
+    const double single_ns = elapsed_ns(begin);
+
+    begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < total; i += OPL_BLOCK_SAMPLES) {
+        const uint32_t count = total - i < OPL_BLOCK_SAMPLES ? total - i : OPL_BLOCK_SAMPLES;
+        resampler_block.get_samples(&block_out[i], count);
+    }
+    const double block_ns = elapsed_ns(begin);
+
+    for (uint32_t i = 0; i < total; ++i) {
+        if (single_out[i] != block_out[i]) {
+            fprintf(stderr, "output differs at sample %u: %d vs %d\n", i, single_out[i], block_out[i]);
+            return 1;
+        }
+    }
+
+    printf("%-8s %12s %10s\n", "path", "ns/sample", "% of RT");
+    const double period_ns = 1e9 / OUTPUT_RATE;
+    printf("%-8s %12.1f %10.2f\n", "single", single_ns / total, 100 * single_ns / total / period_ns);
+    printf("%-8s %12.1f %10.2f\n", "block", block_ns / total, 100 * block_ns / total / period_ns);
+
+    // Engines at the native rate
+    const uint32_t native = seconds * 49716;
+    OPL *emu8950 = OPL_new(3579552, 49716);
+    setup(write_emu8950, emu8950, false);
+    std::vector<int16_t> emu8950_out(native);
+    begin = std::chrono::steady_clock::now();
+    OPL_calc_buffer(emu8950, emu8950_out.data(), native / 4);
+    release(write_emu8950, emu8950, false);
+    OPL_calc_buffer(emu8950, emu8950_out.data() + native / 4, native - native / 4);
+    const double emu8950_ns = elapsed_ns(begin) / native;
+
+    printf("\n%-10s %10s %10s %10s %9s %9s\n", "engine", "ns/sample", "x emu8950", "all slots", "max diff", "diff dB");
+    printf("%-10s %10.1f %10.2f\n", "emu8950", emu8950_ns, 1.0);
+    compare_nuked(false, native, emu8950_ns);
+    compare_nuked(true, native, emu8950_ns);
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side ISA port dispatch benchmark.
+//
+// Compares finding the device for a port with the if/else chain handle_iow
+// used before isa/port_map.c (each enabled device tested in turn) against a
+// port_map lookup. Every device is enabled at its usual port, as in a build
+// with all of them. The two are first checked to agree on all 1024 ports.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "../common/picogus.h"
+#include "isa/port_map.h"
+
+static Settings settings;
+static uint16_t gus_port_test;
+static uint16_t sb_port_test;
+static uint16_t cdrom_port_test;
+
+// The tests handle_iow made, in its order, returning what port_map holds for the port
+__attribute__((noinline)) static uint8_t chain_lookup(uint16_t port) {
+    if ((port >> 4 | 0x10) == gus_port_test) {
+        switch ((uint16_t)(port - settings.GUS.basePort)) {
+        case 0x8:
+        case 0xb:
+        case 0x102:
+        case 0x103:
+        case 0x104:
+            return IO_GUS | IO_FAST_WRITE;
+        default:
+            return IO_GUS;
+        }
+    } else if ((port >> 4) == sb_port_test) {
+        return (port - settings.SB.basePort) == 0x8 ? IO_SB | IO_FAST_WRITE : IO_SB;
+    } else if ((port >> 4) == cdrom_port_test) {
+        return IO_CDROM;
+    } else if ((port & 0x3fe) == settings.SB.oplBasePort) {
+        return (port & 1) == 0 ? IO_OPL | IO_FAST_WRITE : IO_OPL;
+    } else if (port == settings.Tandy.basePort) {
+        return IO_TANDY | IO_FAST_WRITE;
+    } else if (port == settings.Joy.basePort) {
+        return IO_JOY | IO_FAST_WRITE;
+    } else if ((port & ~7) == settings.Mouse.basePort) {
+        return IO_MOUSE;
+    } else if ((port & ~0x1F) == settings.NE2K.basePort) {
+        return IO_NE2K;
+    } else if ((port & 0x3f0) == settings.CMS.basePort) {
+        return IO_CMS | IO_FAST_WRITE;
+    } else if ((port & 0x3fe) == settings.MPU.basePort) {
+        return IO_MPU;
+    } else if (port == CONTROL_PORT) {
+        return IO_CONTROL;
+    } else if (port == DATA_PORT_LOW) {
+        return IO_DATA_LOW | IO_FAST_WRITE;
+    } else if (port == DATA_PORT_HIGH) {
+        return IO_DATA_HIGH;
+    }
+    return IO_NONE;
+}
+
+__attribute__((noinline)) static uint8_t map_lookup(uint16_t port) {
+    return port_map[port & (PORT_MAP_SIZE - 1)];
+}
+
+static const char *device_names[IO_DEVICE_COUNT] = {
+    "none", "gus", "sb", "cdrom", "opl", "tandy", "joy", "mouse", "ne2k", "cms", "mpu", "control", "data low", "data high",
+};
+
+template <typename Lookup>
+static double time_lookup(Lookup lookup, uint16_t port, uint32_t iterations) {
+    volatile uint16_t vport = port;
+    uint32_t sink = 0;
+    const auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        sink += lookup(vport);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    volatile uint32_t keep = sink;
+    (void)keep;
+    return std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-n iterations]\n"
+            "  -n  lookups timed per port (default 20000000)\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = 20000000;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = strtoul(argv[++i], NULL, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!iterations) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    settings.GUS.basePort = 0x240;
+    settings.SB.basePort = 0x220;
+    settings.SB.oplBasePort = 0x388;
+    settings.CD.basePort = 0x250;
+    settings.Tandy.basePort = 0x2c0;
+    settings.Joy.basePort = 0x201;
+    settings.Mouse.basePort = 0x2f8;
+    settings.NE2K.basePort = 0x300;
+    settings.CMS.basePort = 0x260;
+    settings.MPU.basePort = 0x330;
+    gus_port_test = settings.GUS.basePort >> 4 | 0x10;
+    sb_port_test = settings.SB.basePort >> 4;
+    cdrom_port_test = settings.CD.basePort >> 4;
+
+    uint32_t all = 0;
+    for (uint32_t id = IO_NONE + 1; id < IO_DEVICE_COUNT; ++id) {
+        all |= IO_DEV(id);
+    }
+    port_map_build(&settings, all);
+
+    uint32_t mismatches = 0;
+    for (uint16_t port = 0; port < PORT_MAP_SIZE; ++port) {
+        if (chain_lookup(port) != port_map[port]) {
+            fprintf(stderr, "port %03x: chain %02x, map %02x\n", port, chain_lookup(port), port_map[port]);
+            ++mismatches;
+        }
+    }
+    if (mismatches) {
+        fprintf(stderr, "%u ports dispatch differently\n", mismatches);
+        return 1;
+    }
+
+    // Data port of each device, plus a port nobody claims
+    static const uint16_t ports[] = {
+        0x24f, 0x22c, 0x250, 0x389, 0x2c0, 0x201, 0x2f8, 0x310, 0x261, 0x330, CONTROL_PORT, DATA_PORT_LOW, DATA_PORT_HIGH, 0x080,
+    };
+    printf("%-10s %5s %10s %10s\n", "device", "port", "chain ns", "map ns");
+    for (uint32_t i = 0; i < sizeof(ports) / sizeof(ports[0]); ++i) {
+        const double chain_ns = time_lookup(chain_lookup, ports[i], iterations);
+        const double map_ns = time_lookup(map_lookup, ports[i], iterations);
+        printf("%-10s %5x %10.2f %10.2f\n", device_names[port_map[ports[i]] & IO_DEVICE_MASK], ports[i], chain_ns, map_ns);
+    }
+    return 0;
+}
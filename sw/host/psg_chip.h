@@ -0,0 +1,41 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// A Tandy or CMS emulation from square/square.cpp, as square_bench drives it. Each build of
+// square.cpp has its own classes, so the bench reaches them through this.
+
+#include <stdint.h>
+
+class psg_chip {
+public:
+    virtual ~psg_chip() {}
+    // Tandy: a byte written to port 0xc0, reg is ignored. CMS: SAA1099 register reg & 0xff of
+    // chip reg >> 8.
+    virtual void write(uint16_t reg, uint8_t data) = 0;
+    // Adds frames of stereo output to dest, as play_psg() calls the generators
+    virtual void generate(int32_t *dest, uint32_t frames) = 0;
+};
+
+// Band-limited generators, from square_bench.cpp
+psg_chip *new_tandy();
+psg_chip *new_cms();
+// Per-frame generators, from square_naive.cpp
+psg_chip *new_naive_tandy();
+psg_chip *new_naive_cms();
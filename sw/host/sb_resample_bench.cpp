@@ -0,0 +1,128 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side measurement of the SB_BUFFERLESS output path.
+//
+// Feeds a sine at the DSP rates games commonly set through the time constant
+// into sbdsp/sbdsp_resampler.h, with samples arriving when DMA would deliver
+// them relative to the 44.1kHz output, and compares the result against the
+// sample-and-hold output it replaced. For each rate and tone it reports
+// THD+N (everything but the tone) and the level of the strongest image of the
+// tone, which sample-and-hold leaves in the audible band, both relative to
+// the tone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+
+#include "sbdsp/sbdsp_resampler.h"
+#include "spectrum.h"
+
+static constexpr uint32_t FFT_SIZE = 16384;
+// Half-width of the window's main lobe, in bins
+static constexpr int LOBE_BINS = 8;
+
+static double band_power(const std::vector<double>& p, double hz) {
+    const int centre = (int)lround(hz * FFT_SIZE / SB_RESAMPLE_OUTPUT_RATE);
+    double total = 0;
+    for (int i = centre - LOBE_BINS; i <= centre + LOBE_BINS; ++i) {
+        if (i >= 0 && i < (int)p.size()) {
+            total += p[i];
+        }
+    }
+    return total;
+}
+
+// Folds a frequency into 0 - 22050Hz, where it shows up at the output
+static double fold(double hz) {
+    hz = fmod(hz, SB_RESAMPLE_OUTPUT_RATE);
+    return hz > SB_RESAMPLE_OUTPUT_RATE / 2 ? SB_RESAMPLE_OUTPUT_RATE - hz : hz;
+}
+
+struct Result {
+    double thdn_db;
+    double image_db;
+};
+
+static Result measure(const std::vector<double>& out, double tone, double input_rate) {
+    const std::vector<double> p = spectrum(out);
+    const double signal = band_power(p, tone);
+    double total = 0;
+    for (uint32_t i = LOBE_BINS + 1; i < p.size(); ++i) {
+        total += p[i];
+    }
+    double image = 0;
+    for (int k = 1; k <= 4; ++k) {
+        const double below = fold(k * input_rate - tone), above = fold(k * input_rate + tone);
+        if (fabs(below - tone) > 2.0 * LOBE_BINS * SB_RESAMPLE_OUTPUT_RATE / FFT_SIZE) {
+            image = std::max(image, band_power(p, below));
+        }
+        if (fabs(above - tone) > 2.0 * LOBE_BINS * SB_RESAMPLE_OUTPUT_RATE / FFT_SIZE) {
+            image = std::max(image, band_power(p, above));
+        }
+    }
+    return {10 * log10((total - signal) / signal), image > 0 ? 10 * log10(image / signal) : -INFINITY};
+}
+
+// Runs a tone through both paths, with DMA delivering each input sample at its time
+static void run(uint32_t time_constant, double tone) {
+    const uint32_t interval_us = 256 - time_constant;
+    const double input_rate = 1000000.0 / interval_us;
+    const uint32_t warmup = 1024;
+
+    sb_resampler_t resampler = {};
+    sb_resampler_set_rate(&resampler, 1000000u / interval_us);
+    int16_t held = 0;
+    std::vector<double> hold_out, resampled_out;
+    uint64_t in_index = 0;
+    for (uint32_t n = 0; n < warmup + FFT_SIZE; ++n) {
+        const double now_us = n * 1000000.0 / SB_RESAMPLE_OUTPUT_RATE;
+        while (in_index * interval_us <= now_us) {
+            held = (int16_t)lrint(0.9 * 32767 * sin(2 * M_PI * tone * in_index / input_rate));
+            sb_resampler_push(&resampler, held);
+            ++in_index;
+        }
+        const int32_t resampled = sb_resampler_get(&resampler);
+        if (n >= warmup) {
+            hold_out.push_back(held);
+            resampled_out.push_back(resampled);
+        }
+    }
+    const Result hold = measure(hold_out, tone, input_rate);
+    const Result resampled = measure(resampled_out, tone, input_rate);
+    printf("%3u %7.0f %7.0f %9.1f %9.1f %9.1f %9.1f\n", time_constant, input_rate, tone,
+           hold.thdn_db, resampled.thdn_db, hold.image_db, resampled.image_db);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return 1;
+    }
+    // Time constants for 8kHz, 11kHz, 22kHz and the 44kHz of high-speed DMA
+    static const uint32_t time_constants[] = {131, 166, 211, 233};
+    printf("%3s %7s %7s %9s %9s %9s %9s\n", "tc", "rate", "tone", "hold THD", "new THD", "hold img", "new img");
+    for (uint32_t i = 0; i < sizeof(time_constants) / sizeof(time_constants[0]); ++i) {
+        const double input_rate = 1000000.0 / (256 - time_constants[i]);
+        run(time_constants[i], 1000.0);
+        run(time_constants[i], 0.25 * input_rate);
+    }
+    return 0;
+}
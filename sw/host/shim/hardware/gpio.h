@@ -0,0 +1,36 @@
+#pragma once
+
+// Host stand-in for hardware/gpio.h. GPIO state is kept in a mask so that
+// host programs can observe e.g. the ISA IRQ line.
+
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint32_t host_gpio_state;
+
+static inline void gpio_put(uint gpio, bool value) {
+    if (value) {
+        host_gpio_state |= 1u << gpio;
+    } else {
+        host_gpio_state &= ~(1u << gpio);
+    }
+}
+static inline bool gpio_get(uint gpio) {
+    return (host_gpio_state >> gpio) & 1u;
+}
+static inline void gpio_xor_mask(uint32_t mask) {
+    host_gpio_state ^= mask;
+}
+static inline void gpio_set_mask(uint32_t mask) {
+    host_gpio_state |= mask;
+}
+static inline void gpio_clr_mask(uint32_t mask) {
+    host_gpio_state &= ~mask;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+// Host stand-in for hardware/irq.h. Interrupts don't exist on the host.
+
+#include "pico/platform.h"
+
+#define PICO_HIGHEST_IRQ_PRIORITY 0x00
+#define PICO_LOWEST_IRQ_PRIORITY 0xc0
+
+typedef void (*irq_handler_t)(void);
+
+static inline void irq_set_priority(uint num, uint8_t hardware_priority) {
+    (void)num;
+    (void)hardware_priority;
+}
+static inline void irq_set_enabled(uint num, bool enabled) {
+    (void)num;
+    (void)enabled;
+}
+static inline void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    (void)num;
+    (void)handler;
+}
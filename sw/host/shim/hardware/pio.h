@@ -0,0 +1,57 @@
+#pragma once
+
+// Host stand-in for hardware/pio.h. Each state machine is reduced to a one
+// word TX and RX register so that host programs can play the part of the
+// PIO program on the other side.
+
+#include "pico/platform.h"
+#include "hardware/irq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pio_hw {
+    uint32_t txf[4];
+    uint32_t rxf[4];
+    uint32_t rx_level[4];
+} pio_hw_t;
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t host_pio[2];
+#define pio0 (&host_pio[0])
+#define pio1 (&host_pio[1])
+
+static inline void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+    pio->txf[sm] = data;
+}
+static inline void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+    pio->txf[sm] = data;
+}
+static inline uint32_t pio_sm_get(PIO pio, uint sm) {
+    pio->rx_level[sm] = 0;
+    return pio->rxf[sm];
+}
+enum pio_src_dest {
+    pio_pins = 0,
+};
+
+static inline uint32_t pio_encode_jmp(uint addr) {
+    return addr;
+}
+static inline uint32_t pio_encode_set(enum pio_src_dest dest, uint value) {
+    (void)dest;
+    return value;
+}
+static inline void pio_interrupt_clear(PIO pio, uint irq) {
+    (void)pio;
+    (void)irq;
+}
+static inline void pio_sm_exec(PIO pio, uint sm, uint instr) {
+    (void)instr;
+    pio->rx_level[sm] = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
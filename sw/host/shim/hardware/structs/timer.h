@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for hardware/structs/timer.h: time comes from pico/time.h
+
+#include "hardware/timer.h"
@@ -0,0 +1,23 @@
+#pragma once
+
+// Host stand-in for hardware/sync.h. Only the barriers and interrupt masking used by the
+// emulation are provided.
+
+#include "pico/platform.h"
+
+static inline void __dmb(void) {
+    __sync_synchronize();
+}
+
+static inline void __compiler_memory_barrier(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+// Nothing interrupts the host programs
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void)status;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// Host stand-in for hardware/timer.h
+
+#include "pico/platform.h"
+#include "hardware/irq.h"
+
+static inline uint hardware_alarm_get_irq_num(uint alarm_num) {
+    return alarm_num;
+}
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Implementation of the Pico SDK stand-ins declared in sw/host/shim
+
+#include <stdlib.h>
+
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "psram_spi.h"
+#include "isa/isa_dma.h"
+
+uint32_t host_gpio_state;
+pio_hw_t host_pio[2];
+
+psram_spi_inst_t psram_spi_host_init(void) {
+    psram_spi_inst_t spi = {0};
+    spi.mem = (uint8_t *)calloc(HOST_PSRAM_SIZE, 1);
+    return spi;
+}
+
+/* Virtual time and alarm pool */
+
+typedef struct {
+    alarm_id_t id;
+    uint64_t when;
+    alarm_callback_t callback;
+    void *user_data;
+} host_alarm_t;
+
+struct alarm_pool {
+    host_alarm_t alarms[PICO_TIME_DEFAULT_ALARM_POOL_MAX_TIMERS];
+};
+
+static alarm_pool_t host_alarm_pool;
+static uint64_t host_now_us;
+static alarm_id_t host_next_alarm_id = 1;
+static uint32_t host_fired;
+
+alarm_pool_t *alarm_pool_create_with_unused_hardware_alarm(uint max_timers) {
+    (void)max_timers;
+    return &host_alarm_pool;
+}
+
+uint alarm_pool_timer_alarm_num(alarm_pool_t *pool) {
+    (void)pool;
+    return 0;
+}
+
+alarm_id_t alarm_pool_add_alarm_in_us(alarm_pool_t *pool, uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    (void)fire_if_past;
+    for (size_t i = 0; i < PICO_TIME_DEFAULT_ALARM_POOL_MAX_TIMERS; ++i) {
+        host_alarm_t *alarm = &pool->alarms[i];
+        if (!alarm->id) {
+            alarm->id = host_next_alarm_id++;
+            if (host_next_alarm_id <= 0) {
+                host_next_alarm_id = 1;
+            }
+            alarm->when = host_now_us + us;
+            alarm->callback = callback;
+            alarm->user_data = user_data;
+            return alarm->id;
+        }
+    }
+    return -1;
+}
+
+bool alarm_pool_cancel_alarm(alarm_pool_t *pool, alarm_id_t alarm_id) {
+    for (size_t i = 0; i < PICO_TIME_DEFAULT_ALARM_POOL_MAX_TIMERS; ++i) {
+        if (pool->alarms[i].id == alarm_id) {
+            pool->alarms[i].id = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+static host_alarm_t *next_due_alarm(uint64_t until) {
+    host_alarm_t *next = NULL;
+    for (size_t i = 0; i < PICO_TIME_DEFAULT_ALARM_POOL_MAX_TIMERS; ++i) {
+        host_alarm_t *alarm = &host_alarm_pool.alarms[i];
+        if (alarm->id && alarm->when <= until && (!next || alarm->when < next->when)) {
+            next = alarm;
+        }
+    }
+    return next;
+}
+
+void host_time_advance_us(uint64_t us) {
+    const uint64_t until = host_now_us + us;
+    host_alarm_t *alarm;
+    while ((alarm = next_due_alarm(until))) {
+        host_now_us = alarm->when;
+        const alarm_id_t id = alarm->id;
+        ++host_fired;
+        int64_t ret = alarm->callback(id, alarm->user_data);
+        // The callback may have cancelled or re-added alarms, so only touch
+        // this slot if it still holds the alarm that just fired
+        if (alarm->id != id) {
+            continue;
+        }
+        if (ret < 0) {
+            // Negative return re-arms relative to when the alarm was due
+            alarm->when -= ret;
+        } else if (ret > 0) {
+            alarm->when = host_now_us + ret;
+        } else {
+            alarm->id = 0;
+        }
+    }
+    host_now_us = until;
+}
+
+uint32_t host_alarms_fired(void) {
+    return host_fired;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)host_now_us;
+}
+
+uint64_t time_us_64(void) {
+    return host_now_us;
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    host_time_advance_us(delay_us);
+}
+
+void busy_wait_ms(uint32_t delay_ms) {
+    host_time_advance_us((uint64_t)delay_ms * 1000);
+}
+
+// There is no ISA bus to burst from, so DMA always falls back to one alarm per byte
+void DMA_Burst_Init(dma_inst_t *dma, irq_handler_t burst_isr) {
+    (void)dma;
+    (void)burst_isr;
+}
+bool DMA_Burst_Start(dma_inst_t *dma, uint32_t interval_us) {
+    (void)dma;
+    (void)interval_us;
+    return false;
+}
+void DMA_Burst_Stop(dma_inst_t *dma) {
+    (void)dma;
+}
+uint32_t DMA_Burst_Complete(dma_inst_t *dma, const uint32_t **words) {
+    (void)dma;
+    (void)words;
+    return 0;
+}
+uint32_t DMA_Burst_Remainder(dma_inst_t *dma, const uint32_t **words) {
+    (void)dma;
+    (void)words;
+    return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for the header pioasm generates from isa/isa_dma.pio
+
+#define dma_write_offset_start 4u
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for pico/multicore.h. The host programs run what each core
+// would in turn on one thread, so there is nothing to launch.
+
+#include "pico/platform.h"
@@ -0,0 +1,42 @@
+#pragma once
+
+// Host stand-in for the Pico SDK's pico/platform.h. Only what the firmware
+// sources built under sw/host actually use is provided here.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+
+#define PICO_ON_DEVICE 0
+#define PICO_DEFAULT_LED_PIN 25
+
+#ifndef __force_inline
+#define __force_inline inline __attribute__((always_inline))
+#endif
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __scratch_x(group)
+#define __scratch_y(group)
+
+typedef unsigned int uint;
+
+static inline void tight_loop_contents(void) {}
+
+// Everything on the host runs on the one thread, which stands in for core 0
+static inline uint get_core_num(void) {
+    return 0;
+}
+
+#define panic(...) do { fprintf(stderr, __VA_ARGS__); abort(); } while (0)
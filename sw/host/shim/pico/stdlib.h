@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in for the Pico SDK's pico/stdlib.h
+
+#include <stdio.h>
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
@@ -0,0 +1,37 @@
+#pragma once
+
+// Host stand-in for pico/time.h. Time is virtual: it only moves forward when
+// the host program calls host_time_advance_us(), and any alarms that fall due
+// are run synchronously from there.
+
+#include "pico/platform.h"
+#include "hardware/timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PICO_TIME_DEFAULT_ALARM_POOL_MAX_TIMERS 16
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+typedef struct alarm_pool alarm_pool_t;
+
+alarm_pool_t *alarm_pool_create_with_unused_hardware_alarm(uint max_timers);
+uint alarm_pool_timer_alarm_num(alarm_pool_t *pool);
+alarm_id_t alarm_pool_add_alarm_in_us(alarm_pool_t *pool, uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool alarm_pool_cancel_alarm(alarm_pool_t *pool, alarm_id_t alarm_id);
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void busy_wait_us(uint64_t delay_us);
+void busy_wait_ms(uint32_t delay_ms);
+
+// Host-only: move virtual time forward, firing every alarm that comes due
+void host_time_advance_us(uint64_t us);
+// Host-only: number of alarm callbacks fired since startup
+uint32_t host_alarms_fired(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+// Host stand-in for rp2040-psram. PSRAM is an ordinary array; every call is
+// counted as one SPI transaction so the benchmarks can report bus traffic.
+
+#include <string.h>
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_PSRAM_SIZE (8u * 1024u * 1024u)
+
+typedef struct psram_spi_inst {
+    uint8_t *mem;
+    uint32_t read_transactions;
+    uint32_t read_bytes;
+    uint32_t write_transactions;
+    uint32_t write_bytes;
+} psram_spi_inst_t;
+
+psram_spi_inst_t psram_spi_host_init(void);
+
+static inline void psram_read(psram_spi_inst_t *spi, uint32_t addr, uint8_t *dst, size_t count) {
+    ++spi->read_transactions;
+    spi->read_bytes += count;
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = spi->mem[(addr + i) & (HOST_PSRAM_SIZE - 1)];
+    }
+}
+static inline uint8_t psram_read8(psram_spi_inst_t *spi, uint32_t addr) {
+    uint8_t val;
+    psram_read(spi, addr, &val, 1);
+    return val;
+}
+static inline uint16_t psram_read16(psram_spi_inst_t *spi, uint32_t addr) {
+    uint8_t val[2];
+    psram_read(spi, addr, val, 2);
+    return (uint16_t)(val[0] | (val[1] << 8));
+}
+static inline void psram_write(psram_spi_inst_t *spi, uint32_t addr, const uint8_t *src, size_t count) {
+    ++spi->write_transactions;
+    spi->write_bytes += count;
+    for (size_t i = 0; i < count; ++i) {
+        spi->mem[(addr + i) & (HOST_PSRAM_SIZE - 1)] = src[i];
+    }
+}
+static inline void psram_write8(psram_spi_inst_t *spi, uint32_t addr, uint8_t val) {
+    psram_write(spi, addr, &val, 1);
+}
+static inline void psram_write8_async(psram_spi_inst_t *spi, uint32_t addr, uint8_t val) {
+    psram_write(spi, addr, &val, 1);
+}
+static inline void psram_write32_async(psram_spi_inst_t *spi, uint32_t addr, uint32_t val) {
+    const uint8_t bytes[4] = {(uint8_t)val, (uint8_t)(val >> 8), (uint8_t)(val >> 16), (uint8_t)(val >> 24)};
+    psram_write(spi, addr, bytes, 4);
+}
+
+#ifdef __cplusplus
+}
+#endif
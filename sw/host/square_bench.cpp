@@ -0,0 +1,286 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Host-side measurement of the Tandy and CMS square wave generators.
+//
+// Compares the band-limited generators in square/square.cpp with the
+// per-frame ones they replaced (square_naive.cpp). For one voice playing a
+// tone across the range it reports the power of everything in the output that
+// isn't a harmonic of the tone below 22.05kHz, which is aliasing, relative to
+// the whole output, and the level of the fundamental against the old
+// generator's. Then it times music on 1 and 3 Tandy voices and on all 12 CMS
+// voices, rendered in the 64-frame blocks play_psg() uses.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "square/square.h"
+#include "psg_chip.h"
+#include "spectrum.h"
+
+static constexpr uint32_t FFT_SIZE = 16384;
+// Half-width of a tone's peak in the spectrum, in bins
+static constexpr int LOBE_BINS = 8;
+// Frames play_psg() renders at a time
+static constexpr uint32_t BUFFER_FRAMES = 64;
+// Tone frequencies are set up for
+static constexpr double TANDY_CLOCK = 3579545.0 / 32;
+static constexpr double SAA_CLOCK = 3579545.0;
+
+namespace {
+
+class blep_tandy : public psg_chip {
+public:
+    void write(uint16_t, uint8_t data) override { m_tandy.write_register(0, data); }
+    void generate(int32_t *dest, uint32_t frames) override { m_tandy.generator().generate_frames(dest, frames); }
+
+private:
+    tandysound_t m_tandy;
+};
+
+class blep_cms : public psg_chip {
+public:
+    void write(uint16_t reg, uint8_t data) override {
+        const uint32_t chip = (reg >> 8) & 1;
+        m_cms.write_addr(chip * 2 + 1, reg & 0xff);
+        m_cms.write_data(chip * 2, data);
+    }
+    void generate(int32_t *dest, uint32_t frames) override {
+        m_cms.generator(0).generate_frames(dest, frames);
+        m_cms.generator(1).generate_frames(dest, frames);
+    }
+
+private:
+    cms_t m_cms;
+};
+
+} // namespace
+
+psg_chip *new_tandy() {
+    return new blep_tandy;
+}
+
+psg_chip *new_cms() {
+    return new blep_cms;
+}
+
+// Tandy tone on voice 0-2 at full volume, or silenced
+static double tandy_tone(psg_chip *chip, uint32_t voice, uint16_t divisor, bool on = true) {
+    chip->write(0, 0x80 | voice << 5 | (divisor & 0xf));
+    chip->write(0, (divisor >> 4) & 0x3f);
+    chip->write(0, 0x90 | voice << 5 | (on ? 0 : 15));
+    return TANDY_CLOCK / divisor;
+}
+
+// SAA1099 tone on voice 0-5 of a chip, at full volume on both sides
+static double cms_tone(psg_chip *chip, uint32_t voice, uint8_t octave, uint8_t frequency) {
+    static uint8_t octaves[2][3];
+    const uint16_t c = (voice / 6) << 8, v = voice % 6;
+    uint8_t &packed = octaves[voice / 6][v / 2];
+    packed = (v & 1) ? (packed & 0x0f) | octave << 4 : (packed & 0xf0) | octave;
+    chip->write(c | v, 0xff);
+    chip->write(c | (0x08 + v), frequency);
+    chip->write(c | (0x10 + v / 2), packed);
+    return SAA_CLOCK / ((511 - frequency) << (8 - octave));
+}
+
+static void cms_enable(psg_chip *chip, uint8_t tones, uint8_t noises, uint16_t c = 0) {
+    chip->write(c | 0x1c, 0x01);
+    chip->write(c | 0x14, tones);
+    chip->write(c | 0x15, noises);
+}
+
+static double band_power(const std::vector<double>& p, double hz) {
+    const int centre = (int)lround(hz * FFT_SIZE / OUTPUT_FREQUENCY);
+    double total = 0;
+    for (int i = centre - LOBE_BINS; i <= centre + LOBE_BINS; ++i) {
+        if (i >= 0 && i < (int)p.size()) {
+            total += p[i];
+        }
+    }
+    return total;
+}
+
+struct Result {
+    double alias_db;
+    double fundamental;
+};
+
+// Left channel of the chip's output after it has settled
+static Result measure(psg_chip *chip, double tone) {
+    std::vector<int32_t> frames(2 * (1024 + FFT_SIZE));
+    chip->generate(frames.data(), 1024 + FFT_SIZE);
+    std::vector<double> left(FFT_SIZE);
+    for (uint32_t i = 0; i < FFT_SIZE; ++i) {
+        left[i] = frames[2 * (1024 + i)];
+    }
+    const std::vector<double> p = spectrum(left);
+    double total = 0;
+    for (uint32_t i = LOBE_BINS + 1; i < p.size(); ++i) {
+        total += p[i];
+    }
+    double harmonics = 0;
+    for (double hz = tone; hz < OUTPUT_FREQUENCY / 2 - (double)LOBE_BINS * OUTPUT_FREQUENCY / FFT_SIZE; hz += tone) {
+        harmonics += band_power(p, hz);
+    }
+    return {10 * log10((total - harmonics) / total), band_power(p, tone)};
+}
+
+static void compare(const char *name, psg_chip *naive, psg_chip *blep, double tone) {
+    const Result old_result = measure(naive, tone);
+    const Result new_result = measure(blep, tone);
+    printf("%-6s %7.0f %9.1f %9.1f %9.2f\n", name, tone, old_result.alias_db, new_result.alias_db,
+           10 * log10(new_result.fundamental / old_result.fundamental));
+}
+
+// Plays a tune for seconds, changing notes every 100ms, and returns the time taken per frame
+template<typename Play>
+static double time_tune(psg_chip *chip, uint32_t seconds, Play play) {
+    const uint32_t frames = seconds * OUTPUT_FREQUENCY;
+    const uint32_t note_frames = OUTPUT_FREQUENCY / 10;
+    int32_t buf[BUFFER_FRAMES * 2];
+    int32_t sink = 0;
+    const auto begin = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame += BUFFER_FRAMES) {
+        if (frame % note_frames < BUFFER_FRAMES) {
+            play(chip, frame / note_frames);
+        }
+        memset(buf, 0, sizeof(buf));
+        chip->generate(buf, BUFFER_FRAMES);
+        sink += buf[0];
+    }
+    const auto end = std::chrono::steady_clock::now();
+    volatile int32_t keep = sink;
+    (void)keep;
+    return std::chrono::duration<double, std::nano>(end - begin).count() / frames;
+}
+
+// Chords over two octaves around middle C
+static const double tune_hz[8] = {262, 330, 392, 523, 220, 277, 330, 440};
+
+static void tandy_tune(psg_chip *chip, uint32_t note) {
+    for (uint32_t voice = 0; voice < 3; ++voice) {
+        const double hz = tune_hz[(note + voice * 3) & 7] * (voice == 2 ? 0.5 : 1) * (1 << (voice & 1));
+        tandy_tone(chip, voice, (uint16_t)lround(TANDY_CLOCK / hz));
+    }
+}
+
+// A bass line on one voice, the others silent
+static void tandy_bass(psg_chip *chip, uint32_t note) {
+    tandy_tone(chip, 0, (uint16_t)lround(TANDY_CLOCK * 2 / tune_hz[note & 7]));
+    tandy_tone(chip, 1, 1, false);
+    tandy_tone(chip, 2, 1, false);
+}
+
+static void cms_tune(psg_chip *chip, uint32_t note) {
+    if (note == 0) {
+        cms_enable(chip, 0x3f, 0x00);
+        cms_enable(chip, 0x1f, 0x20, 0x100);
+        // Noise on the last voice, clocked at 14kHz; a repeating decay on voice 2
+        chip->write(0x116, 0x10);
+        chip->write(0x018, 0x86);
+    }
+    for (uint32_t voice = 0; voice < 12; ++voice) {
+        // Octave 2 to 5, with the frequency byte giving the note within it
+        const double hz = tune_hz[(note + voice) & 7] * (1 << (voice % 4)) / 4;
+        uint8_t octave = 0;
+        while (SAA_CLOCK / (256 << (8 - octave)) < hz) {
+            ++octave;
+        }
+        cms_tone(chip, voice, octave, (uint8_t)lround(511 - SAA_CLOCK / (hz * (1 << (8 - octave)))));
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-s seconds] [-c MHz]\n"
+            "  -s  seconds of music timed per generator (default 10)\n"
+            "  -c  host CPU clock, to report cycles per frame as well\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = 10;
+    double mhz = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            mhz = strtod(argv[++i], NULL);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!seconds) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%-6s %7s %9s %9s %9s\n", "chip", "tone", "old alias", "new alias", "tone diff");
+    static const uint16_t divisors[] = {254, 56, 22, 11};
+    for (uint16_t divisor : divisors) {
+        std::unique_ptr<psg_chip> naive(new_naive_tandy()), blep(new_tandy());
+        const double hz = tandy_tone(naive.get(), 0, divisor);
+        tandy_tone(blep.get(), 0, divisor);
+        compare("tandy", naive.get(), blep.get(), hz);
+    }
+    // About 440Hz, 2kHz, 5kHz and 7kHz, the highest tone
+    static const uint8_t cms_notes[][2] = {{4, 3}, {6, 64}, {7, 153}, {7, 255}};
+    for (const auto& note : cms_notes) {
+        std::unique_ptr<psg_chip> naive(new_naive_cms()), blep(new_cms());
+        cms_enable(naive.get(), 0x01, 0x00);
+        cms_enable(blep.get(), 0x01, 0x00);
+        const double hz = cms_tone(naive.get(), 0, note[0], note[1]);
+        cms_tone(blep.get(), 0, note[0], note[1]);
+        compare("cms", naive.get(), blep.get(), hz);
+    }
+
+    printf("\n%-16s %10s %10s %9s", "music", "old ns", "new ns", "x old");
+    if (mhz > 0) {
+        printf(" %10s %10s", "old cycles", "new cycles");
+    }
+    printf("\n");
+    struct Tune {
+        const char *name;
+        psg_chip *(*naive)();
+        psg_chip *(*blep)();
+        void (*play)(psg_chip *, uint32_t);
+    };
+    static const Tune tunes[] = {
+        {"tandy 1 voice", new_naive_tandy, new_tandy, tandy_bass},
+        {"tandy 3 voices", new_naive_tandy, new_tandy, tandy_tune},
+        {"cms 12 voices", new_naive_cms, new_cms, cms_tune},
+    };
+    for (const Tune& tune : tunes) {
+        std::unique_ptr<psg_chip> naive(tune.naive()), blep(tune.blep());
+        const double old_ns = time_tune(naive.get(), seconds, tune.play);
+        const double new_ns = time_tune(blep.get(), seconds, tune.play);
+        printf("%-16s %10.1f %10.1f %9.2f", tune.name, old_ns, new_ns, new_ns / old_ns);
+        if (mhz > 0) {
+            printf(" %10.0f %10.0f", old_ns * mhz / 1000, new_ns * mhz / 1000);
+        }
+        printf("\n");
+    }
+    return 0;
+}
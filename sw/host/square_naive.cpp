@@ -0,0 +1,72 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// square/square.cpp built with SQUARE_NAIVE, sampling the square waves every
+// frame as the firmware did before the band-limited generators, for
+// square_bench to compare against. Its classes are renamed so they can be
+// linked alongside the firmware's build.
+
+#define SQUARE_NAIVE 1
+#define speaker_generator_t naive_speaker_generator_t
+#define speaker_t naive_speaker_t
+#define tandy_generator_t naive_tandy_generator_t
+#define tandysound_t naive_tandysound_t
+#define saa1099_generator_t naive_saa1099_generator_t
+#define cms_t naive_cms_t
+#define blep_buffer_t naive_blep_buffer_t
+
+#include "square/square.cpp"
+
+#include "psg_chip.h"
+
+namespace {
+
+class naive_tandy : public psg_chip {
+public:
+    void write(uint16_t, uint8_t data) override { m_tandy.write_register(0, data); }
+    void generate(int32_t *dest, uint32_t frames) override { m_tandy.generator().generate_frames(dest, frames); }
+
+private:
+    tandysound_t m_tandy;
+};
+
+class naive_cms : public psg_chip {
+public:
+    void write(uint16_t reg, uint8_t data) override {
+        const uint32_t chip = (reg >> 8) & 1;
+        m_cms.write_addr(chip * 2 + 1, reg & 0xff);
+        m_cms.write_data(chip * 2, data);
+    }
+    void generate(int32_t *dest, uint32_t frames) override {
+        m_cms.generator(0).generate_frames(dest, frames);
+        m_cms.generator(1).generate_frames(dest, frames);
+    }
+
+private:
+    cms_t m_cms;
+};
+
+} // namespace
+
+psg_chip *new_naive_tandy() {
+    return new naive_tandy;
+}
+
+psg_chip *new_naive_cms() {
+    return new naive_cms;
+}
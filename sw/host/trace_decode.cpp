@@ -0,0 +1,187 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Decodes trace records from a TRACE firmware build into Chrome trace JSON,
+// for chrome://tracing or ui.perfetto.dev.
+//
+// The input is a raw capture of the debug UART, or a pgusinit /tracedump
+// file. Frames are found by their sync byte and checked against their XOR
+// byte, so console text mixed into a UART capture is skipped. Each core is
+// shown as its own thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "system/trace.h"
+
+static const char *event_names[TRACE_EVENT_COUNT] = {
+    NULL,
+    "iow",
+    "ior",
+    "iochrdy",
+    "dma",
+    "render",
+    "render",
+    "underrun",
+    "overrun",
+    "alarm",
+    "dropped",
+};
+
+// Reads the frames in buf, appending the records whose checksum matches. Returns the number of
+// bytes skipped.
+static size_t parse_frames(const std::vector<uint8_t>& buf, std::vector<trace_record_t>& records) {
+    size_t skipped = 0;
+    size_t i = 0;
+    while (i < buf.size()) {
+        if (buf[i] != TRACE_FRAME_SYNC || i + TRACE_FRAME_SIZE > buf.size()) {
+            ++skipped;
+            ++i;
+            continue;
+        }
+        uint8_t check = 0;
+        for (size_t j = 1; j <= sizeof(trace_record_t); ++j) {
+            check ^= buf[i + j];
+        }
+        trace_record_t record;
+        memcpy(&record, &buf[i + 1], sizeof(record));
+        if (check != buf[i + TRACE_FRAME_SIZE - 1] || record.event == 0 ||
+            record.event >= TRACE_EVENT_COUNT || record.core > 1) {
+            ++skipped;
+            ++i;
+            continue;
+        }
+        records.push_back(record);
+        i += TRACE_FRAME_SIZE;
+    }
+    return skipped;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [-c MHz] [-o trace.json] capture.bin\n"
+            "  -c  CPU clock the firmware runs at, for IOCHRDY stall lengths (default 370)\n"
+            "  -o  write the JSON here instead of stdout\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    double mhz = 370.0;
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            mhz = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] == '-' || in_path) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            in_path = argv[i];
+        }
+    }
+    if (!in_path || mhz <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(in_path, "rb");
+    if (!in) {
+        perror(in_path);
+        return 1;
+    }
+    std::vector<uint8_t> buf;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        buf.insert(buf.end(), chunk, chunk + n);
+    }
+    fclose(in);
+
+    std::vector<trace_record_t> records;
+    const size_t skipped = parse_frames(buf, records);
+
+    FILE *out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    fprintf(out, "{\"traceEvents\":[");
+    for (unsigned core = 0; core < 2; ++core) {
+        fprintf(out, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"core%u\"}}",
+                core ? "," : "", core, core);
+    }
+    // The firmware's timer is 32 bits of microseconds, so it wraps every 71 minutes
+    uint64_t time = 0;
+    uint32_t last = records.empty() ? 0 : records[0].time_us;
+    uint32_t stalls = 0, underruns = 0, dropped = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const trace_record_t& r = records[i];
+        const int32_t delta = (int32_t)(r.time_us - last);
+        // Records from the two cores can arrive slightly out of order; only move forward
+        if (delta > 0) {
+            time += delta;
+            last = r.time_us;
+        }
+        const double ts = (double)time + (delta < 0 ? delta : 0);
+        const char *name = event_names[r.event];
+        fprintf(out, ",\n");
+        switch (r.event) {
+        case TRACE_RENDER_BEGIN:
+        case TRACE_RENDER_END:
+            fprintf(out, "{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%.0f,\"args\":{\"frames\":%u}}",
+                    r.event == TRACE_RENDER_BEGIN ? "B" : "E", name, r.core, ts, r.arg);
+            break;
+        case TRACE_IOCHRDY: {
+            // Recorded when the handler finishes, so the stall started dur earlier
+            const double dur = r.arg / mhz;
+            fprintf(out, "{\"ph\":\"X\",\"name\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cycles\":%u}}",
+                    name, r.core, ts - dur, dur, r.arg);
+            ++stalls;
+            break;
+        }
+        case TRACE_IOW:
+        case TRACE_IOR:
+            fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%.0f,\"args\":{\"port\":\"0x%x\"}}",
+                    name, r.core, ts, r.arg);
+            break;
+        default:
+            fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%.0f,\"args\":{\"arg\":%u}}",
+                    name, r.core, ts, r.arg);
+            underruns += r.event == TRACE_UNDERRUN;
+            dropped += r.event == TRACE_DROPPED ? r.arg : 0;
+            break;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "%zu records (%u IOCHRDY stalls, %u underruns, %u dropped), %zu bytes skipped\n",
+            records.size(), stalls, underruns, dropped, skipped);
+    return 0;
+}
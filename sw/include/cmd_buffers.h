@@ -1,19 +1,66 @@
 #pragma once
 /*
- * Command buffers for CMS and Tandy bus events
+ * Command buffers for CMS, Tandy and OPL bus events
  */
 
-typedef struct cms_buffer_t {
+#include <stdint.h>
+
+#include "hardware/sync.h"
+
+// Tandy and CMS writes, each stamped with time_us_32() when it was made so play_psg() can apply
+// it at the matching frame. Tandy writes leave addr unused.
+#define PSG_CMD_QUEUE_SIZE 512 // Must be power of 2
+
+typedef struct psg_cmd_queue_t {
+    struct {
+        uint32_t time;
+        uint16_t addr;
+        uint8_t data;
+    } cmds[PSG_CMD_QUEUE_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    // Writes dropped because the queue was full
+    volatile uint32_t overflows;
+} psg_cmd_queue_t;
+
+static inline void psg_cmd_queue_push(psg_cmd_queue_t *q, uint32_t time, uint16_t addr, uint8_t data) {
+    const uint32_t head = q->head;
+    if (head - q->tail >= PSG_CMD_QUEUE_SIZE) {
+        ++q->overflows;
+        return;
+    }
+    q->cmds[head & (PSG_CMD_QUEUE_SIZE - 1)].time = time;
+    q->cmds[head & (PSG_CMD_QUEUE_SIZE - 1)].addr = addr;
+    q->cmds[head & (PSG_CMD_QUEUE_SIZE - 1)].data = data;
+    __dmb();
+    q->head = head + 1;
+}
+
+// OPL register writes, each stamped with the output sample clock when it was made so the
+// renderer can apply it at the matching sample
+#define OPL_CMD_QUEUE_SIZE 1024 // Must be power of 2
+
+typedef struct opl_cmd_queue_t {
     struct {
+        uint32_t time;
         uint16_t addr;
         uint8_t data;
-    } cmds[256];
-    volatile uint8_t head;
-    volatile uint8_t tail;
-} cms_buffer_t;
-
-typedef struct tandy_buffer_t {
-    uint8_t cmds[256];
-    volatile uint8_t head;
-    volatile uint8_t tail;
-} tandy_buffer_t;
+    } cmds[OPL_CMD_QUEUE_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    // Writes dropped because the queue was full
+    volatile uint32_t overflows;
+} opl_cmd_queue_t;
+
+static inline void opl_cmd_queue_push(opl_cmd_queue_t *q, uint32_t time, uint16_t addr, uint8_t data) {
+    const uint32_t head = q->head;
+    if (head - q->tail >= OPL_CMD_QUEUE_SIZE) {
+        ++q->overflows;
+        return;
+    }
+    q->cmds[head & (OPL_CMD_QUEUE_SIZE - 1)].time = time;
+    q->cmds[head & (OPL_CMD_QUEUE_SIZE - 1)].addr = addr;
+    q->cmds[head & (OPL_CMD_QUEUE_SIZE - 1)].data = data;
+    __dmb();
+    q->head = head + 1;
+}
@@ -18,6 +18,9 @@
 
 #include "isa_dma.h"
 
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+
 dma_inst_t DMA_init(PIO pio, uint sm, irq_handler_t dma_isr) {
     dma_inst_t dma;
     dma.offset = pio_add_program(pio, &dma_write_program);
@@ -37,3 +40,105 @@ dma_inst_t DMA_init(PIO pio, uint sm, irq_handler_t dma_isr) {
 
     return dma;
 };
+
+// Word written to the PIO to trigger each cycle of a burst
+static const uint32_t burst_trigger = 0xffffffffu;
+static uint32_t burst_buffer[2][DMA_BURST_WORDS] __attribute__((aligned(4)));
+
+void DMA_Burst_Init(dma_inst_t* dma, irq_handler_t burst_isr) {
+    dma->burst_trigger_chan = dma_claim_unused_channel(true);
+    dma->burst_collect_chan[0] = dma_claim_unused_channel(true);
+    dma->burst_collect_chan[1] = dma_claim_unused_channel(true);
+    dma->burst_timer = dma_claim_unused_timer(true);
+    dma->burst_next = 0;
+
+    irq_set_exclusive_handler(DMA_IRQ_1, burst_isr);
+    irq_set_priority(DMA_IRQ_1, PICO_HIGHEST_IRQ_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+}
+
+bool DMA_Burst_Start(dma_inst_t* dma, uint32_t interval_us) {
+    // The timer paces at clk_sys * X / Y, and Y is only 16 bits
+    const uint32_t clocks_per_us = clock_get_hz(clk_sys) / 1000000u;
+    if (!interval_us || clocks_per_us * interval_us > 0xffffu) {
+        return false;
+    }
+    dma_timer_set_fraction(dma->burst_timer, 1, clocks_per_us * interval_us);
+
+    // Words from the PIO go to alternate buffers, each channel starting the other when it fills
+    for (int i = 0; i < 2; ++i) {
+        const int chan = dma->burst_collect_chan[i];
+        dma_channel_config c = dma_channel_get_default_config(chan);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_dreq(&c, pio_get_dreq(dma->pio, dma->sm, false));
+        channel_config_set_chain_to(&c, dma->burst_collect_chan[i ^ 1]);
+        dma_channel_configure(chan, &c, burst_buffer[i], &dma->pio->rxf[dma->sm], DMA_BURST_WORDS, false);
+        dma_channel_acknowledge_irq1(chan);
+        dma_channel_set_irq1_enabled(chan, true);
+    }
+    dma->burst_next = 0;
+
+    // One trigger per timer tick for as long as the transfer runs
+    dma_channel_config c = dma_channel_get_default_config(dma->burst_trigger_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, dma_get_timer_dreq(dma->burst_timer));
+    dma_channel_configure(dma->burst_trigger_chan, &c, &dma->pio->txf[dma->sm], &burst_trigger, 0xffffffffu, false);
+
+    // The collecting channels empty the RX FIFO, so only the PIO stopping at TC interrupts
+    const uint sm_source = pis_sm0_rx_fifo_not_empty + dma->sm;
+    pio_set_irq0_source_enabled(dma->pio, sm_source, false);
+    pio_interrupt_clear(dma->pio, dma->sm);
+    pio_set_irq0_source_enabled(dma->pio, pis_interrupt0 + dma->sm, true);
+
+    dma_channel_start(dma->burst_collect_chan[0]);
+    dma_channel_start(dma->burst_trigger_chan);
+    return true;
+}
+
+void DMA_Burst_Stop(dma_inst_t* dma) {
+    dma_channel_abort(dma->burst_trigger_chan);
+    // Let the collecting channels take whatever the PIO has already pushed
+    while (!pio_sm_is_rx_fifo_empty(dma->pio, dma->sm) &&
+           (dma_channel_is_busy(dma->burst_collect_chan[0]) || dma_channel_is_busy(dma->burst_collect_chan[1]))) {
+        tight_loop_contents();
+    }
+    // Aborting a channel can raise its completion interrupt (RP2040-E13), so mask it first
+    for (int i = 0; i < 2; ++i) {
+        dma_channel_set_irq1_enabled(dma->burst_collect_chan[i], false);
+        dma_channel_abort(dma->burst_collect_chan[i]);
+        dma_channel_acknowledge_irq1(dma->burst_collect_chan[i]);
+    }
+
+    pio_set_irq0_source_enabled(dma->pio, pis_interrupt0 + dma->sm, false);
+    DMA_Cancel_Write(dma);
+    pio_sm_clear_fifos(dma->pio, dma->sm);
+    pio_set_irq0_source_enabled(dma->pio, pis_sm0_rx_fifo_not_empty + dma->sm, true);
+}
+
+uint32_t DMA_Burst_Complete(dma_inst_t* dma, const uint32_t** words) {
+    // A buffer has filled once its channel's write address reaches the end of it
+    const uint8_t next = dma->burst_next;
+    const int chan = dma->burst_collect_chan[next];
+    if (dma_hw->ch[chan].write_addr != (uintptr_t)(burst_buffer[next] + DMA_BURST_WORDS)) {
+        return 0;
+    }
+    dma_channel_acknowledge_irq1(chan);
+    // The other channel is filling its buffer now; this one is next after it
+    dma_channel_set_write_addr(chan, burst_buffer[next], false);
+    dma->burst_next = next ^ 1;
+    *words = burst_buffer[next];
+    return DMA_BURST_WORDS;
+}
+
+uint32_t DMA_Burst_Remainder(dma_inst_t* dma, const uint32_t** words) {
+    const uint8_t next = dma->burst_next;
+    const int chan = dma->burst_collect_chan[next];
+    const uint32_t count = (dma_hw->ch[chan].write_addr - (uintptr_t)burst_buffer[next]) / sizeof(uint32_t);
+    dma_channel_set_write_addr(chan, burst_buffer[next], false);
+    *words = burst_buffer[next];
+    return count;
+}
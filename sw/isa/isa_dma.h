@@ -38,12 +38,33 @@ typedef struct dma_inst {
     uint sm;
     uint offset;
     bool invertMsb;
+    // Burst mode resources, claimed by DMA_Burst_Init
+    int burst_trigger_chan;
+    int burst_collect_chan[2];
+    int burst_timer;
+    uint8_t burst_next;
 } dma_inst_t;
 
 dma_inst_t DMA_init(PIO pio, uint sm, irq_handler_t dma_isr);
 
+// Burst mode: a DMA channel paced by a DMA timer triggers the PIO once per interval, and two chained
+// channels collect its words into a pair of SRAM buffers, so the CPU is interrupted once per
+// DMA_BURST_WORDS cycles (on DMA_IRQ_1) and once more when the PIO stops at TC (on the PIO IRQ).
+#define DMA_BURST_WORDS 256
+void DMA_Burst_Init(dma_inst_t* dma, irq_handler_t burst_isr);
+// Returns false if interval_us is too long for the DMA timer to pace
+bool DMA_Burst_Start(dma_inst_t* dma, uint32_t interval_us);
+// Stops triggering and collecting. Words already collected are still returned by
+// DMA_Burst_Complete and then DMA_Burst_Remainder.
+void DMA_Burst_Stop(dma_inst_t* dma);
+// Returns DMA_BURST_WORDS and points words at the next buffer if it has filled, otherwise 0
+uint32_t DMA_Burst_Complete(dma_inst_t* dma, const uint32_t** words);
+// After DMA_Burst_Stop, returns the words collected into the partly filled buffer
+uint32_t DMA_Burst_Remainder(dma_inst_t* dma, const uint32_t** words);
+
 // __force_inline size_t DMA_Write(dma_inst_t* dma, uint32_t dmaaddr, bool invert_msb, bool is_16bit, uint32_t delay, bool* dma_active) {
 __force_inline extern void DMA_Start_Write(dma_inst_t* dma) {
+    pio_interrupt_clear(dma->pio, dma->sm);  // Release the PIO if it stopped at TC
     pio_sm_put_blocking(dma->pio, dma->sm, 0xffffffffu);  // Write 1s to kick off DMA process. note that these 1s are used to set TC flag in PIO!
 }
 
@@ -55,7 +76,9 @@ __force_inline extern uint32_t DMA_Complete_Write(dma_inst_t* dma) {
 }
 
 __force_inline extern void DMA_Cancel_Write(dma_inst_t* dma) {
-    pio_sm_exec(dma->pio, dma->sm, pio_encode_jmp(dma->offset));
+    pio_sm_exec(dma->pio, dma->sm, pio_encode_set(pio_pins, 0));  // deassert DRQ
+    pio_sm_exec(dma->pio, dma->sm, pio_encode_jmp(dma->offset + dma_write_offset_start));
+    pio_interrupt_clear(dma->pio, dma->sm);
 }
 
 #ifdef __cplusplus
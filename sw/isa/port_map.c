@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "port_map.h"
+
+#include <string.h>
+
+#include "../common/picogus.h"
+
+uint8_t port_map[PORT_MAP_SIZE];
+
+// Disabled devices have a base port of 0xffff, which is outside the map
+static void port_map_set(uint32_t first, uint32_t count, uint8_t entry) {
+    for (uint32_t port = first; port < first + count && port < PORT_MAP_SIZE; ++port) {
+        port_map[port] = entry;
+    }
+}
+
+void port_map_build(const Settings* settings, uint32_t devices) {
+    memset(port_map, IO_NONE, sizeof(port_map));
+
+    // Lowest priority first, so each device overwrites the ones handle_iow used to test after it
+    port_map_set(CONTROL_PORT, 1, IO_CONTROL);
+    port_map_set(DATA_PORT_LOW, 1, IO_DATA_LOW | IO_FAST_WRITE);
+    port_map_set(DATA_PORT_HIGH, 1, IO_DATA_HIGH);
+
+    if ((devices & IO_DEV(IO_MPU)) && !(settings->MPU.basePort & 1)) {
+        // Data and command/status
+        port_map_set(settings->MPU.basePort, 2, IO_MPU);
+    }
+    if ((devices & IO_DEV(IO_CMS)) && !(settings->CMS.basePort & 0xf)) {
+        port_map_set(settings->CMS.basePort, 16, IO_CMS | IO_FAST_WRITE);
+    }
+    if ((devices & IO_DEV(IO_NE2K)) && !(settings->NE2K.basePort & 0x1f)) {
+        port_map_set(settings->NE2K.basePort, 32, IO_NE2K);
+    }
+    if ((devices & IO_DEV(IO_MOUSE)) && !(settings->Mouse.basePort & 7)) {
+        port_map_set(settings->Mouse.basePort, 8, IO_MOUSE);
+    }
+    if (devices & IO_DEV(IO_JOY)) {
+        port_map_set(settings->Joy.basePort, 1, IO_JOY | IO_FAST_WRITE);
+    }
+    if (devices & IO_DEV(IO_TANDY)) {
+        port_map_set(settings->Tandy.basePort, 1, IO_TANDY | IO_FAST_WRITE);
+    }
+    if ((devices & IO_DEV(IO_OPL)) && !(settings->SB.oplBasePort & 1)) {
+        // Address writes are fast, data writes wait for the chip
+        port_map_set(settings->SB.oplBasePort, 1, IO_OPL | IO_FAST_WRITE);
+        port_map_set(settings->SB.oplBasePort + 1, 1, IO_OPL);
+#if USE_NUKED_OPL3
+        // Second register bank
+        if (!(settings->SB.oplBasePort & 2)) {
+            port_map_set(settings->SB.oplBasePort + 2, 1, IO_OPL | IO_FAST_WRITE);
+            port_map_set(settings->SB.oplBasePort + 3, 1, IO_OPL);
+        }
+#endif
+    }
+    if (devices & IO_DEV(IO_CDROM)) {
+        port_map_set(settings->CD.basePort & ~0xfu, 16, IO_CDROM);
+    }
+    if (devices & IO_DEV(IO_SB)) {
+        const uint32_t first = settings->SB.basePort & ~0xfu;
+        port_map_set(first, 16, IO_SB);
+        // OPL address port
+        if (((settings->SB.basePort + 0x8u) & ~0xfu) == first) {
+            port_map_set(settings->SB.basePort + 0x8u, 1, IO_SB | IO_FAST_WRITE);
+        }
+    }
+    if (devices & IO_DEV(IO_GUS)) {
+        // The GF1 decodes 2X0-2XF and 3X0-3XF, ignoring address bit 8
+        const uint32_t first = settings->GUS.basePort & ~0x10fu;
+        port_map_set(first, 16, IO_GUS);
+        port_map_set(first | 0x100u, 16, IO_GUS);
+        // AdLib command, IRQ/DMA control, voice select, register select and data low
+        static const uint16_t fast[] = {0x8, 0xb, 0x102, 0x103, 0x104};
+        for (uint32_t i = 0; i < sizeof(fast) / sizeof(fast[0]); ++i) {
+            const uint32_t port = settings->GUS.basePort + fast[i];
+            if ((port & ~0x10fu) == first) {
+                port_map_set(port, 1, IO_GUS | IO_FAST_WRITE);
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// Map from the 10-bit ISA port address to the device that handles it, so handle_iow/handle_ior
+// take the same time to find any device. Rebuilt by port_map_build whenever a base port changes.
+
+#include <stdint.h>
+
+#include "system/flash_settings.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Device ids; also the case of handle_iow/handle_ior that handles the port
+enum io_device {
+    IO_NONE = 0,
+    IO_GUS,
+    IO_SB,
+    IO_CDROM,
+    IO_OPL,
+    IO_TANDY,
+    IO_JOY,
+    IO_MOUSE,
+    IO_NE2K,
+    IO_CMS,
+    IO_MPU,
+    IO_CONTROL,
+    IO_DATA_LOW,
+    IO_DATA_HIGH,
+    IO_DEVICE_COUNT
+};
+
+#define IO_DEVICE_MASK 0x7f
+// Writes to the port are acknowledged before they are handled, without holding IOCHRDY
+#define IO_FAST_WRITE 0x80
+
+#define IO_DEV(id) (1u << (id))
+
+#define PORT_MAP_SIZE 1024
+
+extern uint8_t port_map[PORT_MAP_SIZE];
+
+// Fills the map from the base ports in settings for the devices in the devices mask (IO_DEV bits).
+// Where two devices overlap, the one handle_iow used to test first wins.
+void port_map_build(const Settings* settings, uint32_t devices);
+
+#ifdef __cplusplus
+}
+#endif
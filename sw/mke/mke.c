@@ -341,9 +341,6 @@ uint8_t MKE_READ(uint16_t address) {
 void mke_init() {
     cdrom_fifo_init(&cdrom.data_fifo,2048+2048);
     cdrom_fifo_init(&cdrom.info_fifo,32);
-#if USE_CD_AUDIO_FIFO
-    cdrom_audio_fifo_init(&cdrom);
-#endif
     mke_log("FIFOS, INFO=%p   DATA=%p\n",cdrom.info_fifo,cdrom.data_fifo);
 
     mke.command_buffer_pending=7;
@@ -43,7 +43,6 @@ Bit8u MPU401_ReadData(void);
 Bit8u MPU401_ReadStatus(void);
 void MPU401_WriteData(Bit8u val, bool crit);
 Bit8u QueueUsed();
-void send_midi_bytes(int maxbytes);
 
 #ifdef __cplusplus
 }
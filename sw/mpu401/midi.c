@@ -37,19 +37,24 @@
 #include "config.h"
 #include <util/delay.h>
 */
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "hardware/timer.h"
-#include "pico/critical_section.h"
-static critical_section_t midi_crit;
+#include "pico/time.h"
 
 /* SOFTMPU: Additional defines, typedefs etc. for C */
 typedef uint32_t Bit32u;
 typedef int32_t Bits;
 
-#define SYSEX_SIZE 8192     // sysex buffer for delay calculation
+#define SYSEX_SIZE 8192     // longest sysex counted for delay calculation
+#define SYSEX_HEADER 8      // bytes of each sysex kept to pick its delay
 
 /* RAWBUF: This is the buffer for outgoing MIDI data. The larger the buffer,
     the less likely it is to overrun when SysEx delay is enabled and large SysEx
-    transfers are occurring. */
+    transfers are occurring. PicoGUS: head is only written by PlayMsg, under
+    the MPU's critical section, and tail only by the DMA IRQ, so neither side
+    locks. Both count bytes without wrapping. */
 //#define RAWBUF  14336
 #ifdef MPU_ONLY
 #define RAWBUF  65536
@@ -61,8 +66,8 @@ typedef int32_t Bits;
 
 typedef struct ring_buffer {
     uint8_t buffer[RAWBUF];
-    uint32_t head;
-    uint32_t tail;
+    volatile uint32_t head;
+    volatile uint32_t tail;
 } ring_buffer;
 
 static ring_buffer midi_out_buff = { {0}, 0, 0 };
@@ -114,12 +119,12 @@ static struct {
     Bit8u cmd_buf[8];
     Bit8u rt_buf[8];
     struct {
-        Bit8u buf[SYSEX_SIZE];
+        Bit8u buf[SYSEX_HEADER];
         Bitu used;
         /* Bit8u usedbufs; */
         Bitu delay;
         bool extra_delay;
-        Bit32u start;
+        // Bit32u start;
         // bool delay;
         Bit8u status;
     } sysex;
@@ -131,42 +136,43 @@ static struct {
 /* SOFTMPU: Sysex delay is decremented from PIC_Update */
 //volatile Bitu MIDI_sysex_delaytime;
 
-/* HardMPU: Output a byte to the physical UART */
-__force_inline static void output_to_uart(Bit8u val)
-{
-    uart_write_blocking(uart0, &val, 1);
-}
-
-/* HardMPU: Wait for UART TX buffer to be empty */
-__force_inline static void wait_for_uart()
-{
-    uart_tx_wait_blocking(uart0);
-}
-
-/* HardMPU: Check UART TX status, returns 0 for ready */
-__force_inline static Bit8u uart_tx_status()
+/* PicoGUS: midi_out_buff is sent by a DMA channel pacing itself on the UART's
+   TX DREQ. Each burst runs from tail up to the end of a sysex, the buffer's
+   end or head, whichever comes first. The channel's completion interrupt
+   starts the next burst, or after a sysex arms the alarm that does so once
+   its delay has passed. PlayMsg forces the interrupt to restart an idle
+   channel, so nothing needs to poll. */
+static struct {
+    int chan;
+    int alarm;
+    // Bytes in the burst being sent
+    uint32_t burst;
+    // The burst ends a sysex and midi.sysex.delay is to pass after it
+    bool delay_after;
+    // Waiting on the alarm
+    volatile bool delaying;
+} midi_tx = { -1, -1, 0, false, false };
+
+/* PicoGUS: Raise the DMA IRQ from either core to get the channel going */
+__force_inline static void midi_tx_kick(void)
 {
-    return uart_is_writable(uart0) ? 0 : 1;
+    if (midi_tx.chan >= 0) hw_set_bits(&dma_hw->intf0, 1u << midi_tx.chan);
 }
 
 __force_inline static void PlayMsg(Bit8u* msg, Bitu len)
 {
     // despite the name of this function, we're just going to buffer this message to send later.
+    uint32_t head = midi_out_buff.head;
     for (Bitu i = 0; i < len; i++) {
         /* putchar('m'); */
-        critical_section_enter_blocking(&midi_crit);
-        uint32_t next = (midi_out_buff.head + 1) & RAWBUF_BITS;
-        if (next != midi_out_buff.tail) {
-            midi_out_buff.buffer[midi_out_buff.head] = msg[i];
-            midi_out_buff.head = next;
+        if (head - midi_out_buff.tail < RAWBUF) {
+            midi_out_buff.buffer[head & RAWBUF_BITS] = msg[i];
+            head++;
         }
-        critical_section_exit(&midi_crit);
     }
-}
-
-__force_inline static void send_midi_byte_now(Bit8u byte) {
-    /* wait_for_uart(); */
-    output_to_uart(byte);
+    __dmb();
+    midi_out_buff.head = head;
+    midi_tx_kick();
 }
 
 /* SOFTMPU: Fake "All Notes Off" for Roland RA-50 */
@@ -252,45 +258,26 @@ void MIDI_RawOutByte(Bit8u data) {
     }
 }
 
-__force_inline static bool send_midi_byte() { 
-    if (uart_tx_status()) return false;   // can't send yet
-    /* putchar('s'); */
-    critical_section_enter_blocking(&midi_crit);
-    if (midi_out_buff.head == midi_out_buff.tail) {
-        critical_section_exit(&midi_crit);
-        return false;   // nothing to send
-    }
-    if (midi.sysex.start) {
-        Bit32u passed_ticks = time_us_32() - midi.sysex.start;
-        if (passed_ticks < midi.sysex.delay) { // still waiting for sysex delay
-            critical_section_exit(&midi_crit);
-            return false; // Don't send data yet
-        }
-    }
-    Bit8u data = midi_out_buff.buffer[midi_out_buff.tail];
-    midi_out_buff.tail = (midi_out_buff.tail + 1) & RAWBUF_BITS;   // increment tail, wrap to 0 if we're at the end
-    critical_section_exit(&midi_crit);
-
-    if (midi.sysex.status==0xf0) { // Start 
-        /* putchar('s'); */
-        if (!(data&0x80)) {
-            /*
-            if (midi.sysex.used==SYSEX_SIZE) {
-                midi.sysex.used = 0;
-                midi.sysex.usedbufs++;
+/* PicoGUS: Tracks sysex through the bytes from pos up to end that are about to
+   be sent. A status byte ending a sysex goes out as 0xf7, as HardMPU sent it.
+   Returns where the burst should stop: after the end of a sysex, so its delay
+   can be taken before anything more is sent, or at end. */
+static uint32_t scan_sysex(uint32_t pos, uint32_t end)
+{
+    for (; pos != end; pos++) {
+        Bit8u* byte = &midi_out_buff.buffer[pos & RAWBUF_BITS];
+        Bit8u data = *byte;
+        if (midi.sysex.status==0xf0) { // Start 
+            if (!(data&0x80)) {
+                if (midi.sysex.used<SYSEX_HEADER) midi.sysex.buf[midi.sysex.used] = data;
+                if (midi.sysex.used<(SYSEX_SIZE-1)) midi.sysex.used++;
+                continue;
             }
-            */
-            
-            output_to_uart(data);
-            if (midi.sysex.used<(SYSEX_SIZE-1)) midi.sysex.buf[midi.sysex.used++] = data;
-            /* midi.sysex.buf[midi.sysex.used++] = data; */
-            return true;
-        } else {
-            output_to_uart(0xf7);
-            midi.sysex.buf[midi.sysex.used++] = 0xf7;
+            *byte = 0xf7;
+            midi.sysex.used++;
             midi.sysex.status = 0xf7;
                 /*LOG(LOG_ALL,LOG_NORMAL)("Play sysex; address:%02X %02X %02X, length:%4d, delay:%3d", midi.sysex.buf[5], midi.sysex.buf[6], midi.sysex.buf[7], midi.sysex.used, midi.sysex.delay);*/
-            if (midi.sysex.start) {
+            if (midi.sysex.extra_delay) {
                 /* if (midi.sysex.usedbufs == 0 && midi.sysex.buf[5] == 0x7F) { */
                 if (midi.sysex.buf[5] == 0x7F) {
                     midi.sysex.delay = 290; // PicoGUS // All Parameters reset
@@ -305,64 +292,113 @@ __force_inline static bool send_midi_byte() {
                     /* midi.sysex.delay = ((((midi.sysex.usedbufs*SYSEX_SIZE)+midi.sysex.used)/2)+2); */
                     // DOSBox:
                     /* midi.sysex.delay = (Bitu)(((float)(midi.sysex.used) * 1.25f) * 1000.0f / 3125.0f) + 2 */
-                    // PicoGUS: 1.25 * 1000.0 / 3125.0 = 0.4
+                    // PicoGUS: 1.25 * 1000.0 / 3125.0 = 0.4, in integers as this runs in the DMA IRQ
                     /* midi.sysex.delay = ((midi.sysex.usedbufs*SYSEX_SIZE)+midi.sysex.used) * 0.4f + 2; */
-                    midi.sysex.delay = midi.sysex.used * 0.4f + 2;
-                    if (midi.sysex.extra_delay && midi.sysex.delay < 40) {
+                    midi.sysex.delay = midi.sysex.used * 2 / 5 + 2;
+                    if (midi.sysex.delay < 40) {
                         midi.sysex.delay = 40;
                     }
                 }
-                midi.sysex.start = time_us_32();  // PicoGUS
+                midi_tx.delay_after = true;
+                return pos + 1;
             }
-            return true;
             /*LOG(LOG_ALL,LOG_NORMAL)("Sysex message size %d",midi.sysex.used);*/ /* SOFTMPU */
             /*if (CaptureState & CAPTURE_MIDI) {
                 CAPTURE_AddMidi( true, midi.sysex.used-1, &midi.sysex.buf[1]);
             }*/ /* SOFTMPU */
+            continue;
         }
-    }
-    if (data&0x80) {
-        midi.sysex.status=data;
-        if (midi.sysex.status==0xf0) {
-            output_to_uart(0xf0);
-            midi.sysex.used=1;
-            midi.sysex.buf[0]=0xf0;
-            /* midi.sysex.usedbufs=0; */
-            return true;
+        if (data&0x80) {
+            midi.sysex.status=data;
+            if (midi.sysex.status==0xf0) {
+                midi.sysex.used=1;
+                midi.sysex.buf[0]=0xf0;
+                /* midi.sysex.usedbufs=0; */
+            }
         }
     }
-    
-    output_to_uart(data);   // not sysex
-    return true;
+    return end;
 }
 
-void send_midi_bytes(int maxbytes) {
-    for(int i = 0; i < maxbytes; ++i) {
-        if (!send_midi_byte()) {
-            break;
+/* PicoGUS: Retires the finished burst and starts the next, unless a sysex
+   delay is to be taken first */
+static void midi_tx_next(void)
+{
+    if (midi_tx.delaying || dma_channel_is_busy(midi_tx.chan)) return;
+    uint32_t tail = midi_out_buff.tail + midi_tx.burst;
+    midi_out_buff.tail = tail;
+    midi_tx.burst = 0;
+    if (midi_tx.delay_after) {
+        midi_tx.delay_after = false;
+        midi_tx.delaying = true;
+        if (hardware_alarm_set_target(midi_tx.alarm, make_timeout_time_us(midi.sysex.delay))) {
+            // Already past
+            midi_tx.delaying = false;
+        } else {
+            return;
         }
     }
+    uint32_t head = midi_out_buff.head;
+    __dmb();
+    if (head == tail) return;   // nothing to send
+    uint32_t end = tail + RAWBUF - (tail & RAWBUF_BITS);
+    if (head - tail < end - tail) end = head;
+    end = scan_sysex(tail, end);
+    midi_tx.burst = end - tail;
+    dma_channel_transfer_from_buffer_now(midi_tx.chan, &midi_out_buff.buffer[tail & RAWBUF_BITS], midi_tx.burst);
 }
 
+static void __isr midi_tx_dma_irq(void)
+{
+    const uint32_t mask = 1u << midi_tx.chan;
+    if (!(dma_hw->ints0 & mask)) return;   // another channel's
+    hw_clear_bits(&dma_hw->intf0, mask);
+    dma_hw->ints0 = mask;
+    midi_tx_next();
+}
+
+static void midi_tx_alarm(uint alarm_num)
+{
+    midi_tx.delaying = false;
+    midi_tx_kick();
+}
+
+/* PicoGUS: Set up the DMA channel and alarm on the calling core, once */
+static void midi_tx_init(void)
+{
+    if (midi_tx.chan >= 0) return;
+    midi_tx.chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(midi_tx.chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(uart0, true));
+    dma_channel_configure(midi_tx.chan, &c, &uart_get_hw(uart0)->dr, NULL, 0, false);
+
+    midi_tx.alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(midi_tx.alarm, midi_tx_alarm);
+
+    irq_add_shared_handler(DMA_IRQ_0, midi_tx_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    dma_channel_set_irq0_enabled(midi_tx.chan, true);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
 
 bool MIDI_Available(void)  {
     return midi.available;
 }
 
-/* SOFTMPU: Initialization */
+/* SOFTMPU: Initialization. PicoGUS: Runs again whenever the MPU settings
+   change, under the MPU's critical section like the other writers of the
+   ring, and the DMA may still be sending. So everything is queued behind
+   what is already in the ring, and the sysex state is left to scan_sysex. */
 void MIDI_Init(bool delaysysex,bool fakeallnotesoff){
     Bit8u i; /* SOFTMPU */
+    Bit8u notes_off[3] = { 0x00,0x7b,0x00 };
     // MIDI_sysex_delaytime = 0; /* SOFTMPU */
     // midi.sysex.delay = delaysysex;
     
-    if (!critical_section_is_initialized(&midi_crit)) {
-        critical_section_init(&midi_crit);
-    }
-
     midi.status=0x00;
-    midi.sysex.status=0x00;
-    midi.sysex.delay = 0;
-    midi.sysex.start = delaysysex ? time_us_32() : 0; // PicoGUS
+    /* midi.sysex.start = delaysysex ? time_us_32() : 0; // PicoGUS */
     midi.sysex.extra_delay = delaysysex;
     /* midi.sysex.start = time_us_32(); // PicoGUS */
     midi.cmd_pos=0;
@@ -370,20 +406,17 @@ void MIDI_Init(bool delaysysex,bool fakeallnotesoff){
     midi.fakeallnotesoff = fakeallnotesoff;
     midi.available=true;
 
-    midi_out_buff.head = midi_out_buff.tail = 0;
-        
+    /* PicoGUS: Everything is sent by DMA */
+    midi_tx_init();
+
     /* SOFTMPU: Display welcome message on MT-32 */
-    for (i=0;i<30;i++)
-    {
-        send_midi_byte_now(MIDI_welcome_msg[i]);
-    }
+    PlayMsg((Bit8u*)MIDI_welcome_msg,30);
         
     /* HardMPU: Turn off any stuck notes */
     for (i=0xb0;i<0xc0;i++)
     {
-        send_midi_byte_now(i);
-        send_midi_byte_now(0x7b);
-        send_midi_byte_now(0);
+        notes_off[0]=i;
+        PlayMsg(notes_off,3);
     }
         
     /* SOFTMPU: Init note tracking */
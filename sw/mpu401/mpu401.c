@@ -71,12 +71,17 @@ static PIC_TimerEvent MPU401_EOI = {
 };
 static void MPU401_Reset(void);
 static void MPU401_EOIHandlerDispatch(void);
+static void MPU401_SyncClock(void);
+static void MPU401_Schedule(void);
 
 #define MPU401_VERSION  0x15
 #define MPU401_REVISION 0x01
 #define MPU401_QUEUE 32
 #define MPU401_TIMECONSTANT 60000000
 #define MPU401_RESETBUSY 14000
+/* PicoGUS: Longest the sequencer alarm is set for, in ticks. Track counters
+   waiting on the host sit at 0xf0. */
+#define MPU401_MAXTICKS 0xf0
 
 enum MpuMode { M_UART,M_INTELLIGENT };
 typedef enum MpuMode MpuMode; /* SOFTMPU */
@@ -128,6 +133,10 @@ static struct {
         Bit8u tempo,tempo_rel, tempo_grad;
         Bit8u cth_rate,cth_counter,cth_savecount;
         bool clock_to_host;
+        /* PicoGUS: MPU401_Event is set for the tick scheduled ticks after the
+           one at base_us, or not at all when scheduled is 0 */
+        Bitu tick_us,base_us;
+        Bitu scheduled;
     } clock;
 } mpu;
 
@@ -171,6 +180,7 @@ __force_inline void MPU401_WriteCommand(Bit8u val, bool crit) { /* SOFTMPU */
     if (crit) {
         critical_section_enter_blocking(&mpu_crit);
     }
+    MPU401_SyncClock();
     Bit8u i; /* SOFTMPU */
     if (mpu.state.reset) {
         if (mpu.state.cmd_pending || val!=0xff) {
@@ -189,8 +199,6 @@ __force_inline void MPU401_WriteCommand(Bit8u val, bool crit) { /* SOFTMPU */
         /*if (val&0x20) LOG(LOG_MISC,LOG_ERROR)("MPU-401:Unhandled Recording Command %x",val);*/ /* SOFTMPU */
         switch (val&0xc) {
             case  0x4:      /* Stop */
-                if (mpu.state.playing && !mpu.clock.clock_to_host)
-                    PIC_RemoveEvent(&MPU401_Event);
                 mpu.state.playing=false;
                 for (i=0xb0;i<0xbf;i++) {  /* All notes off */
                     MIDI_RawOutByte(i);
@@ -200,8 +208,6 @@ __force_inline void MPU401_WriteCommand(Bit8u val, bool crit) { /* SOFTMPU */
                 break;
             case 0x8:       /* Play */
                 /*LOG(LOG_MISC,LOG_NORMAL)("MPU-401:Intelligent mode playback started");*/ /* SOFTMPU */
-                if (!mpu.state.playing && !mpu.clock.clock_to_host)
-                    PIC_AddEvent(&MPU401_Event,MPU401_TIMECONSTANT/((mpu.clock.tempo*mpu.clock.timebase*mpu.clock.tempo_rel)/0x40), 0);
                 mpu.state.playing=true;
                 ClrQueue();
                 break;
@@ -231,13 +237,9 @@ __force_inline void MPU401_WriteCommand(Bit8u val, bool crit) { /* SOFTMPU */
             mpu.state.cond_set=true;
             break;
         case 0x94: /* Clock to host */
-            if (mpu.clock.clock_to_host && !mpu.state.playing)
-                PIC_RemoveEvent(&MPU401_Event);
             mpu.clock.clock_to_host=false;
             break;
         case 0x95:
-            if (!mpu.clock.clock_to_host && !mpu.state.playing)
-                PIC_AddEvent(&MPU401_Event,MPU401_TIMECONSTANT/((mpu.clock.tempo*mpu.clock.timebase*mpu.clock.tempo_rel)/0x40), 0);
             mpu.clock.clock_to_host=true;
             break;
         case 0xc2: /* Internal timebase */
@@ -324,6 +326,7 @@ __force_inline void MPU401_WriteCommand(Bit8u val, bool crit) { /* SOFTMPU */
     }
     QueueByte(MSG_MPU_ACK);
 write_command_return:
+    MPU401_Schedule();
     if (crit) {
         critical_section_exit(&mpu_crit);
     }
@@ -331,6 +334,7 @@ write_command_return:
 
 __force_inline Bit8u MPU401_ReadData(void) { /* SOFTMPU */
     critical_section_enter_blocking(&mpu_crit);
+    MPU401_SyncClock();
     Bit8u ret=MSG_MPU_ACK;  // HardMPU: we shouldn't be running this function if the queue is empty.
     if (mpu.queue_used) {
         if (mpu.queue_pos>=MPU401_QUEUE) mpu.queue_pos-=MPU401_QUEUE;
@@ -365,6 +369,7 @@ __force_inline Bit8u MPU401_ReadData(void) { /* SOFTMPU */
         mpu.state.data_onoff=-1;
         MPU401_EOIHandlerDispatch();
     }
+    MPU401_Schedule();
     critical_section_exit(&mpu_crit);
     return ret;
 }
@@ -378,6 +383,7 @@ __force_inline void MPU401_WriteData(Bit8u val, bool crit) { /* SOFTMPU */
         MIDI_RawOutByte(val);
         goto write_return;
     }
+    MPU401_SyncClock();
     switch (mpu.state.command_byte) {       /* 0xe# command data */
         case 0x00:
             break;
@@ -553,6 +559,7 @@ __force_inline void MPU401_WriteData(Bit8u val, bool crit) { /* SOFTMPU */
             if (posd==length) MPU401_EOIHandlerDispatch();
     }
 write_return:
+    MPU401_Schedule();
     if (crit) {
         critical_section_exit(&mpu_crit);
     }
@@ -608,36 +615,120 @@ __force_inline static void UpdateConductor(void) {
     mpu.state.req_mask|=(1<<9);
 }
 
-uint32_t MPU401_EventHandler(Bitu val) {
-    /* SOFTMPU */
-    /* putchar('.'); */
+/* PicoGUS: Rather than firing on every tick, MPU401_Event is set for the next
+   tick on which a track, the conductor or clock to host is due and takes all
+   the ticks up to it at once. Counters count down from the tick at
+   mpu.clock.base_us. MPU401_SyncClock brings them up to the current tick
+   before the host can change them, and MPU401_Schedule moves the alarm if
+   anything is now due sooner, or the tempo changed. */
+__force_inline static Bitu MPU401_TickPeriod(void) {
+    return MPU401_TIMECONSTANT/((mpu.clock.tempo*mpu.clock.timebase*mpu.clock.tempo_rel)/0x40);
+}
+
+/* PicoGUS: Ticks until the next one something is due on */
+static Bitu MPU401_NextTicks(void) {
+    Bitu next=MPU401_MAXTICKS;
     Bit8u i;
-    if (mpu.mode==M_UART) return 0;
-    critical_section_enter_blocking(&mpu_crit);
-    if (mpu.state.irq_pending) goto next_event;
-        if (mpu.state.playing) {
+    if (mpu.state.irq_pending) return 1; /* Ticks are held until the host answers */
+    if (mpu.state.playing) {
+        for (i=0;i<8;i++) {
+            if ((mpu.state.amask&(1<<i)) && mpu.playbuf[i].counter<(Bits)next)
+                next=mpu.playbuf[i].counter>1 ? mpu.playbuf[i].counter : 1;
+        }
+        if (mpu.state.conductor && mpu.condbuf.counter<(Bits)next)
+            next=mpu.condbuf.counter>1 ? mpu.condbuf.counter : 1;
+    }
+    if (mpu.clock.clock_to_host) {
+        Bitu left=mpu.clock.cth_rate>mpu.clock.cth_counter ? mpu.clock.cth_rate-mpu.clock.cth_counter : 1;
+        if (left<next) next=left;
+    }
+    return next;
+}
+
+/* PicoGUS: Runs ticks at once, as many as MPU401_NextTicks allows */
+static void MPU401_Tick(Bitu ticks) {
+    Bit8u i;
+    if (mpu.state.irq_pending) return;
+    if (mpu.state.playing) {
         for (i=0;i<8;i++) { /* Decrease counters */
             if (mpu.state.amask&(1<<i)) {
-                mpu.playbuf[i].counter--;
+                mpu.playbuf[i].counter-=ticks;
                 if (mpu.playbuf[i].counter<=0) UpdateTrack(i);
             }
         }               
         if (mpu.state.conductor) {
-            mpu.condbuf.counter--;
+            mpu.condbuf.counter-=ticks;
             if (mpu.condbuf.counter<=0) UpdateConductor();
         }
     }
     if (mpu.clock.clock_to_host) {
-        mpu.clock.cth_counter++;
+        mpu.clock.cth_counter+=ticks;
         if (mpu.clock.cth_counter >= mpu.clock.cth_rate) {
             mpu.clock.cth_counter=0;
             mpu.state.req_mask|=(1<<13);
         }
     }
+}
+
+static void MPU401_SyncClock(void) {
+    if (!mpu.clock.scheduled) return;
+    Bitu ticks=(time_us_32()-mpu.clock.base_us)/mpu.clock.tick_us;
+    /* The alarm takes the tick it is set for, even if it's running late */
+    if (ticks>=mpu.clock.scheduled) ticks=mpu.clock.scheduled-1;
+    if (!ticks) return;
+    mpu.clock.base_us+=ticks*mpu.clock.tick_us;
+    mpu.clock.scheduled-=ticks;
+    MPU401_Tick(ticks);
+}
+
+static void MPU401_Schedule(void) {
+    if (mpu.mode==M_UART || !(mpu.state.playing || mpu.clock.clock_to_host)) {
+        if (mpu.clock.scheduled) {
+            PIC_RemoveEvent(&MPU401_Event);
+            mpu.clock.scheduled=0;
+        }
+        return;
+    }
+    Bitu now=time_us_32();
+    Bitu tick_us=MPU401_TickPeriod();
+    Bitu next=MPU401_NextTicks();
+    if (!mpu.clock.scheduled) mpu.clock.base_us=now;
+    else if (tick_us==mpu.clock.tick_us && next>=mpu.clock.scheduled) return;
+    mpu.clock.tick_us=tick_us;
+    mpu.clock.scheduled=next;
+    Bits delay=(Bits)(mpu.clock.base_us+next*tick_us-now);
+    PIC_RemoveEvent(&MPU401_Event);
+    PIC_AddEvent(&MPU401_Event, delay>0 ? delay : 0, 0);
+}
+
+uint32_t MPU401_EventHandler(Bitu val) {
+    /* SOFTMPU */
+    /* putchar('.'); */
+    if (mpu.mode==M_UART) {
+        mpu.clock.scheduled=0;
+        return 0;
+    }
+    critical_section_enter_blocking(&mpu_crit);
+    if (!mpu.clock.scheduled) {
+        critical_section_exit(&mpu_crit);
+        return 0;
+    }
+    Bitu due=mpu.clock.base_us+mpu.clock.scheduled*mpu.clock.tick_us;
+    Bits early=(Bits)(due-time_us_32());
+    if (early>0) {
+        /* MPU401_Schedule replaced this alarm as it fired; the new one runs the ticks, so this
+           one isn't set again */
+        critical_section_exit(&mpu_crit);
+        return 0;
+    }
+    mpu.clock.base_us=due;
+    MPU401_Tick(mpu.clock.scheduled);
     if (!mpu.state.irq_pending && mpu.state.req_mask) MPU401_EOIHandler(0);
-next_event:
+    mpu.clock.tick_us=MPU401_TickPeriod();
+    mpu.clock.scheduled=MPU401_NextTicks();
+    Bitu delay=mpu.clock.scheduled*mpu.clock.tick_us;
     critical_section_exit(&mpu_crit);
-    return MPU401_TIMECONSTANT/((mpu.clock.tempo*mpu.clock.timebase*mpu.clock.tempo_rel)/0x40);
+    return delay;
 }
 
 __force_inline static void MPU401_EOIHandlerDispatch(void) {
@@ -652,6 +743,7 @@ __force_inline static void MPU401_EOIHandlerDispatch(void) {
 __force_inline uint32_t MPU401_EOIHandler(Bitu val) {
     if (val) {
         critical_section_enter_blocking(&mpu_crit);
+        MPU401_SyncClock();
     }
     mpu.state.eoi_scheduled=false;
     if (mpu.state.send_now) {
@@ -662,6 +754,7 @@ __force_inline uint32_t MPU401_EOIHandler(Bitu val) {
     mpu.state.irq_pending=false;
     if (!mpu.state.req_mask) {
         if (val) {
+            MPU401_Schedule();
             critical_section_exit(&mpu_crit);
         }
         return 0;
@@ -675,6 +768,7 @@ __force_inline uint32_t MPU401_EOIHandler(Bitu val) {
         }
     } while ((i++)<16);
     if (val) {
+        MPU401_Schedule();
         critical_section_exit(&mpu_crit);
     }
     return 0;
@@ -699,6 +793,7 @@ __force_inline static void MPU401_Reset(void) {
 #endif
     mpu.mode=(mpu.intelligent ? M_INTELLIGENT : M_UART);
     PIC_RemoveEvent(&MPU401_Event);
+    mpu.clock.scheduled=0;
     PIC_RemoveEvent(&MPU401_EOI);
     mpu.state.eoi_scheduled=false;
     mpu.state.wsd=false;
@@ -744,7 +839,9 @@ void MPU401_Init(bool delaysysex, bool fakeallnotesoff)
 uint32_t MPU401_InitHandler(Bitu val)
 {
     /* Initialise MIDI handler */
+    critical_section_enter_blocking(&mpu_crit);
     MIDI_Init(config_delaysysex, config_fakeallnotesoff);
+    critical_section_exit(&mpu_crit);
     if (!MIDI_Available()) return 0;
 
     mpu.queue_used=0;
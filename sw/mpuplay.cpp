@@ -21,6 +21,7 @@
 #include "system/flash_settings.h"
 extern Settings settings;
 
+#include "hardware/sync.h"
 #include "system/pico_pic.h"
 
 #ifdef USB_STACK
@@ -43,11 +44,13 @@ void play_mpu() {
     puts("pic inited on core 1");
     MPU401_Init(settings.MPU.delaySysex, settings.MPU.fakeAllNotesOff);
 
+    // MIDI goes out by DMA, so there's only USB to service here
     for (;;) {
-        send_midi_bytes(8);
 #ifdef USB_STACK
         // Service TinyUSB events
         tuh_task();
+#else
+        __wfi();
 #endif
     }
 }
@@ -46,6 +46,8 @@ int OPL_Pico_Init(unsigned int);
 unsigned int OPL_Pico_PortRead(opl_port_t);
 void OPL_Pico_WriteRegister(unsigned int, unsigned int);
 void OPL_Pico_simple(int16_t*, uint32_t);
+// OPL3 builds: interleaved left and right samples
+void OPL_Pico_stereo(int16_t*, uint32_t);
 
 #ifdef __cplusplus
 } // extern "C"
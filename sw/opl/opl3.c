@@ -26,11 +26,23 @@
 // version: 1.8
 //
 
+#if USE_NUKED_OPL3
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "opl3.h"
 
+#if PICO_ON_DEVICE
+#include "pico.h"
+// Slot state and the sin/exp tables are read for every slot on every sample. Keep them in the
+// scratch banks, off the striped main SRAM that core 0 and DMA are busy with.
+#define OPL3_SLOT_DATA __scratch_x("opl3_slots")
+#define OPL3_TABLE_DATA __scratch_y("opl3_tables")
+#else
+#define OPL3_SLOT_DATA
+#define OPL3_TABLE_DATA
+#endif
+
 #define RSM_FRAC    10
 
 // Channel types
@@ -54,7 +66,7 @@ enum {
 // logsin table
 //
 
-static const Bit16u logsinrom[256] = {
+static const Bit16u OPL3_TABLE_DATA logsinrom[256] = {
     0x859, 0x6c3, 0x607, 0x58b, 0x52e, 0x4e4, 0x4a6, 0x471,
     0x443, 0x41a, 0x3f5, 0x3d3, 0x3b5, 0x398, 0x37e, 0x365,
     0x34e, 0x339, 0x324, 0x311, 0x2ff, 0x2ed, 0x2dc, 0x2cd,
@@ -93,7 +105,7 @@ static const Bit16u logsinrom[256] = {
 // exp table
 //
 
-static const Bit16u exprom[256] = {
+static const Bit16u OPL3_TABLE_DATA exprom[256] = {
     0x7fa, 0x7f5, 0x7ef, 0x7ea, 0x7e4, 0x7df, 0x7da, 0x7d4,
     0x7cf, 0x7c9, 0x7c4, 0x7bf, 0x7b9, 0x7b4, 0x7ae, 0x7a9,
     0x7a4, 0x79f, 0x799, 0x794, 0x78f, 0x78a, 0x784, 0x77f,
@@ -678,6 +690,28 @@ static void OPL3_SlotCalcFB(opl3_slot *slot)
     slot->prout = slot->out;
 }
 
+// A slot that has released to silence with its key off stays silent until it is keyed on, and key
+// on resets its phase, so it only needs to step the noise generator as OPL3_PhaseGenerate would.
+// Its output is held at 0 rather than the -1 a negative half of the waveform gives at full
+// attenuation. The HH and TC slots always run, as the rhythm section takes phase bits from them.
+// OPL3_RUN_IDLE_SLOTS runs every slot, as Nuked OPL3 does.
+static void OPL3_SlotProcess(opl3_slot *slot)
+{
+#if !OPL3_RUN_IDLE_SLOTS
+    if (!slot->key && slot->eg_gen == envelope_gen_num_release && slot->eg_rout == 0x1ff
+        && !slot->out && !slot->prout && slot->slot_num != 13 && slot->slot_num != 17)
+    {
+        Bit32u noise = slot->chip->noise;
+        slot->chip->noise = (noise >> 1) | ((((noise >> 14) ^ noise) & 0x01) << 22);
+        return;
+    }
+#endif
+    OPL3_SlotCalcFB(slot);
+    OPL3_EnvelopeCalc(slot);
+    OPL3_PhaseGenerate(slot);
+    OPL3_SlotGenerate(slot);
+}
+
 //
 // Channel
 //
@@ -1054,10 +1088,7 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 0; ii < 15; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     chip->mixbuff[0] = 0;
@@ -1073,20 +1104,14 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 15; ii < 18; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     buf[0] = OPL3_ClipSample(chip->mixbuff[0]);
 
     for (ii = 18; ii < 33; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     chip->mixbuff[1] = 0;
@@ -1102,10 +1127,7 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 33; ii < 36; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_SlotGenerate(&chip->slot[ii]);
+        OPL3_SlotProcess(&chip->slot[ii]);
     }
 
     if ((chip->timer & 0x3f) == 0x3f)
@@ -1191,12 +1213,16 @@ void OPL3_GenerateResampled(opl3_chip *chip, Bit16s *buf)
     chip->samplecnt += 1 << RSM_FRAC;
 }
 
+static opl3_slot OPL3_SLOT_DATA opl3_slots[36];
+
 void OPL3_Reset(opl3_chip *chip, Bit32u samplerate)
 {
     Bit8u slotnum;
     Bit8u channum;
 
     memset(chip, 0, sizeof(opl3_chip));
+    memset(opl3_slots, 0, sizeof(opl3_slots));
+    chip->slot = opl3_slots;
     for (slotnum = 0; slotnum < 36; slotnum++)
     {
         chip->slot[slotnum].chip = chip;
@@ -1375,3 +1401,4 @@ void OPL3_GenerateStream(opl3_chip *chip, Bit16s *sndptr, Bit32u numsamples)
         sndptr += 2;
     }
 }
+#endif // USE_NUKED_OPL3
@@ -32,7 +32,9 @@
 
 #include <inttypes.h>
 
+#ifndef OPL_WRITEBUF_SIZE
 #define OPL_WRITEBUF_SIZE   1024
+#endif
 #define OPL_WRITEBUF_DELAY  2
 
 typedef uintptr_t       Bitu;
@@ -107,7 +109,8 @@ typedef struct _opl3_writebuf {
 
 struct _opl3_chip {
     opl3_channel channel[18];
-    opl3_slot slot[36];
+    // Points to the one set of slots in opl3.c, so only one chip can be in use
+    opl3_slot *slot;
     Bit16u timer;
     Bit64u eg_timer;
     Bit8u eg_timerrem;
@@ -50,25 +50,47 @@ typedef struct
 } opl_timer_t;
 
 #define opl_op3mode 0
+#if USE_EMU8950_OPL
 static OPL *emu8950_opl;
+#else
+static opl3_chip nuked_opl3;
+#endif
 
 static opl_timer_t timer1 = { 12500, 0, 0, 0 };
 static opl_timer_t timer2 = { 3125, 0, 0, 0 };
 
+#if USE_EMU8950_OPL
 void OPL_Pico_simple(int16_t *buffer, uint32_t nsamples) {
     OPL_calc_buffer(emu8950_opl, buffer, nsamples);
 }
+#else
+void OPL_Pico_stereo(int16_t *buffer, uint32_t nframes) {
+    for (uint32_t i = 0; i < nframes; ++i) {
+        OPL3_Generate(&nuked_opl3, &buffer[i * 2]);
+    }
+}
+#endif
 
 int OPL_Pico_Init(unsigned int port_base)
 {
+#if USE_EMU8950_OPL
     emu8950_opl = OPL_new(3579552, PICO_SOUND_SAMPLE_FREQ); // todo check rate
+#else
+    // At the native rate, so OPL3_Generate needs no resampling
+    OPL3_Reset(&nuked_opl3, PICO_SOUND_SAMPLE_FREQ);
+#endif
     return 1;
 }
 
 unsigned int OPL_Pico_PortRead(opl_port_t port)
 {
+#if USE_EMU8950_OPL
     // OPL2 has 0x06 in its status register. If this is 0, it'll get detected as an OPL3...
     unsigned int result = 0x06;
+#else
+    // ...which is what we want here
+    unsigned int result = 0x00;
+#endif
 
     if (port == OPL_REGISTER_PORT_OPL3)
     {
@@ -142,14 +164,19 @@ void OPL_Pico_WriteRegister(unsigned int reg_num, unsigned int value)
 
                 if ((value & 0x20) == 0)
                 {
-                    timer1.enabled = (value & 0x02) != 0;
+                    timer2.enabled = (value & 0x02) != 0;
                     OPLTimer_CalculateEndTime(&timer2);
                 }
             }
 
             break;
         default:
+#if USE_EMU8950_OPL
             OPL_writeReg(emu8950_opl, reg_num, value);
+#else
+            // Bit 8 of reg_num selects the second register bank
+            OPL3_WriteReg(&nuked_opl3, reg_num, value);
+#endif
             break;
     }
 }
@@ -29,6 +29,7 @@
 
 #include "system/pico_reflash.h"
 #include "system/flash_settings.h"
+#include "system/trace.h"
 
 // For multifw
 #include "hardware/watchdog.h"
@@ -62,41 +63,53 @@ M62429* m62429;
 
 #ifdef SOUND_SB
 #include "sbdsp/sbdsp.h"
-static uint16_t sb_port_test;
 #endif
 #ifdef SOUND_OPL
 #include "opl.h"
 void play_adlib(void);
-#if OPL_CMD_BUFFER
 #include "include/cmd_buffers.h"
-cms_buffer_t opl_cmd_buffer = { {0}, 0, 0 };
-#else
-extern "C" void OPL_Pico_WriteRegister(unsigned int reg_num, unsigned int value);
-static uint8_t opl_addr;
-#endif // OPL_CMD_BUFFER
+opl_cmd_queue_t opl_cmd_queue;
+// Output frames played so far, counted by audio_sample_handler
+extern volatile uint32_t opl_sample_clock;
+static uint16_t opl_addr;
+
+static __force_inline void opl_write(uint8_t value) {
+    if (opl_addr >= OPL_REG_TIMER1 && opl_addr <= OPL_REG_TIMER_CTRL) {
+        // The timers are kept on this core, so status reads never wait on core 1
+        OPL_Pico_WriteRegister(opl_addr, value);
+    } else {
+        opl_cmd_queue_push(&opl_cmd_queue, opl_sample_clock, opl_addr, value);
+    }
+}
 #if AUDIO_CALLBACK_CORE0
 extern void audio_sample_handler(void);
 #endif // AUDIO_CALLBACK_CORE0
 #endif // SOUND_OPL
 
 #ifdef CDROM
-static uint16_t cdrom_port_test;
 extern "C" void MKE_WRITE(uint16_t address, uint8_t value);
 extern "C" uint8_t MKE_READ(uint16_t address);
 extern "C" void mke_init();
 
 #include "cdrom/cdrom.h"
 #include "cdrom/cdrom_image_manager.h"
+#include "cdrom/msc_app.h"
+#include "cdrom/cdrom_cache.h"
 cdrom_t cdrom;
 
-static uint32_t cur_read_idx;
+static int cur_read_idx;
+// The rest of the name CMD_CDLIST is part way through reading, or NULL at the start of one
+static const char *cd_list_name;
+// Copy of the histogram taken when CMD_CDLATENCY is selected, so it reads out consistently
+static uint32_t cd_latency[MSC_LATENCY_BUCKETS];
+// Likewise for the sector cache counters
+static cdrom_cache_stats_t cd_cache_stats;
 #endif
 
 #ifdef SOUND_GUS
 #include "gus/gus-x.cpp"
 #include "isa/isa_dma.h"
 dma_inst_t dma_config;
-static uint16_t gus_port_test;
 void play_gus(void);
 #endif
 
@@ -114,11 +127,11 @@ void play_mpu(void);
 void play_psg(void);
 #endif
 #if SOUND_TANDY
-tandy_buffer_t tandy_buffer = { {0}, 0, 0 };
+psg_cmd_queue_t tandy_cmd_queue;
 #endif
 #if SOUND_CMS
 static uint8_t cms_detect = 0xFF;
-cms_buffer_t cms_buffer = { {0}, 0, 0 };
+psg_cmd_queue_t cms_cmd_queue;
 #endif
 
 
@@ -148,6 +161,41 @@ void play_usb(void);
 #include "audio/volctrl.h"
 #endif
 
+#include "isa/port_map.h"
+// Devices built into this firmware, for port_map_build
+static constexpr uint32_t port_map_devices = IO_DEV(IO_CONTROL) | IO_DEV(IO_DATA_LOW) | IO_DEV(IO_DATA_HIGH)
+#ifdef SOUND_GUS
+    | IO_DEV(IO_GUS)
+#endif
+#ifdef SOUND_SB
+    | IO_DEV(IO_SB)
+#endif
+#ifdef CDROM
+    | IO_DEV(IO_CDROM)
+#endif
+#ifdef SOUND_OPL
+    | IO_DEV(IO_OPL)
+#endif
+#ifdef SOUND_TANDY
+    | IO_DEV(IO_TANDY)
+#endif
+#ifdef USB_JOYSTICK
+    | IO_DEV(IO_JOY)
+#endif
+#ifdef USB_MOUSE
+    | IO_DEV(IO_MOUSE)
+#endif
+#ifdef NE2000
+    | IO_DEV(IO_NE2K)
+#endif
+#ifdef SOUND_CMS
+    | IO_DEV(IO_CMS)
+#endif
+#ifdef SOUND_MPU
+    | IO_DEV(IO_MPU)
+#endif
+    ;
+
 
 // PicoGUS control and data ports
 static bool control_active = false;
@@ -193,6 +241,10 @@ __force_inline void select_picogus(uint8_t value) {
     case CMD_GUSBUF: // Audio buffer size
     case CMD_GUSDMA: // DMA interval
     case CMD_GUS44K: // Force 44k
+    case CMD_GUSINTERP: // Voice interpolation mode
+    case CMD_GUSBUFMAX: // Max audio buffer size
+    case CMD_GUSBUFCUR: // Current audio buffer size
+    case CMD_GUSBUFPEAK: // Peak audio buffer size
         break;
     case CMD_WTVOL: // Wavetable mixer volume
         break;
@@ -227,17 +279,19 @@ __force_inline void select_picogus(uint8_t value) {
         break;
     case CMD_CDLIST:
 #ifdef CDROM
+        // Let go of any name before core 1 rebuilds the catalog, which may free the one it's in
+        cur_read_idx = 0;
+        cd_list_name = NULL;
         if (cdrom.image_status == CD_STATUS_IDLE) {
             cdrom.image_status = CD_STATUS_BUSY;
             cdrom.image_command = CD_COMMAND_IMAGE_LIST;
             // puts("cdimages start");
         }
         // puts("cdimages read");
-        cur_read = 0;
-        cur_read_idx = 0;
 #endif
         break;
     case CMD_CDSTATUS:
+    case CMD_CDCOUNT:
     case CMD_CDLOAD:
     case CMD_CDAUTOADV:
     case CMD_MAINVOL:
@@ -252,10 +306,24 @@ __force_inline void select_picogus(uint8_t value) {
     case CMD_CDERROR:
         cur_read = 0;
         break;
+#ifdef CDROM
+    case CMD_CDLATENCY:
+        msc_latency_get(cd_latency);
+        cur_read = 0;
+        break;
+    case CMD_CDCACHE:
+        cdrom_cache_stats_get(&cd_cache_stats);
+        cur_read = 0;
+        break;
+#endif
     case CMD_SAVE: // Select save settings register
     case CMD_REBOOT: // Select reboot register
     case CMD_DEFAULTS: // Select reset to defaults register
         break;
+#ifdef TRACE
+    case CMD_TRACE: // Trace records
+        break;
+#endif
     case CMD_HWTYPE: // Hardware version
         break;
     case CMD_FLASH: // Firmware write mode
@@ -289,30 +357,31 @@ __force_inline void write_picogus_high(uint8_t value) {
     switch (sel_reg) {
     case CMD_GUSPORT: // GUS Base port
         settings.GUS.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
-#ifdef SOUND_GUS
-        gus_port_test = settings.GUS.basePort >> 4 | 0x10;
-#endif
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_OPLPORT: // Adlib Base port
         settings.SB.oplBasePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_SBPORT: // SB Base port
         settings.SB.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
-#ifdef SOUND_SB
-        sb_port_test = settings.SB.basePort >> 4;
-#endif
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_MPUPORT: // MPU Base port
         settings.MPU.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_TANDYPORT: // Tandy Base port
         settings.Tandy.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_CMSPORT: // CMS Base port
         settings.CMS.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_JOYEN: // enable joystick
         settings.Joy.basePort = value ? 0x201u : 0xffff;
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_GUSBUF: // GUS audio buffer size
         // Value is sent by pgusinit as the size - 1, so we need to add 1 back to it
@@ -331,6 +400,19 @@ __force_inline void write_picogus_high(uint8_t value) {
         settings.GUS.force44k = value;
 #ifdef SOUND_GUS
         GUS_SetFixed44k(settings.GUS.force44k);
+#endif
+        break;
+    case CMD_GUSINTERP: // GUS voice interpolation mode
+        settings.GUS.interpolation = value;
+#ifdef SOUND_GUS
+        GUS_SetInterpolation(settings.GUS.interpolation);
+#endif
+        break;
+    case CMD_GUSBUFMAX: // GUS max audio buffer size
+        // Sent as the size - 1, like CMD_GUSBUF
+        settings.GUS.audioBufferMax = value + 1;
+#ifdef SOUND_GUS
+        GUS_SetAudioBufferMax(settings.GUS.audioBufferMax);
 #endif
         break;
     case CMD_WTVOL: // Wavetable mixer volume
@@ -356,6 +438,7 @@ __force_inline void write_picogus_high(uint8_t value) {
         break;
     case CMD_MOUSEPORT:  // USB Mouse port (0 - disabled)
         settings.Mouse.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_MOUSEPROTO:  // USB Mouse protocol
         settings.Mouse.protocol = value;
@@ -377,6 +460,7 @@ __force_inline void write_picogus_high(uint8_t value) {
         break;
     case CMD_NE2KPORT: // NE2000 Base port
         settings.NE2K.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
+        port_map_build(&settings, port_map_devices);
         break;
     case CMD_WIFISSID:
         settings.WiFi.ssid[cur_write++] = value;
@@ -398,9 +482,7 @@ __force_inline void write_picogus_high(uint8_t value) {
         break;
     case CMD_CDPORT: // CD Base port
         settings.CD.basePort = (value || basePort_low) ? ((value << 8) | basePort_low) : 0xFFFF;
-#ifdef CDROM
-        cdrom_port_test = settings.CD.basePort >> 4;
-#endif
+        port_map_build(&settings, port_map_devices);
         break;
 #ifdef CDROM
     case CMD_CDLOAD: // Load CD image
@@ -419,6 +501,12 @@ __force_inline void write_picogus_high(uint8_t value) {
             cdrom.image_command = CD_COMMAND_IMAGE_LOAD;
         }
         break;
+    case CMD_CDLATENCY: // Any write clears the histogram
+        msc_latency_clear();
+        break;
+    case CMD_CDCACHE: // Any write clears the counters
+        cdrom_cache_stats_clear();
+        break;
 #endif
     case CMD_CDAUTOADV: // enable auto advance of CD image on USB reinsert
         settings.CD.autoAdvance = value;
@@ -481,6 +569,11 @@ __force_inline void write_picogus_high(uint8_t value) {
         getDefaultSettings(&settings);
         processSettings();
         break;
+#ifdef TRACE
+    case CMD_TRACE: // 1 drains trace records to the control port, 0 back to the UART
+        trace_set_drain(value);
+        break;
+#endif
     case CMD_FLASH: // Firmware write
         pico_firmware_write(value);
         break;
@@ -509,6 +602,10 @@ __force_inline uint8_t read_picogus_low(void) {
         return settings.NE2K.basePort == 0xFFFF ? 0 : (settings.NE2K.basePort & 0xFF);
     case CMD_CDPORT: // SB Base port
         return settings.CD.basePort == 0xFFFF ? 0 : (settings.CD.basePort & 0xFF);
+#ifdef CDROM
+    case CMD_CDCOUNT: // Number of images, low byte
+        return cdman_image_count() & 0xFF;
+#endif
     default:
         return 0x0;
     }
@@ -549,6 +646,16 @@ __force_inline uint8_t read_picogus_high(void) {
         return settings.GUS.dmaInterval;
     case CMD_GUS44K: // Force 44k output
         return settings.GUS.force44k;
+    case CMD_GUSINTERP: // GUS voice interpolation mode
+        return settings.GUS.interpolation;
+    case CMD_GUSBUFMAX: // GUS max audio buffer size
+        return settings.GUS.audioBufferMax - 1;
+#ifdef SOUND_GUS
+    case CMD_GUSBUFCUR: // GUS current audio buffer size
+        return GUS_AudioBuffer() - 1;
+    case CMD_GUSBUFPEAK: // GUS peak audio buffer size since it was last set
+        return GUS_AudioBufferPeak() - 1;
+#endif
     case CMD_WTVOL: // Wavetable mixer volume
         return (BOARD_TYPE == PICOGUS_2) ? m62429->getVolume(0) : 0;
     case CMD_MPUDELAY: // SYSEX delay
@@ -586,20 +693,28 @@ __force_inline uint8_t read_picogus_high(void) {
     case CMD_CDSTATUS:
         // printf("cdstatus %x\n", cdrom.image_status);
         return cdrom.image_status;
-    case CMD_CDLIST:
-        if (cur_read_idx == cdrom.image_count) { // If end of the images
-            cur_read_idx = cur_read = 0;
-            cdrom.image_status = CD_STATUS_IDLE;
-            cdman_list_images_free(cdrom.image_list, cdrom.image_count);
-            return 0x04; // EOT
+    case CMD_CDLIST: // Names from the catalog, each null terminated, then EOT
+        if (!cd_list_name) {
+            if (cur_read_idx >= cdman_image_count()) { // If end of the images
+                cur_read_idx = 0;
+                cdrom.image_status = CD_STATUS_IDLE;
+                return 0x04; // EOT
+            }
+            cd_list_name = cdman_image_name(cur_read_idx);
+            if (!cd_list_name) { // The catalog was rebuilt with fewer images
+                cur_read_idx = 0;
+                cdrom.image_status = CD_STATUS_IDLE;
+                return 0x04; // EOT
+            }
         }
-        ret = cdrom.image_list[cur_read_idx][cur_read++];
-        putchar(ret);
+        ret = *cd_list_name++;
         if (ret == 0) { // Null terminated
             ++cur_read_idx;
-            cur_read = 0;
+            cd_list_name = NULL;
         }
         return ret;
+    case CMD_CDCOUNT: // Number of images, high byte
+        return cdman_image_count() >> 8;
     case CMD_CDLOAD: // Load CD image
         return cdman_current_image_index();
     case CMD_CDNAME: // Firmware string
@@ -614,6 +729,18 @@ __force_inline uint8_t read_picogus_high(void) {
             cur_read = 0;
         }
         return ret;
+    case CMD_CDLATENCY: // Histogram counts, 32 bits each, LSB first
+        ret = cd_latency[cur_read >> 2] >> ((cur_read & 3) << 3);
+        if (++cur_read == MSC_LATENCY_BUCKETS * 4) {
+            cur_read = 0;
+        }
+        return ret;
+    case CMD_CDCACHE: // Counters in cdrom_cache_stats_t order, 32 bits each, LSB first
+        ret = ((const uint32_t *)&cd_cache_stats)[cur_read >> 2] >> ((cur_read & 3) << 3);
+        if (++cur_read == CD_CACHE_STATS_WORDS * 4) {
+            cur_read = 0;
+        }
+        return ret;
 #endif
     case CMD_CDAUTOADV: // enable joystick
         return settings.CD.autoAdvance;
@@ -634,6 +761,10 @@ __force_inline uint8_t read_picogus_high(void) {
     case CMD_FLASH:
         // Get status of firmware write
         return pico_firmware_getStatus();
+#ifdef TRACE
+    case CMD_TRACE:
+        return trace_read_byte();
+#endif
     default:
         return 0xff;
     }
@@ -663,13 +794,12 @@ void processSettings(void) {
 #else
     settings.startupMode = INVALID_MODE;
 #endif
-#ifdef SOUND_SB
-    sb_port_test = settings.SB.basePort >> 4;
-#endif
+    port_map_build(&settings, port_map_devices);
 #ifdef SOUND_GUS
-    gus_port_test = settings.GUS.basePort >> 4 | 0x10;
     GUS_SetFixed44k(settings.GUS.force44k);
+    GUS_SetInterpolation(settings.GUS.interpolation);
     GUS_SetAudioBuffer(settings.GUS.audioBuffer);
+    GUS_SetAudioBufferMax(settings.GUS.audioBufferMax);
     GUS_SetDMAInterval(settings.GUS.dmaInterval);
 #endif
 #ifdef USB_MOUSE
@@ -678,7 +808,6 @@ void processSettings(void) {
     sermouse_set_sensitivity(settings.Mouse.sensitivity);
 #endif
 #ifdef CDROM
-    cdrom_port_test = settings.CD.basePort >> 4;
     printf("cdrom base port: %x\n", settings.CD.basePort);
     cdman_set_autoadvance(settings.CD.autoAdvance);
 #endif
@@ -694,113 +823,72 @@ static constexpr uint32_t IO_END = 0x0u;
 static constexpr uint32_t IOR_SET_VALUE = 0x0000ff00u;
 
 __force_inline void handle_iow(void) {
+    TRACE_START(iow_begin);
     uint32_t iow_read = pio_sm_get(pio0, IOW_PIO_SM); //>> 16;
     // printf("%x", iow_read);
     uint16_t port = (iow_read >> 8) & 0x3FF;
+    TRACE_EVENT(TRACE_IOW, port);
+    const uint8_t entry = port_map[port];
+    // Slow writes set iochrdy by writing non-0 and hold it until the handler is done. Fast writes
+    // and ports that aren't ours release the PIO right away by writing 0
+    const bool slow = entry && !(entry & IO_FAST_WRITE);
+    pio_sm_put(pio0, IOW_PIO_SM, slow ? IO_WAIT : IO_END);
     // printf("IOW: %x %x\n", port, iow_read & 0xFF);
+    switch (entry & IO_DEVICE_MASK) {
 #ifdef SOUND_GUS
-    if ((port >> 4 | 0x10) == gus_port_test) {
-        port -= settings.GUS.basePort;
-        switch (port) {
-        case 0x8:
-        case 0xb:
-        case 0x102:
-        case 0x103:
-        case 0x104:
-            // Fast write, don't set iochrdy by writing 0
-            pio_sm_put(pio0, IOW_PIO_SM, IO_END);
-            write_gus(port, iow_read & 0xFF);
-            // Fast write - return early as we've already written 0x0u to the PIO
-            return;
-            break;
-        default:
-            // gpio_xor_mask(LED_PIN);
-            // Slow write, set iochrdy by writing non-0
-            pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
-            write_gus(port, iow_read & 0xFF);
+    case IO_GUS:
+        write_gus(port - settings.GUS.basePort, iow_read & 0xFF);
+        if (slow) {
             gpio_xor_mask(LED_PIN);
-            break;
         }
         // printf("GUS IOW: port: %x value: %x\n", port, value);
-        // puts("IOW");
-    } else // if follows down below
+        break;
 #endif // SOUND_GUS
 #ifdef SOUND_SB
-    if ((port >> 4) == sb_port_test) {
+    case IO_SB:
         switch (port - settings.SB.basePort) {
         // OPL ports
         case 0x8:
-            // Fast write
-            pio_sm_put(pio0, IOW_PIO_SM, IO_END);
-            // pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
-#if OPL_CMD_BUFFER
-            opl_cmd_buffer.cmds[opl_cmd_buffer.head].addr = (uint16_t)(iow_read & 0xFF);
-#else
             opl_addr = (iow_read & 0xff);
-#endif
-            // Fast write - return early as we've already written 0x0u to the PIO
-            return;
             break;
         case 0x9:
-            pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
-#if OPL_CMD_BUFFER
-            opl_cmd_buffer.cmds[opl_cmd_buffer.head++].data = (uint8_t)(iow_read & 0xFF);
-#else
-            OPL_Pico_WriteRegister(opl_addr, iow_read & 0xff);
-#endif
+            opl_write(iow_read & 0xff);
             break;
         // DSP ports
         default:
-            pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);                        
             sbdsp_process();
-            sbdsp_write(port & 0xF,iow_read & 0xFF);       
-            sbdsp_process();                                         
+            sbdsp_write(port & 0xF,iow_read & 0xFF);
+            sbdsp_process();
             break;
-        } 
-    } else // if follows down below
+        }
+        break;
 #endif // SOUND_SB
 #ifdef CDROM
-    if ((port >> 4) == cdrom_port_test) {      
-        pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
+    case IO_CDROM:
         // putchar('w');
         MKE_WRITE(port, iow_read & 0xFF);
-    } else // if follows down below
+        break;
 #endif
 #if defined(SOUND_OPL)
-    if ((port & 0x3fe) == settings.SB.oplBasePort) {
+    case IO_OPL:
         if ((port & 1) == 0) {
-            // Fast write
-            pio_sm_put(pio0, IOW_PIO_SM, IO_END);
-#if OPL_CMD_BUFFER
-            opl_cmd_buffer.cmds[opl_cmd_buffer.head].addr = (uint16_t)(iow_read & 0xFF);
-#else
-            opl_addr = (iow_read & 0xff);
-#endif
-            // Fast write - return early as we've already written 0x0u to the PIO
-            return;
+            // Base+2 selects a register in the OPL3's second bank
+            opl_addr = (iow_read & 0xff) | ((port & 2) << 7);
         } else {
-            pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
             if (settings.SB.oplSpeedSensitive) {
                 busy_wait_us(1); // busy wait for speed sensitive games
             }
-#if OPL_CMD_BUFFER
-            opl_cmd_buffer.cmds[opl_cmd_buffer.head++].data = (uint8_t)(iow_read & 0xFF);
-#else
-            OPL_Pico_WriteRegister(opl_addr, iow_read & 0xff);
-#endif
+            opl_write(iow_read & 0xff);
         }
-    } else // if follows down below
+        break;
 #endif // SOUND_OPL
 #ifdef SOUND_TANDY
-    if (port == settings.Tandy.basePort) {
-        pio_sm_put(pio0, IOW_PIO_SM, IO_END);
-        tandy_buffer.cmds[tandy_buffer.head++] = iow_read & 0xFF;
-        return;
-    } else // if follows down below
+    case IO_TANDY:
+        psg_cmd_queue_push(&tandy_cmd_queue, time_us_32(), 0, iow_read & 0xFF);
+        break;
 #endif // SOUND_TANDY
 #ifdef USB_JOYSTICK
-    if (port == settings.Joy.basePort) {
-        pio_sm_put(pio0, IOW_PIO_SM, IO_END);
+    case IO_JOY:
         // Set times in # of cycles (affected by clkdiv) for each PWM slice to count up and wrap back to 0
         // TODO better calibrate this
         // GUS w/ gravis gamestick -
@@ -821,34 +909,28 @@ __force_inline void handle_iow(void) {
         pwm_set_wrap(1, 0);
         pwm_set_wrap(2, 0);
         pwm_set_wrap(3, 0);
-        return;
-    } else // if follows down below
+        break;
 #endif // USB_JOYSTICK
 #ifdef USB_MOUSE
-    if ((port & ~7) == settings.Mouse.basePort) {
-        pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);      // leave some time for UART logic emualtion
+    case IO_MOUSE:
+        // Slow write leaves some time for UART logic emualtion
         uartemu_write(port & 7, iow_read & 0xFF);
-    } else // if follows down below
+        break;
 #endif // USB_MOUSE
 #ifdef NE2000
-    if((port & ~0x1F) == settings.NE2K.basePort) {
-        pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
-        PG_NE2000_Write(port & 0x1f, iow_read & 0xFF);        
-    } else // if follows down below
+    case IO_NE2K:
+        PG_NE2000_Write(port & 0x1f, iow_read & 0xFF);
+        break;
 #endif
 #ifdef SOUND_CMS
-    if ((port & 0x3f0) == settings.CMS.basePort) {
-        pio_sm_put(pio0, IOW_PIO_SM, IO_END);
+    case IO_CMS:
         switch (port & 0xf) {
         // SAA data/address ports
         case 0x0:
         case 0x1:
         case 0x2:
         case 0x3:
-            cms_buffer.cmds[cms_buffer.head++] = {
-                port,
-                (uint8_t)(iow_read & 0xFF)
-            };
+            psg_cmd_queue_push(&cms_cmd_queue, time_us_32(), port, iow_read & 0xFF);
             break;
         // CMS autodetect ports
         case 0x6:
@@ -856,30 +938,23 @@ __force_inline void handle_iow(void) {
             cms_detect = iow_read & 0xFF;
             break;
         }
-        return;
-    } else
+        break;
 #endif // SOUND_CMS
 #ifdef SOUND_MPU
-    if ((port & 0x3fe) == settings.MPU.basePort) {
-        switch (port & 0xf) {
-        case 0:
-            pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
+    case IO_MPU:
+        if ((port & 1) == 0) {
             // printf("MPU IOW: port: %x value: %x\n", port, iow_read & 0xFF);
             MPU401_WriteData(iow_read & 0xFF, true);
             gpio_xor_mask(LED_PIN);
-            break;
-        case 1:
-            pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
+        } else {
             MPU401_WriteCommand(iow_read & 0xFF, true);
             // printf("MPU IOW: port: %x value: %x\n", port, iow_read & 0xFF);
             // __dsb();
-            break;
         }
-    } else
+        break;
 #endif // SOUND_MPU
     // PicoGUS control
-    if (port == CONTROL_PORT) {
-        pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
+    case IO_CONTROL:
         // printf("iow control port: %x %d\n", iow_read & 0xff, control_active);
         if ((iow_read & 0xFF) == 0xCC) {
             // printf("activate ");
@@ -887,22 +962,24 @@ __force_inline void handle_iow(void) {
         } else if (control_active) {
             select_picogus(iow_read & 0xFF);
         }
-    } else if (port == DATA_PORT_LOW) {
-        pio_sm_put(pio0, IOW_PIO_SM, IO_END);
+        break;
+    case IO_DATA_LOW:
         if (control_active) {
             write_picogus_low(iow_read & 0xFF);
         }
-        // Fast write - return early as we've already written 0x0u to the PIO
-        return;
-    } else if (port == DATA_PORT_HIGH) {
+        break;
+    case IO_DATA_HIGH:
         // printf("iow data port: %x\n", iow_read & 0xff);
-        pio_sm_put(pio0, IOW_PIO_SM, IO_WAIT);
         if (control_active) {
             write_picogus_high(iow_read & 0xFF);
         }
+        break;
+    }
+    if (slow) {
+        // Slow write is done, reset PIO
+        pio_sm_put(pio0, IOW_PIO_SM, IO_END);
+        TRACE_ELAPSED(TRACE_IOCHRDY, iow_begin);
     }
-    // Fallthrough if no match, or for slow write, reset PIO
-    pio_sm_put(pio0, IOW_PIO_SM, IO_END);
     if (queueSaveSettings) {
         saveSettings(&settings);
         queueSaveSettings = false;
@@ -910,27 +987,23 @@ __force_inline void handle_iow(void) {
 }
 
 __force_inline void handle_ior(void) {
-    uint8_t x;
+    TRACE_START(ior_begin);
     uint16_t port = pio_sm_get(pio0, IOR_PIO_SM) & 0x3FF;
+    TRACE_EVENT(TRACE_IOR, port);
+    switch (port_map[port] & IO_DEVICE_MASK) {
 #if defined(SOUND_GUS)
-    if ((port >> 4 | 0x10) == gus_port_test) {
+    case IO_GUS:
         // Tell PIO to wait for data
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | read_gus(port - settings.GUS.basePort));
         // gpio_xor_mask(LED_PIN);
-    } else // if follows down below
+        break;
 #endif
 #if defined(SOUND_SB)
-    if ((port >> 4) == sb_port_test) {
+    case IO_SB:
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         switch (port - settings.SB.basePort) {
         case 0x8:
-#if OPL_CMD_BUFFER
-            // wait for OPL buffer to process
-            while (opl_cmd_buffer.tail != opl_cmd_buffer.head) {
-                tight_loop_contents();
-            }
-#endif
             pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | OPL_Pico_PortRead(OPL_REGISTER_PORT));
             break;
         default:
@@ -939,51 +1012,43 @@ __force_inline void handle_ior(void) {
             sbdsp_process();
             break;
         }
-    } else // if follows down below
+        break;
 #endif
 #if defined(CDROM)
-    if ((port >> 4) == cdrom_port_test) {
-    // if ((port >> 4) == 0x23) {
+    case IO_CDROM:
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | MKE_READ(port));
         // putchar('r');
-    } else // if follows down below
+        break;
 #endif
 #if defined(SOUND_OPL)
-    if (port == settings.SB.oplBasePort) {
+    case IO_OPL:
+        if (port != settings.SB.oplBasePort) {
+            // Only the status port is readable
+            pio_sm_put(pio0, IOR_PIO_SM, IO_END);
+            break;
+        }
         // Tell PIO to wait for data
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
-#if OPL_CMD_BUFFER
-        // wait for OPL buffer to process
-        while (opl_cmd_buffer.tail != opl_cmd_buffer.head) {
-            tight_loop_contents();
-        }
-#endif
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | OPL_Pico_PortRead(OPL_REGISTER_PORT));
-    } else // if follows down below
+        break;
 #endif
 #if defined(SOUND_MPU)
-    if (port == settings.MPU.basePort) {
+    case IO_MPU:
         // Tell PIO to wait for data
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         // printf("MPU IOR: port: %x value: %x\n", port, value);
-        pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | MPU401_ReadData());
-    } else if (port == settings.MPU.basePort + 1) {
-        // Tell PIO to wait for data
-        pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
-        // printf("MPU IOR: port: %x value: %x\n", port, value);
-        pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | MPU401_ReadStatus());
-    } else // if follows down below
+        pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | ((port & 1) ? MPU401_ReadStatus() : MPU401_ReadData()));
+        break;
 #endif
 #ifdef NE2000
-    if((port & ~0x1F) == settings.NE2K.basePort) {
+    case IO_NE2K:
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | PG_NE2000_Read(port & 0x1f));
-        return;
-    }
+        break;
 #endif
 #ifdef USB_JOYSTICK
-    if (port == settings.Joy.basePort) {
+    case IO_JOY: {
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         uint8_t value =
             // Proportional bits: 1 if counter is still counting, 0 otherwise
@@ -993,49 +1058,54 @@ __force_inline void handle_ior(void) {
             ((bool)pwm_get_counter(3) << 3) |
             joystate_struct.button_mask;
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | value);
-    } else // if follows down below
+        break;
+    }
 #endif // USB_JOYSTICK
 #ifdef USB_MOUSE
-    if ((port & ~7) == settings.Mouse.basePort) {
+    case IO_MOUSE:
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | uartemu_read(port & 7));
-        return;
-    } else // if follows down below
+        break;
 #endif // USB_MOUSE
 #if defined(SOUND_CMS)
-    if ((port & 0x3f0) == settings.CMS.basePort) {
+    case IO_CMS:
         switch (port & 0xf) {
         // CMS autodetect ports
         case 0x4:
             pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
             pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | 0x7F);
-            return;
+            break;
         case 0xa:
         case 0xb:
             pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
             pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | cms_detect);
-            return;
+            break;
         default:
             pio_sm_put(pio0, IOR_PIO_SM, IO_END);
-            return;
+            break;
         }
-    } else
+        break;
 #endif // SOUND_CMS
-    if (port == CONTROL_PORT) {
+    case IO_CONTROL:
         // Tell PIO to wait for data
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | sel_reg);
-    } else if (port == DATA_PORT_LOW) {
+        break;
+    case IO_DATA_LOW:
         // Tell PIO to wait for data
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | read_picogus_low());
-    } else if (port == DATA_PORT_HIGH) {
+        break;
+    case IO_DATA_HIGH:
         pio_sm_put(pio0, IOR_PIO_SM, IO_WAIT);
         pio_sm_put(pio0, IOR_PIO_SM, IOR_SET_VALUE | read_picogus_high());
-    } else {
+        break;
+    default:
         // Reset PIO
         pio_sm_put(pio0, IOR_PIO_SM, IO_END);
+        break;
     }
+    TRACE_ELAPSED(TRACE_IOCHRDY, ior_begin);
 }
 
 #ifdef USE_IRQ
@@ -1084,6 +1154,9 @@ int main()
     stdio_async_uart_init_full(UART_ID, BAUD_RATE, UART_TX_PIN, UART_RX_PIN);
 #else
     stdio_init_all();
+#endif
+#ifdef TRACE
+    trace_init_core();
 #endif
     puts(firmware_string);
     io_rw_32 *reset_reason = (io_rw_32 *) (VREG_AND_CHIP_RESET_BASE + VREG_AND_CHIP_RESET_CHIP_RESET_OFFSET);
@@ -1330,6 +1403,9 @@ extern void PIC_DeActivateIRQ(void);
 #endif
 #ifdef POLLING_DMA
         process_dma();
+#endif
+#ifdef TRACE
+        trace_drain_uart();
 #endif
     }
 }
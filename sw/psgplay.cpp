@@ -35,10 +35,10 @@
 #include "audio/volctrl.h"
 
 #if SOUND_TANDY
-extern tandy_buffer_t tandy_buffer;
+extern psg_cmd_queue_t tandy_cmd_queue;
 #endif
 #if SOUND_CMS
-extern cms_buffer_t cms_buffer;
+extern psg_cmd_queue_t cms_cmd_queue;
 #endif
 
 extern uint LED_PIN;
@@ -68,7 +68,51 @@ extern Settings settings;
 #include "mpu401/export.h"
 #endif
 
-#define SAMPLES_PER_BUFFER 8
+// Frames rendered at a time. Writes are applied at the frame matching their timestamp whatever the
+// block size, so this sets how often the loop (and the other core 1 tasks in it) comes round.
+#define PSG_BLOCK_FRAMES 64
+// Blocks in the producer pool, so a block is ready while the one before it plays
+#define PSG_BUFFER_COUNT 3
+
+// The block clock runs in 1/256 us, wrapping every 16 seconds
+#define PSG_TIME_FRAC_BITS 8
+static constexpr uint32_t PSG_BLOCK_TIME = ((uint64_t)PSG_BLOCK_FRAMES * 1000000 << PSG_TIME_FRAC_BITS) / OUTPUT_FREQUENCY;
+static constexpr uint32_t PSG_FRAMES_PER_US_Q16 = ((uint64_t)OUTPUT_FREQUENCY << 16) / 1000000;
+// A write stamped t is applied in the block rendered for t + PSG_CMD_DELAY_US. A block is rendered
+// once the buffer for it comes free, two blocks' time after its writes start arriving, so writes
+// that arrive in time are never late.
+static constexpr uint32_t PSG_CMD_DELAY_US = 2 * (PSG_BLOCK_TIME >> PSG_TIME_FRAC_BITS);
+// How fast the block clock follows the output, by 1 / (1 << PSG_CLOCK_SLEW_SHIFT) of its error per
+// block
+#define PSG_CLOCK_SLEW_SHIFT 4
+
+// time_us_32() time, less PSG_CMD_DELAY_US, of the start of the block being rendered
+static uint32_t psg_block_time;
+
+// Keeps the block clock PSG_CMD_DELAY_US behind now, the time a buffer came free. The I2S clock and
+// the microsecond timer drift apart slowly, so small errors are slewed out rather than moving
+// writes; a large one (starting up, or core 1 held up) is taken at once.
+static void psg_sync_clock(uint32_t now) {
+    const int32_t error = (int32_t)(((now - PSG_CMD_DELAY_US) << PSG_TIME_FRAC_BITS) - psg_block_time);
+    if (error > (int32_t)(4 * PSG_BLOCK_TIME) || error < -(int32_t)(4 * PSG_BLOCK_TIME)) {
+        psg_block_time += error;
+    } else {
+        psg_block_time += error >> PSG_CLOCK_SLEW_SHIFT;
+    }
+}
+
+// Frame of the current block a write stamped time is due at: 0 if it's late, PSG_BLOCK_FRAMES if it
+// belongs to a later block
+static inline uint32_t psg_due_frame(uint32_t time) {
+    const int32_t offset = (int32_t)((time << PSG_TIME_FRAC_BITS) - psg_block_time);
+    if (offset <= 0) {
+        return 0;
+    }
+    if ((uint32_t)offset >= PSG_BLOCK_TIME) {
+        return PSG_BLOCK_FRAMES;
+    }
+    return ((uint32_t)offset * PSG_FRAMES_PER_US_Q16) >> (16 + PSG_TIME_FRAC_BITS);
+}
 
 struct audio_buffer_pool *init_audio() {
 
@@ -83,8 +127,8 @@ struct audio_buffer_pool *init_audio() {
             .sample_stride = 4
     };
 
-    struct audio_buffer_pool *producer_pool = audio_new_producer_pool(&producer_format, 2,
-                                                                      SAMPLES_PER_BUFFER); // todo correct size
+    struct audio_buffer_pool *producer_pool = audio_new_producer_pool(&producer_format, PSG_BUFFER_COUNT,
+                                                                      PSG_BLOCK_FRAMES);
     bool __unused ok;
     const struct audio_format *output_format;
     struct audio_i2s_config config = {
@@ -132,53 +176,84 @@ void play_psg() {
 #endif
 
     struct audio_buffer_pool *ap = init_audio();
-    int32_t buf[SAMPLES_PER_BUFFER * 2];
+    int32_t buf[PSG_BLOCK_FRAMES * 2];
+    uint32_t overflows = 0;
     for (;;) {
+        struct audio_buffer *buffer = take_audio_buffer(ap, true);
+        int16_t *samples = (int16_t *) buffer->buffer->bytes;
+        psg_sync_clock(time_us_32());
+        memset(buf, 0, sizeof(buf));
+
+        // Render up to each queued write's frame, then apply it
         bool notfirst = false;
+        for (uint32_t done = 0; done < PSG_BLOCK_FRAMES; ) {
+            uint32_t until = PSG_BLOCK_FRAMES;
 #if SOUND_TANDY
-        while (tandy_buffer.tail != tandy_buffer.head) {
-            if (!notfirst) {
-                gpio_xor_mask(LED_PIN);
-                notfirst = true;
+            while (tandy_cmd_queue.tail != tandy_cmd_queue.head) {
+                const auto &cmd = tandy_cmd_queue.cmds[tandy_cmd_queue.tail & (PSG_CMD_QUEUE_SIZE - 1)];
+                const uint32_t due = psg_due_frame(cmd.time);
+                if (due > done) {
+                    until = due < until ? due : until;
+                    break;
+                }
+                if (!notfirst) {
+                    gpio_xor_mask(LED_PIN);
+                    notfirst = true;
+                }
+                tandysound.write_register(0, cmd.data);
+                ++tandy_cmd_queue.tail;
             }
-            tandysound.write_register(0, tandy_buffer.cmds[tandy_buffer.tail]);
-            ++tandy_buffer.tail;
-        }
 #endif // SOUND_TANDY
 #if SOUND_CMS
-        while (cms_buffer.tail != cms_buffer.head) {
-            if (!notfirst) {
-                gpio_xor_mask(LED_PIN);
-                notfirst = true;
+            while (cms_cmd_queue.tail != cms_cmd_queue.head) {
+                const auto &cmd = cms_cmd_queue.cmds[cms_cmd_queue.tail & (PSG_CMD_QUEUE_SIZE - 1)];
+                const uint32_t due = psg_due_frame(cmd.time);
+                if (due > done) {
+                    until = due < until ? due : until;
+                    break;
+                }
+                if (!notfirst) {
+                    gpio_xor_mask(LED_PIN);
+                    notfirst = true;
+                }
+                if (cmd.addr & 1) {
+                    cms.write_addr(cmd.addr, cmd.data);
+                } else {
+                    cms.write_data(cmd.addr, cmd.data);
+                }
+                ++cms_cmd_queue.tail;
             }
-            auto cmd = cms_buffer.cmds[cms_buffer.tail];
-            if (cmd.addr & 1) {
-                cms.write_addr(cmd.addr, cmd.data);
-            } else {
-                cms.write_data(cmd.addr, cmd.data);
-            }
-            ++cms_buffer.tail;
-        }
-#endif
-
-        memset(buf, 0, sizeof(buf));
-        struct audio_buffer *buffer = take_audio_buffer(ap, true);
-        int16_t *samples = (int16_t *) buffer->buffer->bytes;
-      
+#endif // SOUND_CMS
 #if SOUND_TANDY
-        tandysound.generator().generate_frames(buf, SAMPLES_PER_BUFFER);
+            tandysound.generator().generate_frames(&buf[done * 2], until - done);
 #endif
 #if SOUND_CMS
-        cms.generator(0).generate_frames(buf, SAMPLES_PER_BUFFER);
-        cms.generator(1).generate_frames(buf, SAMPLES_PER_BUFFER);
+            cms.generator(0).generate_frames(&buf[done * 2], until - done);
+            cms.generator(1).generate_frames(&buf[done * 2], until - done);
 #endif
-        for (int i = 0; i < SAMPLES_PER_BUFFER; ++i) {          
+            done = until;
+        }
+        psg_block_time += PSG_BLOCK_TIME;
+
+        for (int i = 0; i < PSG_BLOCK_FRAMES; ++i) {
             samples[i << 1] = scale_sample(buf[i << 1], psg_volume, 0);
             samples[(i << 1) + 1] = scale_sample(buf[(i << 1) + 1], psg_volume, 0);
         }
-        buffer->sample_count = SAMPLES_PER_BUFFER;
+        buffer->sample_count = PSG_BLOCK_FRAMES;
 
         give_audio_buffer(ap, buffer);
+
+        uint32_t dropped = 0;
+#if SOUND_TANDY
+        dropped += tandy_cmd_queue.overflows;
+#endif
+#if SOUND_CMS
+        dropped += cms_cmd_queue.overflows;
+#endif
+        if (dropped != overflows) {
+            overflows = dropped;
+            printf("PSG queue overflow: %u writes dropped\n", (unsigned)overflows);
+        }
 #ifdef USB_STACK
         // Service TinyUSB events
         tuh_task();
@@ -189,9 +264,6 @@ void play_psg() {
 
         // uart emulation task
         uartemu_core1_task();
-#endif
-#ifdef SOUND_MPU
-        send_midi_bytes(8);
 #endif
     }
 }
@@ -12,42 +12,54 @@
 #include <cmath>
 
 
-template<int16_t (*IN_FN)()>
+// Input is rendered by RENDER_FN into a block of BLOCK frames at a time, so the source pays its
+// per-call setup once per block rather than once per input sample. A frame is CHANNELS interleaved
+// samples, and output frames are interleaved the same way.
+template<void (*RENDER_FN)(int16_t *buf, uint32_t nframes), uint32_t BLOCK = 32, uint32_t CHANNELS = 1>
 class Resampler {
 	int64_t phase; //in 31.32
 	uint64_t ratio;
 	std::size_t fir_pos;
-	int16_t fir[13];
-	int32_t c0,c1,c2,c3; //in 0.15
-public:
-	void set_ratio(uint32_t in, uint32_t out)
+	int16_t fir[CHANNELS][13];
+	int32_t c0[CHANNELS],c1[CHANNELS],c2[CHANNELS],c3[CHANNELS]; //in 0.15
+	int16_t block[BLOCK*CHANNELS];
+	uint32_t block_pos = BLOCK;
+
+	const int16_t* next_input()
 	{
-		uint64_t val = ((uint64_t)in)<<32;
-		ratio = val/out;
+		if(block_pos>=BLOCK)
+		{
+			RENDER_FN(block,BLOCK);
+			block_pos=0;
+		}
+		return &block[CHANNELS*block_pos++];
 	}
-	int16_t get_sample()
+
+	void push(const int16_t* frame)
 	{
-		phase+=ratio;
-		while(phase>=1UL<<31) //0.5
-		{
-			fir[fir_pos]=IN_FN(); //0.15
-			fir_pos++;
-			phase-=1ULL<<32;
-			if(fir_pos>=13)
-				fir_pos=0;
+		for(uint32_t ch=0;ch<CHANNELS;ch++)
+			fir[ch][fir_pos]=frame[ch]; //0.15
+		fir_pos++;
+		if(fir_pos>=13)
+			fir_pos=0;
+		for(uint32_t ch=0;ch<CHANNELS;ch++)
+			filter(fir[ch],ch);
+	}
 
+	void filter(int16_t* hist, uint32_t ch)
+	{
 			const int32_t* lfir = fir_coeff.data();
-			int16_t* inp = &fir[fir_pos];
-			int16_t* inp2 = &fir[0];
-			int16_t* fir_split = &fir[13];
-			int16_t* fir_split2 = &fir[fir_pos];
-
-			uint32_t TMP,TMP2;
 			int32_t lc0,lc1,lc2,lc3; //in 0.15
 			lc0=0;
 			lc1=0;
 			lc2=0;
 			lc3=0;
+#ifdef __arm__
+			int16_t* inp = &hist[fir_pos];
+			int16_t* inp2 = &hist[0];
+			int16_t* fir_split = &hist[13];
+			int16_t* fir_split2 = &hist[fir_pos];
+			uint32_t TMP,TMP2;
 			asm (
 				"1:\n"
 				"ldrh %[TMP2], [%[INP],#0]\n"
@@ -103,19 +115,64 @@ public:
 			, [FIR_SPLIT2]"+r"(fir_split2)
 			, [INP2]"+r"(inp2)
 			);
-			c0=lc0; // maxsignal 2.30 tap 2.
-			c1=lc1>>(30-14); // tap 2.30 -> 2.14
-			c2=lc2>>15; // tap 1.30 -> 1.15
-			c3=lc3>>15; // tap 1.30 -> 1.15
-		};
+#else
+			// Same order as above: oldest sample (at fir_pos) first
+			for(std::size_t i=0;i<13;i++,lfir+=4)
+			{
+				const int32_t in=hist[fir_pos+i<13 ? fir_pos+i : fir_pos+i-13];
+				lc0+=in*lfir[0];
+				lc1+=in*lfir[1];
+				lc2+=in*lfir[2];
+				lc3+=in*lfir[3];
+			}
+#endif
+			c0[ch]=lc0; // maxsignal 2.30 tap 2.
+			c1[ch]=lc1>>(30-14); // tap 2.30 -> 2.14
+			c2[ch]=lc2>>15; // tap 1.30 -> 1.15
+			c3[ch]=lc3>>15; // tap 1.30 -> 1.15
+	}
+
+	int16_t interpolate(int64_t phase, uint32_t ch) const
+	{
 		int32_t lphase = phase>>16; //-1.16
-		int32_t val = (c0 +
-				((lphase*(c1 +
-						((lphase*(c2 +
-								((lphase*(c3))>>(16+15-15)) //1.15
+		int32_t val = (c0[ch] +
+				((lphase*(c1[ch] +
+						((lphase*(c2[ch] +
+								((lphase*(c3[ch]))>>(16+15-15)) //1.15
 								))>>(16+15-14)) //2.14
 								))>>(16+14-30)) //2.30
 								);
 		return val>>16;
 	}
+public:
+	void set_ratio(uint32_t in, uint32_t out)
+	{
+		uint64_t val = ((uint64_t)in)<<32;
+		ratio = val/out;
+	}
+	// Fills out with n output frames
+	void get_samples(int16_t *out, uint32_t n)
+	{
+		int64_t lphase = phase;
+		const uint64_t lratio = ratio;
+		for(uint32_t i=0;i<n;i++)
+		{
+			lphase+=lratio;
+			while(lphase>=1LL<<31) //0.5
+			{
+				push(next_input());
+				lphase-=1ULL<<32;
+			}
+			for(uint32_t ch=0;ch<CHANNELS;ch++)
+				out[i*CHANNELS+ch]=interpolate(lphase,ch);
+		}
+		phase=lphase;
+	}
+	int16_t get_sample()
+	{
+		static_assert(CHANNELS==1, "get_samples() for more than one channel");
+		int16_t out;
+		get_samples(&out,1);
+		return out;
+	}
 };
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+
+# Generates the polyphase filter used to resample SB DSP output to 44.1kHz.
+# Each row holds the taps for one phase of the position between input
+# samples, applied to the TAPS samples around it: a Kaiser-windowed sinc
+# cut off at CUTOFF of the input rate, scaled so each row sums to
+# 1 << TAP_BITS.
+
+import math
+import sys
+
+TAPS = 8
+PHASE_BITS = 8
+TAP_BITS = 14
+CUTOFF = 0.45
+BETA = 6.0
+
+
+def bessel_i0(x):
+    total = term = 1.0
+    k = 1
+    while term > 1e-12 * total:
+        term *= (x / (2 * k)) ** 2
+        total += term
+        k += 1
+    return total
+
+
+def kaiser(d):
+    # d is the distance from the centre of the window, in input samples
+    r = d / (TAPS / 2)
+    if abs(r) >= 1:
+        return 0.0
+    return bessel_i0(BETA * math.sqrt(1 - r * r)) / bessel_i0(BETA)
+
+
+def sinc(x):
+    return 1.0 if x == 0 else math.sin(math.pi * x) / (math.pi * x)
+
+
+def row(frac):
+    # Output is between samples TAPS/2 - 1 and TAPS/2 of the window, frac past the first
+    taps = []
+    for k in range(TAPS):
+        d = k - (TAPS // 2 - 1) - frac
+        taps.append(2 * CUTOFF * sinc(2 * CUTOFF * d) * kaiser(d))
+    total = sum(taps)
+    q = [round(c / total * (1 << TAP_BITS)) for c in taps]
+    # Make every row sum to exactly 1.0 so DC passes through unchanged
+    q[q.index(max(q))] += (1 << TAP_BITS) - sum(q)
+    assert sum(abs(c) for c in q) < (1 << (TAP_BITS + 1))
+    return q
+
+
+rows = []
+for phase in range(1 << PHASE_BITS):
+    rows.append("    {" + ", ".join(str(c) for c in row(phase / (1 << PHASE_BITS))) + "},")
+
+with open(sys.argv[1], 'w') as f:
+    f.write(f"""
+#pragma once
+#include <stdint.h>
+
+#define SB_RESAMPLE_TAPS {TAPS}
+#define SB_RESAMPLE_PHASE_BITS {PHASE_BITS}
+#define SB_RESAMPLE_TAP_BITS {TAP_BITS}
+
+static const int16_t sb_resample_taps[1 << SB_RESAMPLE_PHASE_BITS][SB_RESAMPLE_TAPS] = {{
+""" + "\n".join(rows) + """
+};
+""")
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "system/pico_pic.h"
+#include "system/trace.h"
 #include "audio/volctrl.h"
 #include "sbdsp.h"
 
@@ -110,6 +111,7 @@ static int16_t __force_inline dma_interval_calc() {
 
 void __force_inline sbdsp_fifo_rx(uint8_t byte) {
     if (!fifo_add_sample(&sbdsp.audio_fifo, (int16_t)(byte ^ 0x80) << 8)) {
+        TRACE_EVENT(TRACE_OVERRUN, 0);
         putchar('O');
     }
 }
@@ -132,12 +134,16 @@ static __force_inline void sbdsp_dma_disable() {
     PIC_RemoveEvent(&DSP_DMA_Event);  
 #ifdef SB_BUFFERLESS
     sbdsp.cur_sample = 0;  // zero current sample
+    sb_resampler_silence(&sbdsp.resampler);
 #endif
 }
 
 static __force_inline void sbdsp_dma_enable() {    
     if(!sbdsp.dma_enabled) {
         sbdsp.dma_enabled=true;
+#ifdef SB_BUFFERLESS
+        sbdsp.dac_direct = false;
+#endif
         PIC_AddEvent(&DSP_DMA_Event, sbdsp.dma_interval, 0);
     }
     // else {
@@ -175,7 +181,7 @@ static uint32_t DSP_DMA_EventHandler(Bitu val) {
 static void sbdsp_dma_isr(void) {
     const uint32_t dma_data = DMA_Complete_Write(&dma_config);    
 #ifdef SB_BUFFERLESS
-    sbdsp.cur_sample = scale_sample(((int16_t)(int8_t)((dma_data & 0xFF) ^ 0x80)) << 8, sb_volume, 0);
+    sb_resampler_push(&sbdsp.resampler, scale_sample(((int16_t)(int8_t)((dma_data & 0xFF) ^ 0x80)) << 8, sb_volume, 0));
 #else
     sbdsp_fifo_rx(dma_data & 0xFF);
 #endif
@@ -269,6 +275,9 @@ void sbdsp_process(void) {
                     sbdsp.time_constant = sbdsp.inbox;
                     sbdsp.dma_interval = 256 - sbdsp.time_constant;
                     sbdsp.sample_rate = 1000000ul / sbdsp.dma_interval;           
+#ifdef SB_BUFFERLESS
+                    sb_resampler_set_rate(&sbdsp.resampler, sbdsp.sample_rate);
+#endif
                     sbdsp.dma_interval_trim = MAX(1, sbdsp.dma_interval >> 1);
                     // printf("interval: %u rate: %u, trim: %u\n", sbdsp.dma_interval, sbdsp.sample_rate, sbdsp.dma_interval_trim);
                     
@@ -371,6 +380,7 @@ void sbdsp_process(void) {
                 if(sbdsp.current_command_index==1) {
 #ifdef SB_BUFFERLESS
                     sbdsp.cur_sample = scale_sample(((int16_t)(int8_t)(sbdsp.inbox ^ 0x80)) << 8, sb_volume, 0);
+                    sbdsp.dac_direct = true;
 #endif
                     sbdsp.dav_dsp=0;
                     sbdsp.current_command=0;
@@ -33,6 +33,9 @@ SPDX-License-Identifier: MIT
 #include <inttypes.h>
 #include <stdbool.h>
 #include "audio/audio_fifo.h"
+#ifdef SB_BUFFERLESS
+#include "sbdsp_resampler.h"
+#endif
 
 typedef struct sbdsp_t {
     uint8_t inbox;
@@ -68,7 +71,11 @@ typedef struct sbdsp_t {
     uint8_t reset_state;  
    
 #ifdef SB_BUFFERLESS
+    // Last direct DAC sample, played as is because its rate is up to the program
     volatile int16_t cur_sample;
+    volatile bool dac_direct;
+    // DMA samples, resampled from sample_rate
+    sb_resampler_t resampler;
 #endif
 } sbdsp_t;
 
@@ -80,9 +87,11 @@ uint16_t sbdsp_sample_rate();
 int16_t sbdsp_muted();
 
 #ifdef SB_BUFFERLESS
-static inline int16_t sbdsp_sample() {
+// Called at 44.1kHz. Not clamped: filtering can overshoot full scale a little.
+static inline int32_t sbdsp_sample() {
     extern sbdsp_t sbdsp;
-    return (sbdsp.speaker_on & ~sbdsp.dac_resume_pending) ? sbdsp.cur_sample : 0;
+    const int32_t sample = sbdsp.dac_direct ? sbdsp.cur_sample : sb_resampler_get(&sbdsp.resampler);
+    return (sbdsp.speaker_on & ~sbdsp.dac_resume_pending) ? sample : 0;
 }
 #endif
 
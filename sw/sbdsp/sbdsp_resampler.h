@@ -0,0 +1,101 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// Polyphase resampler from the DSP's DMA rate to 44.1kHz for SB_BUFFERLESS. DMA bytes are pushed
+// into a short history as they arrive and each output sample is filtered from the
+// SB_RESAMPLE_TAPS around its position. The window is kept at most a couple of samples behind the
+// newest, so output lags DMA by about SB_RESAMPLE_TAPS / 2 + 1 input samples.
+
+#include <stdint.h>
+
+#include "sbdsp_resample_taps.h"
+
+#define SB_RESAMPLE_OUTPUT_RATE 44100u
+// Power of 2, more than SB_RESAMPLE_TAPS + SB_RESAMPLE_SLACK
+#define SB_RESAMPLE_HISTORY 16u
+// Samples in hand beyond the window before the output speeds up to catch up, by
+// 1 / (1 << SB_RESAMPLE_CATCH_UP_SHIFT)
+#define SB_RESAMPLE_SLACK 2u
+#define SB_RESAMPLE_CATCH_UP_SHIFT 7
+
+#define SB_RESAMPLE_FRAC_BITS 16
+#define SB_RESAMPLE_ONE (1u << SB_RESAMPLE_FRAC_BITS)
+
+typedef struct sb_resampler {
+    volatile int16_t history[SB_RESAMPLE_HISTORY];
+    // Written by the producer only
+    volatile uint32_t head;
+    // Oldest sample of the window
+    uint32_t tail;
+    // Position past sample tail + SB_RESAMPLE_TAPS / 2 - 1, in 1 / SB_RESAMPLE_ONE samples
+    uint32_t phase;
+    // Input samples per output sample, in 1 / SB_RESAMPLE_ONE samples
+    volatile uint32_t step;
+} sb_resampler_t;
+
+static inline void sb_resampler_set_rate(sb_resampler_t* r, uint32_t input_rate) {
+    r->step = ((uint64_t)input_rate << SB_RESAMPLE_FRAC_BITS) / SB_RESAMPLE_OUTPUT_RATE;
+}
+
+static inline void sb_resampler_push(sb_resampler_t* r, int16_t sample) {
+    const uint32_t head = r->head;
+    r->history[head & (SB_RESAMPLE_HISTORY - 1)] = sample;
+    r->head = head + 1;
+}
+
+// Fades the window to silence within SB_RESAMPLE_TAPS samples of output
+static inline void sb_resampler_silence(sb_resampler_t* r) {
+    for (uint32_t i = 0; i < SB_RESAMPLE_HISTORY; ++i) {
+        r->history[i] = 0;
+    }
+}
+
+static inline int32_t sb_resampler_get(sb_resampler_t* r) {
+    const uint32_t head = r->head;
+    uint32_t tail = r->tail;
+    uint32_t phase = r->phase + r->step;
+    if (head - tail > SB_RESAMPLE_TAPS + SB_RESAMPLE_SLACK) {
+        // Further behind the newest sample than needed, DMA is running a little fast: catch up
+        phase += r->step >> SB_RESAMPLE_CATCH_UP_SHIFT;
+    }
+    // Move the window on for each input sample passed, as far as the samples that have arrived
+    while (phase >= SB_RESAMPLE_ONE && head - tail > SB_RESAMPLE_TAPS) {
+        phase -= SB_RESAMPLE_ONE;
+        ++tail;
+    }
+    if (phase >= SB_RESAMPLE_ONE) {
+        // The next sample hasn't arrived (output just started, DMA stopped or running slow). Stay
+        // on this window so there is a sample in hand from now on, rather than waiting on each one.
+        phase &= SB_RESAMPLE_ONE - 1;
+    }
+    if (head - tail > SB_RESAMPLE_HISTORY - 1) {
+        // Too far behind to catch up, e.g. after output was stopped
+        tail = head - SB_RESAMPLE_TAPS - 1;
+    }
+    r->tail = tail;
+    r->phase = phase;
+
+    const int16_t* taps = sb_resample_taps[phase >> (SB_RESAMPLE_FRAC_BITS - SB_RESAMPLE_PHASE_BITS)];
+    int32_t acc = 0;
+    for (uint32_t i = 0; i < SB_RESAMPLE_TAPS; ++i) {
+        acc += r->history[(tail + i) & (SB_RESAMPLE_HISTORY - 1)] * taps[i];
+    }
+    return acc >> SB_RESAMPLE_TAP_BITS;
+}
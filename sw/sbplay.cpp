@@ -49,10 +49,8 @@
 
 #include "audio/clamp.h"
 
-#if OPL_CMD_BUFFER
 #include "include/cmd_buffers.h"
-extern cms_buffer_t opl_cmd_buffer;
-#endif
+extern opl_cmd_queue_t opl_cmd_queue;
 
 #ifdef USB_STACK
 #include "tusb.h"
@@ -97,15 +95,62 @@ static constexpr uint32_t fixed_ratio(uint16_t a, uint16_t b) {
 static constexpr uint32_t opl_ratio = fixed_ratio(49716, 44100);
 static audio_fifo_t opl_out_fifo;
 
-static int16_t get_opl_sample()
+// OPL samples are rendered this many at a time at the native 49716Hz rate
+static constexpr uint32_t OPL_BLOCK_SAMPLES = 32;
+
+#if USE_NUKED_OPL3
+// opl_out_fifo holds interleaved left and right samples
+static constexpr uint32_t OPL_CHANNELS = 2;
+#define OPL_RENDER OPL_Pico_stereo
+#define OPL_SCALE(sample) scale_sample((sample), opl_volume, 1)
+#else
+static constexpr uint32_t OPL_CHANNELS = 1;
+#define OPL_RENDER OPL_Pico_simple
+#define OPL_SCALE(sample) scale_sample((sample) << 1, opl_volume, 1)
+#endif
+
+// Output frames taken from opl_out_fifo so far. Core 0 stamps OPL writes with it.
+volatile uint32_t opl_sample_clock;
+
+// A write stamped t is applied as output frame t + OPL_CMD_DELAY is rendered. Every frame up to a
+// full FIFO past the one playing has been rendered already, and the resampler runs up to a block of
+// input ahead of that, so writes that arrive in time are never late.
+static constexpr uint32_t OPL_CMD_DELAY = AUDIO_FIFO_SIZE / OPL_CHANNELS + 2 * OPL_BLOCK_SAMPLES;
+// Output frames per native sample, in 1/2^32 frames
+static constexpr uint32_t opl_frame_step = ((uint64_t)44100 << 32) / 49716;
+// Output frame the next native sample lands on, in 1/2^32 frames
+static uint64_t opl_render_time;
+
+static void render_opl_block(int16_t *buffer, uint32_t nframes)
 {
-    int16_t opl_current_sample;
-    OPL_Pico_simple(&opl_current_sample, 1);
-    opl_current_sample = scale_sample(opl_current_sample << 1, opl_volume, 1);
-    return opl_current_sample;
+    // Render up to each queued write's sample, then apply it
+    for (uint32_t done = 0; done < nframes; ) {
+        uint32_t run = nframes - done;
+        while (opl_cmd_queue.tail != opl_cmd_queue.head) {
+            const auto &cmd = opl_cmd_queue.cmds[opl_cmd_queue.tail & (OPL_CMD_QUEUE_SIZE - 1)];
+            const int32_t due = (int32_t)(cmd.time + OPL_CMD_DELAY - (uint32_t)(opl_render_time >> 32));
+            if (due > 0) {
+                // Native samples until then, rounded up
+                const uint64_t until_q32 = ((uint64_t)due << 32) - (uint32_t)opl_render_time;
+                const uint32_t until = (uint32_t)(((until_q32 >> FRAC_BITS) * opl_ratio) >> 32) + 1;
+                if (until < run) {
+                    run = until;
+                }
+                break;
+            }
+            OPL_Pico_WriteRegister(cmd.addr, cmd.data);
+            ++opl_cmd_queue.tail;
+        }
+        OPL_RENDER(&buffer[done * OPL_CHANNELS], run);
+        opl_render_time += (uint64_t)opl_frame_step * run;
+        done += run;
+    }
+    for (uint32_t i = 0; i < nframes * OPL_CHANNELS; ++i) {
+        buffer[i] = OPL_SCALE(buffer[i]);
+    }
 }
 
-static Resampler<get_opl_sample> resampler;
+static Resampler<render_opl_block, OPL_BLOCK_SAMPLES, OPL_CHANNELS> resampler;
 
 // Setup values for audio sample clock
 // 8390 clock cycles per sample (370MHz / 8390 ~= 44100Hz)
@@ -117,10 +162,6 @@ typedef union {
     int16_t data16[2];
 } sample_pair;
 
-#ifdef CDROM
-static audio_fifo_t* cd_fifo;
-#endif
-
 void audio_sample_handler(void) {
     pwm_clear_irq(pwm_slice_num);
 
@@ -131,24 +172,26 @@ void audio_sample_handler(void) {
 #endif
 
 #ifdef CDROM
-    static uint32_t cd_index = 0;
-    const uint32_t has_cd_samples = fifo_take_samples_inline(cd_fifo, 2);
-    if (has_cd_samples) {
-        sample_l += scale_sample(cd_fifo->buffer[cd_index++], cd_audio_volume, 0);
-        sample_r += scale_sample(cd_fifo->buffer[cd_index++], cd_audio_volume, 0);
-        // sample_l += cd_fifo->buffer[cd_index++];
-        // sample_r += cd_fifo->buffer[cd_index++];
-        cd_index &= AUDIO_FIFO_BITS;
+    int16_t cd_l, cd_r;
+    if (cdrom_audio_ring_take_frame(&cdrom.audio_ring, &cd_l, &cd_r)) {
+        sample_l += scale_sample(cd_l, cd_audio_volume, 0);
+        sample_r += scale_sample(cd_r, cd_audio_volume, 0);
     }
 #endif
 
     static uint32_t opl_out_index = 0;
-    const uint32_t has_opl_samples = fifo_take_samples_inline(&opl_out_fifo, 1);
+    const uint32_t has_opl_samples = fifo_take_samples_inline(&opl_out_fifo, OPL_CHANNELS);
     if (has_opl_samples) {
+#if USE_NUKED_OPL3
+        sample_l += opl_out_fifo.buffer[opl_out_index++];
+        sample_r += opl_out_fifo.buffer[opl_out_index++];
+#else
         int16_t opl_sample = opl_out_fifo.buffer[opl_out_index++];
         sample_l += opl_sample;
         sample_r += opl_sample;
+#endif
         opl_out_index &= AUDIO_FIFO_BITS;
+        ++opl_sample_clock;
     }
 
     const sample_pair clamped = {.data16 = {
@@ -193,10 +236,7 @@ void play_adlib() {
 
     printf("opl_ratio: %x ", opl_ratio);
     uint32_t opl_pos = 0;
-
-#ifdef CDROM
-    cd_fifo = cdrom_audio_fifo_peek(&cdrom);
-#endif
+    uint32_t opl_overflows = 0;
 
     // Use the PWM peripheral to trigger an IRQ at 44100Hz
 #if !AUDIO_CALLBACK_CORE0
@@ -212,23 +252,22 @@ void play_adlib() {
 
     for (;;) {
 #if CDROM
-        cdrom_audio_callback(&cdrom, 1024);
+        cdrom_audio_callback(&cdrom);
 #endif
 
-#if OPL_CMD_BUFFER
-        // Process any pending OPL commands
-        while (opl_cmd_buffer.tail != opl_cmd_buffer.head) {
-            auto cmd = opl_cmd_buffer.cmds[opl_cmd_buffer.tail];
-            OPL_Pico_WriteRegister(cmd.addr, cmd.data);
-            ++opl_cmd_buffer.tail;
+        if (opl_cmd_queue.overflows != opl_overflows) {
+            opl_overflows = opl_cmd_queue.overflows;
+            printf("OPL queue overflow: %u writes dropped\n", (unsigned)opl_overflows);
         }
-#endif
 
         // Generate OPL samples and add to output FIFO
-        while (fifo_free_space(&opl_out_fifo) > 0) {
-            // Interpolate at current position
-            fifo_add_sample(&opl_out_fifo, resampler.get_sample());
-		}
+        uint32_t opl_free;
+        while ((opl_free = fifo_free_space(&opl_out_fifo) / OPL_CHANNELS) > 0) {
+            int16_t opl_samples[OPL_BLOCK_SAMPLES * OPL_CHANNELS];
+            const uint32_t opl_count = opl_free < OPL_BLOCK_SAMPLES ? opl_free : OPL_BLOCK_SAMPLES;
+            resampler.get_samples(opl_samples, opl_count);
+            fifo_add_samples(&opl_out_fifo, opl_samples, opl_count * OPL_CHANNELS);
+        }
 #ifdef USB_STACK
         // Service TinyUSB events
         tuh_task();
@@ -240,9 +279,6 @@ void play_adlib() {
         // uart emulation task
         uartemu_core1_task();
 #endif
-#ifdef SOUND_MPU
-        send_midi_bytes(8);
-#endif
 #ifdef CDROM
         cdrom_tasks(&cdrom);
 #endif
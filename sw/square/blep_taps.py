@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+
+# Generates the band-limited step used by the square wave generators. A step
+# at a fraction of a sample is added to a voice's output as its derivative: a
+# Kaiser-windowed sinc cut off at CUTOFF of the output rate, centred on the
+# step's time, spread over the TAPS samples around it and later summed back up.
+# Each row holds the taps for one sub-sample phase, scaled so the row sums to
+# 1 << TAP_BITS and a step settles at exactly its size.
+
+import math
+import sys
+
+TAPS = 8
+PHASE_BITS = 6
+TAP_BITS = 14
+CUTOFF = 0.45
+BETA = 6.0
+
+
+def bessel_i0(x):
+    total = term = 1.0
+    k = 1
+    while term > 1e-12 * total:
+        term *= (x / (2 * k)) ** 2
+        total += term
+        k += 1
+    return total
+
+
+def kaiser(d):
+    # d is the distance from the centre of the window, in output samples
+    r = d / (TAPS / 2)
+    if abs(r) >= 1:
+        return 0.0
+    return bessel_i0(BETA * math.sqrt(1 - r * r)) / bessel_i0(BETA)
+
+
+def sinc(x):
+    return 1.0 if x == 0 else math.sin(math.pi * x) / (math.pi * x)
+
+
+def row(frac):
+    # The step is between samples TAPS/2 - 1 and TAPS/2 of the window, frac past the first
+    taps = []
+    for k in range(TAPS):
+        d = k - (TAPS // 2 - 1) - frac
+        taps.append(2 * CUTOFF * sinc(2 * CUTOFF * d) * kaiser(d))
+    total = sum(taps)
+    q = [round(c / total * (1 << TAP_BITS)) for c in taps]
+    # Make every row sum to exactly 1.0 so the summed output has no drift
+    q[q.index(max(q))] += (1 << TAP_BITS) - sum(q)
+    assert sum(abs(c) for c in q) < (1 << (TAP_BITS + 1))
+    return q
+
+
+rows = []
+for phase in range(1 << PHASE_BITS):
+    rows.append("    {" + ", ".join(str(c) for c in row(phase / (1 << PHASE_BITS))) + "},")
+
+with open(sys.argv[1], 'w') as f:
+    f.write(f"""
+#pragma once
+#include <stdint.h>
+
+#define SQUARE_BLEP_TAPS {TAPS}
+#define SQUARE_BLEP_PHASE_BITS {PHASE_BITS}
+#define SQUARE_BLEP_TAP_BITS {TAP_BITS}
+
+static const int16_t square_blep_taps[1 << SQUARE_BLEP_PHASE_BITS][SQUARE_BLEP_TAPS] = {{
+""" + "\n".join(rows) + """
+};
+""")
@@ -41,6 +41,152 @@
 
 #include "square.h"
 
+#include <string.h>
+
+#ifdef SQUARE_BLEP
+#include "square_blep_taps.h"
+
+static_assert(SQUARE_BLEP_TAPS == blep_buffer_t<1>::TAPS, "blep_buffer_t::TAPS differs from the generated taps");
+
+
+
+//===========================================================================
+//
+// blep_buffer_t
+//
+// This class turns level changes at sub-frame times into band-limited
+// output.
+//
+//===========================================================================
+
+//
+// constructor
+//
+template<int _Channels>
+blep_buffer_t<_Channels>::blep_buffer_t()
+{
+    memset(m_delta, 0, sizeof(m_delta));
+    memset(m_sum, 0, sizeof(m_sum));
+    m_dirty = 0;
+}
+
+//
+// add a step of delta at time, in TIME_BITS fixed point frames
+//
+template<int _Channels>
+inline void blep_buffer_t<_Channels>::add_step(uint32_t time, int32_t delta)
+{
+    int16_t const *taps = square_blep_taps[(time >> (TIME_BITS - SQUARE_BLEP_PHASE_BITS)) & ((1 << SQUARE_BLEP_PHASE_BITS) - 1)];
+    int32_t (*dest)[_Channels] = &m_delta[time >> TIME_BITS];
+    for (uint32_t tap = 0; tap < TAPS; tap++)
+        dest[tap][0] += taps[tap] * delta;
+    if ((time >> TIME_BITS) + TAPS > m_dirty)
+        m_dirty = (time >> TIME_BITS) + TAPS;
+}
+
+template<int _Channels>
+inline void blep_buffer_t<_Channels>::add_step(uint32_t time, int32_t ldelta, int32_t rdelta)
+{
+    int16_t const *taps = square_blep_taps[(time >> (TIME_BITS - SQUARE_BLEP_PHASE_BITS)) & ((1 << SQUARE_BLEP_PHASE_BITS) - 1)];
+    int32_t (*dest)[_Channels] = &m_delta[time >> TIME_BITS];
+    for (uint32_t tap = 0; tap < TAPS; tap++)
+    {
+        dest[tap][0] += taps[tap] * ldelta;
+        dest[tap][1] += taps[tap] * rdelta;
+    }
+    if ((time >> TIME_BITS) + TAPS > m_dirty)
+        m_dirty = (time >> TIME_BITS) + TAPS;
+}
+
+//
+// sum the steps into frames and add them to dest; mono is output on both sides.
+// Only the frames with taps in them are summed: past the last, the output
+// holds its level, and silence adds nothing at all
+//
+template<int _Channels>
+void blep_buffer_t<_Channels>::read(int32_t *dest, uint32_t frames)
+{
+    uint32_t const dirty = (m_dirty < frames) ? m_dirty : frames;
+    for (uint32_t frame = 0; frame < dirty; frame++, dest += 2)
+    {
+        m_sum[0] += m_delta[frame][0];
+        if (_Channels == 1)
+        {
+            int32_t value = m_sum[0] >> SQUARE_BLEP_TAP_BITS;
+            dest[0] += value;
+            dest[1] += value;
+        }
+        else
+        {
+            m_sum[_Channels - 1] += m_delta[frame][_Channels - 1];
+            dest[0] += m_sum[0] >> SQUARE_BLEP_TAP_BITS;
+            dest[1] += m_sum[_Channels - 1] >> SQUARE_BLEP_TAP_BITS;
+        }
+    }
+
+    int32_t const left = m_sum[0] >> SQUARE_BLEP_TAP_BITS;
+    int32_t const right = m_sum[_Channels - 1] >> SQUARE_BLEP_TAP_BITS;
+    if (left != 0 || right != 0)
+        for (uint32_t frame = dirty; frame < frames; frame++, dest += 2)
+        {
+            dest[0] += left;
+            dest[1] += right;
+        }
+
+    // taps past the end of this block start the next one
+    if (m_dirty > frames)
+    {
+        memmove(&m_delta[0], &m_delta[frames], sizeof(m_delta[0]) * (m_dirty - frames));
+        memset(&m_delta[m_dirty - frames], 0, sizeof(m_delta[0]) * frames);
+        m_dirty -= frames;
+    }
+    else
+    {
+        memset(&m_delta[0], 0, sizeof(m_delta[0]) * m_dirty);
+        m_dirty = 0;
+    }
+}
+
+//
+// true once every step has been read out and the output is silent
+//
+template<int _Channels>
+bool blep_buffer_t<_Channels>::idle() const
+{
+    if (m_dirty != 0)
+        return false;
+    for (int chan = 0; chan < _Channels; chan++)
+        if (m_sum[chan] != 0)
+            return false;
+    return true;
+}
+
+//
+// helper to compute the frames per cycle of a position stepping by step,
+// in blep time; 0 if it doesn't move
+//
+static uint32_t cycle_period(uint32_t cycle, uint32_t step)
+{
+    if (step == 0)
+        return 0;
+    uint64_t period = (uint64_t(cycle) << blep_buffer_t<1>::TIME_BITS) / step;
+    return (period < UINT32_MAX) ? uint32_t(period) : UINT32_MAX;
+}
+
+//
+// helper to change a period, keeping the fraction of the current cycle
+// still to run
+//
+static void retime(uint32_t &next, uint32_t &period, uint32_t new_period)
+{
+    if (period == 0 || new_period == 0)
+        next = new_period;
+    else
+        next = uint32_t(uint64_t(next) * new_period / period);
+    period = new_period;
+}
+#endif
+
 
 //===========================================================================
 //
@@ -198,11 +344,11 @@ void tandy_generator_t::process_event(uint8_t data)
                 voice.rawfreq = (voice.rawfreq & 0x00f) | ((data << 4) & 0x3f0);
 
             // recompute the voice step
-            voice.step = this->step_from_divisor(voice.rawfreq);
+            this->set_step(voice, this->step_from_divisor(voice.rawfreq), FRAC_HALF);
 
             // if the noise is connected to channel 2, update it as well
             if (chan == 2 && (m_noise_control & 3) == 3)
-                m_voice[3].step = voice.step;
+                this->set_step(m_voice[3], voice.step, FRAC_ONE);
             break;
 
         // volume registers
@@ -230,13 +376,99 @@ void tandy_generator_t::process_event(uint8_t data)
             // if set to track voice 2, copy from there; otherwise, compute the
             // fixed frequency from the noise control bits
             if ((m_noise_control & 3) == 3)
-                voice.step = m_voice[2].step;
+                this->set_step(voice, m_voice[2].step, FRAC_ONE);
             else
-                voice.step = this->step_from_divisor(16 << (m_noise_control & 3));
+                this->set_step(voice, this->step_from_divisor(16 << (m_noise_control & 3)), FRAC_ONE);
             break;
     }
 }
 
+#ifdef SQUARE_BLEP
+//
+// generate the requested number of audio frames
+//
+void tandy_generator_t::generate_frames(int32_t *dest, uint32_t frames)
+{
+    while (frames > 0)
+    {
+        uint32_t block = (frames < blep_t::MAX_FRAMES) ? frames : blep_t::MAX_FRAMES;
+        this->render_block(dest, block);
+        dest += 2 * block;
+        frames -= block;
+    }
+}
+
+//
+// helper to render a block of frames: the tone edges and noise changes
+// within it are added to the blep buffer at their times, then read out
+//
+void tandy_generator_t::render_block(int32_t *dest, uint32_t frames)
+{
+    uint32_t const end = frames << blep_t::TIME_BITS;
+
+    // tone channels; note that output is inverted
+    for (int chan = 0; chan < 3; chan++)
+    {
+        auto &voice = m_voice[chan];
+
+        // above the Nyquist rate, only the average level can be heard
+        int32_t level;
+        if (voice.period != 0 && voice.period < blep_t::TIME_ONE)
+            level = -voice.volume / 2;
+        else
+            level = voice.high ? -voice.volume : 0;
+
+        // volume changes take effect at the start of the block
+        if (level != voice.level)
+            m_blep.add_step(0, level - voice.level);
+
+        // then each edge flips the output
+        if (voice.period >= blep_t::TIME_ONE)
+        {
+            uint32_t next = voice.next;
+            for ( ; next < end; next += voice.period)
+            {
+                voice.high ^= 1;
+                if (voice.volume != 0)
+                    m_blep.add_step(next, voice.high ? -voice.volume : voice.volume);
+            }
+            voice.next = next - end;
+            level = voice.high ? -voice.volume : 0;
+        }
+        voice.level = level;
+    }
+
+    // noise channel: on rising edge, clock the PRNG
+    auto &noise = m_voice[3];
+    int32_t level = ((m_prng & 1) != 0) ? -noise.volume : 0;
+    if (level != noise.level)
+        m_blep.add_step(0, level - noise.level);
+    if (noise.period != 0)
+    {
+        uint32_t next = noise.next;
+        while (next < end)
+        {
+            // clocks within the same frame are taken together
+            uint32_t const time = next;
+            do
+            {
+                this->clock_noise();
+                next += noise.period;
+            } while ((next >> blep_t::TIME_BITS) == (time >> blep_t::TIME_BITS));
+
+            // PRNG output bit controls the noise contribution
+            int32_t const newlevel = ((m_prng & 1) != 0) ? -noise.volume : 0;
+            if (newlevel != level)
+                m_blep.add_step(time, newlevel - level);
+            level = newlevel;
+        }
+        noise.next = next - end;
+    }
+    noise.level = level;
+
+    m_blep.read(dest, frames);
+}
+#else
 //
 // generate the requested number of audio frames
 //
@@ -292,15 +524,7 @@ void tandy_generator_t::generate_frames(int32_t *dest, uint32_t frames)
         // noise channel: on rising edge, clock the PRNG
         m_voice[3].pos += m_voice[3].step;
         for ( ; m_voice[3].pos >= FRAC_ONE; m_voice[3].pos -= FRAC_ONE)
-        {
-            // mode 0 just feeds back low bit into high bit
-            if ((m_noise_control & 4) == 0)
-                m_prng = (m_prng >> 1) | ((m_prng & 1) << 14);
-
-            // mode 1 is a proper PRNG; feedback from output + bit 4 into bit 14
-            else
-                m_prng = (m_prng >> 1) | (((m_prng ^ (~m_prng >> 4)) & 1) << 14);
-        }
+            this->clock_noise();
 
         // PRNG output bit controls the noise contribution
         if ((m_prng & 1) != 0)
@@ -315,6 +539,21 @@ void tandy_generator_t::generate_frames(int32_t *dest, uint32_t frames)
         *dest++ -= result;
     }
 }
+#endif
+
+//
+// helper to step the noise PRNG once
+//
+inline void tandy_generator_t::clock_noise()
+{
+    // mode 0 just feeds back low bit into high bit
+    if ((m_noise_control & 4) == 0)
+        m_prng = (m_prng >> 1) | ((m_prng & 1) << 14);
+
+    // mode 1 is a proper PRNG; feedback from output + bit 4 into bit 14
+    else
+        m_prng = (m_prng >> 1) | (((m_prng ^ (~m_prng >> 4)) & 1) << 14);
+}
 
 //
 // helper to compute the output sample step from a frequency divisor
@@ -324,6 +563,20 @@ uint32_t tandy_generator_t::step_from_divisor(uint16_t divisor) const
     return uint32_t((uint64_t(INTERNAL_CLOCK) << FRAC_BITS) / (OUTPUT_FREQUENCY * ((divisor != 0) ? divisor : 0x400)));
 }
 
+//
+// helper to change a voice's step; the position advances by cycle between
+// edges (noise clocks for the noise channel)
+//
+void tandy_generator_t::set_step(voice_t &voice, uint32_t step, uint32_t cycle)
+{
+    voice.step = step;
+#ifdef SQUARE_BLEP
+    retime(voice.next, voice.period, cycle_period(cycle, step));
+#else
+    (void)cycle;
+#endif
+}
+
 
 
 //===========================================================================
@@ -391,27 +644,17 @@ void saa1099_generator_t::process_event(uint8_t reg, uint8_t data)
         case 0x08: case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d:
             chan = reg & 7;
             m_voice[chan].frequency = data;
-            m_voice[chan].step = this->step_from_divisor(m_voice[chan]);
-
-            // if the noise channels are driven by our frequency, update them as well
-            if (chan == 0 && m_noise[0].frequency == 3)
-                m_noise[0].step = this->noise_step(m_noise[0], 0);
-            if (chan == 3 && m_noise[1].frequency == 3)
-                m_noise[1].step = this->noise_step(m_noise[1], 1);
+            this->set_voice_step(chan);
             break;
 
         // octave control for each voice, packed two voices to a byte
         case 0x10: case 0x11: case 0x12:
             chan = 2 * (reg & 3);
             m_voice[chan].octave = data & 0x0f;
-            m_voice[chan].step = this->step_from_divisor(m_voice[chan]);
-            if (chan == 0 && m_noise[0].frequency == 3)
-                m_noise[0].step = this->noise_step(m_noise[0], 0);
+            this->set_voice_step(chan);
             chan++;
             m_voice[chan].octave = (data >> 4) & 0x0f;
-            m_voice[chan].step = this->step_from_divisor(m_voice[chan]);
-            if (chan == 3 && m_noise[1].frequency == 3)
-                m_noise[1].step = this->noise_step(m_noise[1], 1);
+            this->set_voice_step(chan);
             break;
 
         // bitmask of tone enables for each voice
@@ -437,9 +680,9 @@ void saa1099_generator_t::process_event(uint8_t reg, uint8_t data)
         // noise control register
         case 0x16:
             m_noise[0].frequency = data & 3;
-            m_noise[0].step = this->noise_step(m_noise[0], 0);
+            this->set_noise_step(0);
             m_noise[1].frequency = (data >> 4) & 3;
-            m_noise[1].step = this->noise_step(m_noise[1], 1);
+            this->set_noise_step(1);
             break;
 
         // envelope control registers
@@ -450,6 +693,9 @@ void saa1099_generator_t::process_event(uint8_t reg, uint8_t data)
             type = (data >> 1) & 7;
             m_envelope[chan].hold = (type == 0) ? 0 : (type == 1) ? 15 : -1;
             m_envelope[chan].pos = 0;
+#ifdef SQUARE_BLEP
+            m_envelope[chan].next = m_envelope[chan].period;
+#endif
             break;
 
         // reset/enable register
@@ -465,11 +711,262 @@ void saa1099_generator_t::process_event(uint8_t reg, uint8_t data)
                 m_voice[5].pos = 0;
                 m_noise[0].pos = 0;
                 m_noise[1].pos = 0;
+#ifdef SQUARE_BLEP
+                for (auto &voice : m_voice)
+                    voice.next = voice.period, voice.high = 0;
+                for (auto &noise : m_noise)
+                    noise.next = noise.period;
+#endif
             }
             break;
     }
 }
 
+//
+// helper to compute an envelope's current level, 0-15
+//
+int8_t saa1099_generator_t::envelope_factor(envelope_t &env)
+{
+    int8_t factor = env.hold;
+
+    // if envelope is still going, get the value
+    if (factor < 0)
+    {
+        // bit 4 is number of bits for envelope control (3 vs 4)
+        uint32_t pos = (env.pos >> FRAC_BITS) - ((env.type >> 4) & 1);
+
+        // bits 1-3 are the type:
+        //   0: hold 0
+        //   1: hold 15
+        //   2: decay 15->0 then hold 0
+        //   3: decay 15->0 repeatedly
+        //   4: triangle 0->15->0 then hold 0
+        //   5: triangle 0->15->0 repeatedly
+        //   6: attack 0->15 then hold 0
+        //   7: attack 0->15 repeatedly
+        uint8_t type = (env.type >> 1) & 7;
+
+        // if past the hold time, clamp to 0 for the even-numbered cases
+        if (pos >= 32 && (type & 1) == 0)
+            env.hold = factor = 0;
+
+        // otherwise, process
+        else
+        {
+            static uint8_t const s_env_shapes[8][32] =
+            {
+                {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+                { 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15 },
+                { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+                { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+                {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15 },
+            };
+            factor = s_env_shapes[type][pos & 31];
+        }
+    }
+    return factor;
+}
+
+#ifdef SQUARE_BLEP
+//
+// helper to bring a voice's output levels in the blep buffer up to date
+// at time; templated like add_voice
+//
+template<int _Voicenum>
+void saa1099_generator_t::update_level(uint32_t time)
+{
+    auto &voice = m_voice[_Voicenum];
+
+    // twice the share of the volume output: a tone above the Nyquist rate
+    // is only heard as its average level
+    int tone = (voice.period != 0 && voice.period < blep_t::TIME_ONE) ? 1 : 2 * voice.high;
+    int outlevel;
+
+    // non-noise case: level is high if tone is enabled and the tone is high
+    if (!voice.noise)
+        outlevel = voice.enable ? tone : 0;
+
+    // noise-only case -- just use the noise source
+    else if (!voice.enable)
+        outlevel = 2 * (m_noise[_Voicenum/3].prng & 1);
+
+    // combined case: follows the tone, as add_voice's integer output does
+    else
+        outlevel = tone;
+
+    int32_t lresult = 0;
+    int32_t rresult = 0;
+    if (outlevel != 0)
+    {
+        // non-envelope case
+        if (_Voicenum % 3 != 2 || (m_envelope[_Voicenum / 3].type & 0x80) == 0)
+        {
+            lresult = voice.lvolume;
+            rresult = voice.rvolume;
+        }
+
+        // envelope case; bit 0 means right is inverted
+        else
+        {
+            auto &env = m_envelope[_Voicenum / 3];
+            int8_t factor = this->envelope_factor(env);
+            lresult = (int32_t)voice.lvolume * factor / 16;
+            if ((env.type & 0x01) != 0)
+                factor ^= 15;
+            rresult = (int32_t)voice.rvolume * factor / 16;
+        }
+        lresult = (lresult * outlevel) >> 1;
+        rresult = (rresult * outlevel) >> 1;
+    }
+
+    if (lresult != voice.llevel || rresult != voice.rlevel)
+    {
+        m_blep.add_step(time, lresult - voice.llevel, rresult - voice.rlevel);
+        voice.llevel = lresult;
+        voice.rlevel = rresult;
+    }
+}
+
+//
+// helper to render a block of frames for one group of three voices and the
+// noise generator and envelope they share: each tone edge, noise clock and
+// envelope step is taken in time order, and changes the output where it
+// alters a voice's level
+//
+template<int _Group>
+void saa1099_generator_t::render_group(uint32_t frames)
+{
+    uint32_t const end = frames << blep_t::TIME_BITS;
+    voice_t *const voice = &m_voice[_Group * 3];
+    auto &noise = m_noise[_Group];
+    auto &env = m_envelope[_Group];
+
+    // register changes take effect at the start of the block
+    this->update_level<_Group * 3 + 0>(0);
+    this->update_level<_Group * 3 + 1>(0);
+    this->update_level<_Group * 3 + 2>(0);
+
+    // only edges of tones that are enabled and below the Nyquist rate are heard
+    uint8_t heard = 0;
+    for (int chan = 0; chan < 3; chan++)
+        if (voice[chan].enable && voice[chan].period >= blep_t::TIME_ONE)
+            heard |= 1 << chan;
+    bool const env_clock = ((env.type & 0xa0) == 0x80) && env.period != 0;
+
+    for (;;)
+    {
+        // find the next event
+        uint32_t time = end;
+        int source = -1;
+        for (int chan = 0; chan < 3; chan++)
+            if (((heard >> chan) & 1) != 0 && voice[chan].next < time)
+                time = voice[chan].next, source = chan;
+        if (noise.period != 0 && noise.next < time)
+            time = noise.next, source = 3;
+        if (env_clock && env.next < time)
+            time = env.next, source = 4;
+
+        switch (source)
+        {
+            case -1:
+                break;
+
+            // tone edges
+            case 0:
+                voice[0].high ^= 1;
+                voice[0].next += voice[0].period;
+                this->update_level<_Group * 3 + 0>(time);
+                continue;
+
+            case 1:
+                voice[1].high ^= 1;
+                voice[1].next += voice[1].period;
+                this->update_level<_Group * 3 + 1>(time);
+                continue;
+
+            case 2:
+                voice[2].high ^= 1;
+                voice[2].next += voice[2].period;
+                this->update_level<_Group * 3 + 2>(time);
+                continue;
+
+            // noise clocks; those within the same frame are taken together
+            case 3:
+                do
+                {
+                    noise.prng = (noise.prng << 1) | (((noise.prng >> 17) ^ (noise.prng >> 10)) & 1);
+                    noise.next += noise.period;
+                } while ((noise.next >> blep_t::TIME_BITS) == (time >> blep_t::TIME_BITS));
+                this->update_level<_Group * 3 + 0>(time);
+                this->update_level<_Group * 3 + 1>(time);
+                this->update_level<_Group * 3 + 2>(time);
+                continue;
+
+            // envelope steps, likewise
+            case 4:
+                do
+                {
+                    env.pos += FRAC_ONE;
+                    env.next += env.period;
+                } while ((env.next >> blep_t::TIME_BITS) == (time >> blep_t::TIME_BITS));
+                this->update_level<_Group * 3 + 2>(time);
+                continue;
+        }
+        break;
+    }
+
+    // tones that aren't heard just keep their place
+    for (int chan = 0; chan < 3; chan++)
+    {
+        if (voice[chan].period < blep_t::TIME_ONE)
+            continue;
+        if (((heard >> chan) & 1) == 0)
+            for ( ; voice[chan].next < end; voice[chan].next += voice[chan].period)
+                voice[chan].high ^= 1;
+        voice[chan].next -= end;
+    }
+    if (noise.period != 0)
+        noise.next -= end;
+    if (env_clock)
+        env.next -= end;
+}
+
+//
+// generate the requested number of audio frames
+//
+void saa1099_generator_t::generate_frames(int32_t *dest, uint32_t frames)
+{
+    // once disabled, finish the steps down to silence then do nothing
+    if (!m_enable && m_blep.idle())
+        return;
+
+    while (frames > 0)
+    {
+        uint32_t block = (frames < blep_t::MAX_FRAMES) ? frames : blep_t::MAX_FRAMES;
+        if (m_enable)
+        {
+            this->render_group<0>(block);
+            this->render_group<1>(block);
+        }
+        else
+        {
+            for (auto &voice : m_voice)
+            {
+                if (voice.llevel != 0 || voice.rlevel != 0)
+                    m_blep.add_step(0, -voice.llevel, -voice.rlevel);
+                voice.llevel = voice.rlevel = 0;
+            }
+        }
+        m_blep.read(dest, block);
+        dest += 2 * block;
+        frames -= block;
+    }
+}
+#else
+
 //
 // helper to add the output of a single voice to the results; templated so
 // that codegen can be optimized for different voices' behaviors
@@ -523,46 +1020,7 @@ void saa1099_generator_t::add_voice(int32_t &lresult, int32_t &rresult, int16_t
     else
     {
         auto &env = m_envelope[_Voicenum / 3];
-        int8_t factor = env.hold;
-
-        // if envelope is still going, get the value
-        if (factor < 0)
-        {
-            // bit 4 is number of bits for envelope control (3 vs 4)
-            uint32_t pos = (env.pos >> FRAC_BITS) - ((env.type >> 4) & 1);
-
-            // bits 1-3 are the type:
-            //   0: hold 0
-            //   1: hold 15
-            //   2: decay 15->0 then hold 0
-            //   3: decay 15->0 repeatedly
-            //   4: triangle 0->15->0 then hold 0
-            //   5: triangle 0->15->0 repeatedly
-            //   6: attack 0->15 then hold 0
-            //   7: attack 0->15 repeatedly
-            uint8_t type = (env.type >> 1) & 7;
-
-            // if past the hold time, clamp to 0 for the even-numbered cases
-            if (pos >= 32 && (type & 1) == 0)
-                env.hold = factor = 0;
-
-            // otherwise, process
-            else
-            {
-                static uint8_t const s_env_shapes[8][32] =
-                {
-                    {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-                    { 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15 },
-                    { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-                    { 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15, 15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-                    {  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15 },
-                };
-                factor = s_env_shapes[type][pos & 31];
-            }
-        }
+        int8_t factor = this->envelope_factor(env);
 
         // apply to left
 #ifdef SQUARE_FLOAT_OUTPUT
@@ -698,6 +1156,7 @@ void saa1099_generator_t::generate_frames(int32_t *dest, uint32_t frames)
             m_noise[1].prng = (m_noise[1].prng << 1) | (((m_noise[1].prng >> 17) ^ (m_noise[1].prng >> 10)) & 1);
     }
 }
+#endif
 
 //
 // helper to compute the output sample step from a voice's frequency and octave
@@ -719,6 +1178,39 @@ uint32_t saa1099_generator_t::noise_step(noise_t &noise, int gen)
         return m_voice[gen * 3].step * 2;
 }
 
+//
+// helper to recompute a voice's step after a frequency or octave change,
+// and the steps that follow it
+//
+void saa1099_generator_t::set_voice_step(int chan)
+{
+    auto &voice = m_voice[chan];
+    voice.step = this->step_from_divisor(voice);
+#ifdef SQUARE_BLEP
+    retime(voice.next, voice.period, cycle_period(FRAC_HALF, voice.step));
+
+    // envelopes are clocked by voices 1 and 4
+    if (chan % 3 == 1)
+        retime(m_envelope[chan / 3].next, m_envelope[chan / 3].period, cycle_period(FRAC_ONE, voice.step));
+#endif
+
+    // if the noise channels are driven by our frequency, update them as well
+    if (chan % 3 == 0 && m_noise[chan / 3].frequency == 3)
+        this->set_noise_step(chan / 3);
+}
+
+//
+// helper to recompute a noise generator's step
+//
+void saa1099_generator_t::set_noise_step(int gen)
+{
+    auto &noise = m_noise[gen];
+    noise.step = this->noise_step(noise, gen);
+#ifdef SQUARE_BLEP
+    retime(noise.next, noise.period, cycle_period(FRAC_ONE, noise.step));
+#endif
+}
+
 
 
 //===========================================================================
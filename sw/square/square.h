@@ -46,6 +46,68 @@
 
 static constexpr uint32_t OUTPUT_FREQUENCY = 44100;
 
+//
+// Tandy and SAA1099 generators are band-limited unless SQUARE_NAIVE or
+// SQUARE_FLOAT_OUTPUT is defined, in which case every frame samples the
+// square waves directly
+//
+#if !defined(SQUARE_NAIVE) && !defined(SQUARE_FLOAT_OUTPUT)
+#define SQUARE_BLEP 1
+#endif
+
+
+//===========================================================================
+//
+// blep_buffer_t
+//
+// This class turns level changes at sub-frame times into band-limited
+// output. Each change is added as the taps of a band-limited step around
+// its time, and the taps are summed back up into output frames.
+//
+//===========================================================================
+
+template<int _Channels>
+class blep_buffer_t
+{
+public:
+    //
+    // times are in frames from the start of the block being rendered
+    //
+    static constexpr uint8_t TIME_BITS = 16;
+    static constexpr uint32_t TIME_ONE = 1 << TIME_BITS;
+
+    //
+    // frames rendered per block; the taps of a step run this far past it
+    //
+    static constexpr uint32_t MAX_FRAMES = 64;
+    static constexpr uint32_t TAPS = 8;
+
+    //
+    // construction/destruction
+    //
+    blep_buffer_t();
+
+    //
+    // steps, mono or left and right
+    //
+    void add_step(uint32_t time, int32_t delta);
+    void add_step(uint32_t time, int32_t ldelta, int32_t rdelta);
+
+    //
+    // output, added to stereo frames
+    //
+    void read(int32_t *dest, uint32_t frames);
+    bool idle() const;
+
+private:
+    //
+    // internal state
+    //
+    int32_t m_delta[MAX_FRAMES + TAPS][_Channels];
+    int32_t m_sum[_Channels];
+    uint32_t m_dirty;   // frames of m_delta that may hold taps
+};
+
 
 //===========================================================================
 //
@@ -168,8 +230,18 @@ class tandy_generator_t
         uint16_t rawfreq = 0;
         uint32_t step = 0;
         uint32_t pos = 0;
+#ifdef SQUARE_BLEP
+        uint32_t period = 0;  // frames per half cycle (per clock for noise), in blep time
+        uint32_t next = 0;    // frames until the next edge or clock, in blep time
+        int32_t level = 0;    // output level added to m_blep so far
+        uint8_t high = 0;     // tone output
+#endif
     };
 
+#ifdef SQUARE_BLEP
+    typedef blep_buffer_t<1> blep_t;
+#endif
+
 public:
     //
     // construction/destruction
@@ -195,6 +267,11 @@ private:
     // internal helpers
     //
     uint32_t step_from_divisor(uint16_t divisor) const;
+    void set_step(voice_t &voice, uint32_t step, uint32_t cycle);
+    void clock_noise();
+#ifdef SQUARE_BLEP
+    void render_block(int32_t *dest, uint32_t frames);
+#endif
 
     //
     // internal state
@@ -203,6 +280,9 @@ private:
     uint8_t m_noise_control;
     uint16_t m_prng;
     voice_t m_voice[4];
+#ifdef SQUARE_BLEP
+    blep_t m_blep;
+#endif
 };
 
 
@@ -279,6 +359,13 @@ class saa1099_generator_t
         uint8_t noise = 0;
         uint32_t step = 0;
         uint32_t pos = 0;
+#ifdef SQUARE_BLEP
+        uint32_t period = 0;  // frames per half cycle, in blep time
+        uint32_t next = 0;    // frames until the next edge, in blep time
+        int32_t llevel = 0;   // output levels added to m_blep so far
+        int32_t rlevel = 0;
+        uint8_t high = 0;     // tone output
+#endif
     };
 
     //
@@ -290,6 +377,10 @@ class saa1099_generator_t
         uint32_t step = 0;
         uint32_t pos = 0;
         uint32_t prng = PRNG_INITIAL;
+#ifdef SQUARE_BLEP
+        uint32_t period = 0;  // frames per clock, in blep time
+        uint32_t next = 0;    // frames until the next clock, in blep time
+#endif
     };
 
     //
@@ -300,8 +391,16 @@ class saa1099_generator_t
         uint8_t type = 0;
         int8_t hold = -1;
         uint32_t pos = 0;
+#ifdef SQUARE_BLEP
+        uint32_t period = 0;  // frames per envelope step when internally clocked, in blep time
+        uint32_t next = 0;    // frames until the next step, in blep time
+#endif
     };
 
+#ifdef SQUARE_BLEP
+    typedef blep_buffer_t<2> blep_t;
+#endif
+
 public:
     //
     // construction/destruction
@@ -328,7 +427,13 @@ private:
     //
     uint32_t step_from_divisor(voice_t &voice);
     uint32_t noise_step(noise_t &noise, int gen);
-#ifdef SQUARE_FLOAT_OUTPUT
+    void set_voice_step(int chan);
+    void set_noise_step(int gen);
+    int8_t envelope_factor(envelope_t &env);
+#ifdef SQUARE_BLEP
+    template<int _Voicenum> void update_level(uint32_t time);
+    template<int _Group> void render_group(uint32_t frames);
+#elif defined(SQUARE_FLOAT_OUTPUT)
     template<int _Voicenum> void add_voice(float &lresult, float &rresult, float lvolume, float rvolume);
 #else
     template<int _Voicenum> void add_voice(int32_t &lresult, int32_t &rresult, int16_t lvolume, int16_t rvolume);
@@ -341,6 +446,9 @@ private:
     voice_t m_voice[8];
     noise_t m_noise[2];
     envelope_t m_envelope[2];
+#ifdef SQUARE_BLEP
+    blep_t m_blep;
+#endif
 };
 
 
@@ -39,7 +39,9 @@ static const Settings defaultSettings = {
         .basePort = 0x240,
         .audioBuffer = 4,
         .dmaInterval = 0,
-        .force44k = false
+        .force44k = false,
+        .interpolation = 0,
+        .audioBufferMax = 4
     },
     .SB = {
         .basePort = 0x220,
@@ -126,6 +128,16 @@ static const VersionFields versionFieldsTable[] = {
     {(const FieldInfo[]){
         FIELD(Volume),
     }, 1},
+
+    // version 5 - added GUS interpolation mode
+    {(const FieldInfo[]){
+        FIELD(GUS.interpolation),
+    }, 1},
+
+    // version 6 - added GUS adaptive audio buffer
+    {(const FieldInfo[]){
+        FIELD(GUS.audioBufferMax),
+    }, 1},
 };
 
 // Apply default values only to fields introduced after the given version
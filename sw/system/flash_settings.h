@@ -25,7 +25,7 @@ extern "C" {
 #include <stdbool.h>
 
 #define SETTINGS_MAGIC 0x70677573  // "pgus" in ascii
-#define SETTINGS_VERSION 4
+#define SETTINGS_VERSION 6
 
 // When adding new fields to Settings struct:
 // 1. Increment SETTINGS_VERSION
@@ -50,6 +50,8 @@ typedef struct Settings {
         uint8_t audioBuffer;
         uint8_t dmaInterval;
         bool force44k : 1;
+        uint8_t interpolation;
+        uint8_t audioBufferMax;
     } GUS;
     struct {
         uint16_t basePort;
@@ -19,6 +19,7 @@
 #include "pico_pic.h"
 
 #include "pico/time.h"
+#include "trace.h"
 
 #include <stdio.h>
 
@@ -29,11 +30,15 @@ int64_t PIC_HandleEvent(alarm_id_t id, void *user_data) {
     if (id != event->alarm_id) {
         return 0;
     }
+    TRACE_EVENT(TRACE_ALARM, (uintptr_t)event->handler);
     uint32_t ret = (event->handler)(event->value);
     // printf("called event handler: %x %x, ret %d\n", event->handler, event->value, ret);
     // gpio_xor_mask(1u << PICO_DEFAULT_LED_PIN);
     if (!ret) {
-        event->alarm_id = 0;
+        // Unless the handler's event was added again while it ran
+        if (event->alarm_id == id) {
+            event->alarm_id = 0;
+        }
         return ret;
     }
     // A negative return value re-sets the alarm from the time when it initially triggered
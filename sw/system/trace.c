@@ -0,0 +1,119 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "trace.h"
+
+#ifdef TRACE
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "hardware/uart.h"
+
+trace_ring_t trace_rings[2];
+// Drops already reported per ring, so the producers never have to reset their counters
+static uint32_t trace_dropped_sent[2];
+static uint8_t trace_drain = 0;
+
+// Frame being sent, and how much of it has gone out
+static uint8_t trace_frame[TRACE_FRAME_SIZE];
+static uint8_t trace_frame_pos = TRACE_FRAME_SIZE;
+
+void trace_init_core(void) {
+    systick_hw->rvr = 0xffffffu;
+    systick_hw->cvr = 0;
+    // Enabled, clocked from the processor clock, no interrupt
+    systick_hw->csr = 0x5;
+}
+
+void trace_set_drain(uint8_t drain) {
+    trace_drain = drain;
+}
+
+// Takes the oldest record from either ring, reporting drops first. Returns false if both are empty.
+static bool trace_take(trace_record_t* out) {
+    for (uint core = 0; core < 2; ++core) {
+        const uint32_t dropped = trace_rings[core].dropped;
+        if (dropped != trace_dropped_sent[core]) {
+            const uint32_t lost = dropped - trace_dropped_sent[core];
+            trace_dropped_sent[core] = dropped;
+            out->time_us = timer_hw->timerawl;
+            out->event = TRACE_DROPPED;
+            out->core = core;
+            out->arg = lost > 0xffffu ? 0xffffu : lost;
+            return true;
+        }
+    }
+    trace_ring_t* ring = NULL;
+    for (uint core = 0; core < 2; ++core) {
+        trace_ring_t* const r = &trace_rings[core];
+        if (r->head == r->tail) {
+            continue;
+        }
+        if (!ring || (int32_t)(r->records[r->tail & (TRACE_RING_SIZE - 1)].time_us -
+                               ring->records[ring->tail & (TRACE_RING_SIZE - 1)].time_us) < 0) {
+            ring = r;
+        }
+    }
+    if (!ring) {
+        return false;
+    }
+    __dmb();
+    *out = ring->records[ring->tail & (TRACE_RING_SIZE - 1)];
+    __dmb();
+    ring->tail = ring->tail + 1;
+    return true;
+}
+
+// Returns the next byte of the frame stream, or -1 if there is nothing to send
+static int trace_next_byte(void) {
+    if (trace_frame_pos == TRACE_FRAME_SIZE) {
+        trace_record_t record;
+        if (!trace_take(&record)) {
+            return -1;
+        }
+        uint8_t check = 0;
+        trace_frame[0] = TRACE_FRAME_SYNC;
+        memcpy(trace_frame + 1, &record, sizeof(record));
+        for (uint i = 1; i <= sizeof(record); ++i) {
+            check ^= trace_frame[i];
+        }
+        trace_frame[TRACE_FRAME_SIZE - 1] = check;
+        trace_frame_pos = 0;
+    }
+    return trace_frame[trace_frame_pos++];
+}
+
+void trace_drain_uart(void) {
+    // Only what the UART takes without waiting; stdio output landing inside a frame breaks its
+    // checksum and the decoder skips it
+    while (trace_drain == 0 && uart_is_writable(uart0)) {
+        const int byte = trace_next_byte();
+        if (byte < 0) {
+            return;
+        }
+        uart_get_hw(uart0)->dr = byte;
+    }
+}
+
+uint8_t trace_read_byte(void) {
+    const int byte = trace_next_byte();
+    return byte < 0 ? 0 : byte;
+}
+
+#endif // TRACE
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (C) 2022-2024  Ian Scott
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+// Hot path tracing. Built with TRACE defined, events are stamped with the shared 1 MHz timer and
+// stored as 8-byte records in a ring per core, then drained to the UART or the control port
+// (CMD_TRACE) as frames that sw/host/trace_decode turns into Chrome trace JSON. Without TRACE
+// the macros compile to nothing.
+
+#include <stdint.h>
+
+enum trace_event_id {
+    TRACE_IOW = 1,          // arg: port
+    TRACE_IOR,              // arg: port
+    TRACE_IOCHRDY,          // arg: CPU cycles the handler held IOCHRDY low for
+    TRACE_DMA,              // arg: bytes written to device memory
+    TRACE_RENDER_BEGIN,     // arg: frames
+    TRACE_RENDER_END,       // arg: frames
+    TRACE_UNDERRUN,         // arg: us the loop was busy for the buffer that missed its deadline
+    TRACE_OVERRUN,          // arg: unused
+    TRACE_ALARM,            // arg: low 16 bits of the PIC event handler's address
+    TRACE_DROPPED,          // arg: records lost to a full ring since the last one was drained
+    TRACE_EVENT_COUNT
+};
+
+typedef struct trace_record {
+    uint32_t time_us;
+    uint8_t event;
+    uint8_t core;
+    uint16_t arg;
+} trace_record_t;
+
+// On the wire each record is framed by TRACE_FRAME_SYNC, which text output never contains, and
+// followed by the XOR of its 8 bytes
+#define TRACE_FRAME_SYNC 0x1e
+#define TRACE_FRAME_SIZE (sizeof(trace_record_t) + 2)
+
+#ifdef TRACE
+
+#include "hardware/structs/systick.h"
+#include "hardware/structs/timer.h"
+#include "hardware/sync.h"
+#include "pico/platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Records per core; a power of 2
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 1024
+#endif
+
+typedef struct trace_ring {
+    trace_record_t records[TRACE_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+} trace_ring_t;
+
+extern trace_ring_t trace_rings[2];
+
+// Starts the SysTick cycle counter on the calling core
+void trace_init_core(void);
+// Sends frame bytes while the UART can take them, unless draining to the control port
+void trace_drain_uart(void);
+// Returns the next byte of the frame stream for CMD_TRACE, or 0 between frames if there is nothing
+// left to send
+uint8_t trace_read_byte(void);
+// 0 drains to the UART, 1 to the control port
+void trace_set_drain(uint8_t drain);
+
+__force_inline static void trace_event(const uint8_t event, const uint16_t arg) {
+    const uint core = get_core_num();
+    trace_ring_t* const ring = &trace_rings[core];
+    const uint32_t irq = save_and_disable_interrupts();
+    const uint32_t head = ring->head;
+    if (head - ring->tail < TRACE_RING_SIZE) {
+        trace_record_t* const r = &ring->records[head & (TRACE_RING_SIZE - 1)];
+        r->time_us = timer_hw->timerawl;
+        r->event = event;
+        r->core = core;
+        r->arg = arg;
+        __dmb();
+        ring->head = head + 1;
+    } else {
+        ++ring->dropped;
+    }
+    restore_interrupts(irq);
+}
+
+// SysTick counts down from 0xffffff at the CPU clock
+__force_inline static uint32_t trace_cycles(void) {
+    return systick_hw->cvr;
+}
+__force_inline static uint16_t trace_elapsed(const uint32_t start) {
+    const uint32_t cycles = (start - systick_hw->cvr) & 0xffffffu;
+    return cycles > 0xffffu ? 0xffffu : cycles;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define TRACE_EVENT(event, arg) trace_event((event), (arg))
+// Marks the start of an interval reported later by TRACE_ELAPSED, in cycles
+#define TRACE_START(var) const uint32_t var = trace_cycles()
+#define TRACE_ELAPSED(event, var) trace_event((event), trace_elapsed(var))
+
+#else
+
+#define TRACE_EVENT(event, arg) ((void)0)
+#define TRACE_START(var)
+#define TRACE_ELAPSED(event, var) ((void)0)
+
+#endif // TRACE